@@ -0,0 +1,286 @@
+#include "catch_up_scheduler.h"
+#include <QDebug>
+
+namespace {
+
+const QString CHANNEL_DIFFERENCE_METHOD = "updates.getChannelDifference";
+
+// 同时在途的差异请求上限
+const int MAX_IN_FLIGHT = 48;
+
+// 单次差异请求的消息数
+const int DIFFERENCE_LIMIT = 100;
+
+// 用户最后一次操作之后暂停派发后台频道的时间
+const int INTERACTION_PAUSE_MS = 1000;
+
+// 请求超过该时间没有响应时重新排队
+const int REQUEST_TIMEOUT_MS = 15000;
+
+// 每个方法的客户端限流：每秒调用次数和允许的突发数量，略低于服务器的限制
+struct MethodRate
+{
+    const char* method;
+    int perSecond;
+    int burst;
+};
+
+const MethodRate METHOD_RATES[] = {
+    { "updates.getChannelDifference", 80, 20 }
+};
+
+const MethodRate DEFAULT_RATE = { nullptr, 20, 5 };
+
+const MethodRate& rateOf(const QString& method)
+{
+    for (const MethodRate& rate : METHOD_RATES) {
+        if (method == QLatin1String(rate.method)) {
+            return rate;
+        }
+    }
+    return DEFAULT_RATE;
+}
+
+} // namespace
+
+CatchUpScheduler::CatchUpScheduler(MTProtoClient* client, QObject* parent)
+    : QObject(parent)
+    , m_client(client)
+    , m_nextOrder(0)
+    , m_visibleChannel(0)
+    , m_completedChannels(0)
+{
+    m_dispatchTimer.setSingleShot(true);
+    connect(&m_dispatchTimer, &QTimer::timeout, this, &CatchUpScheduler::dispatch);
+
+    m_timeoutTimer.setInterval(REQUEST_TIMEOUT_MS / 3);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &CatchUpScheduler::onTimeoutCheck);
+
+    connect(m_client, &MTProtoClient::channelDifferenceReceived, this, &CatchUpScheduler::onChannelDifferenceReceived);
+    connect(m_client, &MTProtoClient::channelDifferenceFailed, this, &CatchUpScheduler::onChannelDifferenceFailed);
+}
+
+void CatchUpScheduler::enqueue(qint64 channelId, qint32 pts, bool unread)
+{
+    auto it = m_tasks.find(channelId);
+    if (it != m_tasks.end()) {
+        if (it->unread != unread) {
+            it->unread = unread;
+            if (!m_inFlight.contains(channelId)) {
+                m_queue.remove(it->key);
+                push(*it);
+            }
+        }
+        return;
+    }
+
+    if (m_tasks.isEmpty()) {
+        m_roundTimer.start();
+        m_completedChannels = 0;
+        m_timeoutTimer.start();
+    }
+    Task task;
+    task.channelId = channelId;
+    task.pts = pts;
+    task.unread = unread;
+    task.order = m_nextOrder++;
+    push(m_tasks.insert(channelId, task).value());
+    scheduleDispatch(0);
+}
+
+void CatchUpScheduler::setVisibleChannel(qint64 channelId)
+{
+    if (m_visibleChannel == channelId) {
+        return;
+    }
+    qint64 previous = m_visibleChannel;
+    m_visibleChannel = channelId;
+
+    // 切换前后两个频道如果还在排队，按新的优先级调整位置
+    for (qint64 id : { previous, channelId }) {
+        auto it = m_tasks.find(id);
+        if (it != m_tasks.end() && !m_inFlight.contains(id)) {
+            m_queue.remove(it->key);
+            push(*it);
+        }
+    }
+    scheduleDispatch(0);
+}
+
+void CatchUpScheduler::pauseForInteraction()
+{
+    m_lastInteraction.start();
+}
+
+void CatchUpScheduler::stop()
+{
+    for (qint64 channelId : std::as_const(m_inFlight)) {
+        m_client->cancelRequest(m_tasks.value(channelId).requestId);
+    }
+    m_tasks.clear();
+    m_queue.clear();
+    m_inFlight.clear();
+    m_dispatchTimer.stop();
+    m_timeoutTimer.stop();
+}
+
+int CatchUpScheduler::pendingCount() const
+{
+    return m_queue.size();
+}
+
+int CatchUpScheduler::inFlightCount() const
+{
+    return m_inFlight.size();
+}
+
+CatchUpScheduler::Priority CatchUpScheduler::priorityOf(const Task& task) const
+{
+    if (task.channelId == m_visibleChannel) {
+        return VisiblePriority;
+    }
+    return task.unread ? UnreadPriority : BackgroundPriority;
+}
+
+void CatchUpScheduler::push(Task& task)
+{
+    task.key = qMakePair(int(priorityOf(task)), task.order);
+    m_queue.insert(task.key, task.channelId);
+}
+
+void CatchUpScheduler::requeue(qint64 channelId)
+{
+    m_inFlight.remove(channelId);
+    auto it = m_tasks.find(channelId);
+    if (it != m_tasks.end()) {
+        push(*it);
+    }
+}
+
+bool CatchUpScheduler::acquire(const QString& method, int* waitMs)
+{
+    const MethodRate& rate = rateOf(method);
+    MethodLimit& limit = m_limits[method];
+
+    if (limit.floodSince.isValid() && limit.floodSince.elapsed() < limit.floodWaitMs) {
+        *waitMs = int(limit.floodWaitMs - limit.floodSince.elapsed());
+        return false;
+    }
+
+    if (!limit.refill.isValid()) {
+        limit.tokens = rate.burst;
+        limit.refill.start();
+    } else {
+        limit.tokens = qMin(double(rate.burst), limit.tokens + limit.refill.restart() * rate.perSecond / 1000.0);
+    }
+    if (limit.tokens < 1) {
+        *waitMs = qMax(1, int((1 - limit.tokens) * 1000 / rate.perSecond));
+        return false;
+    }
+    limit.tokens -= 1;
+    return true;
+}
+
+void CatchUpScheduler::scheduleDispatch(int delayMs)
+{
+    if (!m_dispatchTimer.isActive() || m_dispatchTimer.remainingTime() > delayMs) {
+        m_dispatchTimer.start(delayMs);
+    }
+}
+
+void CatchUpScheduler::dispatch()
+{
+    int waitMs = 0;
+    while (!m_queue.isEmpty() && m_inFlight.size() < MAX_IN_FLIGHT) {
+        auto first = m_queue.begin();
+        Task& task = m_tasks[first.value()];
+
+        // 用户正在操作时只补齐正在查看的频道
+        if (first.key().first != VisiblePriority && m_lastInteraction.isValid()
+            && m_lastInteraction.elapsed() < INTERACTION_PAUSE_MS) {
+            waitMs = INTERACTION_PAUSE_MS - int(m_lastInteraction.elapsed());
+            break;
+        }
+        if (!acquire(CHANNEL_DIFFERENCE_METHOD, &waitMs)) {
+            break;
+        }
+
+        m_queue.erase(first);
+        m_inFlight.insert(task.channelId);
+        task.sent.start();
+        task.requestId = m_client->getChannelDifference(task.channelId, task.pts, DIFFERENCE_LIMIT);
+    }
+    if (waitMs > 0) {
+        scheduleDispatch(waitMs);
+    }
+}
+
+void CatchUpScheduler::onChannelDifferenceReceived(const ChannelDifference& difference)
+{
+    if (!m_inFlight.contains(difference.channelId)) {
+        return;
+    }
+    emit channelDifferenceReady(difference);
+
+    Task& task = m_tasks[difference.channelId];
+    task.pts = difference.pts;
+    if (!difference.isFinal) {
+        // 还有遗漏，沿用原来的入队顺序继续
+        requeue(difference.channelId);
+    } else {
+        m_inFlight.remove(difference.channelId);
+        m_tasks.remove(difference.channelId);
+        ++m_completedChannels;
+    }
+    scheduleDispatch(0);
+    checkFinished();
+}
+
+void CatchUpScheduler::onChannelDifferenceFailed(qint64 channelId, const QString& error, int retryAfter)
+{
+    if (!m_inFlight.contains(channelId)) {
+        return;
+    }
+    if (retryAfter > 0) {
+        // 触发限流后该方法整体暂停，清空令牌避免恢复后立即突发
+        MethodLimit& limit = m_limits[CHANNEL_DIFFERENCE_METHOD];
+        if (!limit.floodSince.isValid() || limit.floodSince.elapsed() >= limit.floodWaitMs) {
+            qDebug() << "频道补齐触发限流，暂停" << retryAfter << "秒";
+        }
+        limit.floodSince.start();
+        limit.floodWaitMs = qint64(retryAfter) * 1000;
+        limit.tokens = 0;
+        requeue(channelId);
+        scheduleDispatch(int(limit.floodWaitMs));
+        return;
+    }
+
+    qWarning() << "频道" << channelId << "补齐失败:" << error;
+    m_inFlight.remove(channelId);
+    m_tasks.remove(channelId);
+    scheduleDispatch(0);
+    checkFinished();
+}
+
+void CatchUpScheduler::onTimeoutCheck()
+{
+    // 客户端会在重连后重发原来的请求，先取消它再重新排队，避免同一段差异被请求和应用两次
+    const QList<qint64> inFlight = m_inFlight.values();
+    for (qint64 channelId : inFlight) {
+        const Task& task = m_tasks[channelId];
+        if (task.sent.elapsed() >= REQUEST_TIMEOUT_MS) {
+            m_client->cancelRequest(task.requestId);
+            requeue(channelId);
+        }
+    }
+    scheduleDispatch(0);
+}
+
+void CatchUpScheduler::checkFinished()
+{
+    if (!m_tasks.isEmpty()) {
+        return;
+    }
+    m_timeoutTimer.stop();
+    emit finished(m_completedChannels, m_roundTimer.elapsed());
+}
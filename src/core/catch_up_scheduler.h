@@ -0,0 +1,111 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QSet>
+#include <QTimer>
+
+#include "mtproto/mtproto_client.h"
+#include "telegram_types.h"
+
+/**
+ * @brief 频道补齐调度器
+ *
+ * 离线后每个频道都要单独调用updates.getChannelDifference。调度器把待补齐的频道
+ * 按优先级排队：正在查看的频道最先，其次是有未读的频道，最后是其余频道；
+ * 同时在途的请求数量有上限，每个方法按自己的速率用令牌桶限流，
+ * 收到FLOOD_WAIT时该方法整体暂停相应时间。用户操作界面时暂停派发后台频道，
+ * 避免补齐与界面争抢主线程。一个频道的差异分片返回时立即以原来的位置继续排队。
+ */
+class CatchUpScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CatchUpScheduler(MTProtoClient* client, QObject* parent = nullptr);
+
+    // 登记一个需要补齐的频道，已在队列中时只更新优先级
+    void enqueue(qint64 channelId, qint32 pts, bool unread);
+
+    // 正在查看的频道，0表示没有
+    void setVisibleChannel(qint64 channelId);
+
+    // 用户操作时调用，短时间内不再派发后台频道
+    void pauseForInteraction();
+
+    void stop();
+
+    int pendingCount() const;
+    int inFlightCount() const;
+
+signals:
+    // 一个频道的一段差异，由核心层写入存储
+    void channelDifferenceReady(const ChannelDifference& difference);
+
+    // 队列中的频道全部补齐
+    void finished(int channelCount, qint64 elapsedMs);
+
+private slots:
+    void onChannelDifferenceReceived(const ChannelDifference& difference);
+    void onChannelDifferenceFailed(qint64 channelId, const QString& error, int retryAfter);
+    void onTimeoutCheck();
+    void dispatch();
+
+private:
+    enum Priority {
+        VisiblePriority = 0,
+        UnreadPriority = 1,
+        BackgroundPriority = 2
+    };
+
+    struct Task
+    {
+        qint64 channelId = 0;
+        qint32 pts = 0;
+        bool unread = false;
+        quint64 order = 0;          // 入队顺序，分片继续时沿用
+        QPair<int, quint64> key;    // 在队列中的位置
+        QElapsedTimer sent;         // 在途请求的发出时间
+        quint64 requestId = 0;      // 在途请求，超时后取消
+    };
+
+    // 每个方法的限流状态
+    struct MethodLimit
+    {
+        double tokens = 0;
+        QElapsedTimer refill;
+        QElapsedTimer floodSince;
+        qint64 floodWaitMs = 0;
+    };
+
+    Priority priorityOf(const Task& task) const;
+    void push(Task& task);
+    void requeue(qint64 channelId);
+
+    // 取得一次调用的配额，不足时返回false并给出需要等待的毫秒数
+    bool acquire(const QString& method, int* waitMs);
+    void scheduleDispatch(int delayMs);
+    void checkFinished();
+
+    MTProtoClient* m_client;
+
+    // 排队和在途的频道
+    QHash<qint64, Task> m_tasks;
+    QMap<QPair<int, quint64>, qint64> m_queue;
+    QSet<qint64> m_inFlight;
+    quint64 m_nextOrder;
+
+    qint64 m_visibleChannel;
+    QElapsedTimer m_lastInteraction;
+    QHash<QString, MethodLimit> m_limits;
+
+    QTimer m_dispatchTimer;
+    QTimer m_timeoutTimer;
+
+    // 本轮补齐的统计
+    QElapsedTimer m_roundTimer;
+    int m_completedChannels;
+};
@@ -0,0 +1,123 @@
+#include "clock.h"
+#include <QCoreApplication>
+#include <QDateTime>
+
+Clock* Clock::s_instance = nullptr;
+
+Clock* Clock::instance()
+{
+    if (!s_instance) {
+        s_instance = new Clock(QCoreApplication::instance());
+    }
+    return s_instance;
+}
+
+Clock::Clock(QObject* parent)
+    : QObject(parent)
+    , m_virtual(false)
+    , m_virtualStart(0)
+    , m_virtualNow(0)
+    , m_nextId(0)
+    , m_advanceScheduled(false)
+{
+}
+
+void Clock::setVirtual(bool enabled)
+{
+    if (m_virtual == enabled) {
+        return;
+    }
+    m_virtual = enabled;
+    m_virtualStart = QDateTime::currentMSecsSinceEpoch();
+    m_virtualNow = m_virtualStart;
+}
+
+bool Clock::isVirtual() const
+{
+    return m_virtual;
+}
+
+qint64 Clock::currentMSecsSinceEpoch() const
+{
+    return m_virtual ? m_virtualNow : QDateTime::currentMSecsSinceEpoch();
+}
+
+qint64 Clock::currentSecsSinceEpoch() const
+{
+    return currentMSecsSinceEpoch() / 1000;
+}
+
+qint64 Clock::virtualElapsedMs() const
+{
+    return m_virtual ? m_virtualNow - m_virtualStart : 0;
+}
+
+int Clock::singleShot(int ms, QObject* context, std::function<void()> callback)
+{
+    int id = ++m_nextId;
+    if (m_virtual) {
+        qint64 due = m_virtualNow + qMax(0, ms);
+        m_tasks.insert(qMakePair(due, id), Task{ context, context != nullptr, std::move(callback) });
+        m_taskDue.insert(id, due);
+        scheduleAdvance();
+        return id;
+    }
+
+    QTimer* timer = new QTimer(context);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, timer, [this, id, timer, callback = std::move(callback)]() {
+        m_timers.remove(id);
+        timer->deleteLater();
+        callback();
+    });
+    m_timers.insert(id, timer);
+    timer->start(qMax(0, ms));
+    return id;
+}
+
+void Clock::cancel(int id)
+{
+    auto due = m_taskDue.find(id);
+    if (due != m_taskDue.end()) {
+        m_tasks.remove(qMakePair(due.value(), id));
+        m_taskDue.erase(due);
+        return;
+    }
+    QPointer<QTimer> timer = m_timers.take(id);
+    if (timer) {
+        timer->stop();
+        timer->deleteLater();
+    }
+}
+
+void Clock::scheduleAdvance()
+{
+    if (m_advanceScheduled) {
+        return;
+    }
+    m_advanceScheduled = true;
+
+    // 零延时定时器在已到达的事件处理完之后才执行，排队的响应和信号不会被跳过
+    QTimer::singleShot(0, this, &Clock::advance);
+}
+
+void Clock::advance()
+{
+    m_advanceScheduled = false;
+    if (m_tasks.isEmpty()) {
+        return;
+    }
+
+    auto first = m_tasks.begin();
+    m_virtualNow = qMax(m_virtualNow, first.key().first);
+    m_taskDue.remove(first.key().second);
+    Task task = first.value();
+    m_tasks.erase(first);
+
+    if (!m_tasks.isEmpty()) {
+        scheduleAdvance();
+    }
+    if (!task.hasContext || task.context) {
+        task.callback();
+    }
+}
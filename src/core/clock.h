@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QPointer>
+#include <QTimer>
+#include <functional>
+
+/**
+ * @brief 时钟和延时任务服务
+ *
+ * 模拟服务器的网络延迟、推送间隔和界面流程中的等待都通过这里调度。
+ * 默认使用真实时间；切换到虚拟时间后，延时任务不再真的等待：
+ * 事件循环每处理完已到达的事件，就把时间直接拨到最早的任务并执行它，
+ * 因此脚本化的登录、getMe循环只消耗CPU时间。虚拟时间下周期性的任务
+ * （如模拟推送）会让时间持续前进，只应在压力测试和脚本运行中开启。
+ */
+class Clock : public QObject
+{
+    Q_OBJECT
+
+public:
+    static Clock* instance();
+
+    // 切换到虚拟时间，起点为当前真实时间，应在调度任何任务之前调用
+    void setVirtual(bool enabled);
+    bool isVirtual() const;
+
+    qint64 currentMSecsSinceEpoch() const;
+    qint64 currentSecsSinceEpoch() const;
+
+    // 在ms毫秒后执行callback，context销毁时任务自动取消；返回任务编号
+    int singleShot(int ms, QObject* context, std::function<void()> callback);
+    void cancel(int id);
+
+    // 虚拟时间相对起点前进的毫秒数
+    qint64 virtualElapsedMs() const;
+
+private:
+    explicit Clock(QObject* parent = nullptr);
+
+    struct Task
+    {
+        QPointer<QObject> context;
+        bool hasContext = false;
+        std::function<void()> callback;
+    };
+
+    // 虚拟时间下执行最早的一个任务
+    void advance();
+    void scheduleAdvance();
+
+    static Clock* s_instance;
+
+    bool m_virtual;
+    qint64 m_virtualStart;
+    qint64 m_virtualNow;
+    int m_nextId;
+    bool m_advanceScheduled;
+
+    // 虚拟时间：按到期时间和编号排序的任务
+    QMap<QPair<qint64, int>, Task> m_tasks;
+    QHash<int, qint64> m_taskDue;
+
+    // 真实时间：每个任务一个单次定时器
+    QHash<int, QPointer<QTimer>> m_timers;
+};
@@ -5,6 +5,7 @@
 #include <QDebug>
 #include <QCoreApplication>
 #include <QDir>
+#include <QFileInfo>
 
 // 静态实例初始化
 ConfigManager* ConfigManager::s_instance = nullptr;
@@ -67,6 +68,12 @@ QString ConfigManager::configFilePath() const
     return m_configFilePath;
 }
 
+QString ConfigManager::dataDirectoryPath(const QString& account) const
+{
+    QDir dir = QFileInfo(m_configFilePath).dir();
+    return account.isEmpty() ? dir.filePath("data") : dir.filePath("data/accounts/" + account);
+}
+
 bool ConfigManager::loadConfig()
 {
     QFile configFile(m_configFilePath);
@@ -212,39 +219,88 @@ void ConfigManager::setProxyPassword(const QString& password)
     emit proxyConfigChanged();
 }
 
+// 账号
+QStringList ConfigManager::accountIds() const
+{
+    QStringList ids;
+    ids.append(QString());
+    const QJsonObject accounts = m_config["accounts"].toObject();
+    for (auto it = accounts.constBegin(); it != accounts.constEnd(); ++it) {
+        ids.append(it.key());
+    }
+    return ids;
+}
+
+QString ConfigManager::addAccount()
+{
+    QJsonObject accounts = m_config["accounts"].toObject();
+    int number = accounts.size() + 2;
+    while (accounts.contains(QString("account%1").arg(number))) {
+        ++number;
+    }
+    QString id = QString("account%1").arg(number);
+    
+    QJsonObject account;
+    account["api"] = createDefaultConfig()["api"];
+    accounts[id] = account;
+    m_config["accounts"] = accounts;
+    return id;
+}
+
+QJsonObject ConfigManager::apiSection(const QString& account) const
+{
+    if (account.isEmpty()) {
+        return m_config["api"].toObject();
+    }
+    return m_config["accounts"].toObject()[account].toObject()["api"].toObject();
+}
+
+void ConfigManager::setApiSection(const QString& account, const QJsonObject& api)
+{
+    if (account.isEmpty()) {
+        m_config["api"] = api;
+        return;
+    }
+    QJsonObject accounts = m_config["accounts"].toObject();
+    QJsonObject section = accounts[account].toObject();
+    section["api"] = api;
+    accounts[account] = section;
+    m_config["accounts"] = accounts;
+}
+
 // API凭据访问器
-int ConfigManager::apiId() const
+int ConfigManager::apiId(const QString& account) const
 {
-    return m_config["api"].toObject()["apiId"].toInt();
+    return apiSection(account)["apiId"].toInt();
 }
 
-QString ConfigManager::apiHash() const
+QString ConfigManager::apiHash(const QString& account) const
 {
-    return m_config["api"].toObject()["apiHash"].toString();
+    return apiSection(account)["apiHash"].toString();
 }
 
-QString ConfigManager::phoneNumber() const
+QString ConfigManager::phoneNumber(const QString& account) const
 {
-    return m_config["api"].toObject()["phoneNumber"].toString();
+    return apiSection(account)["phoneNumber"].toString();
 }
 
-void ConfigManager::setApiId(int apiId)
+void ConfigManager::setApiId(int apiId, const QString& account)
 {
-    QJsonObject api = m_config["api"].toObject();
+    QJsonObject api = apiSection(account);
     api["apiId"] = apiId;
-    m_config["api"] = api;
+    setApiSection(account, api);
 }
 
-void ConfigManager::setApiHash(const QString& apiHash)
+void ConfigManager::setApiHash(const QString& apiHash, const QString& account)
 {
-    QJsonObject api = m_config["api"].toObject();
+    QJsonObject api = apiSection(account);
     api["apiHash"] = apiHash;
-    m_config["api"] = api;
+    setApiSection(account, api);
 }
 
-void ConfigManager::setPhoneNumber(const QString& phoneNumber)
+void ConfigManager::setPhoneNumber(const QString& phoneNumber, const QString& account)
 {
-    QJsonObject api = m_config["api"].toObject();
+    QJsonObject api = apiSection(account);
     api["phoneNumber"] = phoneNumber;
-    m_config["api"] = api;
-} 
\ No newline at end of file
+    setApiSection(account, api);
+}
@@ -2,6 +2,7 @@
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QFile>
@@ -44,17 +45,25 @@ public:
     void setProxyUsername(const QString& username);
     void setProxyPassword(const QString& password);
 
-    // API凭据
-    int apiId() const;
-    QString apiHash() const;
-    QString phoneNumber() const;
+    // 账号：默认账号的ID为空字符串，使用顶层的api段和data目录，
+    // 其他账号的设置保存在accounts段中各自的命名空间下，代理设置所有账号共用
+    QStringList accountIds() const;
+    QString addAccount();
 
-    void setApiId(int apiId);
-    void setApiHash(const QString& apiHash);
-    void setPhoneNumber(const QString& phoneNumber);
+    // API凭据，account为空时是默认账号
+    int apiId(const QString& account = QString()) const;
+    QString apiHash(const QString& account = QString()) const;
+    QString phoneNumber(const QString& account = QString()) const;
+
+    void setApiId(int apiId, const QString& account = QString());
+    void setApiHash(const QString& apiHash, const QString& account = QString());
+    void setPhoneNumber(const QString& phoneNumber, const QString& account = QString());
 
     // 配置文件路径
     QString configFilePath() const;
+    
+    // 本地数据目录（消息存储等），与配置文件位于同一目录，每个账号一个
+    QString dataDirectoryPath(const QString& account = QString()) const;
 
 public slots:
     // 应用程序退出时保存配置
@@ -81,4 +90,8 @@ private:
     
     // 创建默认配置
     QJsonObject createDefaultConfig() const;
+    
+    // 账号的api段
+    QJsonObject apiSection(const QString& account) const;
+    void setApiSection(const QString& account, const QJsonObject& api);
 }; 
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "dialog_views.h"
+#include <algorithm>
+
+DialogViews::DialogViews(QObject* parent)
+    : QObject(parent)
+{
+}
+
+void DialogViews::reset(const QVector<DialogData>& dialogs)
+{
+    // 存储中每个会话只有一条记录
+    m_entries.clear();
+    m_folders.clear();
+    m_total = Counters();
+    m_dirtyFolders.clear();
+    m_entries.reserve(dialogs.size());
+    for (const DialogData& dialog : dialogs) {
+        Entry entry;
+        entry.folderId = dialog.folderId;
+        entry.unreadCount = qMax(0, dialog.unreadCount);
+        m_entries.insert(dialog.peerId, entry);
+        account(dialog.peerId, entry, 1, true);
+    }
+    m_dirtyFolders.clear();
+    emit viewsReset();
+}
+
+void DialogViews::apply(const DialogData& dialog)
+{
+    Entry entry;
+    entry.folderId = dialog.folderId;
+    entry.unreadCount = qMax(0, dialog.unreadCount);
+
+    auto it = m_entries.find(dialog.peerId);
+    if (it == m_entries.end()) {
+        m_entries.insert(dialog.peerId, entry);
+        account(dialog.peerId, entry, 1, true);
+        emit dialogMoved(dialog.peerId, -1, entry.folderId);
+        return;
+    }
+    if (it->folderId == entry.folderId && it->unreadCount == entry.unreadCount) {
+        return;
+    }
+    Entry previous = *it;
+    *it = entry;
+    bool moved = previous.folderId != entry.folderId;
+    account(dialog.peerId, previous, -1, moved);
+    account(dialog.peerId, entry, 1, moved);
+    if (moved) {
+        emit dialogMoved(dialog.peerId, previous.folderId, entry.folderId);
+    }
+}
+
+void DialogViews::remove(qint64 peerId)
+{
+    auto it = m_entries.find(peerId);
+    if (it == m_entries.end()) {
+        return;
+    }
+    Entry previous = *it;
+    m_entries.erase(it);
+    account(peerId, previous, -1, true);
+    emit dialogMoved(peerId, previous.folderId, -1);
+}
+
+void DialogViews::flush()
+{
+    if (m_dirtyFolders.isEmpty()) {
+        return;
+    }
+    // 变化的文件夹通常只有一两个，按编号顺序通知
+    QList<qint32> folders(m_dirtyFolders.cbegin(), m_dirtyFolders.cend());
+    m_dirtyFolders.clear();
+    std::sort(folders.begin(), folders.end());
+    for (qint32 folderId : folders) {
+        emit countersChanged(folderId, counters(folderId));
+    }
+    emit totalChanged(m_total);
+}
+
+DialogViews::Counters DialogViews::counters(qint32 folderId) const
+{
+    auto it = m_folders.constFind(folderId);
+    return it != m_folders.constEnd() ? it->counters : Counters();
+}
+
+DialogViews::Counters DialogViews::total() const
+{
+    return m_total;
+}
+
+QSet<qint64> DialogViews::members(qint32 folderId) const
+{
+    auto it = m_folders.constFind(folderId);
+    return it != m_folders.constEnd() ? it->members : QSet<qint64>();
+}
+
+QList<qint32> DialogViews::folders() const
+{
+    QList<qint32> folders = m_folders.keys();
+    std::sort(folders.begin(), folders.end());
+    return folders;
+}
+
+bool DialogViews::contains(qint64 peerId) const
+{
+    return m_entries.contains(peerId);
+}
+
+void DialogViews::account(qint64 peerId, const Entry& entry, int sign, bool member)
+{
+    Folder& folder = m_folders[entry.folderId];
+    int dialogs = member ? sign : 0;
+    int unreadDialogs = entry.unreadCount > 0 ? sign : 0;
+    qint64 unreadMessages = qint64(entry.unreadCount) * sign;
+
+    folder.counters.dialogs += dialogs;
+    folder.counters.unreadDialogs += unreadDialogs;
+    folder.counters.unreadMessages += unreadMessages;
+    m_total.dialogs += dialogs;
+    m_total.unreadDialogs += unreadDialogs;
+    m_total.unreadMessages += unreadMessages;
+
+    if (member && sign > 0) {
+        folder.members.insert(peerId);
+    } else if (member) {
+        folder.members.remove(peerId);
+    }
+    m_dirtyFolders.insert(entry.folderId);
+
+    // 空文件夹不再列出，计数仍会在flush时以0通知一次
+    if (folder.members.isEmpty()) {
+        m_folders.remove(entry.folderId);
+    }
+}
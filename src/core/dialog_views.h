@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+
+#include "telegram_types.h"
+
+/**
+ * @brief 会话列表的增量视图：各文件夹的会话集合和未读计数
+ *
+ * 打开存储时从全部会话建立一次，之后每个会话的变化（新消息、已读、移动文件夹）只按它与
+ * 旧状态的差值调整所在文件夹和总计，代价与会话总数无关。会话进出文件夹时立即通知，
+ * 计数的变化积累到flush时按文件夹各通知一次，一批更新只刷新一次角标。
+ */
+class DialogViews : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Counters
+    {
+        int dialogs = 0;            // 会话数
+        int unreadDialogs = 0;      // 有未读消息的会话数
+        qint64 unreadMessages = 0;  // 未读消息数
+    };
+
+    explicit DialogViews(QObject* parent = nullptr);
+
+    // 按全部会话重建视图，只在打开存储时调用
+    void reset(const QVector<DialogData>& dialogs);
+
+    // 会话新增或变化，未读数和文件夹都没有变化时不做任何事
+    void apply(const DialogData& dialog);
+    void remove(qint64 peerId);
+
+    // 发出积累的计数变化
+    void flush();
+
+    Counters counters(qint32 folderId) const;
+    Counters total() const;
+    QSet<qint64> members(qint32 folderId) const;
+    QList<qint32> folders() const;
+    bool contains(qint64 peerId) const;
+
+signals:
+    // 视图重建，接收方重新读取全部内容
+    void viewsReset();
+
+    // 会话进出文件夹，新会话的fromFolder和移除的会话的toFolder为-1
+    void dialogMoved(qint64 peerId, qint32 fromFolder, qint32 toFolder);
+
+    // 文件夹和总计的计数变化
+    void countersChanged(qint32 folderId, const DialogViews::Counters& counters);
+    void totalChanged(const DialogViews::Counters& total);
+
+private:
+    struct Entry
+    {
+        qint32 folderId = 0;
+        qint32 unreadCount = 0;
+    };
+
+    struct Folder
+    {
+        Counters counters;
+        QSet<qint64> members;
+    };
+
+    // 把一个会话计入（sign为1）或移出（sign为-1）所在文件夹；member为false时只调整未读计数
+    void account(qint64 peerId, const Entry& entry, int sign, bool member);
+
+    QHash<qint64, Entry> m_entries;
+    QHash<qint32, Folder> m_folders;
+    Counters m_total;
+    QSet<qint32> m_dirtyFolders;    // 计数变化、等待flush通知的文件夹
+};
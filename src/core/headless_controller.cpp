@@ -0,0 +1,305 @@
+#include "headless_controller.h"
+#include "clock.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+namespace {
+
+// 等待服务器响应的上限，超时后继续执行下一条命令
+const int COMMAND_TIMEOUT_MS = 30000;
+
+// history命令默认的条数
+const int DEFAULT_HISTORY_LIMIT = 20;
+
+// 搜索命令返回的条数
+const int SEARCH_LIMIT = 50;
+
+QString formatMessage(const MessageData& message)
+{
+    return QString("%1 #%2 %3 %4: %5")
+        .arg(message.peerId)
+        .arg(message.id)
+        .arg(QDateTime::fromSecsSinceEpoch(message.date).toString(Qt::ISODate))
+        .arg(message.fromName, message.text);
+}
+
+QString formatPeer(const PeerData& peer)
+{
+    QString name = peer.type == PeerData::User
+        ? (peer.firstName + ' ' + peer.lastName).trimmed()
+        : peer.title;
+    return peer.username.isEmpty()
+        ? QString("%1 %2").arg(peer.id).arg(name)
+        : QString("%1 %2 @%3").arg(peer.id).arg(name, peer.username);
+}
+
+} // namespace
+
+HeadlessController::HeadlessController(TelegramClient* client, QObject* parent)
+    : QObject(parent)
+    , m_client(client)
+    , m_server(nullptr)
+    , m_stdout(stdout)
+    , m_busy(false)
+    , m_waiting(None)
+    , m_waitingPeer(0)
+    , m_delayTask(0)
+{
+    m_timeout.setSingleShot(true);
+    connect(&m_timeout, &QTimer::timeout, this, [this]() {
+        reply("error 等待响应超时");
+        finishCommand();
+    });
+
+    connect(m_client, &TelegramClient::codeRequested, this, [this](const QString& phoneCodeHash) {
+        m_phoneCodeHash = phoneCodeHash;
+        if (m_waiting == CodeSent) {
+            reply("ok 验证码已发送");
+            finishCommand();
+        }
+    });
+    connect(m_client, &TelegramClient::loginSuccess, this, [this](const QString& username) {
+        if (m_waiting == SignedIn) {
+            reply("ok 已登录 " + username);
+            finishCommand();
+        }
+    });
+    connect(m_client, &TelegramClient::loginFailed, this, [this](const QString& error) {
+        if (m_waiting == CodeSent || m_waiting == SignedIn) {
+            reply("error " + error);
+            finishCommand();
+        }
+    });
+    connect(m_client, &TelegramClient::authorizationError, this, [this](const QString& error) {
+        if (m_waiting != None && m_waiting != Delay) {
+            reply("error " + error);
+            finishCommand();
+        }
+    });
+    connect(m_client, &TelegramClient::userInfoReceived, this,
+        [this](const QString& username, const QString& firstName, const QString& lastName) {
+            if (m_waiting == UserInfo) {
+                reply(QString("ok %1 %2 %3").arg(username, firstName, lastName).trimmed());
+                finishCommand();
+            }
+        });
+    connect(m_client, &TelegramClient::historyReceived, this,
+        [this](qint64 peerId, qint32 offsetId, const QVector<MessageData>& messages, int totalCount) {
+            Q_UNUSED(offsetId);
+            if (m_waiting != History || peerId != m_waitingPeer) {
+                return;
+            }
+            for (const MessageData& message : messages) {
+                reply(formatMessage(message));
+            }
+            reply(QString("ok %1/%2").arg(messages.size()).arg(totalCount));
+            finishCommand();
+        });
+
+    // 推送的新消息发给所有连接的客户端
+    connect(m_client, &TelegramClient::newMessagesReceived, this, [this](const QVector<MessageData>& messages) {
+        for (const MessageData& message : messages) {
+            broadcast("new " + formatMessage(message));
+        }
+    });
+}
+
+bool HeadlessController::runCommandFile(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "无法打开命令文件:" << path;
+        return false;
+    }
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        enqueue(stream.readLine(), nullptr);
+    }
+    return true;
+}
+
+bool HeadlessController::listen(const QString& serverName)
+{
+    if (!m_server) {
+        m_server = new QLocalServer(this);
+        connect(m_server, &QLocalServer::newConnection, this, &HeadlessController::onNewConnection);
+    }
+
+    // 上次异常退出可能留下同名的套接字文件
+    QLocalServer::removeServer(serverName);
+    if (!m_server->listen(serverName)) {
+        qWarning() << "无法监听本地套接字" << serverName << ":" << m_server->errorString();
+        return false;
+    }
+    qDebug() << "命令套接字:" << m_server->fullServerName();
+    return true;
+}
+
+void HeadlessController::onNewConnection()
+{
+    m_sockets.removeIf([](const QPointer<QLocalSocket>& socket) {
+        return socket.isNull();
+    });
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        m_sockets.append(socket);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            while (socket->canReadLine()) {
+                enqueue(QString::fromUtf8(socket->readLine()), socket);
+            }
+        });
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void HeadlessController::enqueue(const QString& line, QLocalSocket* origin)
+{
+    QString trimmed = line.trimmed();
+    if (trimmed.isEmpty() || trimmed.startsWith('#')) {
+        return;
+    }
+    Command command;
+    command.line = trimmed;
+    command.origin = origin;
+    command.fromSocket = origin != nullptr;
+    m_commands.enqueue(command);
+
+    // 命令可能在信号处理中排入，统一推迟到事件循环中执行
+    if (!m_busy) {
+        m_busy = true;
+        QMetaObject::invokeMethod(this, &HeadlessController::processNext, Qt::QueuedConnection);
+    }
+}
+
+void HeadlessController::processNext()
+{
+    // 响应可能在命令执行过程中同步到达，此时外层循环仍在进行
+    if (m_waiting != None) {
+        return;
+    }
+    while (!m_commands.isEmpty()) {
+        m_current = m_commands.dequeue();
+        // 发出命令的客户端已断开，不再执行
+        if (m_current.fromSocket && !m_current.origin) {
+            continue;
+        }
+        execute(m_current.line);
+        if (m_waiting != None) {
+            // 等响应到达后由finishCommand继续
+            return;
+        }
+    }
+    m_busy = false;
+}
+
+void HeadlessController::execute(const QString& line)
+{
+    const QStringList args = line.split(' ', Qt::SkipEmptyParts);
+    const QString name = args.first().toLower();
+    const QString rest = line.mid(args.first().size()).trimmed();
+
+    if (name == "code" && args.size() == 2) {
+        m_waiting = CodeSent;
+        m_timeout.start(COMMAND_TIMEOUT_MS);
+        m_client->sendAuthenticationCode(args.at(1));
+    } else if (name == "signin" && args.size() == 3) {
+        if (m_phoneCodeHash.isEmpty()) {
+            reply("error 请先发送验证码");
+            return;
+        }
+        m_waiting = SignedIn;
+        m_timeout.start(COMMAND_TIMEOUT_MS);
+        m_client->signIn(args.at(1), m_phoneCodeHash, args.at(2));
+    } else if (name == "me") {
+        m_waiting = UserInfo;
+        m_timeout.start(COMMAND_TIMEOUT_MS);
+        m_client->getMe();
+    } else if (name == "history" && (args.size() == 2 || args.size() == 3)) {
+        bool ok = false;
+        qint64 peerId = args.at(1).toLongLong(&ok);
+        int limit = args.size() == 3 ? args.at(2).toInt() : DEFAULT_HISTORY_LIMIT;
+        if (!ok || limit <= 0) {
+            reply("error 参数无效");
+            return;
+        }
+        m_waiting = History;
+        m_waitingPeer = peerId;
+        m_timeout.start(COMMAND_TIMEOUT_MS);
+        m_client->requestHistory(peerId, 0, limit);
+    } else if (name == "search" && !rest.isEmpty()) {
+        // 本地搜索同步返回结果
+        QMetaObject::Connection connection = connect(m_client, &TelegramClient::searchResultsReady, this,
+            [this](const QString&, const QVector<MessageData>& messages) {
+                for (const MessageData& message : messages) {
+                    reply(formatMessage(message));
+                }
+                reply(QString("ok %1").arg(messages.size()));
+            });
+        m_client->searchMessages(rest, SEARCH_LIMIT);
+        disconnect(connection);
+    } else if (name == "peers" && !rest.isEmpty()) {
+        QMetaObject::Connection connection = connect(m_client, &TelegramClient::peerSearchResultsReady, this,
+            [this](const QString&, const QVector<PeerData>& peers) {
+                for (const PeerData& peer : peers) {
+                    reply(formatPeer(peer));
+                }
+                reply(QString("ok %1").arg(peers.size()));
+            });
+        m_client->searchPeers(rest, SEARCH_LIMIT);
+        disconnect(connection);
+    } else if (name == "read" && args.size() == 3) {
+        m_client->markHistoryRead(args.at(1).toLongLong(), args.at(2).toInt());
+        reply("ok");
+    } else if (name == "typing" && args.size() == 2) {
+        m_client->setTyping(args.at(1).toLongLong());
+        reply("ok");
+    } else if (name == "wait" && args.size() == 2) {
+        m_waiting = Delay;
+        m_delayTask = Clock::instance()->singleShot(qMax(0, args.at(1).toInt()), this, [this]() {
+            m_delayTask = 0;
+            finishCommand();
+        });
+    } else if (name == "quit") {
+        reply("ok");
+        m_commands.clear();
+        QCoreApplication::quit();
+    } else {
+        reply("error 未知命令: " + line);
+    }
+}
+
+void HeadlessController::finishCommand()
+{
+    m_timeout.stop();
+    if (m_delayTask != 0) {
+        Clock::instance()->cancel(m_delayTask);
+        m_delayTask = 0;
+    }
+    m_waiting = None;
+    m_waitingPeer = 0;
+    QMetaObject::invokeMethod(this, &HeadlessController::processNext, Qt::QueuedConnection);
+}
+
+void HeadlessController::reply(const QString& text)
+{
+    if (m_current.fromSocket) {
+        if (m_current.origin) {
+            m_current.origin->write(text.toUtf8() + '\n');
+        }
+        return;
+    }
+    m_stdout << text << Qt::endl;
+}
+
+void HeadlessController::broadcast(const QString& text)
+{
+    m_stdout << text << Qt::endl;
+    for (const QPointer<QLocalSocket>& socket : std::as_const(m_sockets)) {
+        if (socket) {
+            socket->write(text.toUtf8() + '\n');
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QObject>
+#include <QList>
+#include <QPointer>
+#include <QQueue>
+#include <QTextStream>
+#include <QTimer>
+
+#include "telegram_client.h"
+
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * @brief 无界面模式下用文本命令驱动TelegramClient
+ *
+ * 命令来自命令文件或本地套接字，每行一条，按顺序执行：
+ * 需要等待服务器响应的命令在收到结果（或超时）后才执行下一条。
+ * 结果写回发出命令的套接字，来自命令文件的结果写到标准输出。
+ *
+ * 支持的命令：
+ *   code <手机号>            发送验证码
+ *   signin <手机号> <验证码>  登录
+ *   me                       获取账户信息
+ *   history <会话ID> [数量]   获取聊天记录
+ *   search <关键词>          搜索本地消息
+ *   peers <关键词>           查找联系人和会话
+ *   read <会话ID> <消息ID>    标记已读（合并后发送）
+ *   typing <会话ID>          发送输入状态（合并后发送）
+ *   wait <毫秒>              等待一段时间，用于等更新同步
+ *   quit                     退出程序
+ */
+class HeadlessController : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessController(TelegramClient* client, QObject* parent = nullptr);
+
+    // 读取命令文件并排队执行，文件执行完后不退出，除非其中有quit
+    bool runCommandFile(const QString& path);
+
+    // 在本地套接字上监听命令
+    bool listen(const QString& serverName);
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Command
+    {
+        QString line;
+        QPointer<QLocalSocket> origin;  // 为空时来自命令文件
+        bool fromSocket = false;
+    };
+
+    // 当前命令在等待的响应
+    enum Waiting {
+        None,
+        CodeSent,
+        SignedIn,
+        UserInfo,
+        History,
+        Delay
+    };
+
+    void enqueue(const QString& line, QLocalSocket* origin);
+    void processNext();
+    void execute(const QString& line);
+    void finishCommand();
+    void reply(const QString& text);
+    void broadcast(const QString& text);
+
+    TelegramClient* m_client;
+    QLocalServer* m_server;
+    QList<QPointer<QLocalSocket>> m_sockets;
+    QTextStream m_stdout;
+
+    QQueue<Command> m_commands;
+    Command m_current;
+    bool m_busy;
+    Waiting m_waiting;
+    qint64 m_waitingPeer;
+    QString m_phoneCodeHash;
+    QTimer m_timeout;
+    int m_delayTask;        // wait命令的延时任务，跟随虚拟时间
+};
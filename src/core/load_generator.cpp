@@ -0,0 +1,373 @@
+#include "load_generator.h"
+#include "clock.h"
+#include "config_manager.h"
+#include "shared_runtime.h"
+#include <QDebug>
+#include <QRandomGenerator>
+#include <algorithm>
+
+namespace {
+
+// 单个操作超过这个时间仍未完成时记为失败
+const qint64 OPERATION_TIMEOUT_MS = 10000;
+
+// 进度输出的间隔
+const qint64 REPORT_INTERVAL_MS = 5000;
+
+// 历史请求在这么多个会话中随机选择，每次取的条数
+const int HISTORY_PEERS = 1000;
+const int HISTORY_LIMIT = 50;
+
+// 模拟登录使用的验证码
+const char SIMULATED_CODE[] = "12345";
+
+const char* const OPERATION_NAMES[LoadGenerator::OperationCount] = {
+    "auth", "getMe", "history", "send"
+};
+
+} // namespace
+
+bool LoadGenerator::parseMix(const QString& text, Options* options)
+{
+    int weights[OperationCount] = { 0, 0, 0, 0 };
+    const QStringList items = text.split(',', Qt::SkipEmptyParts);
+    for (const QString& item : items) {
+        const QStringList pair = item.split('=');
+        bool ok = false;
+        int weight = pair.size() == 2 ? pair.at(1).trimmed().toInt(&ok) : 0;
+        if (!ok || weight < 0) {
+            return false;
+        }
+        int operation = 0;
+        while (operation < OperationCount
+               && pair.at(0).trimmed().compare(OPERATION_NAMES[operation], Qt::CaseInsensitive) != 0) {
+            ++operation;
+        }
+        if (operation == OperationCount) {
+            return false;
+        }
+        weights[operation] = weight;
+    }
+
+    int total = 0;
+    for (int weight : weights) {
+        total += weight;
+    }
+    if (total == 0) {
+        return false;
+    }
+    std::copy(weights, weights + OperationCount, options->weights);
+    return true;
+}
+
+LoadGenerator::LoadGenerator(const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_totalWeight(0)
+    , m_running(false)
+    , m_lastReportMs(0)
+    , m_baselineBytes(0)
+    , m_clientsBytes(0)
+    , m_startCpuUs(0)
+{
+    for (int weight : m_options.weights) {
+        m_totalWeight += weight;
+    }
+    connect(&m_tick, &QTimer::timeout, this, &LoadGenerator::checkTimeouts);
+}
+
+void LoadGenerator::start()
+{
+    // 先创建共享资源，基线中不包含它们
+    SharedRuntime::instance();
+    m_baselineBytes = SharedRuntime::residentBytes();
+
+    m_clients.resize(m_options.clients);
+    for (int i = 0; i < m_clients.size(); ++i) {
+        createClient(i);
+    }
+    m_clientsBytes = SharedRuntime::residentBytes();
+    qDebug() << "已创建" << m_clients.size() << "个客户端，平均每个客户端"
+             << (m_clientsBytes - m_baselineBytes) / qMax(1, int(m_clients.size())) << "字节";
+
+    m_running = true;
+    m_startCpuUs = SharedRuntime::cpuTimeMicroseconds();
+    m_clock.start();
+    m_tick.start(1000);
+    for (int i = 0; i < m_clients.size(); ++i) {
+        issue(i);
+    }
+}
+
+void LoadGenerator::createClient(int index)
+{
+    ConfigManager* config = ConfigManager::instance();
+    Client& client = m_clients[index];
+    client.mtproto = new MTProtoClient(SharedRuntime::instance()->networkManager(), this);
+    client.mtproto->init();
+    SharedRuntime::instance()->applyHedgeBudget(client.mtproto);
+    client.mtproto->setApiCredentials(config->apiId(), config->apiHash());
+    client.phoneNumber = QString("+8613%1").arg(index, 9, 10, QChar('0'));
+
+    MTProtoClient* mtproto = client.mtproto;
+    connect(mtproto, &MTProtoClient::authCodeRequested, this, [this, index](const QString& phoneCodeHash) {
+        Client& client = m_clients[index];
+        if (client.busy && client.operation == Auth) {
+            client.mtproto->signIn(client.phoneNumber, phoneCodeHash, SIMULATED_CODE);
+        }
+    });
+    connect(mtproto, &MTProtoClient::authSuccess, this, [this, index](const QString&) {
+        m_clients[index].authorized = true;
+        if (m_clients[index].operation == Auth) {
+            complete(index, true);
+        }
+    });
+    connect(mtproto, &MTProtoClient::authError, this, [this, index](const QString&) {
+        complete(index, false);
+    });
+    connect(mtproto, &MTProtoClient::authCodeError, this, [this, index](const QString&) {
+        complete(index, false);
+    });
+    connect(mtproto, &MTProtoClient::userDataReceived, this, [this, index]() {
+        if (m_clients[index].operation == GetMe) {
+            complete(index, true);
+        }
+    });
+    connect(mtproto, &MTProtoClient::historyReceived, this, [this, index]() {
+        if (m_clients[index].operation == History) {
+            complete(index, true);
+        }
+    });
+    connect(mtproto, &MTProtoClient::messageSent, this, [this, index](qint64 randomId) {
+        if (m_clients[index].operation == Send && m_clients[index].randomId == randomId) {
+            complete(index, true);
+        }
+    });
+    connect(mtproto, &MTProtoClient::messageSendFailed, this, [this, index](qint64 randomId) {
+        if (m_clients[index].operation == Send && m_clients[index].randomId == randomId) {
+            complete(index, false);
+        }
+    });
+}
+
+LoadGenerator::Operation LoadGenerator::pickOperation() const
+{
+    int value = QRandomGenerator::global()->bounded(m_totalWeight);
+    for (int operation = 0; operation < OperationCount; ++operation) {
+        value -= m_options.weights[operation];
+        if (value < 0) {
+            return Operation(operation);
+        }
+    }
+    return Auth;
+}
+
+void LoadGenerator::issue(int index)
+{
+    if (!m_running) {
+        return;
+    }
+    Client& client = m_clients[index];
+
+    // 未登录的客户端先登录
+    Operation operation = client.authorized ? pickOperation() : Auth;
+    client.operation = operation;
+    client.busy = true;
+    client.startedNs = m_clock.nsecsElapsed();
+
+    QRandomGenerator* generator = QRandomGenerator::global();
+    switch (operation) {
+    case Auth:
+        client.mtproto->sendAuthCode(client.phoneNumber);
+        break;
+    case GetMe:
+        client.mtproto->getMe();
+        break;
+    case History:
+        client.mtproto->getHistory(1 + generator->bounded(HISTORY_PEERS), 0, HISTORY_LIMIT);
+        break;
+    case Send:
+        client.randomId = qint64(generator->generate64() >> 1);
+        client.mtproto->sendMessage(1 + generator->bounded(HISTORY_PEERS),
+                                    QString("压力测试消息 %1").arg(client.randomId), client.randomId);
+        break;
+    default:
+        break;
+    }
+}
+
+void LoadGenerator::complete(int index, bool ok)
+{
+    Client& client = m_clients[index];
+    if (!client.busy) {
+        return;
+    }
+    client.busy = false;
+
+    Stats& stats = m_stats[client.operation];
+    qint64 elapsedNs = m_clock.nsecsElapsed() - client.startedNs;
+    if (ok) {
+        ++stats.completed;
+        stats.totalNs += elapsedNs;
+        stats.maxNs = qMax(stats.maxNs, elapsedNs);
+    } else {
+        ++stats.failed;
+    }
+
+    // 失败可能在发起请求时同步发生，下一个操作推迟到事件循环中发起
+    QMetaObject::invokeMethod(this, [this, index]() {
+        issue(index);
+    }, Qt::QueuedConnection);
+}
+
+void LoadGenerator::checkTimeouts()
+{
+    qint64 now = m_clock.nsecsElapsed();
+    for (int i = 0; i < m_clients.size(); ++i) {
+        if (m_clients.at(i).busy && now - m_clients.at(i).startedNs > OPERATION_TIMEOUT_MS * 1000000) {
+            complete(i, false);
+        }
+    }
+
+    if (m_clock.elapsed() >= qint64(m_options.durationSeconds) * 1000) {
+        m_running = false;
+        m_tick.stop();
+        report(true);
+        emit finished();
+        return;
+    }
+    if (m_clock.elapsed() - m_lastReportMs >= REPORT_INTERVAL_MS) {
+        m_lastReportMs = m_clock.elapsed();
+        report(false);
+    }
+}
+
+void LoadGenerator::report(bool final)
+{
+    qint64 completed = 0;
+    qint64 failed = 0;
+    for (const Stats& stats : m_stats) {
+        completed += stats.completed;
+        failed += stats.failed;
+    }
+    double seconds = qMax<qint64>(1, m_clock.elapsed()) / 1000.0;
+    qint64 cpuUs = SharedRuntime::cpuTimeMicroseconds() - m_startCpuUs;
+    qint64 rss = SharedRuntime::residentBytes();
+
+    // 使用qInfo，压力测试时通常会关闭调试输出
+    qInfo().noquote() << QString("%1 %2秒: 完成 %3 个请求（失败 %4），%5 请求/秒，每请求CPU %6 微秒，常驻内存 %7 KB")
+        .arg(final ? "压力测试结束" : "进度")
+        .arg(seconds, 0, 'f', 1)
+        .arg(completed)
+        .arg(failed)
+        .arg(completed / seconds, 0, 'f', 1)
+        .arg(completed > 0 ? cpuUs / completed : 0)
+        .arg(rss / 1024);
+    if (!final) {
+        return;
+    }
+    if (Clock::instance()->isVirtual()) {
+        qInfo().noquote() << QString("  虚拟时间前进 %1 秒").arg(Clock::instance()->virtualElapsedMs() / 1000.0, 0, 'f', 1);
+    }
+
+    for (int operation = 0; operation < OperationCount; ++operation) {
+        const Stats& stats = m_stats[operation];
+        if (stats.completed == 0 && stats.failed == 0) {
+            continue;
+        }
+        qInfo().noquote() << QString("  %1: 完成 %2，失败 %3，平均延迟 %4 毫秒，最大延迟 %5 毫秒")
+            .arg(OPERATION_NAMES[operation])
+            .arg(stats.completed)
+            .arg(stats.failed)
+            .arg(stats.completed > 0 ? stats.totalNs / stats.completed / 1000000 : 0)
+            .arg(stats.maxNs / 1000000);
+    }
+    MTProtoClient::CompressionStats compression;
+    for (const Client& client : std::as_const(m_clients)) {
+        MTProtoClient::CompressionStats stats = client.mtproto->compressionStats();
+        compression.packedResponses += stats.packedResponses;
+        compression.responseCompressedBytes += stats.responseCompressedBytes;
+        compression.responseBytes += stats.responseBytes;
+        compression.inflateNs += stats.inflateNs;
+    }
+    if (compression.packedResponses > 0) {
+        qInfo().noquote() << QString("  gzip_packed响应 %1 个，压缩率 %2，平均解压 %3 微秒")
+            .arg(compression.packedResponses)
+            .arg(double(compression.responseCompressedBytes) / compression.responseBytes, 0, 'f', 3)
+            .arg(compression.inflateNs / compression.packedResponses / 1000);
+    }
+    MTProtoClient::OutgoingStats outgoing;
+    for (const Client& client : std::as_const(m_clients)) {
+        MTProtoClient::OutgoingStats stats = client.mtproto->outgoingStats();
+        outgoing.submitted += stats.submitted;
+        outgoing.messages += stats.messages;
+        outgoing.packets += stats.packets;
+        outgoing.readMarks += stats.readMarks;
+        outgoing.typingActions += stats.typingActions;
+        outgoing.statusChanges += stats.statusChanges;
+    }
+    if (outgoing.packets > 0) {
+        qInfo().noquote() << QString("  出站: 提交 %1 条消息（含确认），合并后发送 %2 条，共 %3 个容器；服务器收到已读 %4、输入状态 %5、在线状态 %6 条")
+            .arg(outgoing.submitted)
+            .arg(outgoing.messages)
+            .arg(outgoing.packets)
+            .arg(outgoing.readMarks)
+            .arg(outgoing.typingActions)
+            .arg(outgoing.statusChanges);
+    }
+    MTProtoClient::SessionStats session;
+    for (const Client& client : std::as_const(m_clients)) {
+        MTProtoClient::SessionStats stats = client.mtproto->sessionStats();
+        session.badServerSalts += stats.badServerSalts;
+        session.badMsgNotifications += stats.badMsgNotifications;
+        session.saltPrefetches += stats.saltPrefetches;
+        session.duplicateMessages += stats.duplicateMessages;
+        session.staleMessages += stats.staleMessages;
+        session.sessionRestarts += stats.sessionRestarts;
+    }
+    qInfo().noquote() << QString("  会话: bad_server_salt %1 次，bad_msg_notification %2 次，预取盐 %3 次，"
+                                 "丢弃重复消息 %4 条、过期消息 %5 条，新会话 %6 次")
+        .arg(session.badServerSalts)
+        .arg(session.badMsgNotifications)
+        .arg(session.saltPrefetches)
+        .arg(session.duplicateMessages)
+        .arg(session.staleMessages)
+        .arg(session.sessionRestarts);
+    MTProtoClient::DecodeStats decode;
+    for (const Client& client : std::as_const(m_clients)) {
+        MTProtoClient::DecodeStats stats = client.mtproto->decodeStats();
+        decode.responses += stats.responses;
+        decode.decodeNs += stats.decodeNs;
+        decode.objects += stats.objects;
+        decode.strings += stats.strings;
+        decode.heapAllocations += stats.heapAllocations;
+    }
+    if (decode.responses > 0) {
+        qInfo().noquote() << QString("  arena解码: %1 个响应，平均 %2 微秒，每个响应 %3 个对象、%4 个字符串、堆分配 %5 次")
+            .arg(decode.responses)
+            .arg(decode.decodeNs / decode.responses / 1000.0, 0, 'f', 1)
+            .arg(double(decode.objects) / decode.responses, 0, 'f', 1)
+            .arg(double(decode.strings) / decode.responses, 0, 'f', 1)
+            .arg(double(decode.heapAllocations) / decode.responses, 0, 'f', 3);
+    }
+    MTProtoClient::HedgeStats hedge;
+    for (const Client& client : std::as_const(m_clients)) {
+        MTProtoClient::HedgeStats stats = client.mtproto->hedgeStats();
+        hedge.idempotentRequests += stats.idempotentRequests;
+        hedge.hedges += stats.hedges;
+        hedge.hedgeWins += stats.hedgeWins;
+        hedge.budgetDenied += stats.budgetDenied;
+    }
+    if (hedge.idempotentRequests > 0) {
+        qInfo().noquote() << QString("  对冲: 幂等请求 %1 个，发出对冲 %2 个（%3%），其中先返回 %4 个，预算不足未对冲 %5 次")
+            .arg(hedge.idempotentRequests)
+            .arg(hedge.hedges)
+            .arg(100.0 * hedge.hedges / hedge.idempotentRequests, 0, 'f', 1)
+            .arg(hedge.hedgeWins)
+            .arg(hedge.budgetDenied);
+    }
+    int clients = qMax(1, int(m_clients.size()));
+    qInfo().noquote() << QString("  每个客户端内存: 创建后 %1 KB，运行后 %2 KB")
+        .arg((m_clientsBytes - m_baselineBytes) / clients / 1024.0, 0, 'f', 1)
+        .arg((rss - m_baselineBytes) / clients / 1024.0, 0, 'f', 1);
+}
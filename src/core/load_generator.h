@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include "mtproto/mtproto_client.h"
+
+/**
+ * @brief 在一个进程内模拟大量客户端的压力测试
+ *
+ * 创建若干个MTProtoClient（共用网络管理器，与多账号运行时相同），
+ * 每个客户端串行地按配置的比例发起登录、getMe、拉取历史和发送消息，
+ * 一个请求完成后立即发起下一个。运行期间定期输出进度，结束时汇总
+ * 吞吐量、各操作的延迟、每个请求消耗的CPU时间和每个客户端的内存开销，
+ * 用于估计一台机器能承载多少个账号。
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Operation {
+        Auth = 0,
+        GetMe,
+        History,
+        Send,
+        OperationCount
+    };
+
+    struct Options
+    {
+        int clients = 200;
+        int durationSeconds = 60;
+        int weights[OperationCount] = { 1, 4, 4, 1 };
+    };
+
+    // 解析形如"auth=1,getMe=4,history=4,send=1"的比例，未列出的操作比例为0
+    static bool parseMix(const QString& text, Options* options);
+
+    explicit LoadGenerator(const Options& options, QObject* parent = nullptr);
+
+    void start();
+
+signals:
+    void finished();
+
+private:
+    struct Client
+    {
+        MTProtoClient* mtproto = nullptr;
+        QString phoneNumber;
+        bool authorized = false;
+        bool busy = false;
+        Operation operation = Auth;
+        qint64 randomId = 0;
+        qint64 startedNs = 0;       // 当前操作开始的时间，相对m_clock
+    };
+
+    struct Stats
+    {
+        qint64 completed = 0;
+        qint64 failed = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+    };
+
+    void createClient(int index);
+    Operation pickOperation() const;
+    void issue(int index);
+    void complete(int index, bool ok);
+    void checkTimeouts();
+    void report(bool final);
+
+    Options m_options;
+    int m_totalWeight;
+    QVector<Client> m_clients;
+    Stats m_stats[OperationCount];
+    bool m_running;
+
+    QElapsedTimer m_clock;
+    QTimer m_tick;
+    qint64 m_lastReportMs;
+
+    // 基线：创建客户端之前的内存和开始运行时的CPU时间
+    qint64 m_baselineBytes;
+    qint64 m_clientsBytes;
+    qint64 m_startCpuUs;
+};
@@ -0,0 +1,980 @@
+#include "message_store.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QtEndian>
+#include <algorithm>
+#include <iterator>
+#include <fcntl.h>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// 日志文件头：魔数和格式版本
+const quint32 LOG_MAGIC = 0x54475354; // "TGST"
+const quint32 LOG_VERSION = 1;
+const int HEADER_SIZE = 8;
+
+// 记录头：长度和CRC32，之后是类型字节和数据
+const int RECORD_HEADER_SIZE = 8;
+const quint32 MAX_RECORD_SIZE = 64 * 1024 * 1024;
+
+// 组提交：最多等待的时间和缓冲上限
+const int COMMIT_INTERVAL_MS = 20;
+const int COMMIT_BUFFER_LIMIT = 1024 * 1024;
+
+// 压缩：检查周期、触发阈值和压缩时每批的大小
+const int COMPACT_INTERVAL_MS = 10 * 60 * 1000;
+const qint64 COMPACT_MIN_DEAD_BYTES = 4 * 1024 * 1024;
+const int COMPACT_BATCH_BYTES = 4 * 1024 * 1024;
+
+quint32 crc32(const QByteArray& data)
+{
+    static const QVector<quint32> table = [] {
+        QVector<quint32> result(256);
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+
+    quint32 crc = 0xFFFFFFFFu;
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    for (qsizetype i = 0; i < data.size(); ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// QFile不提供fsync，写入端直接使用文件描述符打开
+int openAppendDescriptor(const QString& path)
+{
+#ifdef Q_OS_WIN
+    return _wopen(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(path).utf16()),
+                  _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+}
+
+bool syncDescriptor(int fd)
+{
+#ifdef Q_OS_WIN
+    return _commit(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+bool openLogForAppend(QFile& file, const QString& path)
+{
+    int fd = openAppendDescriptor(path);
+    if (fd < 0) {
+        return false;
+    }
+    return file.open(fd, QIODevice::ReadWrite | QIODevice::Append, QFileDevice::AutoCloseHandle);
+}
+
+QByteArray logHeader()
+{
+    QByteArray header(HEADER_SIZE, Qt::Uninitialized);
+    qToLittleEndian<quint32>(LOG_MAGIC, header.data());
+    qToLittleEndian<quint32>(LOG_VERSION, header.data() + 4);
+    return header;
+}
+
+} // namespace
+
+MessageStore::MessageStore(QObject* parent)
+    : QObject(parent)
+    , m_committedSize(0)
+    , m_deadBytes(0)
+    , m_pendingRecords(0)
+{
+    m_commitTimer.setSingleShot(true);
+    m_commitTimer.setInterval(COMMIT_INTERVAL_MS);
+    connect(&m_commitTimer, &QTimer::timeout, this, [this]() {
+        flush();
+    });
+
+    m_compactTimer.setInterval(COMPACT_INTERVAL_MS);
+    connect(&m_compactTimer, &QTimer::timeout, this, &MessageStore::maybeCompact);
+}
+
+MessageStore::~MessageStore()
+{
+    close();
+}
+
+bool MessageStore::open(const QString& directory)
+{
+    close();
+
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(".")) {
+        emit storeError(tr("无法创建存储目录: %1").arg(directory));
+        return false;
+    }
+    m_directory = directory;
+    m_logPath = dir.filePath("messages.log");
+
+    // 压缩过程中退出：旧日志已删除时临时文件是完整的，否则丢弃临时文件
+    QString compactPath = m_logPath + ".compact";
+    if (QFile::exists(compactPath)) {
+        if (QFile::exists(m_logPath)) {
+            QFile::remove(compactPath);
+        } else {
+            QFile::rename(compactPath, m_logPath);
+        }
+    }
+
+    if (!recover()) {
+        resetIndex();
+        return false;
+    }
+
+    if (!openLogForAppend(m_writeFile, m_logPath)) {
+        emit storeError(tr("无法打开存储文件: %1").arg(m_logPath));
+        resetIndex();
+        return false;
+    }
+
+    // 读取端不使用缓冲，保证能读到刚追加的数据
+    m_readFile.setFileName(m_logPath);
+    if (!m_readFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        emit storeError(tr("无法读取存储文件: %1").arg(m_readFile.errorString()));
+        m_writeFile.close();
+        resetIndex();
+        return false;
+    }
+
+    m_compactTimer.start();
+    qDebug() << "本地存储已打开:" << m_logPath << "大小:" << m_committedSize << "死数据:" << m_deadBytes;
+    return true;
+}
+
+void MessageStore::close()
+{
+    if (isOpen()) {
+        flush();
+    }
+    m_commitTimer.stop();
+    m_compactTimer.stop();
+    m_writeFile.close();
+    m_readFile.close();
+    resetIndex();
+}
+
+bool MessageStore::isOpen() const
+{
+    return m_writeFile.isOpen();
+}
+
+void MessageStore::resetIndex()
+{
+    m_committedSize = 0;
+    m_deadBytes = 0;
+    m_pendingBuffer.clear();
+    m_pendingRecords = 0;
+    m_messages.clear();
+    m_dialogs.clear();
+    m_peers.clear();
+    m_historyRanges.clear();
+    m_updatesState = UpdatesState();
+    m_updatesStateRef = RecordRef();
+    m_lists.clear();
+}
+
+bool MessageStore::recover()
+{
+    QFile file(m_logPath);
+    if (!file.open(QIODevice::ReadWrite)) {
+        emit storeError(tr("无法打开存储文件: %1").arg(file.errorString()));
+        return false;
+    }
+
+    // 新文件：写入文件头
+    if (file.size() == 0) {
+        if (file.write(logHeader()) != HEADER_SIZE || !file.flush()) {
+            emit storeError(tr("无法写入存储文件: %1").arg(file.errorString()));
+            return false;
+        }
+        m_committedSize = HEADER_SIZE;
+        return true;
+    }
+
+    QByteArray header = file.read(HEADER_SIZE);
+    if (header.size() != HEADER_SIZE
+        || qFromLittleEndian<quint32>(header.constData()) != LOG_MAGIC
+        || qFromLittleEndian<quint32>(header.constData() + 4) != LOG_VERSION) {
+        emit storeError(tr("存储文件格式不正确: %1").arg(m_logPath));
+        return false;
+    }
+
+    struct PendingRecord
+    {
+        RecordType type;
+        QByteArray payload;
+        RecordRef ref;
+    };
+    QVector<PendingRecord> batch;
+
+    // 顺序扫描，只有遇到提交记录的批次才应用到索引
+    qint64 offset = HEADER_SIZE;
+    qint64 validEnd = HEADER_SIZE;
+    for (;;) {
+        QByteArray recordHeader = file.read(RECORD_HEADER_SIZE);
+        if (recordHeader.size() != RECORD_HEADER_SIZE) {
+            break;
+        }
+        quint32 length = qFromLittleEndian<quint32>(recordHeader.constData());
+        quint32 checksum = qFromLittleEndian<quint32>(recordHeader.constData() + 4);
+        if (length == 0 || length > MAX_RECORD_SIZE) {
+            break;
+        }
+        QByteArray body = file.read(length);
+        if (body.size() != qsizetype(length) || crc32(body) != checksum) {
+            break;
+        }
+
+        RecordRef ref;
+        ref.offset = offset;
+        ref.size = RECORD_HEADER_SIZE + length;
+        offset += ref.size;
+
+        RecordType type = RecordType(quint8(body.at(0)));
+        if (type == CommitRecord) {
+            for (const PendingRecord& record : batch) {
+                applyRecord(record.type, record.payload, record.ref);
+            }
+            batch.clear();
+            m_deadBytes += ref.size;
+            validEnd = offset;
+        } else {
+            batch.append(PendingRecord{type, body.mid(1), ref});
+        }
+    }
+
+    // 截断未提交或损坏的尾部
+    if (validEnd < file.size()) {
+        qWarning() << "本地存储: 丢弃未提交的日志尾部" << (file.size() - validEnd) << "字节";
+        if (!file.resize(validEnd)) {
+            emit storeError(tr("无法截断存储文件: %1").arg(file.errorString()));
+            return false;
+        }
+    }
+
+    m_committedSize = validEnd;
+    return true;
+}
+
+QByteArray MessageStore::encodeRecord(RecordType type, const QByteArray& payload)
+{
+    QByteArray body;
+    body.reserve(payload.size() + 1);
+    body.append(char(type));
+    body.append(payload);
+
+    QByteArray record(RECORD_HEADER_SIZE, Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(body.size()), record.data());
+    qToLittleEndian<quint32>(crc32(body), record.data() + 4);
+    record.append(body);
+    return record;
+}
+
+QByteArray MessageStore::encodeMessage(const MessageData& message)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << message.peerId << message.id << message.date << message.editDate
+           << message.fromId << message.fromName << message.text;
+    return payload;
+}
+
+MessageData MessageStore::decodeMessage(const QByteArray& payload)
+{
+    MessageData message;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream >> message.peerId >> message.id >> message.date >> message.editDate
+           >> message.fromId >> message.fromName >> message.text;
+    return message;
+}
+
+QByteArray MessageStore::encodeDialog(const DialogData& dialog)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << dialog.peerId << dialog.topMessageId << dialog.readInboxMaxId
+           << dialog.unreadCount << dialog.folderId << dialog.pinned << dialog.pts;
+    return payload;
+}
+
+DialogData MessageStore::decodeDialog(const QByteArray& payload)
+{
+    DialogData dialog;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream >> dialog.peerId >> dialog.topMessageId >> dialog.readInboxMaxId
+           >> dialog.unreadCount >> dialog.folderId >> dialog.pinned;
+    // 旧版本的记录没有pts，读到末尾时保持为0
+    if (!stream.atEnd()) {
+        stream >> dialog.pts;
+    }
+    return dialog;
+}
+
+QByteArray MessageStore::encodePeer(const PeerData& peer)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << peer.id << qint32(peer.type) << peer.title << peer.username
+           << peer.firstName << peer.lastName;
+    return payload;
+}
+
+PeerData MessageStore::decodePeer(const QByteArray& payload)
+{
+    PeerData peer;
+    qint32 type = 0;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream >> peer.id >> type >> peer.title >> peer.username >> peer.firstName >> peer.lastName;
+    peer.type = PeerData::Type(type);
+    return peer;
+}
+
+QByteArray MessageStore::encodeUpdatesState(const UpdatesState& state)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << state.pts << state.qts << state.seq << state.date;
+    return payload;
+}
+
+UpdatesState MessageStore::decodeUpdatesState(const QByteArray& payload)
+{
+    UpdatesState state;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream >> state.pts >> state.qts >> state.seq >> state.date;
+    return state;
+}
+
+MessageStore::RecordRef MessageStore::appendRecord(RecordType type, const QByteArray& payload)
+{
+    return appendEncoded(encodeRecord(type, payload));
+}
+
+MessageStore::RecordRef MessageStore::appendEncoded(const QByteArray& record)
+{
+    RecordRef ref;
+    ref.offset = m_committedSize + m_pendingBuffer.size();
+    ref.size = quint32(record.size());
+
+    m_pendingBuffer.append(record);
+    ++m_pendingRecords;
+    scheduleCommit();
+    return ref;
+}
+
+bool MessageStore::readRecord(const RecordRef& ref, QByteArray* payload) const
+{
+    QByteArray record;
+    if (ref.offset >= m_committedSize) {
+        // 尚未提交，从待提交缓冲读取
+        qint64 position = ref.offset - m_committedSize;
+        if (position + ref.size > m_pendingBuffer.size()) {
+            return false;
+        }
+        record = m_pendingBuffer.mid(position, ref.size);
+    } else {
+        if (!m_readFile.seek(ref.offset)) {
+            return false;
+        }
+        record = m_readFile.read(ref.size);
+        if (record.size() != qsizetype(ref.size)) {
+            return false;
+        }
+    }
+
+    *payload = record.mid(RECORD_HEADER_SIZE + 1);
+    return true;
+}
+
+void MessageStore::replaceRef(RecordRef* slot, const RecordRef& ref)
+{
+    // 被覆盖的旧记录成为死数据
+    if (slot->size > 0) {
+        m_deadBytes += slot->size;
+    }
+    *slot = ref;
+}
+
+void MessageStore::applyRecord(RecordType type, const QByteArray& payload, const RecordRef& ref)
+{
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    switch (type) {
+    case MessageRecord: {
+        qint64 peerId = 0;
+        qint32 id = 0;
+        stream >> peerId >> id;
+        replaceRef(&m_messages[peerId][id], ref);
+        break;
+    }
+    case RemoveMessageRecord: {
+        qint64 peerId = 0;
+        qint32 id = 0;
+        stream >> peerId >> id;
+        auto peerIt = m_messages.find(peerId);
+        if (peerIt != m_messages.end()) {
+            auto it = peerIt->find(id);
+            if (it != peerIt->end()) {
+                m_deadBytes += it->size;
+                peerIt->erase(it);
+            }
+        }
+        m_deadBytes += ref.size;
+        break;
+    }
+    case DialogRecord: {
+        qint64 peerId = 0;
+        stream >> peerId;
+        replaceRef(&m_dialogs[peerId], ref);
+        break;
+    }
+    case PeerRecord: {
+        qint64 peerId = 0;
+        stream >> peerId;
+        replaceRef(&m_peers[peerId], ref);
+        break;
+    }
+    case HistoryRangeRecord: {
+        // 区间在压缩时合并重写，原记录都算作死数据
+        qint64 peerId = 0;
+        qint32 minId = 0;
+        qint32 maxId = 0;
+        stream >> peerId >> minId >> maxId;
+        mergeRange(peerId, minId, maxId);
+        m_deadBytes += ref.size;
+        break;
+    }
+    case UpdatesStateRecord:
+        m_updatesState = decodeUpdatesState(payload);
+        replaceRef(&m_updatesStateRef, ref);
+        break;
+    case ListRecord: {
+        QString key;
+        stream >> key;
+        replaceRef(&m_lists[key], ref);
+        break;
+    }
+    default:
+        qWarning() << "本地存储: 未知的记录类型" << int(type);
+        m_deadBytes += ref.size;
+        break;
+    }
+}
+
+void MessageStore::mergeRange(qint64 peerId, qint32 minId, qint32 maxId)
+{
+    QMap<qint32, qint32>& ranges = m_historyRanges[peerId];
+
+    // 与前一个相交或相邻的区间合并
+    auto it = ranges.upperBound(minId);
+    if (it != ranges.begin()) {
+        auto previous = std::prev(it);
+        if (previous.value() >= minId - 1) {
+            minId = previous.key();
+            maxId = qMax(maxId, previous.value());
+            it = ranges.erase(previous);
+        }
+    }
+
+    // 吞并后面被覆盖的区间
+    while (it != ranges.end() && it.key() <= maxId + 1) {
+        maxId = qMax(maxId, it.value());
+        it = ranges.erase(it);
+    }
+
+    ranges.insert(minId, maxId);
+}
+
+void MessageStore::putMessage(const MessageData& message)
+{
+    if (!isOpen() || message.id <= 0) {
+        return;
+    }
+    RecordRef ref = appendRecord(MessageRecord, encodeMessage(message));
+    replaceRef(&m_messages[message.peerId][message.id], ref);
+}
+
+void MessageStore::putMessages(const QVector<MessageData>& messages)
+{
+    for (const MessageData& message : messages) {
+        putMessage(message);
+    }
+}
+
+QByteArray MessageStore::encodeMessageRecord(const MessageData& message)
+{
+    return encodeRecord(MessageRecord, encodeMessage(message));
+}
+
+void MessageStore::putEncodedMessage(const MessageData& message, const QByteArray& record)
+{
+    if (!isOpen() || message.id <= 0) {
+        return;
+    }
+    RecordRef ref = appendEncoded(record);
+    replaceRef(&m_messages[message.peerId][message.id], ref);
+}
+
+void MessageStore::removeMessage(qint64 peerId, qint32 id)
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << peerId << id;
+
+    RecordRef ref = appendRecord(RemoveMessageRecord, payload);
+    applyRecord(RemoveMessageRecord, payload, ref);
+}
+
+void MessageStore::putDialog(const DialogData& dialog)
+{
+    if (!isOpen()) {
+        return;
+    }
+    RecordRef ref = appendRecord(DialogRecord, encodeDialog(dialog));
+    replaceRef(&m_dialogs[dialog.peerId], ref);
+}
+
+void MessageStore::putPeer(const PeerData& peer)
+{
+    if (!isOpen()) {
+        return;
+    }
+    RecordRef ref = appendRecord(PeerRecord, encodePeer(peer));
+    replaceRef(&m_peers[peer.id], ref);
+}
+
+void MessageStore::addHistoryRange(qint64 peerId, qint32 minId, qint32 maxId)
+{
+    if (!isOpen() || minId <= 0 || minId > maxId) {
+        return;
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << peerId << minId << maxId;
+
+    RecordRef ref = appendRecord(HistoryRangeRecord, payload);
+    applyRecord(HistoryRangeRecord, payload, ref);
+}
+
+void MessageStore::putUpdatesState(const UpdatesState& state)
+{
+    if (!isOpen()) {
+        return;
+    }
+    QByteArray payload = encodeUpdatesState(state);
+    RecordRef ref = appendRecord(UpdatesStateRecord, payload);
+    applyRecord(UpdatesStateRecord, payload, ref);
+}
+
+UpdatesState MessageStore::updatesState() const
+{
+    return m_updatesState;
+}
+
+void MessageStore::putList(const QString& key, qint64 hash, const QByteArray& data)
+{
+    if (!isOpen()) {
+        return;
+    }
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << key << hash << data;
+
+    RecordRef ref = appendRecord(ListRecord, payload);
+    replaceRef(&m_lists[key], ref);
+}
+
+bool MessageStore::list(const QString& key, qint64* hash, QByteArray* data) const
+{
+    auto it = m_lists.constFind(key);
+    QByteArray payload;
+    if (it == m_lists.constEnd() || !readRecord(it.value(), &payload)) {
+        return false;
+    }
+    QString storedKey;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream >> storedKey >> *hash >> *data;
+    return stream.status() == QDataStream::Ok;
+}
+
+void MessageStore::scheduleCommit()
+{
+    // 缓冲过大时立即提交，否则等待同一批次的其他写入
+    if (m_pendingBuffer.size() >= COMMIT_BUFFER_LIMIT) {
+        flush();
+    } else if (!m_commitTimer.isActive()) {
+        m_commitTimer.start();
+    }
+}
+
+bool MessageStore::syncFile(QFile& file)
+{
+    return file.flush() && syncDescriptor(file.handle());
+}
+
+bool MessageStore::flush()
+{
+    if (m_pendingRecords == 0) {
+        return true;
+    }
+    if (!isOpen()) {
+        return false;
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << qint32(m_pendingRecords);
+    QByteArray commit = encodeRecord(CommitRecord, payload);
+
+    // 整批加提交记录一次写入，同步后才算提交
+    bool ok = m_writeFile.write(m_pendingBuffer) == m_pendingBuffer.size()
+              && m_writeFile.write(commit) == commit.size()
+              && syncFile(m_writeFile);
+    if (!ok) {
+        // 回滚文件长度，缓冲保留到下次重试
+        QString error = m_writeFile.errorString();
+        m_writeFile.resize(m_committedSize);
+        qWarning() << "本地存储: 提交失败" << error;
+        emit storeError(tr("写入本地存储失败: %1").arg(error));
+        m_commitTimer.start();
+        return false;
+    }
+
+    int recordCount = m_pendingRecords;
+    m_committedSize += m_pendingBuffer.size() + commit.size();
+    m_deadBytes += commit.size();
+    m_pendingBuffer.clear();
+    m_pendingRecords = 0;
+    m_commitTimer.stop();
+
+    emit committed(recordCount);
+    return true;
+}
+
+bool MessageStore::message(qint64 peerId, qint32 id, MessageData* message) const
+{
+    auto peerIt = m_messages.constFind(peerId);
+    if (peerIt == m_messages.constEnd()) {
+        return false;
+    }
+    auto it = peerIt->constFind(id);
+    if (it == peerIt->constEnd()) {
+        return false;
+    }
+
+    QByteArray payload;
+    if (!readRecord(it.value(), &payload)) {
+        return false;
+    }
+    *message = decodeMessage(payload);
+    return true;
+}
+
+bool MessageStore::dialog(qint64 peerId, DialogData* dialog) const
+{
+    auto it = m_dialogs.constFind(peerId);
+    QByteArray payload;
+    if (it == m_dialogs.constEnd() || !readRecord(it.value(), &payload)) {
+        return false;
+    }
+    *dialog = decodeDialog(payload);
+    return true;
+}
+
+bool MessageStore::peer(qint64 peerId, PeerData* peer) const
+{
+    auto it = m_peers.constFind(peerId);
+    QByteArray payload;
+    if (it == m_peers.constEnd() || !readRecord(it.value(), &payload)) {
+        return false;
+    }
+    *peer = decodePeer(payload);
+    return true;
+}
+
+QVector<MessageData> MessageStore::history(qint64 peerId, qint32 offsetId, int limit) const
+{
+    QVector<MessageData> result;
+    auto peerIt = m_messages.constFind(peerId);
+    if (peerIt == m_messages.constEnd()) {
+        return result;
+    }
+
+    const QMap<qint32, RecordRef>& index = *peerIt;
+    auto it = offsetId > 0 ? index.lowerBound(offsetId) : index.constEnd();
+    while (it != index.constBegin() && result.size() < limit) {
+        --it;
+        QByteArray payload;
+        if (readRecord(it.value(), &payload)) {
+            result.append(decodeMessage(payload));
+        }
+    }
+    return result;
+}
+
+bool MessageStore::hasHistory(qint64 peerId, qint32 offsetId, int limit) const
+{
+    if (offsetId <= 0) {
+        return false;
+    }
+    qint32 maxId = offsetId - 1;
+    qint32 minId = qMax(1, offsetId - limit);
+    if (maxId < minId) {
+        return true;
+    }
+
+    auto rangesIt = m_historyRanges.constFind(peerId);
+    if (rangesIt == m_historyRanges.constEnd()) {
+        return false;
+    }
+
+    // 找到起点不大于minId的最后一个区间
+    auto it = rangesIt->upperBound(minId);
+    if (it == rangesIt->constBegin()) {
+        return false;
+    }
+    --it;
+    return it.value() >= maxId;
+}
+
+QVector<DialogData> MessageStore::dialogs() const
+{
+    QVector<DialogData> result;
+    result.reserve(m_dialogs.size());
+    for (auto it = m_dialogs.constBegin(); it != m_dialogs.constEnd(); ++it) {
+        QByteArray payload;
+        if (readRecord(it.value(), &payload)) {
+            result.append(decodeDialog(payload));
+        }
+    }
+    return result;
+}
+
+QVector<PeerData> MessageStore::peers() const
+{
+    QVector<PeerData> result;
+    result.reserve(m_peers.size());
+    for (auto it = m_peers.constBegin(); it != m_peers.constEnd(); ++it) {
+        QByteArray payload;
+        if (readRecord(it.value(), &payload)) {
+            result.append(decodePeer(payload));
+        }
+    }
+    return result;
+}
+
+int MessageStore::messageCount(qint64 peerId) const
+{
+    auto it = m_messages.constFind(peerId);
+    return it == m_messages.constEnd() ? 0 : int(it->size());
+}
+
+void MessageStore::forEachMessage(const std::function<bool(const MessageData&)>& callback) const
+{
+    // 按文件偏移顺序读取，避免随机访问
+    QVector<RecordRef> refs;
+    for (auto peerIt = m_messages.constBegin(); peerIt != m_messages.constEnd(); ++peerIt) {
+        for (auto it = peerIt->constBegin(); it != peerIt->constEnd(); ++it) {
+            refs.append(it.value());
+        }
+    }
+    std::sort(refs.begin(), refs.end(), [](const RecordRef& a, const RecordRef& b) {
+        return a.offset < b.offset;
+    });
+
+    for (const RecordRef& ref : refs) {
+        QByteArray payload;
+        if (readRecord(ref, &payload) && !callback(decodeMessage(payload))) {
+            break;
+        }
+    }
+}
+
+void MessageStore::maybeCompact()
+{
+    if (m_deadBytes >= COMPACT_MIN_DEAD_BYTES && m_deadBytes * 2 >= m_committedSize) {
+        compact();
+    }
+}
+
+bool MessageStore::compact()
+{
+    if (!isOpen() || !flush()) {
+        return false;
+    }
+
+    QString compactPath = m_logPath + ".compact";
+    QFile::remove(compactPath);
+
+    QFile output;
+    if (!openLogForAppend(output, compactPath)) {
+        emit storeError(tr("无法创建压缩文件: %1").arg(compactPath));
+        return false;
+    }
+
+    bool ok = output.write(logHeader()) == HEADER_SIZE;
+    qint64 offset = HEADER_SIZE;
+    qint64 overhead = 0;
+    QByteArray batch;
+    int batchRecords = 0;
+
+    // 压缩结果同样按批次提交，启动恢复时每批占用的内存有上限
+    auto writeBatch = [&]() {
+        if (!ok || batchRecords == 0) {
+            return;
+        }
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_6_0);
+        stream << qint32(batchRecords);
+        QByteArray commit = encodeRecord(CommitRecord, payload);
+        batch.append(commit);
+
+        ok = output.write(batch) == batch.size();
+        offset += batch.size();
+        overhead += commit.size();
+        batch.clear();
+        batchRecords = 0;
+    };
+    auto copyRecord = [&](RecordType type, const QByteArray& payload) {
+        QByteArray record = encodeRecord(type, payload);
+        RecordRef ref;
+        ref.offset = offset + batch.size();
+        ref.size = quint32(record.size());
+        batch.append(record);
+        ++batchRecords;
+        if (batch.size() >= COMPACT_BATCH_BYTES) {
+            writeBatch();
+        }
+        return ref;
+    };
+
+    QHash<qint64, QMap<qint32, RecordRef>> messages;
+    QHash<qint64, RecordRef> dialogs;
+    QHash<qint64, RecordRef> peers;
+
+    for (auto peerIt = m_messages.constBegin(); ok && peerIt != m_messages.constEnd(); ++peerIt) {
+        QMap<qint32, RecordRef>& index = messages[peerIt.key()];
+        for (auto it = peerIt->constBegin(); ok && it != peerIt->constEnd(); ++it) {
+            QByteArray payload;
+            if (readRecord(it.value(), &payload)) {
+                index.insert(it.key(), copyRecord(MessageRecord, payload));
+            }
+        }
+    }
+    for (auto it = m_dialogs.constBegin(); ok && it != m_dialogs.constEnd(); ++it) {
+        QByteArray payload;
+        if (readRecord(it.value(), &payload)) {
+            dialogs.insert(it.key(), copyRecord(DialogRecord, payload));
+        }
+    }
+    for (auto it = m_peers.constBegin(); ok && it != m_peers.constEnd(); ++it) {
+        QByteArray payload;
+        if (readRecord(it.value(), &payload)) {
+            peers.insert(it.key(), copyRecord(PeerRecord, payload));
+        }
+    }
+    RecordRef updatesStateRef;
+    if (ok && m_updatesStateRef.size > 0) {
+        updatesStateRef = copyRecord(UpdatesStateRecord, encodeUpdatesState(m_updatesState));
+    }
+    QHash<QString, RecordRef> lists;
+    for (auto it = m_lists.constBegin(); ok && it != m_lists.constEnd(); ++it) {
+        QByteArray payload;
+        if (readRecord(it.value(), &payload)) {
+            lists.insert(it.key(), copyRecord(ListRecord, payload));
+        }
+    }
+    qint64 rangeBytes = 0;
+    for (auto peerIt = m_historyRanges.constBegin(); ok && peerIt != m_historyRanges.constEnd(); ++peerIt) {
+        for (auto it = peerIt->constBegin(); it != peerIt->constEnd(); ++it) {
+            QByteArray payload;
+            QDataStream stream(&payload, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_6_0);
+            stream << peerIt.key() << it.key() << it.value();
+            rangeBytes += copyRecord(HistoryRangeRecord, payload).size;
+        }
+    }
+    writeBatch();
+
+    ok = ok && syncFile(output);
+    output.close();
+    if (!ok) {
+        QFile::remove(compactPath);
+        emit storeError(tr("压缩本地存储失败"));
+        return false;
+    }
+
+    // 先删除旧日志再改名，中途退出时由open()完成替换
+    qint64 oldSize = m_committedSize;
+    m_writeFile.close();
+    m_readFile.close();
+    if (!QFile::remove(m_logPath) || !QFile::rename(compactPath, m_logPath)
+        || !openLogForAppend(m_writeFile, m_logPath)
+        || !m_readFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        emit storeError(tr("替换存储文件失败，重新打开"));
+        return open(m_directory);
+    }
+
+    m_messages = messages;
+    m_dialogs = dialogs;
+    m_peers = peers;
+    m_updatesStateRef = updatesStateRef;
+    m_lists = lists;
+    m_committedSize = offset;
+    m_deadBytes = overhead + rangeBytes;
+
+    qDebug() << "本地存储压缩完成:" << oldSize << "->" << m_committedSize << "字节";
+    return true;
+}
+
+qint64 MessageStore::fileSize() const
+{
+    return m_committedSize;
+}
+
+qint64 MessageStore::deadBytes() const
+{
+    return m_deadBytes;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+
+#include "telegram_types.h"
+
+/**
+ * @brief 本地消息存储
+ *
+ * 所有数据追加写入同一个日志文件，日志本身即预写日志：
+ * 写入先在内存中攒成一批，由定时器或缓冲区大小触发一次性写入并同步到磁盘，
+ * 每批以提交记录结尾。启动时顺序扫描日志重建内存索引，
+ * 没有提交记录的残缺批次会被截断。被覆盖的旧记录在死数据比例过高时通过压缩清理。
+ *
+ * 消息按 (会话, 消息ID) 建立有序索引，支持单条读取和按ID范围扫描。
+ */
+class MessageStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MessageStore(QObject* parent = nullptr);
+    ~MessageStore();
+
+    // 打开或关闭存储目录
+    bool open(const QString& directory);
+    void close();
+    bool isOpen() const;
+
+    // 写入，在下一次提交时落盘
+    void putMessage(const MessageData& message);
+    void putMessages(const QVector<MessageData>& messages);
+    void removeMessage(qint64 peerId, qint32 id);
+    void putDialog(const DialogData& dialog);
+    void putPeer(const PeerData& peer);
+
+    // 写入在其他线程用encodeMessageRecord编码好的消息记录
+    void putEncodedMessage(const MessageData& message, const QByteArray& record);
+    static QByteArray encodeMessageRecord(const MessageData& message);
+
+    // 记录服务器确认的连续消息区间 [minId, maxId]
+    void addHistoryRange(qint64 peerId, qint32 minId, qint32 maxId);
+
+    // 更新同步状态，与已应用的更新写在同一批次中
+    void putUpdatesState(const UpdatesState& state);
+    UpdatesState updatesState() const;
+
+    // 带hash的列表请求的缓存：服务器上次返回的列表（由调用方编码）和它的hash
+    void putList(const QString& key, qint64 hash, const QByteArray& data);
+    bool list(const QString& key, qint64* hash, QByteArray* data) const;
+
+    // 立即提交缓冲中的写入
+    bool flush();
+
+    // 单条读取
+    bool message(qint64 peerId, qint32 id, MessageData* message) const;
+    bool dialog(qint64 peerId, DialogData* dialog) const;
+    bool peer(qint64 peerId, PeerData* peer) const;
+
+    // 范围读取：ID小于offsetId（为0时不限）的最近limit条消息，按ID降序
+    QVector<MessageData> history(qint64 peerId, qint32 offsetId, int limit) const;
+
+    // 本地是否有 [offsetId - limit, offsetId - 1] 的完整数据
+    bool hasHistory(qint64 peerId, qint32 offsetId, int limit) const;
+
+    QVector<DialogData> dialogs() const;
+    QVector<PeerData> peers() const;
+    int messageCount(qint64 peerId) const;
+
+    // 遍历全部消息，回调返回false时停止
+    void forEachMessage(const std::function<bool(const MessageData&)>& callback) const;
+
+    // 压缩日志，丢弃被覆盖和删除的记录
+    bool compact();
+
+    // 统计信息
+    qint64 fileSize() const;
+    qint64 deadBytes() const;
+
+signals:
+    void committed(int recordCount);
+    void storeError(const QString& error);
+
+private:
+    // 记录在日志中的位置，偏移超出已提交长度时位于待提交缓冲中
+    struct RecordRef
+    {
+        qint64 offset = 0;
+        quint32 size = 0;
+    };
+
+    enum RecordType : quint8 {
+        MessageRecord = 1,
+        RemoveMessageRecord = 2,
+        DialogRecord = 3,
+        PeerRecord = 4,
+        HistoryRangeRecord = 5,
+        CommitRecord = 6,
+        UpdatesStateRecord = 7,
+        ListRecord = 8
+    };
+
+    // 记录编解码
+    static QByteArray encodeRecord(RecordType type, const QByteArray& payload);
+    static QByteArray encodeMessage(const MessageData& message);
+    static MessageData decodeMessage(const QByteArray& payload);
+    static QByteArray encodeDialog(const DialogData& dialog);
+    static DialogData decodeDialog(const QByteArray& payload);
+    static QByteArray encodePeer(const PeerData& peer);
+    static PeerData decodePeer(const QByteArray& payload);
+    static QByteArray encodeUpdatesState(const UpdatesState& state);
+    static UpdatesState decodeUpdatesState(const QByteArray& payload);
+
+    // 追加到待提交缓冲并返回其位置
+    RecordRef appendRecord(RecordType type, const QByteArray& payload);
+    RecordRef appendEncoded(const QByteArray& record);
+    bool readRecord(const RecordRef& ref, QByteArray* payload) const;
+
+    // 将一条记录应用到内存索引
+    void applyRecord(RecordType type, const QByteArray& payload, const RecordRef& ref);
+    void replaceRef(RecordRef* slot, const RecordRef& ref);
+    void mergeRange(qint64 peerId, qint32 minId, qint32 maxId);
+
+    bool recover();
+    bool syncFile(QFile& file);
+    void scheduleCommit();
+    void maybeCompact();
+    void resetIndex();
+
+    QString m_directory;
+    QString m_logPath;
+    QFile m_writeFile;
+    mutable QFile m_readFile;
+
+    // 已提交的日志长度
+    qint64 m_committedSize;
+    qint64 m_deadBytes;
+
+    // 待提交的批次
+    QByteArray m_pendingBuffer;
+    int m_pendingRecords;
+    QTimer m_commitTimer;
+    QTimer m_compactTimer;
+
+    // 内存索引
+    QHash<qint64, QMap<qint32, RecordRef>> m_messages;
+    QHash<qint64, RecordRef> m_dialogs;
+    QHash<qint64, RecordRef> m_peers;
+    QHash<qint64, QMap<qint32, qint32>> m_historyRanges;
+    UpdatesState m_updatesState;
+    RecordRef m_updatesStateRef;
+    QHash<QString, RecordRef> m_lists;
+};
@@ -0,0 +1,478 @@
+#include "micro_benchmark.h"
+#include "dialog_views.h"
+#include "mtproto/replay_window.h"
+#include "mtproto/session_clock.h"
+#include "mtproto/tl_decoder.h"
+#include "mtproto/utf8_codec.h"
+#include <QCborMap>
+#include <QCborValue>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSet>
+#include <functional>
+
+namespace {
+
+// 重放窗口测试模拟的服务器消息速率
+const int MESSAGES_PER_SECOND = 50000;
+
+// 重复送达的比例（百分之几）
+const int DUPLICATE_PERCENT = 1;
+
+// 解码测试中每个历史响应的消息数和其中不同发送者的数量
+const int HISTORY_MESSAGES = 100;
+const int HISTORY_SENDERS = 20;
+
+// UTF-8测试的消息数，每条由一到四个中英文短句组成
+const int UTF8_MESSAGES = 1000;
+
+// 会话视图测试的会话数和文件夹数，以及全量重算的对比只运行的更新数
+const int VIEW_DIALOGS = 100000;
+const int VIEW_FOLDERS = 4;
+const int VIEW_RECOMPUTE_UPDATES = 200;
+
+struct Benchmark
+{
+    const char* name;
+    std::function<void(int)> run;
+};
+
+// 以每秒MESSAGES_PER_SECOND条的速率生成服务器msg_id，其中少量是最近消息的重复
+QVector<quint64> serverMessageIds(int count, qint64 startMs)
+{
+    MessageIdGenerator generator;
+    QRandomGenerator random(1);
+    QVector<quint64> ids;
+    ids.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (!ids.isEmpty() && int(random.bounded(100)) < DUPLICATE_PERCENT) {
+            ids.append(ids.at(ids.size() - 1 - random.bounded(qMin(int(ids.size()), 100))));
+        } else {
+            ids.append(generator.next(startMs + qint64(i) * 1000 / MESSAGES_PER_SECOND) | 1);
+        }
+    }
+    return ids;
+}
+
+void benchmarkReplayWindow(int iterations)
+{
+    qint64 startMs = QDateTime::currentMSecsSinceEpoch();
+    const QVector<quint64> ids = serverMessageIds(iterations, startMs);
+    auto nowOf = [startMs](int i) {
+        return startMs + qint64(i) * 1000 / MESSAGES_PER_SECOND;
+    };
+
+    ReplayWindow window;
+    int rejected = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < ids.size(); ++i) {
+        rejected += window.check(ids.at(i), nowOf(i)) != ReplayWindow::Accepted;
+    }
+    qint64 windowNs = timer.nsecsElapsed();
+
+    // 对比：记住所有见过的ID
+    QSet<quint64> seen;
+    int seenRejected = 0;
+    timer.restart();
+    for (quint64 id : ids) {
+        if (seen.contains(id)) {
+            ++seenRejected;
+        } else {
+            seen.insert(id);
+        }
+    }
+    qint64 setNs = timer.nsecsElapsed();
+
+    double nsPerCheck = double(windowNs) / qMax(1, int(ids.size()));
+    qInfo().noquote() << QString("replay-window: %1 条消息（%2 条/秒，%3%重复）")
+        .arg(ids.size()).arg(MESSAGES_PER_SECOND).arg(DUPLICATE_PERCENT);
+    qInfo().noquote() << QString("  滑动窗口: 每次 %1 纳秒，丢弃 %2 条，固定保存 %3 个ID，%4 条/秒时占用单核 %5%")
+        .arg(nsPerCheck, 0, 'f', 1)
+        .arg(rejected)
+        .arg(window.size())
+        .arg(MESSAGES_PER_SECOND)
+        .arg(nsPerCheck * MESSAGES_PER_SECOND / 1e7, 0, 'f', 3);
+    qInfo().noquote() << QString("  QSet（不限大小）: 每次 %1 纳秒，丢弃 %2 条，保存 %3 个ID")
+        .arg(double(setNs) / qMax(1, int(ids.size())), 0, 'f', 1)
+        .arg(seenRejected)
+        .arg(seen.size());
+}
+
+const char* const PHRASES[] = {
+    "大家好，今天的会议改到下午三点。",
+    "这个版本的性能提升很明显，滚动流畅多了。",
+    "Please check the latest build before release.",
+    "我已经把文档上传到群文件了，请大家查看并提出修改意见。"
+};
+
+// 与模拟服务器的messages.getHistory响应结构相同，序列化为网络上传输的字节
+QByteArray historyResponse()
+{
+    QJsonArray messages;
+    for (int i = 0; i < HISTORY_MESSAGES; ++i) {
+        qint64 fromId = 1000 + i % HISTORY_SENDERS;
+        QString text;
+        for (int part = 0; part <= i % 3; ++part) {
+            text += QString::fromUtf8(PHRASES[(i + part) % 4]);
+        }
+        QJsonObject message;
+        message["id"] = HISTORY_MESSAGES - i;
+        message["peer_id"] = double(777000);
+        message["from_id"] = double(fromId);
+        message["from_name"] = "用户" + QString::number(fromId);
+        message["date"] = 1600000000 + i * 37;
+        message["edit_date"] = 0;
+        message["message"] = text;
+        messages.append(message);
+    }
+    QJsonObject response;
+    response["peer"] = double(777000);
+    response["offset_id"] = 0;
+    response["limit"] = HISTORY_MESSAGES;
+    response["count"] = HISTORY_MESSAGES;
+    response["messages"] = messages;
+    response["success"] = true;
+    return QCborMap::fromJsonObject(response).toCborValue().toCbor();
+}
+
+// 对比：先解析为文档对象，再逐个字段复制
+QVector<MessageData> decodeThroughDocument(const QByteArray& bytes)
+{
+    QJsonObject response = QCborValue::fromCbor(bytes).toMap().toJsonObject();
+    QJsonArray array = response["messages"].toArray();
+    QVector<MessageData> messages;
+    messages.reserve(array.size());
+    for (const QJsonValue& value : array) {
+        QJsonObject object = value.toObject();
+        MessageData message;
+        message.peerId = qint64(object["peer_id"].toDouble());
+        message.id = object["id"].toInt();
+        message.date = object["date"].toInt();
+        message.editDate = object["edit_date"].toInt();
+        message.fromId = qint64(object["from_id"].toDouble());
+        message.fromName = object["from_name"].toString();
+        message.text = object["message"].toString();
+        messages.append(message);
+    }
+    return messages;
+}
+
+// 消息持有的堆内存块：消息数组和各个字符串，共享的字符串只算一次
+int heapBlocks(const QVector<MessageData>& messages)
+{
+    QSet<const QChar*> strings;
+    for (const MessageData& message : messages) {
+        if (!message.fromName.isEmpty()) {
+            strings.insert(message.fromName.constData());
+        }
+        if (!message.text.isEmpty()) {
+            strings.insert(message.text.constData());
+        }
+    }
+    return int(strings.size()) + 1;
+}
+
+bool sameMessages(const QVector<MessageData>& a, const QVector<MessageData>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); ++i) {
+        if (a[i].peerId != b[i].peerId || a[i].id != b[i].id || a[i].date != b[i].date
+            || a[i].editDate != b[i].editDate || a[i].fromId != b[i].fromId
+            || a[i].fromName != b[i].fromName || a[i].text != b[i].text) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void benchmarkTlDecode(int iterations)
+{
+    const QByteArray bytes = historyResponse();
+    int responses = qMax(1, iterations / HISTORY_MESSAGES);
+    qint64 checksum = 0;
+
+    QVector<MessageData> documentMessages;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < responses; ++i) {
+        documentMessages = decodeThroughDocument(bytes);
+        checksum += documentMessages.size();
+    }
+    qint64 documentNs = timer.nsecsElapsed();
+
+    // 只解码，接收方不保存任何对象
+    TlArena arena;
+    TlDecoder decoder(&arena);
+    timer.restart();
+    for (int i = 0; i < responses; ++i) {
+        TlHistory history;
+        if (decoder.decodeHistory(bytes, &history) == TlDecoder::Ok) {
+            checksum += history.messages.size();
+        }
+        arena.reset();
+    }
+    qint64 arenaNs = timer.nsecsElapsed();
+    TlArena::Stats arenaStats = arena.stats();
+
+    // 解码后复制出全部消息，相当于界面要保存这一页历史
+    QVector<MessageData> promotedMessages;
+    timer.restart();
+    for (int i = 0; i < responses; ++i) {
+        TlHistory history;
+        if (decoder.decodeHistory(bytes, &history) == TlDecoder::Ok) {
+            promotedMessages = history.promoteMessages();
+            checksum += promotedMessages.size();
+        }
+        arena.reset();
+    }
+    qint64 promoteNs = timer.nsecsElapsed();
+
+    if (!sameMessages(documentMessages, promotedMessages)) {
+        qWarning() << "tl-decode: arena解码的结果与文档对象不一致";
+    }
+
+    qInfo().noquote() << QString("tl-decode: %1 个响应，每个 %2 条消息、%3 字节（校验和 %4）")
+        .arg(responses).arg(HISTORY_MESSAGES).arg(bytes.size()).arg(checksum);
+    qInfo().noquote() << QString("  文档对象: 每个响应 %1 微秒，结果占用堆分配 %2 次（不含解析时的文档对象）")
+        .arg(documentNs / 1000.0 / responses, 0, 'f', 2)
+        .arg(heapBlocks(documentMessages));
+    qInfo().noquote() << QString("  arena只解码: 每个响应 %1 微秒，%2 个对象、%3 个字符串，全程向堆申请 %4 块内存")
+        .arg(arenaNs / 1000.0 / responses, 0, 'f', 2)
+        .arg(arenaStats.objects / responses)
+        .arg(arenaStats.strings / responses)
+        .arg(arenaStats.chunkAllocations);
+    qInfo().noquote() << QString("  arena解码后复制出消息: 每个响应 %1 微秒，结果占用堆分配 %2 次")
+        .arg(promoteNs / 1000.0 / responses, 0, 'f', 2)
+        .arg(heapBlocks(promotedMessages));
+}
+
+QVector<QByteArray> utf8Messages()
+{
+    QVector<QByteArray> messages;
+    messages.reserve(UTF8_MESSAGES);
+    for (int i = 0; i < UTF8_MESSAGES; ++i) {
+        QByteArray text;
+        for (int part = 0; part <= i % 4; ++part) {
+            text += PHRASES[(i * 7 + part) % 4];
+        }
+        messages.append(text);
+    }
+    return messages;
+}
+
+void printUtf8Result(const char* name, qint64 ns, qint64 bytes, int conversions)
+{
+    qInfo().noquote() << QString("  %1: 每条 %2 纳秒，%3 MB/s")
+        .arg(QString::fromLatin1(name), -12)
+        .arg(double(ns) / qMax(1, conversions), 0, 'f', 1)
+        .arg(bytes * 1000.0 / qMax<qint64>(1, ns), 0, 'f', 0);
+}
+
+void benchmarkUtf8(int iterations)
+{
+    const QVector<QByteArray> messages = utf8Messages();
+    int passes = qMax(1, iterations / UTF8_MESSAGES);
+    int conversions = passes * int(messages.size());
+    qint64 bytes = 0;
+    qsizetype longest = 0;
+    for (const QByteArray& message : messages) {
+        bytes += message.size();
+        longest = qMax(longest, message.size());
+    }
+    bytes *= passes;
+
+    QVector<QString> expected;
+    expected.reserve(messages.size());
+    for (const QByteArray& message : messages) {
+        expected.append(QString::fromUtf8(message));
+    }
+
+    qInfo().noquote() << QString("utf8: %1 条消息 x %2 遍，共 %3 MB，本机最佳实现 %4")
+        .arg(messages.size()).arg(passes).arg(bytes / 1e6, 0, 'f', 1)
+        .arg(QString::fromLatin1(Utf8Codec::implementationName(Utf8Codec::bestImplementation())));
+
+    qint64 checksum = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (const QByteArray& message : messages) {
+            checksum += QString::fromUtf8(message).size();
+        }
+    }
+    printUtf8Result("fromUtf8", timer.nsecsElapsed(), bytes, conversions);
+
+    // 只测转换本身，输出到复用的缓冲
+    QVector<char16_t> output(longest);
+    for (int implementation = Utf8Codec::Scalar; implementation <= Utf8Codec::bestImplementation(); ++implementation) {
+        Utf8Codec::Implementation selected = Utf8Codec::Implementation(implementation);
+        bool matches = true;
+        for (int i = 0; i < messages.size(); ++i) {
+            qsizetype length = Utf8Codec::toUtf16(messages[i].constData(), messages[i].size(), output.data(), selected);
+            matches = matches && QStringView(output.constData(), qMax<qsizetype>(length, 0)) == expected[i];
+        }
+        if (!matches) {
+            qWarning() << "utf8:" << Utf8Codec::implementationName(selected) << "的转换结果与fromUtf8不一致";
+        }
+        timer.restart();
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const QByteArray& message : messages) {
+                checksum += Utf8Codec::toUtf16(message.constData(), message.size(), output.data(), selected);
+            }
+        }
+        printUtf8Result(Utf8Codec::implementationName(selected), timer.nsecsElapsed(), bytes, conversions);
+    }
+
+    // 包括分配QString，即arena字符串提升时的实际开销
+    timer.restart();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (const QByteArray& message : messages) {
+            checksum += Utf8Codec::toString(message.constData(), message.size()).size();
+        }
+    }
+    printUtf8Result("toString", timer.nsecsElapsed(), bytes, conversions);
+
+    timer.restart();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (int i = 0; i < messages.size(); ++i) {
+            checksum += Utf8Codec::equals(messages[i].constData(), messages[i].size(), expected[i]);
+        }
+    }
+    printUtf8Result("equals", timer.nsecsElapsed(), bytes, conversions);
+    qInfo().noquote() << QString("  校验和 %1").arg(checksum);
+}
+
+// 模拟一批更新：多数是新消息，其次是已读，少量会话移到其他文件夹
+DialogData nextDialogUpdate(QRandomGenerator& random, QHash<qint64, DialogData>& dialogs)
+{
+    DialogData& dialog = dialogs[1 + random.bounded(VIEW_DIALOGS)];
+    int kind = int(random.bounded(100));
+    if (kind < 70) {
+        ++dialog.topMessageId;
+        ++dialog.unreadCount;
+    } else if (kind < 95) {
+        dialog.readInboxMaxId = dialog.topMessageId;
+        dialog.unreadCount = 0;
+    } else {
+        dialog.folderId = int(random.bounded(VIEW_FOLDERS));
+    }
+    return dialog;
+}
+
+// 对比：每次变化后遍历全部会话重新统计各文件夹
+QHash<qint32, DialogViews::Counters> recomputeCounters(const QHash<qint64, DialogData>& dialogs)
+{
+    QHash<qint32, DialogViews::Counters> folders;
+    for (const DialogData& dialog : dialogs) {
+        DialogViews::Counters& counters = folders[dialog.folderId];
+        ++counters.dialogs;
+        counters.unreadDialogs += dialog.unreadCount > 0;
+        counters.unreadMessages += dialog.unreadCount;
+    }
+    return folders;
+}
+
+void benchmarkDialogViews(int iterations)
+{
+    QRandomGenerator random(1);
+    QHash<qint64, DialogData> dialogs;
+    dialogs.reserve(VIEW_DIALOGS);
+    QVector<DialogData> initial;
+    initial.reserve(VIEW_DIALOGS);
+    for (int i = 1; i <= VIEW_DIALOGS; ++i) {
+        DialogData dialog;
+        dialog.peerId = i;
+        dialog.topMessageId = 100;
+        dialog.readInboxMaxId = i % 5 == 0 ? 90 : 100;
+        dialog.unreadCount = dialog.topMessageId - dialog.readInboxMaxId;
+        dialog.folderId = i % 10 == 0 ? 1 : 0;
+        dialogs.insert(i, dialog);
+        initial.append(dialog);
+    }
+
+    DialogViews views;
+    QElapsedTimer timer;
+    timer.start();
+    views.reset(initial);
+    qint64 resetNs = timer.nsecsElapsed();
+
+    // 每条更新后都通知一次，是最坏的情况；实际一批更新只通知一次
+    int notifications = 0;
+    QObject::connect(&views, &DialogViews::totalChanged, [&notifications](const DialogViews::Counters&) {
+        ++notifications;
+    });
+    timer.restart();
+    for (int i = 0; i < iterations; ++i) {
+        views.apply(nextDialogUpdate(random, dialogs));
+        views.flush();
+    }
+    qint64 incrementalNs = timer.nsecsElapsed();
+
+    int recomputeUpdates = qMin(iterations, VIEW_RECOMPUTE_UPDATES);
+    QHash<qint32, DialogViews::Counters> recomputed;
+    timer.restart();
+    for (int i = 0; i < recomputeUpdates; ++i) {
+        views.apply(nextDialogUpdate(random, dialogs));
+        recomputed = recomputeCounters(dialogs);
+    }
+    qint64 recomputeNs = timer.nsecsElapsed();
+
+    bool matches = true;
+    for (auto it = recomputed.constBegin(); it != recomputed.constEnd(); ++it) {
+        DialogViews::Counters counters = views.counters(it.key());
+        matches = matches && counters.dialogs == it->dialogs && counters.unreadDialogs == it->unreadDialogs
+            && counters.unreadMessages == it->unreadMessages;
+    }
+    if (!matches) {
+        qWarning() << "dialog-views: 增量计数与全量重算不一致";
+    }
+
+    DialogViews::Counters total = views.total();
+    qInfo().noquote() << QString("dialog-views: %1 个会话，%2 个文件夹，%3 条更新")
+        .arg(VIEW_DIALOGS).arg(views.folders().size()).arg(iterations);
+    qInfo().noquote() << QString("  建立视图: %1 毫秒（只在打开存储时一次）").arg(resetNs / 1e6, 0, 'f', 2);
+    qInfo().noquote() << QString("  增量更新并通知: 每条 %1 纳秒，通知 %2 次")
+        .arg(double(incrementalNs) / qMax(1, iterations), 0, 'f', 1)
+        .arg(notifications);
+    qInfo().noquote() << QString("  全量重算: 每条 %1 微秒（%2 条）")
+        .arg(recomputeNs / 1000.0 / qMax(1, recomputeUpdates), 0, 'f', 1)
+        .arg(recomputeUpdates);
+    qInfo().noquote() << QString("  未读: %1 个会话，%2 条消息")
+        .arg(total.unreadDialogs).arg(total.unreadMessages);
+}
+
+const Benchmark BENCHMARKS[] = {
+    { "replay-window", benchmarkReplayWindow },
+    { "tl-decode", benchmarkTlDecode },
+    { "utf8", benchmarkUtf8 },
+    { "dialog-views", benchmarkDialogViews }
+};
+
+} // namespace
+
+QStringList MicroBenchmark::names()
+{
+    QStringList result;
+    for (const Benchmark& benchmark : BENCHMARKS) {
+        result.append(benchmark.name);
+    }
+    return result;
+}
+
+bool MicroBenchmark::run(const QString& name, int iterations)
+{
+    bool found = false;
+    for (const Benchmark& benchmark : BENCHMARKS) {
+        if (name == "all" || name == benchmark.name) {
+            benchmark.run(qMax(1, iterations));
+            found = true;
+        }
+    }
+    return found;
+}
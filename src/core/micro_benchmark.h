@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief 进程内的微基准测试
+ *
+ * 每个测试针对一个独立的组件，在当前线程中同步运行，
+ * 结果（每次操作的耗时，以及与简单实现的对比）通过qInfo输出。
+ */
+class MicroBenchmark
+{
+public:
+    static QStringList names();
+
+    // 运行指定的测试，名称为all时运行全部；未知名称返回false
+    static bool run(const QString& name, int iterations);
+};
@@ -0,0 +1,389 @@
+#include "peer_search_index.h"
+#include "pinyin_table.h"
+#include <algorithm>
+
+namespace {
+
+// 每个名称最多从前几个词开始生成后缀键
+const int MAX_KEY_POSITIONS = 8;
+const int MAX_KEY_LENGTH = 64;
+
+// 新键先进入有序缓冲，超过该数量再合并到主数组
+const int PENDING_LIMIT = 2048;
+
+// 失效键至少达到该数量并且超过一半时重建
+const int REBUILD_MIN_DEAD_KEYS = 4096;
+
+// 单次查询最多检查的前缀匹配，单个字母的查询不必扫完所有联系人
+const int MAX_PREFIX_CANDIDATES = 4096;
+
+// 名称中的一个词，汉字每个字单独成词
+struct NameUnit
+{
+    QString text;
+    QString pinyin;
+    bool han = false;
+};
+
+QVector<NameUnit> splitName(const QString& name)
+{
+    QVector<NameUnit> units;
+    QString word;
+    auto flushWord = [&units, &word]() {
+        if (!word.isEmpty()) {
+            units.append({ word, word, false });
+            word.clear();
+        }
+    };
+
+    for (QChar ch : name) {
+        QLatin1String syllable = PinyinTable::syllable(ch);
+        if (!syllable.isEmpty()) {
+            flushWord();
+            units.append({ QString(ch), QString(syllable), true });
+        } else if (ch.isLetterOrNumber() || ch.isSurrogate()) {
+            word += ch.toCaseFolded();
+        } else {
+            flushWord();
+        }
+    }
+    flushWord();
+    return units;
+}
+
+QString joinUnits(const QVector<NameUnit>& units, int from, bool pinyin)
+{
+    QString result;
+    for (int i = from; i < units.size() && result.size() < MAX_KEY_LENGTH; ++i) {
+        result += pinyin ? units.at(i).pinyin : units.at(i).text;
+    }
+    return result.left(MAX_KEY_LENGTH);
+}
+
+// 查询串去掉分隔符并折叠大小写，toPinyin时汉字换成拼音
+QString normalizeQuery(const QString& query, bool toPinyin)
+{
+    QString result;
+    for (QChar ch : query) {
+        QLatin1String syllable = toPinyin ? PinyinTable::syllable(ch) : QLatin1String();
+        if (!syllable.isEmpty()) {
+            result += syllable;
+        } else if (ch.isLetterOrNumber() || ch.isSurrogate()) {
+            result += ch.toCaseFolded();
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+PeerSearchIndex::PeerSearchIndex()
+    : m_deadKeys(0)
+{
+}
+
+QString PeerSearchIndex::displayName(const PeerData& peer)
+{
+    if (peer.type != PeerData::User) {
+        return peer.title;
+    }
+    if (peer.lastName.isEmpty()) {
+        return peer.firstName;
+    }
+    return peer.firstName.isEmpty() ? peer.lastName : peer.firstName + ' ' + peer.lastName;
+}
+
+void PeerSearchIndex::addPeer(const PeerData& peer)
+{
+    auto it = m_slots.constFind(peer.id);
+    if (it != m_slots.constEnd()) {
+        Entry& entry = m_entries[it.value()];
+        if (entry.name == displayName(peer) && entry.peer.username == peer.username) {
+            entry.peer = peer;
+            return;
+        }
+        removePeer(peer.id);
+    }
+
+    m_slots.insert(peer.id, appendEntry(peer));
+
+    if (m_deadKeys >= REBUILD_MIN_DEAD_KEYS && m_deadKeys * 2 >= keyCount()) {
+        rebuild();
+    }
+}
+
+void PeerSearchIndex::removePeer(qint64 peerId)
+{
+    auto it = m_slots.find(peerId);
+    if (it == m_slots.end()) {
+        return;
+    }
+    Entry& entry = m_entries[it.value()];
+    entry.alive = false;
+    m_deadKeys += entry.keyCount;
+    m_slots.erase(it);
+}
+
+void PeerSearchIndex::clear()
+{
+    m_entries.clear();
+    m_slots.clear();
+    m_pool.clear();
+    m_keys.clear();
+    m_pending.clear();
+    m_deadKeys = 0;
+}
+
+bool PeerSearchIndex::contains(qint64 peerId) const
+{
+    return m_slots.contains(peerId);
+}
+
+PeerData PeerSearchIndex::peer(qint64 peerId) const
+{
+    auto it = m_slots.constFind(peerId);
+    return it == m_slots.constEnd() ? PeerData() : m_entries.at(it.value()).peer;
+}
+
+int PeerSearchIndex::peerCount() const
+{
+    return m_slots.size();
+}
+
+int PeerSearchIndex::keyCount() const
+{
+    return m_keys.size() + m_pending.size();
+}
+
+quint32 PeerSearchIndex::appendEntry(const PeerData& peer)
+{
+    quint32 slot = quint32(m_entries.size());
+    Entry entry;
+    entry.peer = peer;
+    entry.name = displayName(peer);
+    entry.alive = true;
+
+    const QVector<NameUnit> units = splitName(entry.name);
+    bool hasHan = std::any_of(units.begin(), units.end(), [](const NameUnit& unit) { return unit.han; });
+    entry.compactName = joinUnits(units, 0, false);
+    if (hasHan) {
+        entry.pinyin = joinUnits(units, 0, true);
+    }
+    if (units.size() >= 2) {
+        for (const NameUnit& unit : units) {
+            entry.initials += unit.pinyin.at(0);
+        }
+    }
+
+    QVector<Key> keys;
+    for (int i = 0; i < units.size() && i < MAX_KEY_POSITIONS; ++i) {
+        appendKey(&keys, joinUnits(units, i, false), NameKey, i, slot);
+        if (hasHan) {
+            appendKey(&keys, joinUnits(units, i, true), PinyinKey, i, slot);
+        }
+    }
+    appendKey(&keys, entry.initials.left(MAX_KEY_LENGTH), InitialsKey, 0, slot);
+    appendKey(&keys, normalizeQuery(peer.username, false).left(MAX_KEY_LENGTH), UsernameKey, 0, slot);
+
+    entry.keyCount = keys.size();
+    m_entries.append(entry);
+    for (const Key& key : keys) {
+        insertPending(key);
+    }
+    return slot;
+}
+
+void PeerSearchIndex::appendKey(QVector<Key>* keys, const QString& text, KeyKind kind, int position, quint32 slot)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    // 同一个名称的拼音键与名称键相同时（纯字母名称）不重复添加
+    for (const Key& key : *keys) {
+        if (keyText(key) == text) {
+            return;
+        }
+    }
+
+    Key key;
+    key.offset = quint32(m_pool.size());
+    key.length = quint16(text.size());
+    key.kind = kind;
+    key.position = quint8(position);
+    key.slot = slot;
+    m_pool += text;
+    keys->append(key);
+}
+
+QStringView PeerSearchIndex::keyText(const Key& key) const
+{
+    return QStringView(m_pool).mid(key.offset, key.length);
+}
+
+bool PeerSearchIndex::keyLess(const Key& a, const Key& b) const
+{
+    return keyText(a).compare(keyText(b)) < 0;
+}
+
+void PeerSearchIndex::insertPending(const Key& key)
+{
+    auto position = std::upper_bound(m_pending.begin(), m_pending.end(), key,
+        [this](const Key& a, const Key& b) { return keyLess(a, b); });
+    m_pending.insert(position, key);
+    if (m_pending.size() >= PENDING_LIMIT) {
+        mergePending();
+    }
+}
+
+void PeerSearchIndex::mergePending()
+{
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    int middle = m_keys.size();
+    m_keys += m_pending;
+    m_pending.clear();
+    std::inplace_merge(m_keys.begin(), m_keys.begin() + middle, m_keys.end(),
+        [this](const Key& a, const Key& b) { return keyLess(a, b); });
+}
+
+void PeerSearchIndex::rebuild()
+{
+    QVector<PeerData> peers;
+    peers.reserve(m_slots.size());
+    for (const Entry& entry : std::as_const(m_entries)) {
+        if (entry.alive) {
+            peers.append(entry.peer);
+        }
+    }
+
+    clear();
+    for (const PeerData& peer : std::as_const(peers)) {
+        m_slots.insert(peer.id, appendEntry(peer));
+    }
+    mergePending();
+}
+
+QVector<PeerSearchIndex::Result> PeerSearchIndex::search(const QString& query, int limit) const
+{
+    QVector<Result> results;
+    const QString compactQuery = normalizeQuery(query, false);
+    if (compactQuery.isEmpty() || limit <= 0) {
+        return results;
+    }
+
+    // 前缀匹配，查询中的汉字再换成拼音查一次，以便混合输入和同音字也能找到
+    QHash<quint32, int> scores;
+    int budget = MAX_PREFIX_CANDIDATES;
+    collectPrefix(m_keys, compactQuery, &scores, &budget);
+    collectPrefix(m_pending, compactQuery, &scores, &budget);
+    const QString pinyinQuery = normalizeQuery(query, true);
+    if (pinyinQuery != compactQuery) {
+        collectPrefix(m_keys, pinyinQuery, &scores, &budget);
+        collectPrefix(m_pending, pinyinQuery, &scores, &budget);
+    }
+
+    // 结果不足时按子序列模糊匹配，例如 "zhsf" 匹配 "张三丰"
+    if (scores.size() < limit && pinyinQuery.size() >= 2) {
+        for (quint32 slot = 0; slot < quint32(m_entries.size()); ++slot) {
+            const Entry& entry = m_entries.at(slot);
+            if (!entry.alive || scores.contains(slot)) {
+                continue;
+            }
+            int score = qMax(fuzzyScore(entry.compactName, compactQuery),
+                             qMax(fuzzyScore(entry.pinyin, pinyinQuery),
+                                  fuzzyScore(entry.initials, pinyinQuery)));
+            if (score > 0) {
+                scores.insert(slot, score);
+            }
+        }
+    }
+
+    results.reserve(scores.size());
+    for (auto it = scores.constBegin(); it != scores.constEnd(); ++it) {
+        results.append({ m_entries.at(it.key()).peer.id, it.value() });
+    }
+    auto better = [](const Result& a, const Result& b) {
+        return a.score != b.score ? a.score > b.score : a.peerId < b.peerId;
+    };
+    if (results.size() > limit) {
+        std::partial_sort(results.begin(), results.begin() + limit, results.end(), better);
+        results.resize(limit);
+    } else {
+        std::sort(results.begin(), results.end(), better);
+    }
+    return results;
+}
+
+void PeerSearchIndex::collectPrefix(const QVector<Key>& keys, const QString& query,
+                                    QHash<quint32, int>* scores, int* budget) const
+{
+    if (query.size() > MAX_KEY_LENGTH) {
+        return;
+    }
+    auto it = std::lower_bound(keys.begin(), keys.end(), query,
+        [this](const Key& key, const QString& value) { return keyText(key).compare(value) < 0; });
+    for (; it != keys.end() && *budget > 0; ++it) {
+        if (!keyText(*it).startsWith(query)) {
+            break;
+        }
+        const Entry& entry = m_entries.at(it->slot);
+        if (!entry.alive) {
+            continue;
+        }
+        --*budget;
+        int score = scoreKey(*it, entry, query.size());
+        auto existing = scores->find(it->slot);
+        if (existing == scores->end()) {
+            scores->insert(it->slot, score);
+        } else if (*existing < score) {
+            *existing = score;
+        }
+    }
+}
+
+int PeerSearchIndex::scoreKey(const Key& key, const Entry& entry, int queryLength) const
+{
+    // 名称开头的完整匹配最优先，其次是词首、用户名、拼音、首字母，名称越短越靠前
+    int score = 0;
+    switch (key.kind) {
+    case NameKey:
+        score = 1000;
+        break;
+    case UsernameKey:
+        score = 900;
+        break;
+    case PinyinKey:
+        score = 800;
+        break;
+    case InitialsKey:
+        score = 700;
+        break;
+    }
+    score -= key.position * 50;
+    if (key.length == queryLength) {
+        score += 200;
+    }
+    return score - qMin(int(entry.compactName.size()), 50);
+}
+
+int PeerSearchIndex::fuzzyScore(const QString& text, const QString& query)
+{
+    if (text.size() < query.size()) {
+        return 0;
+    }
+    int first = -1;
+    int position = 0;
+    for (QChar ch : query) {
+        position = text.indexOf(ch, position);
+        if (position < 0) {
+            return 0;
+        }
+        if (first < 0) {
+            first = position;
+        }
+        ++position;
+    }
+    int gaps = position - first - int(query.size());
+    return qMax(1, 500 - gaps * 10 - first * 5 - int(text.size()));
+}
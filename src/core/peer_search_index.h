@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+#include "telegram_types.h"
+
+/**
+ * @brief 联系人和会话名称的快速查找索引
+ *
+ * 每个名称生成若干检索键：整个名称、从每个词（汉字按单字）开始的后缀、用户名、
+ * 全拼和拼音首字母，全部放进一个按字典序排列的数组，前缀查询只需二分定位后顺序扫描。
+ * 新增的键先进入一个较小的有序缓冲，缓冲满了再合并到主数组；
+ * 更新或删除的资料只做标记，失效键过多时整体重建。
+ * 前缀结果不足时再按子序列做模糊匹配。
+ */
+class PeerSearchIndex
+{
+public:
+    struct Result
+    {
+        qint64 peerId = 0;
+        int score = 0;
+    };
+
+    PeerSearchIndex();
+
+    // 新增或更新资料，显示名和用户名不变时直接返回
+    void addPeer(const PeerData& peer);
+    void removePeer(qint64 peerId);
+    void clear();
+
+    bool contains(qint64 peerId) const;
+    PeerData peer(qint64 peerId) const;
+
+    // 按匹配程度从高到低返回最多limit个结果
+    QVector<Result> search(const QString& query, int limit) const;
+
+    int peerCount() const;
+    int keyCount() const;
+
+    // 用户取姓名，群组和频道取标题
+    static QString displayName(const PeerData& peer);
+
+private:
+    enum KeyKind : quint8 {
+        NameKey,        // 名称或其中某个词开始的后缀
+        UsernameKey,
+        PinyinKey,      // 全拼
+        InitialsKey     // 拼音首字母
+    };
+
+    // 检索键的文本保存在公共字符池中
+    struct Key
+    {
+        quint32 offset = 0;
+        quint16 length = 0;
+        KeyKind kind = NameKey;
+        quint8 position = 0;    // 从名称中第几个词开始
+        quint32 slot = 0;
+    };
+
+    struct Entry
+    {
+        PeerData peer;
+        QString name;
+        QString compactName;    // 折叠大小写并去掉分隔符
+        QString pinyin;
+        QString initials;
+        int keyCount = 0;
+        bool alive = false;
+    };
+
+    QStringView keyText(const Key& key) const;
+    bool keyLess(const Key& a, const Key& b) const;
+
+    quint32 appendEntry(const PeerData& peer);
+    void appendKey(QVector<Key>* keys, const QString& text, KeyKind kind, int position, quint32 slot);
+    void insertPending(const Key& key);
+    void mergePending();
+    void rebuild();
+
+    // 在一个有序数组中收集前缀匹配
+    void collectPrefix(const QVector<Key>& keys, const QString& query,
+                       QHash<quint32, int>* scores, int* budget) const;
+    int scoreKey(const Key& key, const Entry& entry, int queryLength) const;
+    static int fuzzyScore(const QString& text, const QString& query);
+
+    QVector<Entry> m_entries;
+    QHash<qint64, quint32> m_slots;
+    QString m_pool;
+    QVector<Key> m_keys;
+    QVector<Key> m_pending;
+    int m_deadKeys;
+};
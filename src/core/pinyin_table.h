@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QChar>
+#include <QLatin1String>
+
+/**
+ * @brief 汉字拼音表
+ *
+ * 收录约两万个常用和扩展A区汉字，每个字只取最常用的一个读音，不带声调，
+ * ü 记作 v。用于联系人和会话名称的拼音搜索。
+ */
+class PinyinTable
+{
+public:
+    // 返回汉字的拼音（小写），未收录的字符返回空串
+    static QLatin1String syllable(QChar ch);
+
+    static bool contains(QChar ch);
+};
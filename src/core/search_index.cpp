@@ -0,0 +1,428 @@
+#include "search_index.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SEARCH_INDEX_SSE2
+#endif
+
+namespace {
+
+const quint32 SNAPSHOT_MAGIC = 0x54475358; // "TGSX"
+const quint32 SNAPSHOT_VERSION = 1;
+
+// 两个倒排表长度相差超过该倍数时改用跳跃查找
+const int GALLOP_RATIO = 32;
+
+bool isCjk(char32_t cp)
+{
+    return (cp >= 0x4E00 && cp <= 0x9FFF)     // 中日韩统一表意文字
+        || (cp >= 0x3400 && cp <= 0x4DBF)     // 扩展A
+        || (cp >= 0x20000 && cp <= 0x2EBEF)   // 扩展B-F
+        || (cp >= 0xF900 && cp <= 0xFAFF)     // 兼容表意文字
+        || (cp >= 0x3040 && cp <= 0x30FF)     // 平假名、片假名
+        || (cp >= 0xAC00 && cp <= 0xD7AF);    // 韩文音节
+}
+
+// 在有序数组中查找第一个不小于value的位置，从from开始按指数步长跳跃
+int gallop(const quint32* data, int from, int size, quint32 value)
+{
+    int step = 1;
+    int low = from;
+    int high = from;
+    while (high < size && data[high] < value) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    return int(std::lower_bound(data + low, data + qMin(high + 1, size), value) - data);
+}
+
+// 小表对大表：逐个在大表中跳跃查找
+int intersectGalloping(const quint32* small, int smallSize, const quint32* large, int largeSize, quint32* out)
+{
+    int count = 0;
+    int position = 0;
+    for (int i = 0; i < smallSize && position < largeSize; ++i) {
+        position = gallop(large, position, largeSize, small[i]);
+        if (position < largeSize && large[position] == small[i]) {
+            out[count++] = small[i];
+        }
+    }
+    return count;
+}
+
+// 有序去重数组求交集，结果写入out，返回结果数量
+int intersectSorted(const quint32* a, int aSize, const quint32* b, int bSize, quint32* out)
+{
+    if (aSize > bSize) {
+        std::swap(a, b);
+        std::swap(aSize, bSize);
+    }
+    if (aSize == 0) {
+        return 0;
+    }
+    if (bSize / aSize >= GALLOP_RATIO) {
+        return intersectGalloping(a, aSize, b, bSize, out);
+    }
+
+    int i = 0;
+    int j = 0;
+    int count = 0;
+
+#ifdef SEARCH_INDEX_SSE2
+    // 每次比较a的4个元素与b的4个元素的全部4种循环移位
+    while (i + 4 <= aSize && j + 4 <= bSize) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+        __m128i cmp0 = _mm_cmpeq_epi32(va, vb);
+        __m128i cmp1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)));
+        __m128i cmp2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2)));
+        __m128i cmp3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)));
+        __m128i any = _mm_or_si128(_mm_or_si128(cmp0, cmp1), _mm_or_si128(cmp2, cmp3));
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(any));
+        while (mask) {
+            int bit = 0;
+            while (!(mask & (1 << bit))) {
+                ++bit;
+            }
+            out[count++] = a[i + bit];
+            mask &= mask - 1;
+        }
+
+        quint32 aMax = a[i + 3];
+        quint32 bMax = b[j + 3];
+        if (aMax <= bMax) {
+            i += 4;
+        }
+        if (bMax <= aMax) {
+            j += 4;
+        }
+    }
+#endif
+
+    // 标量处理剩余部分
+    while (i < aSize && j < bSize) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            out[count++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+} // namespace
+
+MessageSearchIndex::MessageSearchIndex()
+    : m_postingBytes(0)
+{
+}
+
+QStringList MessageSearchIndex::tokenize(const QString& text)
+{
+    QStringList tokens;
+    QString word;
+    QVector<char32_t> run;
+
+    auto flushWord = [&]() {
+        if (!word.isEmpty()) {
+            tokens.append(word.toCaseFolded());
+            word.clear();
+        }
+    };
+    // 连续的表意文字：每个字和每对相邻字各作为一个词项
+    auto flushRun = [&]() {
+        for (int i = 0; i < run.size(); ++i) {
+            tokens.append(QString::fromUcs4(run.constData() + i, 1));
+            if (i + 1 < run.size()) {
+                tokens.append(QString::fromUcs4(run.constData() + i, 2));
+            }
+        }
+        run.clear();
+    };
+
+    const int size = text.size();
+    for (int i = 0; i < size;) {
+        char32_t cp = text.at(i).unicode();
+        int length = 1;
+        if (text.at(i).isHighSurrogate() && i + 1 < size && text.at(i + 1).isLowSurrogate()) {
+            cp = QChar::surrogateToUcs4(text.at(i), text.at(i + 1));
+            length = 2;
+        }
+
+        if (isCjk(cp)) {
+            flushWord();
+            run.append(cp);
+        } else if (QChar::isLetterOrNumber(cp)) {
+            flushRun();
+            word.append(text.mid(i, length));
+        } else {
+            flushWord();
+            flushRun();
+        }
+        i += length;
+    }
+    flushWord();
+    flushRun();
+
+    tokens.removeDuplicates();
+    return tokens;
+}
+
+void MessageSearchIndex::appendPosting(PostingList& list, quint32 doc)
+{
+    // 文档号递增，记录与上一个的差值
+    quint32 delta = list.count == 0 ? doc : doc - list.lastDoc;
+    while (delta >= 0x80) {
+        list.data.append(char((delta & 0x7F) | 0x80));
+        delta >>= 7;
+    }
+    list.data.append(char(delta));
+    list.lastDoc = doc;
+    ++list.count;
+}
+
+QVector<quint32> MessageSearchIndex::decodePostings(const PostingList& list)
+{
+    QVector<quint32> docs(list.count);
+    const uchar* data = reinterpret_cast<const uchar*>(list.data.constData());
+    const uchar* end = data + list.data.size();
+
+    quint32 doc = 0;
+    int index = 0;
+    while (data < end && index < docs.size()) {
+        quint32 delta = 0;
+        int shift = 0;
+        uchar byte;
+        do {
+            byte = *data++;
+            delta |= quint32(byte & 0x7F) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && data < end);
+        doc = index == 0 ? delta : doc + delta;
+        docs[index++] = doc;
+    }
+    docs.resize(index);
+    return docs;
+}
+
+void MessageSearchIndex::addMessage(const MessageData& message)
+{
+    insertDocument(message, nullptr);
+}
+
+void MessageSearchIndex::addTokenizedMessage(const MessageData& message, const QStringList& terms)
+{
+    insertDocument(message, &terms);
+}
+
+void MessageSearchIndex::insertDocument(const MessageData& message, const QStringList* tokenized)
+{
+    if (message.id <= 0) {
+        return;
+    }
+
+    QPair<qint64, qint32> key(message.peerId, message.id);
+    uint textHash = qHash(message.text);
+
+    // 正文未变化的重复消息（重新拉取的历史）直接跳过，变化时作废旧文档
+    auto existing = m_documentIds.constFind(key);
+    if (existing != m_documentIds.constEnd()) {
+        Document& document = m_documents[existing.value()];
+        if (document.textHash == textHash) {
+            return;
+        }
+        document.deleted = true;
+    }
+
+    quint32 doc = quint32(m_documents.size());
+    Document document;
+    document.peerId = message.peerId;
+    document.messageId = message.id;
+    document.textHash = textHash;
+    m_documents.append(document);
+    m_documentIds.insert(key, doc);
+
+    const QStringList terms = tokenized ? *tokenized : tokenize(message.text);
+    for (const QString& term : terms) {
+        auto it = m_termIds.constFind(term);
+        int termId;
+        if (it == m_termIds.constEnd()) {
+            termId = m_postings.size();
+            m_termIds.insert(term, termId);
+            m_postings.append(PostingList());
+        } else {
+            termId = it.value();
+        }
+        PostingList& list = m_postings[termId];
+        qsizetype before = list.data.size();
+        appendPosting(list, doc);
+        m_postingBytes += list.data.size() - before;
+    }
+}
+
+void MessageSearchIndex::removeMessage(qint64 peerId, qint32 messageId)
+{
+    auto it = m_documentIds.find(qMakePair(peerId, messageId));
+    if (it == m_documentIds.end()) {
+        return;
+    }
+    m_documents[it.value()].deleted = true;
+    m_documentIds.erase(it);
+}
+
+void MessageSearchIndex::clear()
+{
+    m_documents.clear();
+    m_documentIds.clear();
+    m_termIds.clear();
+    m_postings.clear();
+    m_postingBytes = 0;
+}
+
+QVector<MessageSearchIndex::Hit> MessageSearchIndex::search(const QString& query, int limit) const
+{
+    QVector<Hit> hits;
+    const QStringList terms = tokenize(query);
+    if (terms.isEmpty() || limit <= 0) {
+        return hits;
+    }
+
+    // 任一词项不存在即无结果；从最短的倒排表开始求交集
+    QVector<const PostingList*> lists;
+    for (const QString& term : terms) {
+        auto it = m_termIds.constFind(term);
+        if (it == m_termIds.constEnd()) {
+            return hits;
+        }
+        lists.append(&m_postings.at(it.value()));
+    }
+    std::sort(lists.begin(), lists.end(), [](const PostingList* a, const PostingList* b) {
+        return a->count < b->count;
+    });
+
+    QVector<quint32> docs = decodePostings(*lists.first());
+    for (int i = 1; i < lists.size() && !docs.isEmpty(); ++i) {
+        QVector<quint32> other = decodePostings(*lists.at(i));
+        QVector<quint32> result(qMin(docs.size(), other.size()));
+        int count = intersectSorted(docs.constData(), docs.size(), other.constData(), other.size(), result.data());
+        result.resize(count);
+        docs.swap(result);
+    }
+
+    for (int i = docs.size() - 1; i >= 0 && hits.size() < limit; --i) {
+        const Document& document = m_documents.at(docs.at(i));
+        if (!document.deleted) {
+            Hit hit;
+            hit.peerId = document.peerId;
+            hit.messageId = document.messageId;
+            hits.append(hit);
+        }
+    }
+    return hits;
+}
+
+bool MessageSearchIndex::save(const QString& path, qint64 watermark) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "无法保存搜索索引:" << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << watermark;
+
+    stream << qint32(m_documents.size());
+    for (const Document& document : m_documents) {
+        stream << document.peerId << document.messageId << quint32(document.textHash) << document.deleted;
+    }
+
+    stream << qint32(m_postings.size());
+    for (auto it = m_termIds.constBegin(); it != m_termIds.constEnd(); ++it) {
+        const PostingList& list = m_postings.at(it.value());
+        stream << it.key() << list.lastDoc << list.count << list.data;
+    }
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool MessageSearchIndex::load(const QString& path, qint64 watermark)
+{
+    clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 savedWatermark = -1;
+    stream >> magic >> version >> savedWatermark;
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION || savedWatermark != watermark) {
+        return false;
+    }
+
+    qint32 documentCount = 0;
+    stream >> documentCount;
+    m_documents.reserve(documentCount);
+    for (qint32 i = 0; i < documentCount && stream.status() == QDataStream::Ok; ++i) {
+        Document document;
+        quint32 textHash = 0;
+        stream >> document.peerId >> document.messageId >> textHash >> document.deleted;
+        document.textHash = textHash;
+        if (!document.deleted) {
+            m_documentIds.insert(qMakePair(document.peerId, document.messageId), quint32(i));
+        }
+        m_documents.append(document);
+    }
+
+    qint32 termCount = 0;
+    stream >> termCount;
+    m_postings.reserve(termCount);
+    for (qint32 i = 0; i < termCount && stream.status() == QDataStream::Ok; ++i) {
+        QString term;
+        PostingList list;
+        stream >> term >> list.lastDoc >> list.count >> list.data;
+        m_termIds.insert(term, m_postings.size());
+        m_postingBytes += list.data.size();
+        m_postings.append(list);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "搜索索引快照损坏，将重新建立";
+        clear();
+        return false;
+    }
+    return true;
+}
+
+int MessageSearchIndex::documentCount() const
+{
+    return m_documentIds.size();
+}
+
+int MessageSearchIndex::termCount() const
+{
+    return m_termIds.size();
+}
+
+qint64 MessageSearchIndex::postingBytes() const
+{
+    return m_postingBytes;
+}
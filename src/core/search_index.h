@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "telegram_types.h"
+
+/**
+ * @brief 本地消息全文索引
+ *
+ * 中文（以及日文、韩文）按单字和相邻两字切分，其他文字按词切分并统一大小写。
+ * 每个词项的倒排表保存递增的文档号，以差值加变长整数编码压缩，
+ * 新消息只需在表尾追加。查询时对各词项的倒排表求交集（SSE2加速），
+ * 返回的是候选结果，调用方需要用原文确认。
+ */
+class MessageSearchIndex
+{
+public:
+    struct Hit
+    {
+        qint64 peerId = 0;
+        qint32 messageId = 0;
+    };
+
+    MessageSearchIndex();
+
+    // 添加消息，已索引的消息正文变化时重新索引
+    void addMessage(const MessageData& message);
+
+    // 与addMessage相同，但使用预先切分好的词项（可在其他线程调用tokenize）
+    void addTokenizedMessage(const MessageData& message, const QStringList& terms);
+
+    void removeMessage(qint64 peerId, qint32 messageId);
+    void clear();
+
+    // 查询候选消息，按索引顺序从新到旧，最多limit条
+    QVector<Hit> search(const QString& query, int limit) const;
+
+    // 切分文本，结果已去重
+    static QStringList tokenize(const QString& text);
+
+    // 快照：watermark与本地存储的长度一致时快照才有效
+    bool save(const QString& path, qint64 watermark) const;
+    bool load(const QString& path, qint64 watermark);
+
+    int documentCount() const;
+    int termCount() const;
+    qint64 postingBytes() const;
+
+private:
+    // 压缩的倒排表
+    struct PostingList
+    {
+        QByteArray data;        // 文档号差值的变长编码
+        quint32 lastDoc = 0;
+        quint32 count = 0;
+    };
+
+    struct Document
+    {
+        qint64 peerId = 0;
+        qint32 messageId = 0;
+        uint textHash = 0;
+        bool deleted = false;
+    };
+
+    // terms为空指针时在需要时才切分正文
+    void insertDocument(const MessageData& message, const QStringList* terms);
+
+    static void appendPosting(PostingList& list, quint32 doc);
+    static QVector<quint32> decodePostings(const PostingList& list);
+
+    QVector<Document> m_documents;
+    QHash<QPair<qint64, qint32>, quint32> m_documentIds;
+    QHash<QString, int> m_termIds;
+    QVector<PostingList> m_postings;
+    qint64 m_postingBytes;
+};
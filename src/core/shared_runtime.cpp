@@ -0,0 +1,202 @@
+#include "shared_runtime.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkInformation>
+#include <QNetworkReply>
+#include <QSslError>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+SharedRuntime* SharedRuntime::s_instance = nullptr;
+
+SharedRuntime* SharedRuntime::instance()
+{
+    if (!s_instance) {
+        s_instance = new SharedRuntime(QCoreApplication::instance());
+    }
+    return s_instance;
+}
+
+SharedRuntime::SharedRuntime(QObject* parent)
+    : QObject(parent)
+    , m_networkManager(new QNetworkAccessManager(this))
+    , m_updateWorkers(new UpdateWorkerPool(this))
+    , m_dcProber(new DcProber(this))
+    , m_networkReachable(true)
+    , m_baselineBytes(0)
+    , m_accountCount(0)
+    , m_replaySpeed(1.0)
+    , m_hedgeBudget(-1.0)
+{
+    // 共享的网络管理器统一处理响应和SSL错误，不由各账号分别连接
+    connect(m_networkManager, &QNetworkAccessManager::finished, this, [](QNetworkReply* reply) {
+        if (reply->error() != QNetworkReply::NoError) {
+            qWarning() << "网络请求错误: " << reply->errorString();
+        }
+        reply->deleteLater();
+    });
+    connect(m_networkManager, &QNetworkAccessManager::sslErrors, this,
+        [](QNetworkReply* reply, const QList<QSslError>& errors) {
+            qWarning() << "SSL错误:" << errors;
+            // 在生产环境中不应忽略SSL错误，这里只是为了调试目的
+            reply->ignoreSslErrors();
+        });
+
+    // 通过networkinformation插件观察网络变化，连接在变化后主动重连而不是等到请求超时
+    if (QNetworkInformation::loadBackendByFeatures(QNetworkInformation::Feature::Reachability)) {
+        QNetworkInformation* information = QNetworkInformation::instance();
+        auto reachable = [information]() {
+            return information->reachability() != QNetworkInformation::Reachability::Disconnected;
+        };
+        m_networkReachable = reachable();
+        connect(information, &QNetworkInformation::reachabilityChanged, this, [this, reachable]() {
+            m_networkReachable = reachable();
+            qDebug() << "网络可达性变化:" << m_networkReachable;
+            emit networkChanged(m_networkReachable);
+        });
+        connect(information, &QNetworkInformation::transportMediumChanged, this,
+            [this, reachable](QNetworkInformation::TransportMedium medium) {
+                m_networkReachable = reachable();
+                qDebug() << "网络接口变化:" << medium;
+                emit networkChanged(m_networkReachable);
+            });
+    } else {
+        qWarning() << "网络状态插件不可用，只能在请求失败后重连";
+    }
+
+    m_baselineBytes = residentBytes();
+}
+
+QNetworkAccessManager* SharedRuntime::networkManager() const
+{
+    return m_networkManager;
+}
+
+UpdateWorkerPool* SharedRuntime::updateWorkers() const
+{
+    return m_updateWorkers;
+}
+
+DcProber* SharedRuntime::dcProber() const
+{
+    return m_dcProber;
+}
+
+bool SharedRuntime::isNetworkReachable() const
+{
+    return m_networkReachable;
+}
+
+void SharedRuntime::setTrafficCapture(const QString& recordPath, const QString& replayPath, double replaySpeed)
+{
+    m_recordPath = recordPath;
+    m_replayPath = replayPath;
+    m_replaySpeed = replaySpeed;
+}
+
+void SharedRuntime::applyTrafficCapture(MTProtoClient* client, const QString& accountId) const
+{
+    auto pathFor = [&accountId](const QString& path) {
+        if (accountId.isEmpty()) {
+            return path;
+        }
+        QFileInfo info(path);
+        return info.dir().filePath(info.completeBaseName() + '.' + accountId
+                                   + (info.suffix().isEmpty() ? QString() : '.' + info.suffix()));
+    };
+    if (!m_replayPath.isEmpty()) {
+        client->startReplay(pathFor(m_replayPath), m_replaySpeed);
+    }
+    if (!m_recordPath.isEmpty()) {
+        client->startRecording(pathFor(m_recordPath));
+    }
+}
+
+void SharedRuntime::setHedgeBudget(double share)
+{
+    m_hedgeBudget = share;
+}
+
+void SharedRuntime::applyHedgeBudget(MTProtoClient* client) const
+{
+    if (m_hedgeBudget >= 0.0) {
+        client->setHedgeBudget(m_hedgeBudget);
+    }
+}
+
+void SharedRuntime::accountCreated(const QString& accountId)
+{
+    ++m_accountCount;
+
+    qint64 current = residentBytes();
+    if (current > 0 && m_baselineBytes > 0) {
+        qDebug() << "账号" << (accountId.isEmpty() ? QStringLiteral("默认") : accountId) << "已创建，共"
+                 << m_accountCount << "个账号，常驻内存" << current / 1024 << "KB，平均每个账号"
+                 << (current - m_baselineBytes) / m_accountCount / 1024 << "KB";
+    }
+}
+
+void SharedRuntime::accountDestroyed(const QString& accountId)
+{
+    Q_UNUSED(accountId);
+    m_accountCount = qMax(0, m_accountCount - 1);
+}
+
+int SharedRuntime::accountCount() const
+{
+    return m_accountCount;
+}
+
+qint64 SharedRuntime::residentBytes()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return qint64(counters.WorkingSetSize);
+    }
+    return 0;
+#elif defined(Q_OS_LINUX)
+    // statm的第二项是常驻页数
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QList<QByteArray> fields = file.readAll().split(' ');
+    return fields.size() > 1 ? fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+qint64 SharedRuntime::cpuTimeMicroseconds()
+{
+#ifdef Q_OS_WIN
+    // FILETIME以100纳秒为单位
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto toMicroseconds = [](const FILETIME& time) {
+        return qint64((quint64(time.dwHighDateTime) << 32 | time.dwLowDateTime) / 10);
+    };
+    return toMicroseconds(kernel) + toMicroseconds(user);
+#elif defined(Q_OS_LINUX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+         + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
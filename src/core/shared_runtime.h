@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QObject>
+#include <QNetworkAccessManager>
+
+#include "update_worker_pool.h"
+#include "mtproto/mtproto_client.h"
+#include "mtproto/dc_prober.h"
+
+/**
+ * @brief 同一进程中所有账号共用的运行时资源
+ *
+ * 网络管理器（连接池、DNS缓存、TLS会话缓存和它内部的网络线程）、数据中心延迟探测和更新处理线程池
+ * 每个进程只有一份，账号只持有自己的会话状态、存储和索引。
+ * 同时统计账号数量和进程常驻内存，用于观察每个账号的额外开销。
+ */
+class SharedRuntime : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SharedRuntime* instance();
+
+    QNetworkAccessManager* networkManager() const;
+    UpdateWorkerPool* updateWorkers() const;
+    
+    // 数据中心延迟探测，由第一个账号启动
+    DcProber* dcProber() const;
+    
+    // 系统报告的网络可达性，没有网络状态插件时总是可达
+    bool isNetworkReachable() const;
+
+    // 录制或回放请求，对之后创建的账号生效；非默认账号的文件名加上账号名
+    void setTrafficCapture(const QString& recordPath, const QString& replayPath, double replaySpeed);
+    void applyTrafficCapture(MTProtoClient* client, const QString& accountId) const;
+    
+    // 对冲请求的预算（占请求数的比例），对之后创建的客户端生效；没有设置时使用客户端的默认值
+    void setHedgeBudget(double share);
+    void applyHedgeBudget(MTProtoClient* client) const;
+    
+    // 账号创建和销毁时调用
+    void accountCreated(const QString& accountId);
+    void accountDestroyed(const QString& accountId);
+    int accountCount() const;
+
+    // 进程常驻内存，无法获取时返回0
+    static qint64 residentBytes();
+    
+    // 进程累计占用的CPU时间（用户态加内核态，微秒），无法获取时返回0
+    static qint64 cpuTimeMicroseconds();
+
+signals:
+    // 网络可达性或使用的接口（如Wi-Fi换成有线）发生变化
+    void networkChanged(bool reachable);
+
+private:
+    explicit SharedRuntime(QObject* parent = nullptr);
+
+    static SharedRuntime* s_instance;
+
+    QNetworkAccessManager* m_networkManager;
+    UpdateWorkerPool* m_updateWorkers;
+    DcProber* m_dcProber;
+    bool m_networkReachable;
+
+    // 创建共享资源后、第一个账号创建前的常驻内存，作为计算每账号开销的基线
+    qint64 m_baselineBytes;
+    int m_accountCount;
+    
+    QString m_recordPath;
+    QString m_replayPath;
+    double m_replaySpeed;
+    double m_hedgeBudget;       // 小于0为没有设置
+};
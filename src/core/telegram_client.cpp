@@ -4,16 +4,100 @@
 #include <QSslSocket>
 #include <QDir>
 #include <QCoreApplication>
+#include <QSet>
+#include <QDataStream>
+#include <algorithm>
+
+namespace {
+
+// 带hash的列表请求在本地存储中的键，与请求的方法名一致
+const char CONTACTS_LIST[] = "contacts.getContacts";
+const char DIALOGS_LIST[] = "messages.getDialogs";
+
+bool samePeer(const PeerData& a, const PeerData& b)
+{
+    return a.type == b.type && a.title == b.title && a.username == b.username
+        && a.firstName == b.firstName && a.lastName == b.lastName;
+}
+
+QByteArray encodeDialogList(const QVector<DialogData>& dialogs)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << quint32(dialogs.size());
+    for (const DialogData& dialog : dialogs) {
+        stream << dialog.peerId << dialog.topMessageId << dialog.readInboxMaxId
+               << dialog.unreadCount << dialog.folderId << dialog.pinned << dialog.pts;
+    }
+    return data;
+}
+
+bool decodeDialogList(const QByteArray& data, QVector<DialogData>* dialogs)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint32 count = 0;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        DialogData dialog;
+        stream >> dialog.peerId >> dialog.topMessageId >> dialog.readInboxMaxId
+               >> dialog.unreadCount >> dialog.folderId >> dialog.pinned >> dialog.pts;
+        dialogs->append(dialog);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+// 与服务器的算法一致：按会话顺序混入会话、最新消息、已读位置、pts和文件夹
+qint64 dialogListHash(const QVector<DialogData>& dialogs)
+{
+    ListHash hash;
+    for (const DialogData& dialog : dialogs) {
+        hash.add(quint64(dialog.peerId));
+        hash.add(quint64(dialog.topMessageId));
+        hash.add(quint64(dialog.readInboxMaxId));
+        hash.add(quint64(dialog.pts));
+        hash.add(quint64(dialog.folderId));
+    }
+    return hash.result();
+}
+
+// 已读位置前进到maxId，消息ID连续，剩余的未读是之后到最新消息之间的消息；位置没有前进时返回false
+bool readInboxUpTo(DialogData* dialog, qint32 maxId)
+{
+    if (maxId <= dialog->readInboxMaxId) {
+        return false;
+    }
+    dialog->readInboxMaxId = maxId;
+    dialog->unreadCount = qBound(0, dialog->topMessageId - maxId, dialog->unreadCount);
+    return true;
+}
+
+} // namespace
 
 TelegramClient::TelegramClient(QObject *parent)
+    : TelegramClient(QString(), parent)
+{
+}
+
+TelegramClient::TelegramClient(const QString& accountId, QObject *parent)
     : QObject(parent)
-    , m_mtprotoClient(new MTProtoClient(this))
+    , m_accountId(accountId)
+    , m_mtprotoClient(new MTProtoClient(SharedRuntime::instance()->networkManager(), this))
     , m_configManager(ConfigManager::instance())
+    , m_store(new MessageStore(this))
+    , m_updates(new UpdatesEngine(m_mtprotoClient, this))
+    , m_catchUp(new CatchUpScheduler(m_mtprotoClient, this))
+    , m_dialogViews(new DialogViews(this))
+    , m_workers(SharedRuntime::instance()->updateWorkers())
+    , m_workerStream(m_workers->openStream())
     , m_apiId(0)
     , m_isAuthorized(false)
 {
     // 初始化MTProto客户端
     m_mtprotoClient->init();
+    SharedRuntime::instance()->applyTrafficCapture(m_mtprotoClient, m_accountId);
+    SharedRuntime::instance()->applyHedgeBudget(m_mtprotoClient);
     
     // 检查TLS支持
     checkTlsSupport();
@@ -26,6 +110,18 @@ TelegramClient::TelegramClient(QObject *parent)
     connect(m_mtprotoClient, &MTProtoClient::authSuccess, this, [this](const QString& username) {
         m_isAuthorized = true;
         emit loginSuccess(username);
+        
+        // 从上次保存的状态开始同步更新
+        m_updates->start(m_store->updatesState());
+        
+        // 登录后拉取联系人，供快速查找使用；带上缓存的hash，没有变化时服务器不再返回整个列表
+        qint64 hash = 0;
+        QByteArray data;
+        m_mtprotoClient->getContacts(m_store->list(CONTACTS_LIST, &hash, &data) ? hash : 0);
+        
+        // 会话列表给出各频道的pts，落后的频道逐个补齐
+        hash = 0;
+        m_mtprotoClient->getDialogs(m_store->list(DIALOGS_LIST, &hash, &data) ? hash : 0);
     });
     
     connect(m_mtprotoClient, &MTProtoClient::authError, this, [this](const QString& error) {
@@ -38,25 +134,126 @@ TelegramClient::TelegramClient(QObject *parent)
         }
     );
     
+    connect(m_mtprotoClient, &MTProtoClient::historyReceived, this, &TelegramClient::onHistoryReceived);
+    connect(m_mtprotoClient, &MTProtoClient::peersReceived, this, &TelegramClient::onPeersReceived);
+    connect(m_mtprotoClient, &MTProtoClient::contactsReceived, this, &TelegramClient::onContactsReceived);
+    connect(m_mtprotoClient, &MTProtoClient::listNotModified, this, &TelegramClient::onListNotModified);
+    connect(m_updates, &UpdatesEngine::updatesReady, this, &TelegramClient::onUpdatesReady);
+    connect(m_mtprotoClient, &MTProtoClient::dialogsReceived, this, &TelegramClient::onDialogsReceived);
+    connect(m_catchUp, &CatchUpScheduler::channelDifferenceReady, this, &TelegramClient::onChannelDifferenceReady);
+    connect(m_workers, &UpdateWorkerPool::batchReady, this,
+        [this](int stream, quint64 batchId, const QVector<PreparedUpdate>& updates) {
+            if (stream == m_workerStream) {
+                onPreparedUpdates(batchId, updates);
+            }
+        });
+    connect(m_catchUp, &CatchUpScheduler::finished, this, [](int channelCount, qint64 elapsedMs) {
+        qDebug() << "频道补齐完成:" << channelCount << "个频道, 用时" << elapsedMs << "毫秒";
+    });
+    connect(m_updates, &UpdatesEngine::differenceTooLong, this, [this](const UpdatesState& state) {
+        qWarning() << "离线时间过长，本地缓存可能缺少部分更新，新的pts:" << state.pts;
+    });
+    
+    // 打开本地消息存储，失败时仍可在线使用
+    if (!m_store->open(m_configManager->dataDirectoryPath(m_accountId))) {
+        qWarning() << "无法打开本地消息存储，消息将只从服务器获取";
+    }
+    loadSearchIndex();
+    loadPeerIndex();
+    m_dialogViews->reset(m_store->dialogs());
+    
+    // 探测结果由所有账号共用，缓存在默认账号的会话目录中；先按缓存的结果选择地址
+    DcProber* prober = SharedRuntime::instance()->dcProber();
+    prober->start(QDir(m_configManager->dataDirectoryPath()).filePath("dc_latency.dat"));
+    m_mtprotoClient->setEndpoints(prober->rankedEndpoints());
+    connect(prober, &DcProber::probeFinished, this, [this, prober]() {
+        m_mtprotoClient->setEndpoints(prober->rankedEndpoints());
+    });
+    connect(m_mtprotoClient, &MTProtoClient::endpointFailed, prober, &DcProber::reportFailure);
+    
+    // 网络变化时主动重连，不需要重新登录
+    connect(SharedRuntime::instance(), &SharedRuntime::networkChanged,
+            m_mtprotoClient, &MTProtoClient::handleNetworkChange);
+    
     // 连接配置管理器信号
     connect(m_configManager, &ConfigManager::proxyConfigChanged, this, &TelegramClient::onProxyConfigChanged);
     
     // 加载配置
     loadSettings();
+    
+    SharedRuntime::instance()->accountCreated(m_accountId);
 }
 
 TelegramClient::~TelegramClient()
 {
     // 保存设置
     saveSettings();
+    
+    // 存储落盘后保存索引快照，两者长度一致下次启动才能直接加载
+    if (m_store->isOpen() && m_store->flush()) {
+        m_searchIndex.save(searchIndexPath(), m_store->fileSize());
+    }
+    
+    m_workers->closeStream(m_workerStream);
+    SharedRuntime::instance()->accountDestroyed(m_accountId);
+}
+
+QString TelegramClient::searchIndexPath() const
+{
+    return QDir(m_configManager->dataDirectoryPath(m_accountId)).filePath("search.idx");
+}
+
+void TelegramClient::loadSearchIndex()
+{
+    if (!m_store->isOpen()) {
+        return;
+    }
+    if (m_searchIndex.load(searchIndexPath(), m_store->fileSize())) {
+        qDebug() << "已加载搜索索引:" << m_searchIndex.documentCount() << "条消息";
+        return;
+    }
+    
+    // 快照缺失或与存储不一致（上次未正常退出），从存储重建
+    m_searchIndex.clear();
+    m_store->forEachMessage([this](const MessageData& message) {
+        m_searchIndex.addMessage(message);
+        return true;
+    });
+    qDebug() << "已重建搜索索引:" << m_searchIndex.documentCount() << "条消息,"
+             << m_searchIndex.termCount() << "个词项," << m_searchIndex.postingBytes() << "字节";
+}
+
+void TelegramClient::loadPeerIndex()
+{
+    if (!m_store->isOpen()) {
+        return;
+    }
+    const QVector<PeerData> peers = m_store->peers();
+    for (const PeerData& peer : peers) {
+        m_peerIndex.addPeer(peer);
+    }
+    qDebug() << "已加载联系人索引:" << m_peerIndex.peerCount() << "个联系人,"
+             << m_peerIndex.keyCount() << "个检索键";
+}
+
+void TelegramClient::storePeer(const PeerData& peer)
+{
+    m_store->putPeer(peer);
+    m_peerIndex.addPeer(peer);
+}
+
+void TelegramClient::storeDialog(const DialogData& dialog)
+{
+    m_store->putDialog(dialog);
+    m_dialogViews->apply(dialog);
 }
 
 void TelegramClient::loadSettings()
 {
     // 从配置管理器加载API凭据
-    m_apiId = m_configManager->apiId();
-    m_apiHash = m_configManager->apiHash();
-    m_phoneNumber = m_configManager->phoneNumber();
+    m_apiId = m_configManager->apiId(m_accountId);
+    m_apiHash = m_configManager->apiHash(m_accountId);
+    m_phoneNumber = m_configManager->phoneNumber(m_accountId);
     
     // 设置MTProto客户端的API凭据
     if (m_apiId > 0 && !m_apiHash.isEmpty()) {
@@ -70,9 +267,9 @@ void TelegramClient::loadSettings()
 void TelegramClient::saveSettings()
 {
     // 保存API凭据
-    m_configManager->setApiId(m_apiId);
-    m_configManager->setApiHash(m_apiHash);
-    m_configManager->setPhoneNumber(m_phoneNumber);
+    m_configManager->setApiId(m_apiId, m_accountId);
+    m_configManager->setApiHash(m_apiHash, m_accountId);
+    m_configManager->setPhoneNumber(m_phoneNumber, m_accountId);
     
     // 保存配置
     m_configManager->saveConfig();
@@ -104,11 +301,21 @@ void TelegramClient::setApiCredentials(int apiId, const QString& apiHash)
     m_mtprotoClient->setApiCredentials(apiId, apiHash);
     
     // 保存到配置
-    m_configManager->setApiId(apiId);
-    m_configManager->setApiHash(apiHash);
+    m_configManager->setApiId(apiId, m_accountId);
+    m_configManager->setApiHash(apiHash, m_accountId);
     m_configManager->saveConfig();
 }
 
+QString TelegramClient::accountId() const
+{
+    return m_accountId;
+}
+
+DialogViews* TelegramClient::dialogViews() const
+{
+    return m_dialogViews;
+}
+
 QString TelegramClient::phoneNumber() const
 {
     return m_phoneNumber;
@@ -160,7 +367,7 @@ void TelegramClient::sendAuthenticationCode(const QString& phoneNumber)
     m_mtprotoClient->sendAuthCode(phoneNumber);
     
     // 保存电话号码到配置
-    m_configManager->setPhoneNumber(phoneNumber);
+    m_configManager->setPhoneNumber(phoneNumber, m_accountId);
     m_configManager->saveConfig();
 }
 
@@ -178,6 +385,388 @@ void TelegramClient::getMe()
     }
 }
 
+void TelegramClient::requestHistory(qint64 peerId, qint32 offsetId, int limit)
+{
+    if (!m_isAuthorized) {
+        emit authorizationError("未授权，请先登录");
+        return;
+    }
+    
+    // 本地已有完整区间时直接从磁盘读取，异步发出信号以保持与网络请求一致的时序
+    if (m_store->hasHistory(peerId, offsetId, limit)) {
+        QVector<MessageData> messages = m_store->history(peerId, offsetId, limit);
+        int count = m_store->messageCount(peerId);
+        QMetaObject::invokeMethod(this, [this, peerId, offsetId, messages, count]() {
+            emit historyReceived(peerId, offsetId, messages, count);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    
+    m_mtprotoClient->getHistory(peerId, offsetId, limit);
+}
+
+void TelegramClient::onHistoryReceived(const TlHistory& history)
+{
+    qint64 peerId = history.peerId;
+    qint32 offsetId = history.offsetId;
+    int limit = history.limit;
+    QVector<MessageData> messages = history.promoteMessages();
+    
+    // 写入本地存储，并记录服务器确认的连续区间（返回数量不足说明已到最早的消息）
+    if (!messages.isEmpty()) {
+        m_store->putMessages(messages);
+        for (const MessageData& message : messages) {
+            m_searchIndex.addMessage(message);
+        }
+        
+        QSet<qint64> senders;
+        for (const MessageData& message : messages) {
+            if (message.fromId == 0 || senders.contains(message.fromId)) {
+                continue;
+            }
+            senders.insert(message.fromId);
+            
+            // 资料未变化时不重复写入
+            PeerData peer;
+            if (m_store->peer(message.fromId, &peer) && peer.firstName == message.fromName) {
+                continue;
+            }
+            peer.id = message.fromId;
+            peer.type = PeerData::User;
+            peer.firstName = message.fromName;
+            storePeer(peer);
+        }
+        
+        // 偏移超过服务器当前的最新消息时，更大的ID还不存在，不能记为已确认
+        qint32 serverTopId = qMax(history.count, messages.first().id);
+        qint32 maxId = offsetId > 0 ? qMin(offsetId - 1, serverTopId) : messages.first().id;
+        qint32 minId = messages.size() < limit ? 1 : messages.last().id;
+        m_store->addHistoryRange(peerId, minId, maxId);
+    } else if (offsetId > 0 && offsetId - 1 <= history.count) {
+        m_store->addHistoryRange(peerId, 1, offsetId - 1);
+    }
+    
+    emit historyReceived(peerId, offsetId, messages, history.count);
+}
+
+void TelegramClient::onPeersReceived(const QVector<PeerData>& peers)
+{
+    for (const PeerData& peer : peers) {
+        // 资料未变化时不重复写入
+        PeerData stored;
+        if (m_store->peer(peer.id, &stored) && samePeer(stored, peer)) {
+            continue;
+        }
+        storePeer(peer);
+    }
+}
+
+void TelegramClient::onContactsReceived(const QVector<PeerData>& users)
+{
+    onPeersReceived(users);
+    
+    // 缓存联系人ID和列表的hash，hash按ID从小到大计算
+    QVector<qint64> ids;
+    ids.reserve(users.size());
+    for (const PeerData& user : users) {
+        ids.append(user.id);
+    }
+    std::sort(ids.begin(), ids.end());
+    ListHash hash;
+    for (qint64 id : ids) {
+        hash.add(quint64(id));
+    }
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << ids;
+    m_store->putList(CONTACTS_LIST, hash.result(), data);
+}
+
+void TelegramClient::onListNotModified(const QString& method)
+{
+    qint64 hash = 0;
+    QByteArray data;
+    bool cached = m_store->list(method, &hash, &data);
+    
+    if (method == CONTACTS_LIST) {
+        // 联系人的资料已经在存储中，缺少任何一个时不带hash重新获取
+        QVector<qint64> ids;
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_6_0);
+        stream >> ids;
+        PeerData peer;
+        bool complete = cached && stream.status() == QDataStream::Ok;
+        for (int i = 0; complete && i < ids.size(); ++i) {
+            complete = m_store->peer(ids.at(i), &peer);
+        }
+        if (!complete) {
+            qWarning() << "联系人缓存不完整，重新获取";
+            m_mtprotoClient->getContacts();
+            return;
+        }
+        qDebug() << "联系人列表未变化，使用缓存:" << ids.size() << "个联系人";
+    } else if (method == DIALOGS_LIST) {
+        // 频道资料已经在存储中，按缓存的服务器状态检查各频道是否需要补齐
+        QVector<DialogData> dialogs;
+        if (!cached || !decodeDialogList(data, &dialogs)) {
+            qWarning() << "会话列表缓存损坏，重新获取";
+            m_mtprotoClient->getDialogs();
+            return;
+        }
+        qDebug() << "会话列表未变化，使用缓存:" << dialogs.size() << "个会话";
+        syncDialogs(dialogs);
+    }
+}
+
+void TelegramClient::onUpdatesReady(const QVector<UpdateData>& updates, const UpdatesState& state)
+{
+    // 编码和切分在工作线程中完成，状态随这一批在合并时写入
+    PendingBatch pending;
+    pending.state = state;
+    m_pendingBatches.insert(m_workers->submit(m_workerStream, updates), pending);
+}
+
+void TelegramClient::onDialogsReceived(const TlDialogs& dialogs)
+{
+    for (const TlPeer& chat : dialogs.chats) {
+        PeerData stored;
+        if (m_store->peer(chat.id, &stored) && chat.sameAs(stored)) {
+            continue;
+        }
+        storePeer(chat.promote());
+    }
+    
+    QVector<DialogData> serverDialogs;
+    serverDialogs.reserve(dialogs.dialogs.size());
+    for (const DialogData& dialog : dialogs.dialogs) {
+        serverDialogs.append(dialog);
+    }
+    m_store->putList(DIALOGS_LIST, dialogListHash(serverDialogs), encodeDialogList(serverDialogs));
+    syncDialogs(serverDialogs);
+}
+
+void TelegramClient::syncDialogs(const QVector<DialogData>& dialogs)
+{
+    for (const DialogData& dialog : dialogs) {
+        DialogData local;
+        if (!m_store->dialog(dialog.peerId, &local) || (dialog.pts > 0 && local.pts <= 0)) {
+            // 第一次见到的会话以服务器状态为起点，历史在打开时按需加载
+            storeDialog(dialog);
+            continue;
+        }
+        if (dialog.pts > local.pts) {
+            m_catchUp->enqueue(dialog.peerId, local.pts, dialog.unreadCount > 0);
+        }
+        // 会话在其他设备上移动了文件夹；消息和已读位置由补齐和更新推进
+        if (dialog.folderId != local.folderId) {
+            local.folderId = dialog.folderId;
+            storeDialog(local);
+        }
+    }
+    m_dialogViews->flush();
+}
+
+void TelegramClient::onChannelDifferenceReady(const ChannelDifference& difference)
+{
+    QVector<UpdateData> updates;
+    updates.reserve(difference.messages.size());
+    for (const MessageData& message : difference.messages) {
+        UpdateData update;
+        update.type = UpdateData::NewMessage;
+        update.peerId = message.peerId;
+        update.message = message;
+        updates.append(update);
+    }
+    
+    PendingBatch pending;
+    pending.channelId = difference.channelId;
+    pending.channelPts = difference.pts;
+    pending.channelTooLong = difference.kind == ChannelDifference::TooLong;
+    m_pendingBatches.insert(m_workers->submit(m_workerStream, updates), pending);
+}
+
+void TelegramClient::onPreparedUpdates(quint64 batchId, const QVector<PreparedUpdate>& updates)
+{
+    const PendingBatch pending = m_pendingBatches.take(batchId);
+    
+    QVector<MessageData> newMessages;
+    QHash<qint64, DialogData> dialogs;
+    // 只有新消息会建立会话，其他更新遇到存储中没有的会话时返回空指针
+    auto dialogFor = [this, &dialogs](qint64 peerId, bool create) -> DialogData* {
+        auto it = dialogs.find(peerId);
+        if (it == dialogs.end()) {
+            DialogData dialog;
+            if (!m_store->dialog(peerId, &dialog)) {
+                if (!create) {
+                    return nullptr;
+                }
+                dialog.peerId = peerId;
+            }
+            it = dialogs.insert(peerId, dialog);
+        }
+        return &*it;
+    };
+    
+    for (const PreparedUpdate& prepared : updates) {
+        const UpdateData& update = prepared.update;
+        switch (update.type) {
+        case UpdateData::NewMessage: {
+            const MessageData& message = update.message;
+            m_store->putEncodedMessage(message, prepared.record);
+            m_searchIndex.addTokenizedMessage(message, prepared.terms);
+            
+            // 更新按序到达，与本地已有的连续区间相接时延长区间
+            if (m_store->hasHistory(message.peerId, message.id, 1)) {
+                m_store->addHistoryRange(message.peerId, message.id, message.id);
+            }
+            
+            DialogData* dialog = dialogFor(message.peerId, true);
+            if (message.id > dialog->topMessageId) {
+                dialog->topMessageId = message.id;
+                ++dialog->unreadCount;
+            }
+            newMessages.append(message);
+            break;
+        }
+        case UpdateData::EditMessage:
+            m_store->putEncodedMessage(update.message, prepared.record);
+            m_searchIndex.addTokenizedMessage(update.message, prepared.terms);
+            emit messageEdited(update.message);
+            break;
+        case UpdateData::DeleteMessages: {
+            // 已读位置之后被删除的消息不再计入未读
+            DialogData* dialog = dialogFor(update.peerId, false);
+            for (qint32 id : update.messageIds) {
+                m_store->removeMessage(update.peerId, id);
+                m_searchIndex.removeMessage(update.peerId, id);
+                if (dialog && id > dialog->readInboxMaxId && id <= dialog->topMessageId && dialog->unreadCount > 0) {
+                    --dialog->unreadCount;
+                }
+            }
+            emit messagesDeleted(update.peerId, update.messageIds);
+            break;
+        }
+        case UpdateData::ReadHistoryInbox:
+            if (DialogData* dialog = dialogFor(update.peerId, false)) {
+                readInboxUpTo(dialog, update.maxId);
+            }
+            break;
+        }
+    }
+    
+    if (pending.channelId != 0) {
+        // 频道差异中的消息是服务器上连续的一段，TooLong时与本地已有区间之间可能有空隙
+        if (DialogData* dialog = dialogFor(pending.channelId, false)) {
+            dialog->pts = qMax(dialog->pts, pending.channelPts);
+        }
+        if (pending.channelTooLong && !newMessages.isEmpty()) {
+            m_store->addHistoryRange(pending.channelId, newMessages.first().id, newMessages.last().id);
+        }
+    }
+    
+    for (const DialogData& dialog : std::as_const(dialogs)) {
+        storeDialog(dialog);
+    }
+    m_dialogViews->flush();
+    
+    // 状态与这批更新写入同一批次，崩溃后最多重复应用，不会遗漏
+    if (pending.state.isValid()) {
+        m_store->putUpdatesState(pending.state);
+    }
+    
+    if (!newMessages.isEmpty()) {
+        emit newMessagesReceived(newMessages);
+    }
+}
+
+void TelegramClient::setVisiblePeer(qint64 peerId)
+{
+    m_catchUp->setVisibleChannel(peerId);
+}
+
+void TelegramClient::notifyUserActivity()
+{
+    m_catchUp->pauseForInteraction();
+}
+
+void TelegramClient::markHistoryRead(qint64 peerId, qint32 maxId)
+{
+    if (!m_isAuthorized || peerId == 0 || maxId <= 0) {
+        return;
+    }
+    m_mtprotoClient->markRead(peerId, maxId);
+    
+    // 本地的已读位置立即前进，角标不等服务器；每次绘制都会调用，先按上次的位置过滤
+    if (maxId <= m_readMarks.value(peerId, 0)) {
+        return;
+    }
+    m_readMarks.insert(peerId, maxId);
+    DialogData dialog;
+    if (m_store->dialog(peerId, &dialog) && readInboxUpTo(&dialog, maxId)) {
+        storeDialog(dialog);
+        m_dialogViews->flush();
+    }
+}
+
+void TelegramClient::setTyping(qint64 peerId, const QString& action)
+{
+    if (m_isAuthorized && peerId != 0) {
+        m_mtprotoClient->setTyping(peerId, action);
+    }
+}
+
+void TelegramClient::setOnline(bool online)
+{
+    if (m_isAuthorized) {
+        m_mtprotoClient->setOnline(online);
+    }
+}
+
+void TelegramClient::searchPeers(const QString& query, int limit)
+{
+    QVector<PeerData> peers;
+    const QVector<PeerSearchIndex::Result> results = m_peerIndex.search(query, limit);
+    peers.reserve(results.size());
+    for (const PeerSearchIndex::Result& result : results) {
+        peers.append(m_peerIndex.peer(result.peerId));
+    }
+    emit peerSearchResultsReady(query, peers);
+}
+
+void TelegramClient::searchMessages(const QString& query, int limit)
+{
+    QVector<MessageData> results;
+    
+    // 索引给出的是候选，逐条用原文确认每个关键词都出现
+    const QStringList keywords = query.split(' ', Qt::SkipEmptyParts);
+    const QVector<MessageSearchIndex::Hit> hits = m_searchIndex.search(query, limit * 4);
+    for (const MessageSearchIndex::Hit& hit : hits) {
+        MessageData message;
+        if (!m_store->message(hit.peerId, hit.messageId, &message)) {
+            continue;
+        }
+        bool matched = true;
+        for (const QString& keyword : keywords) {
+            if (!message.text.contains(keyword, Qt::CaseInsensitive)) {
+                matched = false;
+                break;
+            }
+        }
+        if (matched) {
+            results.append(message);
+            if (results.size() >= limit) {
+                break;
+            }
+        }
+    }
+    
+    std::sort(results.begin(), results.end(), [](const MessageData& a, const MessageData& b) {
+        return a.date > b.date;
+    });
+    emit searchResultsReady(query, results);
+}
+
 void TelegramClient::checkTlsSupport()
 {
     if (!QSslSocket::supportsSsl()) {
@@ -9,6 +9,15 @@
 
 #include "mtproto/mtproto_client.h"
 #include "config_manager.h"
+#include "telegram_types.h"
+#include "message_store.h"
+#include "search_index.h"
+#include "peer_search_index.h"
+#include "updates_engine.h"
+#include "catch_up_scheduler.h"
+#include "dialog_views.h"
+#include "update_worker_pool.h"
+#include "shared_runtime.h"
 
 class TelegramClient : public QObject
 {
@@ -16,7 +25,12 @@ class TelegramClient : public QObject
 
 public:
     explicit TelegramClient(QObject *parent = nullptr);
+    
+    // accountId为配置中的账号命名空间，空字符串为默认账号
+    TelegramClient(const QString& accountId, QObject *parent);
     ~TelegramClient();
+    
+    QString accountId() const;
 
     // 加载设置
     void loadSettings();
@@ -41,9 +55,32 @@ public:
     void sendAuthenticationCode(const QString& phoneNumber);
     void signIn(const QString& phoneNumber, const QString& phoneCodeHash, const QString& code);
     void getMe();
+    
+    // 消息历史
+    void requestHistory(qint64 peerId, qint32 offsetId, int limit);
+    
+    // 在本地缓存的消息中搜索，结果按时间从新到旧
+    void searchMessages(const QString& query, int limit);
+    
+    // 按名称、用户名或拼音查找联系人和会话，用于快速切换
+    void searchPeers(const QString& query, int limit);
+    
+    // 界面正在查看的会话，频道补齐时优先处理
+    void setVisiblePeer(qint64 peerId);
+    
+    // 用户滚动或输入时调用，后台补齐短暂让路
+    void notifyUserActivity();
+    
+    // 已读位置、输入状态和在线状态，可以频繁调用，发送前会合并
+    void markHistoryRead(qint64 peerId, qint32 maxId);
+    void setTyping(qint64 peerId, const QString& action = QStringLiteral("typing"));
+    void setOnline(bool online);
 
     bool isAuthorized() const;
     QString phoneCodeHash() const;
+    
+    // 各文件夹的会话和未读计数，随更新增量维护
+    DialogViews* dialogViews() const;
 
 signals:
     // 登录状态信号
@@ -54,18 +91,80 @@ signals:
     
     // 用户信息信号
     void userInfoReceived(const QString& username, const QString& firstName, const QString& lastName);
+    
+    // 消息信号
+    void historyReceived(qint64 peerId, qint32 offsetId, const QVector<MessageData>& messages, int totalCount);
+    void messageEdited(const MessageData& message);
+    void newMessagesReceived(const QVector<MessageData>& messages);
+    void messagesDeleted(qint64 peerId, const QVector<qint32>& messageIds);
+    void searchResultsReady(const QString& query, const QVector<MessageData>& messages);
+    void peerSearchResultsReady(const QString& query, const QVector<PeerData>& peers);
 
 private slots:
     // 设置变化响应槽
     void onProxyConfigChanged();
+    
+    // 服务器返回消息历史，复制出的消息写入存储并交给界面
+    void onHistoryReceived(const TlHistory& history);
+    
+    // 服务器返回用户、群组资料
+    void onPeersReceived(const QVector<PeerData>& peers);
+    
+    // 联系人列表，资料写入存储，列表和hash缓存供下次请求使用
+    void onContactsReceived(const QVector<PeerData>& users);
+    
+    // 带hash的列表请求没有变化，改用缓存的结果
+    void onListNotModified(const QString& method);
+    
+    // 更新引擎按序交付的一批更新
+    void onUpdatesReady(const QVector<UpdateData>& updates, const UpdatesState& state);
+    
+    // 会话列表，只复制有变化的频道资料；频道pts落后时加入补齐队列
+    void onDialogsReceived(const TlDialogs& dialogs);
+    void onChannelDifferenceReady(const ChannelDifference& difference);
+    
+    // 工作线程准备好的一批更新，按提交顺序写入存储和索引
+    void onPreparedUpdates(quint64 batchId, const QVector<PreparedUpdate>& updates);
 
 private:
+    // 账号命名空间
+    QString m_accountId;
+    
     // 核心MTProto客户端
     MTProtoClient* m_mtprotoClient;
     
     // 配置管理器
     ConfigManager* m_configManager;
     
+    // 本地消息存储
+    MessageStore* m_store;
+    
+    // 更新同步
+    UpdatesEngine* m_updates;
+    CatchUpScheduler* m_catchUp;
+    
+    // 会话列表的增量视图，以及本地标记过的已读位置
+    DialogViews* m_dialogViews;
+    QHash<qint64, qint32> m_readMarks;
+    
+    // 更新的并行准备，以及每一批合并时要一并写入的状态
+    struct PendingBatch
+    {
+        UpdatesState state;         // 来自更新引擎时有效
+        qint64 channelId = 0;       // 来自频道补齐时非0
+        qint32 channelPts = 0;
+        bool channelTooLong = false;
+    };
+    UpdateWorkerPool* m_workers;    // 所有账号共用
+    int m_workerStream;
+    QHash<quint64, PendingBatch> m_pendingBatches;
+    
+    // 本地全文索引
+    MessageSearchIndex m_searchIndex;
+    
+    // 联系人和会话名称索引
+    PeerSearchIndex m_peerIndex;
+    
     // API凭据
     int m_apiId;
     QString m_apiHash;
@@ -82,4 +181,12 @@ private:
     void checkTlsSupport();
     void loadApiCredentialsFromConfig();
     void loadProxySettingsFromConfig();
+    void loadSearchIndex();
+    void loadPeerIndex();
+    void storePeer(const PeerData& peer);
+    void storeDialog(const DialogData& dialog);
+    QString searchIndexPath() const;
+    
+    // 按服务器的会话状态写入新会话，pts落后的频道加入补齐队列
+    void syncDialogs(const QVector<DialogData>& dialogs);
 }; 
\ No newline at end of file
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <QMetaType>
+
+/**
+ * @brief 单条消息的数据
+ *
+ * 由MTProto层解析服务器响应后生成，在核心层与界面之间传递
+ */
+struct MessageData
+{
+    qint64 peerId = 0;      // 所属会话
+    qint32 id = 0;          // 消息ID（会话内递增），0表示空位
+    qint32 date = 0;        // 发送时间（Unix时间戳）
+    qint32 editDate = 0;    // 最后编辑时间，未编辑为0
+    qint64 fromId = 0;      // 发送者
+    QString fromName;       // 发送者显示名
+    QString text;           // 消息正文
+};
+
+/**
+ * @brief 会话列表中的一项
+ */
+struct DialogData
+{
+    qint64 peerId = 0;
+    qint32 topMessageId = 0;    // 最新消息ID
+    qint32 readInboxMaxId = 0;  // 已读的最大消息ID
+    qint32 unreadCount = 0;
+    qint32 folderId = 0;        // 所属文件夹，0为主列表
+    bool pinned = false;
+    qint32 pts = 0;             // 频道自己的更新序号，其他会话为0
+};
+
+/**
+ * @brief 用户、群组或频道的基本资料
+ */
+struct PeerData
+{
+    enum Type {
+        User = 0,
+        Chat = 1,
+        Channel = 2
+    };
+
+    qint64 id = 0;
+    Type type = User;
+    QString title;          // 群组/频道名称
+    QString username;
+    QString firstName;
+    QString lastName;
+};
+
+/**
+ * @brief 更新序列的同步状态
+ *
+ * pts为普通会话的更新序号，qts为加密会话和机器人更新的序号，
+ * seq为更新容器的序号，date为服务器时间
+ */
+struct UpdatesState
+{
+    qint32 pts = 0;
+    qint32 qts = 0;
+    qint32 seq = 0;
+    qint32 date = 0;
+
+    bool isValid() const { return pts > 0; }
+};
+
+/**
+ * @brief 服务器推送或差异响应中的一条更新
+ */
+struct UpdateData
+{
+    enum Type {
+        NewMessage = 0,
+        EditMessage = 1,
+        DeleteMessages = 2,
+        ReadHistoryInbox = 3
+    };
+
+    Type type = NewMessage;
+    qint32 pts = 0;             // 应用后的pts，0表示不带pts
+    qint32 ptsCount = 0;        // 本条更新占用的pts数量
+    qint32 qts = 0;             // 应用后的qts，0表示不带qts
+    MessageData message;        // 新消息或编辑后的消息
+    qint64 peerId = 0;          // 删除消息、已读所在的会话
+    QVector<qint32> messageIds; // 被删除的消息
+    qint32 maxId = 0;           // 已读到的消息ID
+};
+
+/**
+ * @brief 一个更新容器，对应服务器的updates/updatesCombined
+ *
+ * seq为0表示容器不参与seq排序
+ */
+struct UpdatesBatch
+{
+    qint32 seqStart = 0;
+    qint32 seq = 0;
+    qint32 date = 0;
+    QVector<UpdateData> updates;
+};
+
+/**
+ * @brief updates.getDifference 的结果
+ */
+struct UpdatesDifference
+{
+    enum Kind {
+        Empty = 0,      // 没有遗漏
+        Complete = 1,   // 已返回全部遗漏，state为最新状态
+        Slice = 2,      // 只返回一部分，state为中间状态，需要继续获取
+        TooLong = 3     // 遗漏过多，只返回最新的pts，本地需要重新加载
+    };
+
+    Kind kind = Empty;
+    QVector<UpdateData> updates;
+    UpdatesState state;
+};
+
+/**
+ * @brief updates.getChannelDifference 的结果
+ *
+ * 频道的更新不走公共pts，每个频道单独维护自己的pts
+ */
+struct ChannelDifference
+{
+    enum Kind {
+        Empty = 0,      // 没有遗漏
+        Complete = 1,   // 返回了pts之后的一段遗漏
+        TooLong = 2     // 遗漏过多，只返回最新的一段消息
+    };
+
+    Kind kind = Empty;
+    qint64 channelId = 0;
+    qint32 pts = 0;                 // 应用后频道的pts
+    bool isFinal = true;            // 为false时还有遗漏，需要继续获取
+    QVector<MessageData> messages;  // 按ID升序
+};
+
+/**
+ * @brief 列表请求（联系人、会话列表等）的hash
+ *
+ * 与服务器使用同样的算法依次混入列表中的值，列表不变时hash不变。
+ * 刷新时带上上次结果的hash，服务器的列表没有变化时只回复NotModified
+ */
+struct ListHash
+{
+    quint64 value = 0;
+
+    void add(quint64 item)
+    {
+        value ^= value >> 21;
+        value ^= value << 35;
+        value ^= value >> 4;
+        value += item;
+    }
+    qint64 result() const { return qint64(value); }
+};
+
+Q_DECLARE_METATYPE(MessageData)
+Q_DECLARE_METATYPE(DialogData)
+Q_DECLARE_METATYPE(PeerData)
+Q_DECLARE_METATYPE(UpdatesState)
+Q_DECLARE_METATYPE(UpdateData)
+Q_DECLARE_METATYPE(UpdatesBatch)
+Q_DECLARE_METATYPE(UpdatesDifference)
+Q_DECLARE_METATYPE(ChannelDifference)
@@ -0,0 +1,439 @@
+#include "transport_benchmark.h"
+#include "shared_runtime.h"
+#include <QDebug>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QRandomGenerator>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+#include <algorithm>
+
+namespace {
+
+// 单条消息超过这个时间没有回显时结束当前模式
+const int ECHO_TIMEOUT_MS = 10000;
+
+// HTTP请求头的长度上限
+const int MAX_HTTP_HEADER_SIZE = 64 * 1024;
+
+const char BENCHMARK_HOST[] = "127.0.0.1";
+
+// 上传的分片大小和同时未确认的分片数；分片越小，交互消息在套接字中等待的数据越少
+const int UPLOAD_PART_SIZE = 128 * 1024;
+const int UPLOAD_WINDOW = 16;
+
+// 上传分片以这个标记开头，服务器只回复确认，不回显
+const char UPLOAD_MARKER[] = "UPLD";
+const char UPLOAD_ACK[] = "ACK!";
+
+// 文件分片使用的数据中心
+const int FILE_DC_ID = 2;
+
+bool isUploadPart(const QByteArray& packet)
+{
+    return packet.size() >= UPLOAD_PART_SIZE && packet.startsWith(UPLOAD_MARKER);
+}
+
+qint64 percentile(QVector<qint64> values, int percent)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    int index = qMin(int(values.size()) - 1, int(values.size()) * percent / 100);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values.at(index);
+}
+
+} // namespace
+
+TransportBenchmark::TransportBenchmark(const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_modeIndex(0)
+    , m_server(new QTcpServer(this))
+    , m_serverBytesIn(0)
+    , m_serverBytesOut(0)
+    , m_transport(nullptr)
+    , m_http(nullptr)
+    , m_pool(nullptr)
+    , m_uploadSent(0)
+    , m_uploadAcked(0)
+    , m_partsInFlight(0)
+    , m_sent(0)
+    , m_sentAtNs(0)
+    , m_totalLatencyNs(0)
+    , m_startCpuUs(0)
+{
+    const TransportCodec::Framing framings[] = {
+        TransportCodec::Abridged, TransportCodec::Intermediate, TransportCodec::PaddedIntermediate
+    };
+    for (bool obfuscated : { false, true }) {
+        for (TransportCodec::Framing framing : framings) {
+            Mode mode;
+            mode.framing = framing;
+            mode.obfuscated = obfuscated;
+            m_modes.append(mode);
+        }
+    }
+    Mode http;
+    http.http = true;
+    m_modes.append(http);
+    
+    if (m_options.uploadBytes > 0) {
+        // 不上传时的延迟作为基准，其余三种方式都边上传边往返
+        Mode idle;
+        idle.qos = true;
+        m_modes.append(idle);
+        Mode fifo = idle;
+        fifo.upload = true;
+        fifo.fairQueuing = false;
+        m_modes.append(fifo);
+        Mode fair = idle;
+        fair.upload = true;
+        m_modes.append(fair);
+        Mode pooled = fair;
+        pooled.fileConnection = true;
+        m_modes.append(pooled);
+    }
+
+    m_timeout.setSingleShot(true);
+    m_timeout.setInterval(ECHO_TIMEOUT_MS);
+    connect(&m_timeout, &QTimer::timeout, this, [this]() {
+        finishMode(false);
+    });
+    connect(m_server, &QTcpServer::newConnection, this, &TransportBenchmark::onServerConnection);
+}
+
+void TransportBenchmark::start()
+{
+    // abridged以4字节为单位记录长度，消息长度取4的倍数
+    int size = qMax(4, (m_options.payloadSize + 3) / 4 * 4);
+    m_payload.resize(size);
+    QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(m_payload.data()), size / 4);
+
+    if (!m_server->listen(QHostAddress::LocalHost, 0)) {
+        qCritical() << "传输基准测试无法监听本地端口:" << m_server->errorString();
+        // 此时事件循环还没有开始，推迟发出结束信号
+        QMetaObject::invokeMethod(this, &TransportBenchmark::finished, Qt::QueuedConnection);
+        return;
+    }
+    qInfo().noquote() << QString("传输基准测试：每种方式往返 %1 条 %2 字节的消息")
+        .arg(m_options.messages).arg(m_payload.size());
+    if (m_options.uploadBytes > 0) {
+        m_uploadPart = QByteArray(UPLOAD_PART_SIZE, '\0');
+        m_uploadPart.replace(0, int(sizeof(UPLOAD_MARKER)) - 1, UPLOAD_MARKER);
+        qInfo().noquote() << QString("带宽调度：上传 %1 MB（分片 %2 KB，限速 %3）时交互消息的往返延迟")
+            .arg(m_options.uploadBytes / 1024 / 1024)
+            .arg(UPLOAD_PART_SIZE / 1024)
+            .arg(m_options.bulkRateLimit > 0
+                 ? QString("%1 MB/s").arg(m_options.bulkRateLimit / 1024.0 / 1024.0, 0, 'f', 1)
+                 : QString("无"));
+    }
+    startMode();
+}
+
+void TransportBenchmark::startMode()
+{
+    const Mode& mode = m_modes.at(m_modeIndex);
+    m_serverBytesIn = 0;
+    m_serverBytesOut = 0;
+    m_sent = 0;
+    m_totalLatencyNs = 0;
+    m_latenciesNs.clear();
+    m_uploadSent = 0;
+    m_uploadAcked = 0;
+    m_partsInFlight = 0;
+    m_startCpuUs = SharedRuntime::cpuTimeMicroseconds();
+    m_clock.start();
+
+    if (mode.http) {
+        if (!m_http) {
+            m_http = new QNetworkAccessManager(this);
+        }
+        sendNext();
+        return;
+    }
+    
+    if (mode.qos) {
+        // 不混淆，避免加密的开销掩盖排队的影响
+        m_pool = new TransportPool(TransportCodec::Intermediate, false, this);
+        m_pool->setFairQueuing(mode.fairQueuing);
+        m_pool->setBulkRateLimit(m_options.bulkRateLimit);
+        if (mode.fileConnection) {
+            m_pool->addFileEndpoint(FILE_DC_ID, BENCHMARK_HOST, m_server->serverPort());
+        }
+        connect(m_pool, &TransportPool::connected, this, [this]() {
+            sendUploadParts();
+            sendNext();
+        });
+        connect(m_pool, &TransportPool::packetReceived, this, &TransportBenchmark::onEcho);
+        connect(m_pool, &TransportPool::errorOccurred, this, [this](const QString& error) {
+            qWarning() << "传输错误:" << error;
+            finishMode(false);
+        });
+        m_timeout.start();
+        m_pool->connectToHost(BENCHMARK_HOST, m_server->serverPort());
+        return;
+    }
+
+    m_transport = new TcpTransport(mode.framing, mode.obfuscated, this);
+    connect(m_transport, &TcpTransport::connected, this, &TransportBenchmark::sendNext);
+    connect(m_transport, &TcpTransport::packetReceived, this, &TransportBenchmark::onEcho);
+    connect(m_transport, &TcpTransport::errorOccurred, this, [this](const QString& error) {
+        qWarning() << "传输错误:" << error;
+        finishMode(false);
+    });
+    m_timeout.start();
+    m_transport->connectToHost(BENCHMARK_HOST, m_server->serverPort());
+}
+
+void TransportBenchmark::sendNext()
+{
+    m_sentAtNs = m_clock.nsecsElapsed();
+    m_timeout.start();
+    if (m_transport) {
+        m_transport->send(m_payload);
+        return;
+    }
+    if (m_pool) {
+        m_pool->send(m_payload, BandwidthScheduler::Interactive);
+        return;
+    }
+
+    QNetworkRequest request(QUrl(QString("http://%1:%2/api").arg(BENCHMARK_HOST).arg(m_server->serverPort())));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    QNetworkReply* reply = m_http->post(request, m_payload);
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError) {
+            qWarning() << "HTTP请求失败:" << reply->errorString();
+            finishMode(false);
+            return;
+        }
+        onEcho(reply->readAll());
+    });
+}
+
+void TransportBenchmark::onEcho(const QByteArray& payload)
+{
+    if (m_pool && payload == UPLOAD_ACK) {
+        onUploadAck();
+        return;
+    }
+    
+    // 超时后才到达的回显不再计入
+    if (!m_timeout.isActive()) {
+        return;
+    }
+    m_timeout.stop();
+    if (payload != m_payload) {
+        qWarning() << "回显的数据与发送的不一致";
+        finishMode(false);
+        return;
+    }
+
+    qint64 latencyNs = m_clock.nsecsElapsed() - m_sentAtNs;
+    m_totalLatencyNs += latencyNs;
+    m_latenciesNs.append(latencyNs);
+    
+    // 上传时一直往返到上传完成
+    const Mode& mode = m_modes.at(m_modeIndex);
+    if (++m_sent >= m_options.messages && !mode.upload) {
+        finishMode(true);
+        return;
+    }
+    sendNext();
+}
+
+void TransportBenchmark::sendUploadParts()
+{
+    const Mode& mode = m_modes.at(m_modeIndex);
+    if (!mode.upload) {
+        return;
+    }
+    while (m_partsInFlight < UPLOAD_WINDOW && m_uploadSent < m_options.uploadBytes) {
+        m_pool->send(m_uploadPart, BandwidthScheduler::Bulk, mode.fileConnection ? FILE_DC_ID : 0);
+        m_uploadSent += m_uploadPart.size();
+        ++m_partsInFlight;
+    }
+}
+
+void TransportBenchmark::onUploadAck()
+{
+    --m_partsInFlight;
+    m_uploadAcked += m_uploadPart.size();
+    if (m_uploadAcked >= m_options.uploadBytes) {
+        finishMode(true);
+        return;
+    }
+    sendUploadParts();
+}
+
+QString TransportBenchmark::modeName(const Mode& mode) const
+{
+    if (mode.http) {
+        return "http";
+    }
+    if (!mode.qos) {
+        return TransportCodec::framingName(mode.framing, mode.obfuscated);
+    }
+    if (!mode.upload) {
+        return "不上传";
+    }
+    if (!mode.fairQueuing) {
+        return "按顺序发送";
+    }
+    return mode.fileConnection ? "加权公平排队+文件连接" : "加权公平排队";
+}
+
+void TransportBenchmark::finishMode(bool ok)
+{
+    m_timeout.stop();
+    const Mode& mode = m_modes.at(m_modeIndex);
+    QString name = modeName(mode);
+    if (!ok) {
+        qWarning().noquote() << QString("  %1: 在第 %2 条消息处失败").arg(name).arg(m_sent + 1);
+    } else if (mode.qos) {
+        double seconds = qMax<qint64>(1, m_clock.nsecsElapsed()) / 1e9;
+        qInfo().noquote() << QString("  %1: 往返 %2 条，p50 %3 微秒，p99 %4 微秒，最大 %5 微秒%6")
+            .arg(name, -16)
+            .arg(m_sent)
+            .arg(percentile(m_latenciesNs, 50) / 1000)
+            .arg(percentile(m_latenciesNs, 99) / 1000)
+            .arg(percentile(m_latenciesNs, 100) / 1000)
+            .arg(mode.upload
+                 ? QString("，上传 %1 MB/s").arg(m_uploadAcked / 1024.0 / 1024.0 / seconds, 0, 'f', 1)
+                 : QString());
+    } else {
+        // 线路字节包含连接握手和（HTTP的）请求头，按消息平均
+        int messages = qMax(1, m_sent);
+        double wireBytes = double(m_serverBytesIn + m_serverBytesOut) / messages;
+        qint64 cpuUs = SharedRuntime::cpuTimeMicroseconds() - m_startCpuUs;
+        qInfo().noquote() << QString("  %1: 每条消息线路字节 %2（开销 %3），平均往返 %4 微秒，每条消息CPU %5 微秒")
+            .arg(name, -24)
+            .arg(wireBytes, 0, 'f', 1)
+            .arg(wireBytes - 2.0 * m_payload.size(), 0, 'f', 1)
+            .arg(m_totalLatencyNs / messages / 1000)
+            .arg(cpuUs / messages);
+    }
+
+    if (m_transport) {
+        m_transport->disconnect(this);
+        m_transport->disconnectFromHost();
+        m_transport->deleteLater();
+        m_transport = nullptr;
+    }
+    if (m_pool) {
+        m_pool->disconnect(this);
+        m_pool->disconnectFromHost();
+        m_pool->deleteLater();
+        m_pool = nullptr;
+    }
+
+    if (++m_modeIndex >= m_modes.size()) {
+        emit finished();
+        return;
+    }
+    // 可能在传输对象的信号中调用，下一种方式推迟到事件循环中开始
+    QMetaObject::invokeMethod(this, &TransportBenchmark::startMode, Qt::QueuedConnection);
+}
+
+void TransportBenchmark::onServerConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket* socket = m_server->nextPendingConnection();
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        m_connections.insert(socket, ServerConnection());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            onServerReadyRead(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void TransportBenchmark::onServerReadyRead(QTcpSocket* socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || m_modeIndex >= m_modes.size()) {
+        return;
+    }
+    QByteArray data = socket->readAll();
+    m_serverBytesIn += data.size();
+    if (m_modes.at(m_modeIndex).http) {
+        serveHttp(socket, it.value(), data);
+    } else {
+        serveTransport(socket, it.value(), data);
+    }
+}
+
+void TransportBenchmark::serveTransport(QTcpSocket* socket, ServerConnection& connection, const QByteArray& data)
+{
+    QByteArray received = data;
+    if (!connection.handshaken) {
+        connection.buffer.append(data);
+        int consumed = connection.codec.acceptHandshake(connection.buffer);
+        if (consumed == 0) {
+            return;
+        }
+        if (consumed < 0) {
+            qWarning() << "无法识别的传输握手";
+            socket->abort();
+            return;
+        }
+        connection.handshaken = true;
+        received = connection.buffer.mid(consumed);
+        connection.buffer.clear();
+    }
+
+    QVector<QByteArray> packets;
+    if (!connection.codec.decode(received, &packets)) {
+        qWarning() << "服务器收到格式错误的数据";
+        socket->abort();
+        return;
+    }
+    for (const QByteArray& packet : std::as_const(packets)) {
+        // 上传分片只回复确认；padded intermediate的包末尾带有随机填充，按原始长度截取后回显
+        QByteArray reply = isUploadPart(packet) ? QByteArray(UPLOAD_ACK) : packet.left(m_payload.size());
+        m_serverBytesOut += socket->write(connection.codec.encode(reply));
+    }
+}
+
+void TransportBenchmark::serveHttp(QTcpSocket* socket, ServerConnection& connection, const QByteArray& data)
+{
+    connection.buffer.append(data);
+    for (;;) {
+        qsizetype headerEnd = connection.buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (connection.buffer.size() > MAX_HTTP_HEADER_SIZE) {
+                socket->abort();
+            }
+            return;
+        }
+
+        qint64 contentLength = 0;
+        const QList<QByteArray> lines = connection.buffer.left(headerEnd).split('\n');
+        for (const QByteArray& line : lines) {
+            qsizetype colon = line.indexOf(':');
+            if (colon > 0 && line.left(colon).trimmed().toLower() == "content-length") {
+                contentLength = line.mid(colon + 1).trimmed().toLongLong();
+            }
+        }
+        qsizetype requestSize = headerEnd + 4 + contentLength;
+        if (connection.buffer.size() < requestSize) {
+            return;
+        }
+
+        QByteArray body = connection.buffer.mid(headerEnd + 4, contentLength);
+        connection.buffer.remove(0, requestSize);
+        QByteArray response = "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: application/octet-stream\r\n"
+                              "Connection: keep-alive\r\n"
+                              "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+        m_serverBytesOut += socket->write(response + body);
+    }
+}
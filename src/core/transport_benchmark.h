@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <QVector>
+
+#include "mtproto/mtproto_transport.h"
+
+class QNetworkAccessManager;
+class QTcpServer;
+class QTcpSocket;
+
+/**
+ * @brief 比较各种TCP封装与HTTP传输开销的基准测试
+ *
+ * 在本机启动一个回显服务器，依次用abridged、intermediate、padded intermediate
+ * （各自带或不带混淆）和HTTP/1.1 keep-alive POST发送同样的消息并等待回显，
+ * 逐条串行往返。在服务器端统计线路上的字节数，输出每条消息的字节开销、
+ * 平均往返延迟和每条消息消耗的CPU时间。
+ * 指定上传大小时再测试带宽调度：交互消息持续往返的同时上传文件分片，比较不上传、
+ * 按顺序发送、加权公平排队以及文件分片走独立连接时交互消息往返延迟的p50和p99。
+ */
+class TransportBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        int messages = 2000;
+        int payloadSize = 256;
+        qint64 uploadBytes = 0;         // 0为不测试带宽调度
+        qint64 bulkRateLimit = 0;       // 上传的速率上限，每秒字节数
+    };
+
+    explicit TransportBenchmark(const Options& options, QObject* parent = nullptr);
+
+    void start();
+
+signals:
+    void finished();
+
+private:
+    struct Mode
+    {
+        bool http = false;
+        TransportCodec::Framing framing = TransportCodec::Intermediate;
+        bool obfuscated = false;
+        
+        // 带宽调度测试
+        bool qos = false;
+        bool upload = false;
+        bool fairQueuing = true;
+        bool fileConnection = false;
+    };
+
+    // 服务器端每个连接的状态
+    struct ServerConnection
+    {
+        TransportCodec codec;
+        bool handshaken = false;
+        QByteArray buffer;
+    };
+
+    void startMode();
+    void finishMode(bool ok);
+    void sendNext();
+    void onEcho(const QByteArray& payload);
+    void sendUploadParts();
+    void onUploadAck();
+    QString modeName(const Mode& mode) const;
+
+    void onServerConnection();
+    void onServerReadyRead(QTcpSocket* socket);
+    void serveTransport(QTcpSocket* socket, ServerConnection& connection, const QByteArray& data);
+    void serveHttp(QTcpSocket* socket, ServerConnection& connection, const QByteArray& data);
+
+    Options m_options;
+    QVector<Mode> m_modes;
+    int m_modeIndex;
+    QByteArray m_payload;
+
+    QTcpServer* m_server;
+    QHash<QTcpSocket*, ServerConnection> m_connections;
+    qint64 m_serverBytesIn;
+    qint64 m_serverBytesOut;
+
+    TcpTransport* m_transport;
+    QNetworkAccessManager* m_http;
+    
+    // 带宽调度测试
+    TransportPool* m_pool;
+    QByteArray m_uploadPart;
+    qint64 m_uploadSent;
+    qint64 m_uploadAcked;
+    int m_partsInFlight;
+    QVector<qint64> m_latenciesNs;
+
+    int m_sent;
+    QElapsedTimer m_clock;
+    qint64 m_sentAtNs;
+    qint64 m_totalLatencyNs;
+    qint64 m_startCpuUs;
+    QTimer m_timeout;
+};
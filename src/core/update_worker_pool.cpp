@@ -0,0 +1,213 @@
+#include "update_worker_pool.h"
+#include "message_store.h"
+#include "search_index.h"
+#include <QMutexLocker>
+
+namespace {
+
+// 工作线程上限，主线程还要负责写存储和界面
+const int MAX_WORKERS = 8;
+
+} // namespace
+
+UpdateWorkerPool::UpdateWorkerPool(QObject* parent)
+    : QObject(parent)
+    , m_stopping(false)
+    , m_stolen(0)
+    , m_nextStream(1)
+{
+    int count = qBound(1, QThread::idealThreadCount() - 1, MAX_WORKERS);
+    m_ready.resize(count);
+    for (int shard = 0; shard < count; ++shard) {
+        QThread* thread = QThread::create([this, shard]() {
+            workerLoop(shard);
+        });
+        thread->setObjectName(QStringLiteral("UpdateWorker%1").arg(shard));
+        thread->start();
+        m_threads.append(thread);
+    }
+}
+
+UpdateWorkerPool::~UpdateWorkerPool()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wakeup.wakeAll();
+    }
+    for (QThread* thread : std::as_const(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+int UpdateWorkerPool::workerCount() const
+{
+    return m_threads.size();
+}
+
+qint64 UpdateWorkerPool::stolenCount() const
+{
+    return m_stolen.loadRelaxed();
+}
+
+int UpdateWorkerPool::shardOf(const PeerKey& key) const
+{
+    quint64 hash = (quint64(key.second) + quint64(key.first) * 0xBF58476D1CE4E5B9ull) * 0x9E3779B97F4A7C15ull;
+    return int((hash >> 32) % quint64(m_ready.size()));
+}
+
+int UpdateWorkerPool::openStream()
+{
+    int stream = m_nextStream++;
+    m_streams.insert(stream, Stream());
+    return stream;
+}
+
+void UpdateWorkerPool::closeStream(int stream)
+{
+    m_streams.remove(stream);
+}
+
+quint64 UpdateWorkerPool::submit(int stream, const QVector<UpdateData>& updates)
+{
+    auto streamIt = m_streams.find(stream);
+    if (streamIt == m_streams.end()) {
+        return 0;
+    }
+    QSharedPointer<Batch> batch(new Batch);
+    batch->stream = stream;
+    batch->id = streamIt->nextBatchId++;
+    batch->items.resize(updates.size());
+
+    // 按会话分段，段内保持原来的顺序
+    QHash<qint64, QVector<int>> byPeer;
+    QVector<qint64> order;
+    for (int i = 0; i < updates.size(); ++i) {
+        batch->items[i].update = updates.at(i);
+        auto it = byPeer.find(updates.at(i).peerId);
+        if (it == byPeer.end()) {
+            order.append(updates.at(i).peerId);
+            it = byPeer.insert(updates.at(i).peerId, QVector<int>());
+        }
+        it->append(i);
+    }
+
+    if (order.isEmpty()) {
+        quint64 batchId = batch->id;
+        QMetaObject::invokeMethod(this, [this, stream, batchId]() {
+            deliver(stream, batchId, QVector<PreparedUpdate>());
+        }, Qt::QueuedConnection);
+        return batchId;
+    }
+
+    batch->remaining.storeRelease(order.size());
+    QMutexLocker locker(&m_mutex);
+    for (qint64 peerId : std::as_const(order)) {
+        const PeerKey key(stream, peerId);
+        PeerQueue& queue = m_peers[key];
+        queue.chunks.enqueue({ batch, byPeer.value(peerId) });
+        if (!queue.scheduled) {
+            queue.scheduled = true;
+            m_ready[shardOf(key)].push_back(key);
+        }
+    }
+    m_wakeup.wakeAll();
+    return batch->id;
+}
+
+bool UpdateWorkerPool::takePeer(int shard, PeerKey* key)
+{
+    std::deque<PeerKey>& own = m_ready[shard];
+    if (!own.empty()) {
+        *key = own.front();
+        own.pop_front();
+        return true;
+    }
+
+    // 自己的分片空了，从积压最多的分片尾部窃取
+    int victim = -1;
+    size_t longest = 0;
+    for (int i = 0; i < m_ready.size(); ++i) {
+        if (m_ready.at(i).size() > longest) {
+            longest = m_ready.at(i).size();
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return false;
+    }
+    *key = m_ready[victim].back();
+    m_ready[victim].pop_back();
+    m_stolen.fetchAndAddRelaxed(1);
+    return true;
+}
+
+void UpdateWorkerPool::workerLoop(int shard)
+{
+    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        PeerKey key;
+        while (!m_stopping && !takePeer(shard, &key)) {
+            m_wakeup.wait(&m_mutex);
+        }
+        if (m_stopping) {
+            return;
+        }
+
+        // 会话已标记为处理中，其他线程不会再取到它，解锁后按顺序处理一段
+        Chunk chunk = m_peers[key].chunks.dequeue();
+        locker.unlock();
+
+        for (int index : std::as_const(chunk.indices)) {
+            prepare(chunk.batch->items[index]);
+        }
+        bool batchDone = !chunk.batch->remaining.deref();
+
+        locker.relock();
+        auto it = m_peers.find(key);
+        if (it->chunks.isEmpty()) {
+            m_peers.erase(it);
+        } else {
+            // 还有后续的段，重新排到自己分片的末尾，让其他会话也有机会
+            m_ready[shardOf(key)].push_back(key);
+            m_wakeup.wakeOne();
+        }
+
+        if (batchDone) {
+            QSharedPointer<Batch> batch = chunk.batch;
+            QMetaObject::invokeMethod(this, [this, batch]() {
+                deliver(batch->stream, batch->id, QVector<PreparedUpdate>(batch->items.begin(), batch->items.end()));
+            }, Qt::QueuedConnection);
+        }
+    }
+}
+
+void UpdateWorkerPool::prepare(PreparedUpdate& item)
+{
+    const UpdateData& update = item.update;
+    if (update.type == UpdateData::NewMessage || update.type == UpdateData::EditMessage) {
+        item.record = MessageStore::encodeMessageRecord(update.message);
+        item.terms = MessageSearchIndex::tokenize(update.message.text);
+    }
+}
+
+void UpdateWorkerPool::deliver(int stream, quint64 batchId, const QVector<PreparedUpdate>& updates)
+{
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end()) {
+        return;
+    }
+    it->finished.insert(batchId, updates);
+    while (!it->finished.isEmpty() && it->finished.firstKey() == it->nextDelivery) {
+        quint64 id = it->nextDelivery++;
+        QVector<PreparedUpdate> ready = it->finished.take(id);
+        emit batchReady(stream, id, ready);
+
+        // 接收者可能在槽中关闭流或提交新的批次，重新查找
+        it = m_streams.find(stream);
+        if (it == m_streams.end()) {
+            return;
+        }
+    }
+}
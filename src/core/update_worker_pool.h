@@ -0,0 +1,119 @@
+#pragma once
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QMutex>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <deque>
+#include <vector>
+
+#include "telegram_types.h"
+
+/**
+ * @brief 在工作线程中准备好的一条更新
+ *
+ * record为编码好的存储记录，terms为切分好的检索词项，
+ * 主线程合并时只需追加记录和倒排表
+ */
+struct PreparedUpdate
+{
+    UpdateData update;
+    QByteArray record;
+    QStringList terms;
+};
+
+/**
+ * @brief 按会话分片的更新处理线程池
+ *
+ * 一批更新按会话拆成若干段，每个会话有自己的先进先出队列，同一时间只由一个工作线程消费，
+ * 因此同一会话的更新按到达顺序处理。会话按ID分配到各线程的就绪列表，
+ * 线程空闲时从最长的其他列表尾部窃取会话，热点会话集中在一个分片时其余线程不会闲着。
+ * 编码存储记录、切分检索词这类耗时的工作在线程中完成，
+ * 结果按提交顺序在主线程逐批交付，写存储和索引仍在主线程进行。
+ *
+ * 多个账号共用一个线程池，每个账号打开一个流，批次号和交付顺序按流独立计算，
+ * 不同账号中相同ID的会话互不影响。
+ */
+class UpdateWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UpdateWorkerPool(QObject* parent = nullptr);
+    ~UpdateWorkerPool();
+
+    // 每个使用者打开一个流，关闭后尚未交付的批次被丢弃
+    int openStream();
+    void closeStream(int stream);
+
+    // 提交一批更新，返回批次号，同一个流的批次按提交顺序交付
+    quint64 submit(int stream, const QVector<UpdateData>& updates);
+
+    int workerCount() const;
+    qint64 stolenCount() const;
+
+signals:
+    void batchReady(int stream, quint64 batchId, const QVector<PreparedUpdate>& updates);
+
+private:
+    // 会话在池中的键：流和会话ID
+    typedef QPair<int, qint64> PeerKey;
+
+    struct Batch
+    {
+        int stream = 0;
+        quint64 id = 0;
+        std::vector<PreparedUpdate> items;  // 各段写入互不重叠的位置
+        QAtomicInt remaining;
+    };
+
+    // 一个会话在一批中的更新
+    struct Chunk
+    {
+        QSharedPointer<Batch> batch;
+        QVector<int> indices;
+    };
+
+    struct PeerQueue
+    {
+        QQueue<Chunk> chunks;
+        bool scheduled = false;     // 已在就绪列表中或正在处理
+    };
+
+    // 主线程中每个流的交付状态
+    struct Stream
+    {
+        quint64 nextBatchId = 1;
+        quint64 nextDelivery = 1;
+        QMap<quint64, QVector<PreparedUpdate>> finished;
+    };
+
+    void workerLoop(int shard);
+    bool takePeer(int shard, PeerKey* key);
+    int shardOf(const PeerKey& key) const;
+    static void prepare(PreparedUpdate& item);
+    void deliver(int stream, quint64 batchId, const QVector<PreparedUpdate>& updates);
+
+    // 以下由m_mutex保护
+    QMutex m_mutex;
+    QWaitCondition m_wakeup;
+    bool m_stopping;
+    QHash<PeerKey, PeerQueue> m_peers;
+    QVector<std::deque<PeerKey>> m_ready;
+
+    QVector<QThread*> m_threads;
+    QAtomicInteger<qint64> m_stolen;
+
+    // 主线程：按流和批次号顺序交付
+    QHash<int, Stream> m_streams;
+    int m_nextStream;
+};
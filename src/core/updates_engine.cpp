@@ -0,0 +1,321 @@
+#include "updates_engine.h"
+#include <QDebug>
+
+namespace {
+
+// 缺口等待补齐的时间，超时后才获取差异
+const int GAP_TIMEOUT_MS = 500;
+
+// 两次差异请求的最小间隔，避免更新密集时反复请求
+const int MIN_DIFFERENCE_INTERVAL_MS = 1000;
+
+// 差异请求超过该时间没有响应时允许重新请求
+const int DIFFERENCE_TIMEOUT_MS = 10000;
+
+// 长时间没有收到更新时主动检查一次
+const int IDLE_DIFFERENCE_MS = 15 * 60 * 1000;
+
+// 缓存的乱序更新过多时不再等待，直接获取差异
+const int MAX_PENDING_UPDATES = 10000;
+
+} // namespace
+
+UpdatesEngine::UpdatesEngine(MTProtoClient* client, QObject* parent)
+    : QObject(parent)
+    , m_client(client)
+    , m_running(false)
+    , m_differenceInFlight(false)
+    , m_flushScheduled(false)
+{
+    m_gapTimer.setSingleShot(true);
+    m_gapTimer.setInterval(GAP_TIMEOUT_MS);
+    connect(&m_gapTimer, &QTimer::timeout, this, &UpdatesEngine::onGapTimeout);
+
+    m_differenceTimer.setSingleShot(true);
+    connect(&m_differenceTimer, &QTimer::timeout, this, &UpdatesEngine::requestDifference);
+
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(IDLE_DIFFERENCE_MS);
+    connect(&m_idleTimer, &QTimer::timeout, this, &UpdatesEngine::requestDifference);
+
+    connect(m_client, &MTProtoClient::updatesReceived, this, &UpdatesEngine::onUpdatesReceived);
+    connect(m_client, &MTProtoClient::updatesStateReceived, this, &UpdatesEngine::onStateReceived);
+    connect(m_client, &MTProtoClient::differenceReceived, this, &UpdatesEngine::onDifferenceReceived);
+}
+
+void UpdatesEngine::start(const UpdatesState& state)
+{
+    m_running = true;
+    m_state = state;
+    m_differenceInFlight = false;
+    m_lastDifference.invalidate();
+    clearPending();
+    m_idleTimer.start();
+
+    // 没有保存的状态时以服务器当前状态为起点，否则补齐离线期间的更新
+    if (!m_state.isValid()) {
+        m_client->getUpdatesState();
+    } else {
+        requestDifference();
+    }
+}
+
+void UpdatesEngine::stop()
+{
+    m_running = false;
+    m_differenceInFlight = false;
+    m_gapTimer.stop();
+    m_differenceTimer.stop();
+    m_idleTimer.stop();
+    clearPending();
+}
+
+bool UpdatesEngine::isRunning() const
+{
+    return m_running;
+}
+
+UpdatesState UpdatesEngine::state() const
+{
+    return m_state;
+}
+
+void UpdatesEngine::onUpdatesReceived(const UpdatesBatch& batch)
+{
+    // 等待初始状态期间收到的更新已包含在服务器返回的状态中
+    if (!m_running || !m_state.isValid()) {
+        return;
+    }
+    m_idleTimer.start();
+
+    applyBatch(batch);
+    drainPending();
+
+    if (m_pendingPts.size() + m_pendingQts.size() + m_pendingSeq.size() > MAX_PENDING_UPDATES) {
+        requestDifference();
+    }
+}
+
+void UpdatesEngine::onStateReceived(const UpdatesState& state)
+{
+    if (!m_running || m_state.isValid()) {
+        return;
+    }
+    m_state = state;
+    scheduleFlush();
+}
+
+void UpdatesEngine::applyBatch(const UpdatesBatch& batch)
+{
+    if (batch.seq == 0) {
+        for (const UpdateData& update : batch.updates) {
+            applyUpdate(update);
+        }
+        return;
+    }
+
+    qint32 seqStart = batch.seqStart > 0 ? batch.seqStart : batch.seq;
+    if (seqStart > m_state.seq + 1) {
+        // 前面的容器还没有到达
+        m_pendingSeq.insert(seqStart, batch);
+        if (!m_gapTimer.isActive()) {
+            m_gapTimer.start();
+        }
+        return;
+    }
+    if (seqStart < m_state.seq + 1) {
+        // 已经处理过的容器，带序号的更新由序号检查过滤，其余的丢弃
+        for (const UpdateData& update : batch.updates) {
+            if (update.pts > 0 || update.qts > 0) {
+                applyUpdate(update);
+            }
+        }
+        return;
+    }
+
+    for (const UpdateData& update : batch.updates) {
+        applyUpdate(update);
+    }
+    m_state.seq = batch.seq;
+    m_state.date = qMax(m_state.date, batch.date);
+    scheduleFlush();
+}
+
+void UpdatesEngine::applyUpdate(const UpdateData& update)
+{
+    if (update.pts > 0) {
+        qint32 before = update.pts - update.ptsCount;
+        if (before < m_state.pts) {
+            return;
+        }
+        if (before > m_state.pts) {
+            m_pendingPts.insert(before, update);
+            if (!m_gapTimer.isActive()) {
+                m_gapTimer.start();
+            }
+            return;
+        }
+        m_state.pts = update.pts;
+    } else if (update.qts > 0) {
+        qint32 before = update.qts - 1;
+        if (before < m_state.qts) {
+            return;
+        }
+        if (before > m_state.qts) {
+            m_pendingQts.insert(before, update);
+            if (!m_gapTimer.isActive()) {
+                m_gapTimer.start();
+            }
+            return;
+        }
+        m_state.qts = update.qts;
+    }
+    accept(update);
+}
+
+void UpdatesEngine::accept(const UpdateData& update)
+{
+    m_outgoing.append(update);
+    scheduleFlush();
+}
+
+void UpdatesEngine::drainPending()
+{
+    bool progressed = true;
+    while (progressed) {
+        progressed = false;
+        while (!m_pendingPts.isEmpty() && m_pendingPts.firstKey() <= m_state.pts) {
+            qint32 before = m_pendingPts.firstKey();
+            UpdateData update = m_pendingPts.take(before);
+            if (before == m_state.pts) {
+                m_state.pts = update.pts;
+                accept(update);
+            }
+            progressed = true;
+        }
+        while (!m_pendingQts.isEmpty() && m_pendingQts.firstKey() <= m_state.qts) {
+            qint32 before = m_pendingQts.firstKey();
+            UpdateData update = m_pendingQts.take(before);
+            if (before == m_state.qts) {
+                m_state.qts = update.qts;
+                accept(update);
+            }
+            progressed = true;
+        }
+        while (!m_pendingSeq.isEmpty() && m_pendingSeq.firstKey() <= m_state.seq + 1) {
+            applyBatch(m_pendingSeq.take(m_pendingSeq.firstKey()));
+            progressed = true;
+        }
+    }
+
+    if (!hasPending()) {
+        m_gapTimer.stop();
+    }
+}
+
+bool UpdatesEngine::hasPending() const
+{
+    return !m_pendingPts.isEmpty() || !m_pendingQts.isEmpty() || !m_pendingSeq.isEmpty();
+}
+
+void UpdatesEngine::clearPending()
+{
+    m_pendingPts.clear();
+    m_pendingQts.clear();
+    m_pendingSeq.clear();
+    m_gapTimer.stop();
+}
+
+void UpdatesEngine::onGapTimeout()
+{
+    if (hasPending()) {
+        qDebug() << "更新缺口未补齐，获取差异: pts" << m_state.pts << "seq" << m_state.seq;
+        requestDifference();
+    }
+}
+
+void UpdatesEngine::requestDifference()
+{
+    if (!m_running || !m_state.isValid()) {
+        return;
+    }
+    if (m_differenceInFlight && m_lastDifference.elapsed() < DIFFERENCE_TIMEOUT_MS) {
+        return;
+    }
+    if (m_lastDifference.isValid() && m_lastDifference.elapsed() < MIN_DIFFERENCE_INTERVAL_MS) {
+        if (!m_differenceTimer.isActive()) {
+            m_differenceTimer.start(MIN_DIFFERENCE_INTERVAL_MS - int(m_lastDifference.elapsed()));
+        }
+        return;
+    }
+
+    m_differenceInFlight = true;
+    m_lastDifference.start();
+    m_gapTimer.stop();
+    m_idleTimer.start();
+    m_client->getDifference(m_state);
+}
+
+void UpdatesEngine::onDifferenceReceived(const UpdatesDifference& difference)
+{
+    if (!m_running || !m_differenceInFlight) {
+        return;
+    }
+    m_differenceInFlight = false;
+
+    switch (difference.kind) {
+    case UpdatesDifference::Empty:
+        m_state.seq = difference.state.seq;
+        m_state.date = difference.state.date;
+        break;
+    case UpdatesDifference::Complete:
+    case UpdatesDifference::Slice:
+        // 差异中的更新已按序排列，跳过等待期间已经应用的部分
+        for (const UpdateData& update : difference.updates) {
+            if ((update.pts > 0 && update.pts <= m_state.pts) || (update.qts > 0 && update.qts <= m_state.qts)) {
+                continue;
+            }
+            accept(update);
+        }
+        m_state = difference.state;
+        break;
+    case UpdatesDifference::TooLong:
+        qWarning() << "遗漏的更新过多，从pts" << difference.state.pts << "重新开始";
+        clearPending();
+        m_state = difference.state;
+        emit differenceTooLong(m_state);
+        break;
+    }
+    scheduleFlush();
+
+    // 分片立即继续获取，不受请求间隔限制
+    if (difference.kind == UpdatesDifference::Slice) {
+        m_lastDifference.invalidate();
+        requestDifference();
+        return;
+    }
+
+    drainPending();
+    if (hasPending() && !m_gapTimer.isActive()) {
+        m_gapTimer.start();
+    }
+}
+
+void UpdatesEngine::scheduleFlush()
+{
+    if (m_flushScheduled) {
+        return;
+    }
+    m_flushScheduled = true;
+    QMetaObject::invokeMethod(this, [this]() {
+        flush();
+    }, Qt::QueuedConnection);
+}
+
+void UpdatesEngine::flush()
+{
+    m_flushScheduled = false;
+    QVector<UpdateData> updates;
+    updates.swap(m_outgoing);
+    emit updatesReady(updates, m_state);
+}
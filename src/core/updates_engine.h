@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTimer>
+#include <QVector>
+
+#include "mtproto/mtproto_client.h"
+#include "telegram_types.h"
+
+/**
+ * @brief 更新同步引擎
+ *
+ * 跟踪pts、qts、seq和date，按序号应用服务器推送的更新。
+ * 序号不连续的更新先缓存一小段时间等待补齐，缺口持续存在才调用
+ * updates.getDifference，同一时间最多一个差异请求，并限制请求频率。
+ * 应用后的更新在事件循环的下一轮批量发出，而不是每条一个信号。
+ */
+class UpdatesEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UpdatesEngine(MTProtoClient* client, QObject* parent = nullptr);
+
+    // 从保存的状态开始同步，状态无效时先向服务器获取当前状态
+    void start(const UpdatesState& state);
+    void stop();
+    bool isRunning() const;
+
+    UpdatesState state() const;
+
+signals:
+    // 一批按序应用的更新，以及应用后的状态
+    void updatesReady(const QVector<UpdateData>& updates, const UpdatesState& state);
+
+    // 遗漏过多，本地缓存需要重新从服务器加载
+    void differenceTooLong(const UpdatesState& state);
+
+private slots:
+    void onUpdatesReceived(const UpdatesBatch& batch);
+    void onStateReceived(const UpdatesState& state);
+    void onDifferenceReceived(const UpdatesDifference& difference);
+    void onGapTimeout();
+
+private:
+    void applyBatch(const UpdatesBatch& batch);
+    void applyUpdate(const UpdateData& update);
+    void accept(const UpdateData& update);
+
+    // 依次应用已经补齐的缓存更新
+    void drainPending();
+    bool hasPending() const;
+    void clearPending();
+
+    void requestDifference();
+    void scheduleFlush();
+    void flush();
+
+    MTProtoClient* m_client;
+    UpdatesState m_state;
+    bool m_running;
+
+    // 等待补齐的更新，按应用前应有的序号索引
+    QMap<qint32, UpdateData> m_pendingPts;
+    QMap<qint32, UpdateData> m_pendingQts;
+    QMap<qint32, UpdatesBatch> m_pendingSeq;
+    QTimer m_gapTimer;
+
+    // 差异请求
+    bool m_differenceInFlight;
+    QElapsedTimer m_lastDifference;
+    QTimer m_differenceTimer;
+    QTimer m_idleTimer;
+
+    // 待发出的批次
+    QVector<UpdateData> m_outgoing;
+    bool m_flushScheduled;
+};
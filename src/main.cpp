@@ -1,10 +1,22 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QLoggingCategory>
 #include <QDebug>
 #include <QSslSocket>
+#include <QTimer>
+#include <cstring>
 #include "ui/mainwindow.h"
+#include "core/clock.h"
 #include "core/config_manager.h"
+#include "core/headless_controller.h"
+#include "core/load_generator.h"
+#include "core/micro_benchmark.h"
+#include "core/shared_runtime.h"
+#include "core/telegram_client.h"
+#include "core/transport_benchmark.h"
 #include <iostream>
 
 // 自定义消息处理程序，将日志输出到控制台
@@ -33,18 +45,27 @@ void messageHandler(QtMsgType type, const QMessageLogContext &context, const QSt
     }
 }
 
-int main(int argc, char *argv[])
+namespace {
+
+// 无界面模式默认监听的本地套接字名
+const char DEFAULT_SOCKET_NAME[] = "telegram-client";
+
+// 必须在创建应用程序对象之前判断，以决定创建QApplication还是QCoreApplication
+bool isHeadless(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0 || std::strcmp(argv[i], "--load-test") == 0
+            || std::strcmp(argv[i], "--transport-bench") == 0
+            || std::strcmp(argv[i], "--micro-bench") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 两种模式共用的初始化：应用信息、日志、TLS检查、工作目录和配置
+void setupApplication(QCoreApplication& app)
 {
-    // 安装自定义消息处理程序
-    qInstallMessageHandler(messageHandler);
-    
-    // 设置高DPI缩放
-    QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
-    QCoreApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
-    
-    // 创建应用程序实例
-    QApplication app(argc, argv);
-    
     // Qt6 已默认使用UTF-8编码
     
     // 设置应用名称和组织信息
@@ -65,12 +86,192 @@ int main(int argc, char *argv[])
     qDebug() << "当前工作目录: " << QDir::currentPath();
     
     // 初始化配置管理器并确保退出前保存配置
+    ConfigManager::instance()->ensureSaveBeforeExit();
+}
+
+// 模拟相关的选项（录制、回放、虚拟时间和请求对冲），图形界面和无界面模式都支持
+void addSimulationOptions(QCommandLineParser& parser)
+{
+    parser.addOption(QCommandLineOption("virtual-time", "使用虚拟时间，模拟的网络延迟和界面等待不再真的等待"));
+    parser.addOption(QCommandLineOption("record", "把请求、响应和推送录制到抓包文件", "file"));
+    parser.addOption(QCommandLineOption("replay", "用抓包文件中的响应代替模拟服务器", "file"));
+    parser.addOption(QCommandLineOption("replay-speed", "回放的时间压缩倍数，1为原始时序，0为不等待", "factor", "1"));
+    parser.addOption(QCommandLineOption("hedge-budget", "对冲请求最多占请求数的百分比，0为不对冲，默认5", "percent"));
+}
+
+// 必须在创建账号之前调用
+void applySimulationOptions(const QCommandLineParser& parser)
+{
+    if (parser.isSet("virtual-time")) {
+        Clock::instance()->setVirtual(true);
+    }
+    if (parser.isSet("record") || parser.isSet("replay")) {
+        SharedRuntime::instance()->setTrafficCapture(parser.value("record"), parser.value("replay"),
+                                                     parser.value("replay-speed").toDouble());
+    }
+    if (parser.isSet("hedge-budget")) {
+        SharedRuntime::instance()->setHedgeBudget(parser.value("hedge-budget").toDouble() / 100.0);
+    }
+}
+
+// 事件循环开始处理事件时输出启动耗时和常驻内存，用于比较两种模式的开销
+void reportStartup(const QElapsedTimer& timer, const char *mode)
+{
+    qint64 startedAt = timer.elapsed();
+    QTimer::singleShot(0, [timer, mode, startedAt]() {
+        qDebug() << mode << "启动完成，用时" << timer.elapsed() << "毫秒（创建对象" << startedAt
+                 << "毫秒），常驻内存" << SharedRuntime::residentBytes() / 1024 << "KB";
+    });
+}
+
+int runHeadless(int argc, char *argv[], const QElapsedTimer& timer)
+{
+    QCoreApplication app(argc, argv);
+    setupApplication(app);
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("无界面模式：从命令文件或本地套接字读取命令");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("headless", "不创建窗口，使用QCoreApplication运行"));
+    QCommandLineOption commandsOption("commands", "按顺序执行命令文件中的命令", "file");
+    QCommandLineOption socketOption("socket", "在本地套接字上监听命令", "name");
+    QCommandLineOption accountOption("account", "使用的账号，默认为主账号", "id");
+    QCommandLineOption loadTestOption("load-test", "压力测试：在进程内模拟多个客户端");
+    QCommandLineOption clientsOption("clients", "压力测试的客户端数量", "count", "200");
+    QCommandLineOption durationOption("duration", "压力测试的时长（秒）", "seconds", "60");
+    QCommandLineOption mixOption("mix", "各操作的比例，如auth=1,getMe=4,history=4,send=1", "mix");
+    parser.addOption(commandsOption);
+    parser.addOption(socketOption);
+    parser.addOption(accountOption);
+    parser.addOption(loadTestOption);
+    parser.addOption(clientsOption);
+    parser.addOption(durationOption);
+    QCommandLineOption transportBenchOption("transport-bench", "比较各种TCP封装与HTTP传输的线路开销和延迟");
+    QCommandLineOption messagesOption("messages", "传输基准测试每种方式往返的消息数", "count", "2000");
+    QCommandLineOption payloadOption("payload", "传输基准测试每条消息的字节数", "bytes", "256");
+    QCommandLineOption uploadOption("upload-mb", "传输基准测试中同时上传的文件大小（MB），测试带宽调度", "megabytes", "0");
+    QCommandLineOption bulkLimitOption("bulk-limit", "上传的速率上限（MB/s），0为不限速", "megabytes", "0");
+    QCommandLineOption microBenchOption("micro-bench",
+        QString("运行组件的微基准测试（%1 或 all）").arg(MicroBenchmark::names().join(", ")), "name");
+    QCommandLineOption iterationsOption("iterations", "微基准测试的操作次数", "count", "1000000");
+    parser.addOption(mixOption);
+    parser.addOption(transportBenchOption);
+    parser.addOption(messagesOption);
+    parser.addOption(payloadOption);
+    parser.addOption(uploadOption);
+    parser.addOption(bulkLimitOption);
+    parser.addOption(microBenchOption);
+    parser.addOption(iterationsOption);
+    addSimulationOptions(parser);
+    parser.process(app);
+    applySimulationOptions(parser);
+    
+    if (parser.isSet(microBenchOption)) {
+        if (!MicroBenchmark::run(parser.value(microBenchOption), parser.value(iterationsOption).toInt())) {
+            qCritical() << "未知的微基准测试:" << parser.value(microBenchOption)
+                        << "，可用:" << MicroBenchmark::names().join(", ");
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (parser.isSet(transportBenchOption)) {
+        // 混淆使用自带的AES实现，先用标准测试向量检查，结果不对时不测
+        if (!AesCtr::selfTest()) {
+            qCritical() << "AES-256-CTR与FIPS-197/SP 800-38A的测试向量不符，混淆的结果不可信";
+            return 1;
+        }
+        
+        TransportBenchmark::Options options;
+        options.messages = qMax(1, parser.value(messagesOption).toInt());
+        options.payloadSize = qMax(4, parser.value(payloadOption).toInt());
+        options.uploadBytes = qMax<qint64>(0, parser.value(uploadOption).toLongLong()) * 1024 * 1024;
+        options.bulkRateLimit = qint64(qMax(0.0, parser.value(bulkLimitOption).toDouble()) * 1024 * 1024);
+        
+        TransportBenchmark benchmark(options);
+        QObject::connect(&benchmark, &TransportBenchmark::finished, &app, &QCoreApplication::quit);
+        benchmark.start();
+        return app.exec();
+    }
+    
+    if (parser.isSet(loadTestOption)) {
+        LoadGenerator::Options options;
+        options.clients = qMax(1, parser.value(clientsOption).toInt());
+        options.durationSeconds = qMax(1, parser.value(durationOption).toInt());
+        if (parser.isSet(mixOption) && !LoadGenerator::parseMix(parser.value(mixOption), &options)) {
+            qCritical() << "无效的操作比例:" << parser.value(mixOption);
+            return 1;
+        }
+        
+        // 每个请求都有调试输出，数百个客户端时会淹没结果
+        QLoggingCategory::setFilterRules("default.debug=false\nqt.network.ssl.warning=true");
+        
+        LoadGenerator generator(options);
+        QObject::connect(&generator, &LoadGenerator::finished, &app, &QCoreApplication::quit);
+        generator.start();
+        return app.exec();
+    }
+    
+    TelegramClient client(parser.value(accountOption), nullptr);
+    HeadlessController controller(&client);
+    
+    // 没有指定命令来源时监听默认套接字
+    if (parser.isSet(commandsOption) && !controller.runCommandFile(parser.value(commandsOption))) {
+        return 1;
+    }
+    if (parser.isSet(socketOption) || !parser.isSet(commandsOption)) {
+        QString name = parser.isSet(socketOption) ? parser.value(socketOption) : QString(DEFAULT_SOCKET_NAME);
+        if (!controller.listen(name)) {
+            return 1;
+        }
+    }
+    
+    reportStartup(timer, "无界面模式");
+    return app.exec();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+    
+    // 安装自定义消息处理程序
+    qInstallMessageHandler(messageHandler);
+    
+    // 无界面模式不创建QApplication，也不加载平台插件和窗口部件
+    if (isHeadless(argc, argv)) {
+        return runHeadless(argc, argv, startupTimer);
+    }
+    
+    // 设置高DPI缩放
+    QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
+    QCoreApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
+    
+    // 创建应用程序实例
+    QApplication app(argc, argv);
+    setupApplication(app);
     ConfigManager* configManager = ConfigManager::instance();
-    configManager->ensureSaveBeforeExit();
+    
+    // 图形界面只识别模拟相关的选项，忽略其他参数
+    QCommandLineParser parser;
+    addSimulationOptions(parser);
+    parser.parse(app.arguments());
+    applySimulationOptions(parser);
     
     // 创建并显示主窗口
     MainWindow mainWindow;
     mainWindow.show();
     
+    // 其他已配置的账号各开一个窗口，所有账号共用同一个事件循环
+    const QStringList accountIds = configManager->accountIds();
+    for (const QString& accountId : accountIds) {
+        if (!accountId.isEmpty()) {
+            mainWindow.openAccountWindow(accountId);
+        }
+    }
+    
+    reportStartup(startupTimer, "图形界面模式");
     return app.exec();
-} 
\ No newline at end of file
+}
\ No newline at end of file
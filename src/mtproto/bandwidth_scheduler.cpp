@@ -0,0 +1,149 @@
+#include "bandwidth_scheduler.h"
+
+namespace {
+
+// 各类流量的默认权重：有积压时交互、预览和批量传输大致按16:4:1分享带宽
+const int INTERACTIVE_WEIGHT = 16;
+const int MEDIA_PREVIEW_WEIGHT = 4;
+const int BULK_WEIGHT = 1;
+
+// 令牌桶最多积累100毫秒的流量，空闲后不会一下子发出太多
+const int RATE_BURST_MS = 100;
+
+} // namespace
+
+RateLimiter::RateLimiter()
+    : m_rate(0)
+    , m_tokens(0.0)
+    , m_updatedMs(0)
+{
+}
+
+void RateLimiter::setRate(qint64 bytesPerSecond)
+{
+    m_rate = qMax<qint64>(0, bytesPerSecond);
+    m_tokens = qMin(m_tokens, double(m_rate) * RATE_BURST_MS / 1000.0);
+}
+
+qint64 RateLimiter::rate() const
+{
+    return m_rate;
+}
+
+bool RateLimiter::canSend(qint64 nowMs, qint64* waitMs)
+{
+    if (m_rate <= 0) {
+        return true;
+    }
+    refill(nowMs);
+    if (m_tokens >= 0.0) {
+        return true;
+    }
+    // 透支的部分按速率补回，至少等待1毫秒
+    *waitMs = qMax<qint64>(1, qint64(-m_tokens * 1000.0 / m_rate) + 1);
+    return false;
+}
+
+void RateLimiter::consume(qint64 bytes)
+{
+    if (m_rate > 0) {
+        m_tokens -= double(bytes);
+    }
+}
+
+void RateLimiter::refill(qint64 nowMs)
+{
+    if (m_updatedMs == 0) {
+        m_updatedMs = nowMs;
+    }
+    double burst = double(m_rate) * RATE_BURST_MS / 1000.0;
+    m_tokens = qMin(burst, m_tokens + double(nowMs - m_updatedMs) * m_rate / 1000.0);
+    m_updatedMs = nowMs;
+}
+
+BandwidthScheduler::BandwidthScheduler()
+    : m_virtualTime(0.0)
+    , m_bulkLimiter(nullptr)
+{
+    m_queues[Interactive].weight = INTERACTIVE_WEIGHT;
+    m_queues[MediaPreview].weight = MEDIA_PREVIEW_WEIGHT;
+    m_queues[Bulk].weight = BULK_WEIGHT;
+}
+
+void BandwidthScheduler::setWeight(TrafficClass trafficClass, int weight)
+{
+    m_queues[trafficClass].weight = qMax(1, weight);
+}
+
+void BandwidthScheduler::setBulkLimiter(RateLimiter* limiter)
+{
+    m_bulkLimiter = limiter;
+}
+
+void BandwidthScheduler::enqueue(TrafficClass trafficClass, const QByteArray& payload)
+{
+    // 类别空闲后重新开始时从当前虚拟时间算起，不能用空闲期间攒下的份额插队
+    Queue& queue = m_queues[trafficClass];
+    Packet packet;
+    packet.payload = payload;
+    packet.finish = qMax(m_virtualTime, queue.lastFinish) + double(payload.size()) / queue.weight;
+    queue.lastFinish = packet.finish;
+    queue.bytes += payload.size();
+    queue.packets.enqueue(packet);
+}
+
+bool BandwidthScheduler::isEmpty() const
+{
+    for (const Queue& queue : m_queues) {
+        if (!queue.packets.isEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 BandwidthScheduler::queuedBytes(TrafficClass trafficClass) const
+{
+    return m_queues[trafficClass].bytes;
+}
+
+void BandwidthScheduler::clear()
+{
+    for (Queue& queue : m_queues) {
+        queue.packets.clear();
+        queue.lastFinish = 0.0;
+        queue.bytes = 0;
+    }
+    m_virtualTime = 0.0;
+}
+
+bool BandwidthScheduler::dequeue(qint64 nowMs, QByteArray* payload, qint64* waitMs)
+{
+    *waitMs = -1;
+    Queue* selected = nullptr;
+    for (int i = 0; i < TrafficClassCount; ++i) {
+        Queue& queue = m_queues[i];
+        if (queue.packets.isEmpty()) {
+            continue;
+        }
+        // 超过限速的批量包留在队列中，不影响其他类别
+        if (i == Bulk && m_bulkLimiter && !m_bulkLimiter->canSend(nowMs, waitMs)) {
+            continue;
+        }
+        if (!selected || queue.packets.head().finish < selected->packets.head().finish) {
+            selected = &queue;
+        }
+    }
+    if (!selected) {
+        return false;
+    }
+
+    Packet packet = selected->packets.dequeue();
+    selected->bytes -= packet.payload.size();
+    m_virtualTime = packet.finish;
+    if (selected == &m_queues[Bulk] && m_bulkLimiter) {
+        m_bulkLimiter->consume(packet.payload.size());
+    }
+    *payload = packet.payload;
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QByteArray>
+#include <QQueue>
+#include <QtGlobal>
+
+/**
+ * @brief 按字节限速的令牌桶
+ *
+ * 可以由多个连接共用，使它们的批量流量合计不超过上限。允许透支：令牌不为负时就可以发送
+ * 一个包，发送后扣除包的长度，大于桶容量的包也不会一直等待。
+ */
+class RateLimiter
+{
+public:
+    RateLimiter();
+
+    // 每秒字节数，0为不限速
+    void setRate(qint64 bytesPerSecond);
+    qint64 rate() const;
+
+    // 现在能否发送，不能时*waitMs为需要等待的时间
+    bool canSend(qint64 nowMs, qint64* waitMs);
+    void consume(qint64 bytes);
+
+private:
+    void refill(qint64 nowMs);
+
+    qint64 m_rate;
+    double m_tokens;
+    qint64 m_updatedMs;
+};
+
+/**
+ * @brief 一个连接上出站包的带宽调度
+ *
+ * 包分为交互（RPC）、媒体预览和批量传输（文件分片）三类，按加权公平排队（自计时公平排队，SCFQ）
+ * 决定发送顺序：每个包按入队时的虚拟时间和所属类别的权重得到结束标记，总是先发标记最小的包。
+ * 有积压时各类按权重分享带宽，交互包不需要排在已经入队的大量文件分片之后。
+ * 批量传输可以另外限速，限速器由调用方提供，可以在多个连接间共用。
+ */
+class BandwidthScheduler
+{
+public:
+    enum TrafficClass {
+        Interactive = 0,
+        MediaPreview,
+        Bulk,
+        TrafficClassCount
+    };
+
+    BandwidthScheduler();
+
+    void setWeight(TrafficClass trafficClass, int weight);
+    void setBulkLimiter(RateLimiter* limiter);
+
+    void enqueue(TrafficClass trafficClass, const QByteArray& payload);
+    bool isEmpty() const;
+    qint64 queuedBytes(TrafficClass trafficClass) const;
+    void clear();
+
+    // 取出下一个要发送的包；队列中只剩被限速的批量包时返回false，*waitMs为需要等待的时间（队列为空时为-1）
+    bool dequeue(qint64 nowMs, QByteArray* payload, qint64* waitMs);
+
+private:
+    struct Packet
+    {
+        QByteArray payload;
+        double finish = 0.0;
+    };
+
+    struct Queue
+    {
+        QQueue<Packet> packets;
+        int weight = 1;
+        double lastFinish = 0.0;
+        qint64 bytes = 0;
+    };
+
+    Queue m_queues[TrafficClassCount];
+    double m_virtualTime;
+    RateLimiter* m_bulkLimiter;
+};
@@ -0,0 +1,254 @@
+#include "dc_prober.h"
+#include "mtproto_transport.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+
+const quint32 CACHE_MAGIC = 0x54474443; // "TGDC"
+const quint32 CACHE_VERSION = 1;
+
+// 一轮探测的超时，超时仍未响应的地址记为不可达
+const int PROBE_TIMEOUT_MS = 5000;
+
+// 定期重新探测的间隔
+const int PROBE_INTERVAL_MS = 10 * 60 * 1000;
+
+// req_pq_multi的构造号
+const quint32 REQ_PQ_MULTI = 0xbe7e8ef1;
+
+struct KnownAddress
+{
+    int dcId;
+    const char* ipv4;
+    const char* ipv6;
+};
+
+const KnownAddress KNOWN_ADDRESSES[] = {
+    { 1, "149.154.175.53", "2001:b28:f23d:f001::a" },
+    { 2, "149.154.167.51", "2001:67c:4e8:f002::a" },
+    { 3, "149.154.175.100", "2001:b28:f23d:f003::a" },
+    { 4, "149.154.167.91", "2001:67c:4e8:f004::a" },
+    { 5, "91.108.56.130", "2001:b28:f23f:f005::a" }
+};
+
+// 未加密的req_pq_multi：auth_key_id为0，随后是msg_id、长度和请求本身
+QByteArray buildReqPq()
+{
+    QByteArray packet(40, '\0');
+    qint64 ms = QDateTime::currentMSecsSinceEpoch();
+    quint64 messageId = (quint64(ms / 1000) << 32) | (quint64(ms % 1000) * 4294967ull & ~quint64(3));
+    qToLittleEndian<quint64>(messageId, packet.data() + 8);
+    qToLittleEndian<quint32>(20, packet.data() + 16);
+    qToLittleEndian<quint32>(REQ_PQ_MULTI, packet.data() + 20);
+    QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(packet.data() + 24), 4);
+    return packet;
+}
+
+// 排序用的类别：0为可达，1为尚未探测，2为不可达或连接失败过
+int rankOf(const DcEndpoint& endpoint)
+{
+    if (endpoint.failures > 0) {
+        return 2;
+    }
+    return endpoint.rttUs >= 0 ? 0 : 1;
+}
+
+} // namespace
+
+DcProber::DcProber(QObject* parent)
+    : QObject(parent)
+    , m_endpoints(defaultEndpoints())
+    , m_pending(0)
+    , m_started(false)
+{
+    m_interval.setInterval(PROBE_INTERVAL_MS);
+    connect(&m_interval, &QTimer::timeout, this, &DcProber::probe);
+
+    m_timeout.setSingleShot(true);
+    m_timeout.setInterval(PROBE_TIMEOUT_MS);
+    connect(&m_timeout, &QTimer::timeout, this, [this]() {
+        for (int i = 0; i < m_probes.size(); ++i) {
+            finishProbe(i, -1);
+        }
+    });
+}
+
+QVector<DcEndpoint> DcProber::defaultEndpoints()
+{
+    QVector<DcEndpoint> endpoints;
+    for (const KnownAddress& address : KNOWN_ADDRESSES) {
+        DcEndpoint endpoint;
+        endpoint.dcId = address.dcId;
+        endpoint.host = address.ipv4;
+        endpoints.append(endpoint);
+        endpoint.host = address.ipv6;
+        endpoint.ipv6 = true;
+        endpoints.append(endpoint);
+    }
+    return endpoints;
+}
+
+void DcProber::start(const QString& cachePath)
+{
+    if (m_started) {
+        return;
+    }
+    m_started = true;
+    m_cachePath = cachePath;
+    if (!m_cachePath.isEmpty() && loadCache(m_cachePath)) {
+        qDebug() << "已加载数据中心延迟缓存";
+    }
+    m_interval.start();
+    probe();
+}
+
+void DcProber::probe()
+{
+    if (m_pending > 0) {
+        return;
+    }
+
+    // 所有地址同时探测，延迟从开始连接算起，包含TCP握手，与新连接上第一个请求的等待时间一致
+    m_probes.resize(m_endpoints.size());
+    m_pending = m_endpoints.size();
+    for (int i = 0; i < m_endpoints.size(); ++i) {
+        Probe& probe = m_probes[i];
+        probe.transport = new TcpTransport(TransportCodec::Intermediate, false, this);
+        connect(probe.transport, &TcpTransport::connected, this, [this, i]() {
+            m_probes[i].transport->send(buildReqPq());
+        });
+        connect(probe.transport, &TcpTransport::packetReceived, this, [this, i](const QByteArray& packet) {
+            // 响应同样是未加密消息，auth_key_id为0
+            bool valid = packet.size() >= 20 && qFromLittleEndian<quint64>(packet.constData()) == 0;
+            finishProbe(i, valid ? m_probes.at(i).clock.nsecsElapsed() / 1000 : -1);
+        });
+        connect(probe.transport, &TcpTransport::errorOccurred, this, [this, i]() {
+            finishProbe(i, -1);
+        });
+        probe.clock.start();
+        probe.transport->connectToHost(m_endpoints.at(i).host, m_endpoints.at(i).port);
+    }
+    m_timeout.start();
+}
+
+void DcProber::finishProbe(int index, qint64 rttUs)
+{
+    Probe& probe = m_probes[index];
+    if (!probe.transport) {
+        return;
+    }
+    probe.transport->disconnect(this);
+    probe.transport->disconnectFromHost();
+    probe.transport->deleteLater();
+    probe.transport = nullptr;
+
+    DcEndpoint& endpoint = m_endpoints[index];
+    endpoint.rttUs = rttUs;
+    endpoint.probedAt = QDateTime::currentSecsSinceEpoch();
+    endpoint.failures = rttUs < 0 ? endpoint.failures + 1 : 0;
+
+    if (--m_pending > 0) {
+        return;
+    }
+    m_timeout.stop();
+
+    QVector<DcEndpoint> ranked = rankedEndpoints();
+    if (rankOf(ranked.first()) == 0) {
+        qDebug() << "数据中心探测完成，最快的地址:" << ranked.first().host << "DC" << ranked.first().dcId
+                 << "延迟" << ranked.first().rttUs / 1000 << "毫秒";
+    } else {
+        qWarning() << "数据中心探测完成，没有可达的地址";
+    }
+    if (!m_cachePath.isEmpty()) {
+        saveCache(m_cachePath);
+    }
+    emit probeFinished();
+}
+
+QVector<DcEndpoint> DcProber::rankedEndpoints(int dcId) const
+{
+    QVector<DcEndpoint> ranked;
+    for (const DcEndpoint& endpoint : m_endpoints) {
+        if (dcId == 0 || endpoint.dcId == dcId) {
+            ranked.append(endpoint);
+        }
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const DcEndpoint& a, const DcEndpoint& b) {
+        int rankA = rankOf(a);
+        int rankB = rankOf(b);
+        if (rankA != rankB) {
+            return rankA < rankB;
+        }
+        return rankA == 0 && a.rttUs < b.rttUs;
+    });
+    return ranked;
+}
+
+void DcProber::reportFailure(const QString& host, quint16 port)
+{
+    for (DcEndpoint& endpoint : m_endpoints) {
+        if (endpoint.host == host && endpoint.port == port) {
+            ++endpoint.failures;
+        }
+    }
+}
+
+bool DcProber::saveCache(const QString& path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "无法保存数据中心延迟缓存:" << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << CACHE_MAGIC << CACHE_VERSION << qint32(m_endpoints.size());
+    for (const DcEndpoint& endpoint : m_endpoints) {
+        stream << qint32(endpoint.dcId) << endpoint.host << endpoint.port << endpoint.ipv6
+               << endpoint.rttUs << endpoint.probedAt << qint32(endpoint.failures);
+    }
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool DcProber::loadCache(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 count = 0;
+    stream >> magic >> version >> count;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+
+    // 只更新内置列表中仍然存在的地址，地址列表以内置的为准
+    for (qint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        DcEndpoint cached;
+        qint32 dcId = 0;
+        qint32 failures = 0;
+        stream >> dcId >> cached.host >> cached.port >> cached.ipv6
+               >> cached.rttUs >> cached.probedAt >> failures;
+        for (DcEndpoint& endpoint : m_endpoints) {
+            if (endpoint.host == cached.host && endpoint.port == cached.port) {
+                endpoint.rttUs = cached.rttUs;
+                endpoint.probedAt = cached.probedAt;
+                endpoint.failures = failures;
+            }
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
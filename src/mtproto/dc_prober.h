@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+class TcpTransport;
+
+// 一个数据中心地址及其最近一次探测结果
+struct DcEndpoint
+{
+    int dcId = 0;
+    QString host;
+    quint16 port = 443;
+    bool ipv6 = false;
+    qint64 rttUs = -1;          // 握手往返时间，-1为不可达或尚未探测
+    qint64 probedAt = 0;        // 探测时间（Unix秒），0为尚未探测
+    int failures = 0;           // 连续失败次数
+};
+
+/**
+ * @brief 并行探测所有数据中心地址，按握手延迟排序
+ *
+ * 对每个IPv4和IPv6地址同时建立TCP连接并发送一个未加密的req_pq_multi，
+ * 收到服务器响应的时间即握手往返时间。启动时和之后每隔一段时间探测一次，
+ * 结果保存在会话目录中，下次启动时先按上次的结果选择地址，不必等探测完成。
+ * 一个进程只需要一个探测器，由所有账号共用。
+ */
+class DcProber : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DcProber(QObject* parent = nullptr);
+
+    // 内置的生产环境数据中心地址
+    static QVector<DcEndpoint> defaultEndpoints();
+
+    // 加载缓存的结果并开始定期探测，重复调用时忽略
+    void start(const QString& cachePath);
+
+    // 立即探测一轮，上一轮未结束时忽略
+    void probe();
+
+    // 按优先顺序排列的地址：可达的按延迟从低到高，然后是未探测的，最后是不可达的。
+    // dcId为0时包含所有数据中心
+    QVector<DcEndpoint> rankedEndpoints(int dcId = 0) const;
+
+    // 连接某个地址失败时调用，使它排到同一数据中心其他地址之后，直到下次探测成功
+    void reportFailure(const QString& host, quint16 port);
+
+    bool loadCache(const QString& path);
+    bool saveCache(const QString& path) const;
+
+signals:
+    void probeFinished();
+
+private:
+    struct Probe
+    {
+        TcpTransport* transport = nullptr;
+        QElapsedTimer clock;
+    };
+
+    void finishProbe(int index, qint64 rttUs);
+
+    QVector<DcEndpoint> m_endpoints;
+    QVector<Probe> m_probes;
+    int m_pending;
+    bool m_started;
+    QString m_cachePath;
+    QTimer m_interval;
+    QTimer m_timeout;
+};
@@ -0,0 +1,609 @@
+#include "gzip_inflater.h"
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// gzip头部标志位
+const int FLAG_HCRC = 0x02;
+const int FLAG_EXTRA = 0x04;
+const int FLAG_NAME = 0x08;
+const int FLAG_COMMENT = 0x10;
+
+// 长度码257..285和距离码0..29的基数与附加位数（RFC 1951 3.2.5）
+const quint16 LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const quint8 LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const quint16 DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const quint8 DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// 动态块中码长码的排列顺序
+const quint8 CODE_LENGTH_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+const quint32* crcTable()
+{
+    static const std::array<quint32, 256> table = []() {
+        std::array<quint32, 256> result;
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+    return table.data();
+}
+
+} // namespace
+
+GzipInflater::GzipInflater()
+{
+    reset();
+}
+
+void GzipInflater::reset()
+{
+    m_stage = GzipHeader;
+    m_finalBlock = false;
+    m_storedRemaining = 0;
+    m_input.clear();
+    m_position = 0;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    m_savedPosition = 0;
+    m_savedBitBuffer = 0;
+    m_savedBitCount = 0;
+    m_outputStart = 0;
+    m_outputStartKnown = false;
+    m_outputLimit = -1;
+    m_outputLimitExceeded = false;
+}
+
+GzipInflater::Status GzipInflater::status() const
+{
+    if (m_stage == Done) {
+        return Finished;
+    }
+    return m_stage == Failed ? Error : NeedMoreInput;
+}
+
+bool GzipInflater::outputLimitExceeded() const
+{
+    return m_outputLimitExceeded;
+}
+
+GzipInflater::Status GzipInflater::feed(const char* data, int size, QByteArray* output, qint64 outputLimit)
+{
+    if (m_stage == Done || m_stage == Failed) {
+        return status();
+    }
+    m_outputLimit = outputLimit;
+    if (!m_outputStartKnown) {
+        m_outputStart = output->size();
+        m_outputStartKnown = true;
+    }
+
+    // 丢弃已消费的输入，只保留上次未能处理完的尾部
+    if (m_position > 0) {
+        m_input.remove(0, m_position);
+        m_position = 0;
+    }
+    m_input.append(data, size);
+
+    for (;;) {
+        switch (m_stage) {
+        case GzipHeader:
+            saveCheckpoint();
+            if (!readGzipHeader()) {
+                break;
+            }
+            m_stage = BlockHeader;
+            continue;
+        case BlockHeader:
+            saveCheckpoint();
+            if (!readBlockHeader()) {
+                break;
+            }
+            continue;
+        case StoredBlock: {
+            Status blockStatus = copyStored(output);
+            if (blockStatus != Finished) {
+                return blockStatus;
+            }
+            continue;
+        }
+        case HuffmanBlock: {
+            Status blockStatus = inflateBlock(output);
+            if (blockStatus != Finished) {
+                return blockStatus;
+            }
+            continue;
+        }
+        case Trailer:
+            saveCheckpoint();
+            if (!readTrailer(*output)) {
+                break;
+            }
+            m_stage = Done;
+            return Finished;
+        case Done:
+            return Finished;
+        case Failed:
+            return Error;
+        }
+
+        // 头部或块头的输入不完整，回到它的开头等待更多数据
+        if (m_stage == Failed) {
+            return Error;
+        }
+        restoreCheckpoint();
+        return NeedMoreInput;
+    }
+}
+
+bool GzipInflater::needBits(int count)
+{
+    while (m_bitCount < count) {
+        if (m_position >= m_input.size()) {
+            return false;
+        }
+        m_bitBuffer |= quint32(quint8(m_input.at(m_position++))) << m_bitCount;
+        m_bitCount += 8;
+    }
+    return true;
+}
+
+quint32 GzipInflater::takeBits(int count)
+{
+    quint32 value = m_bitBuffer & ((1u << count) - 1);
+    m_bitBuffer >>= count;
+    m_bitCount -= count;
+    return value;
+}
+
+void GzipInflater::saveCheckpoint()
+{
+    m_savedPosition = m_position;
+    m_savedBitBuffer = m_bitBuffer;
+    m_savedBitCount = m_bitCount;
+}
+
+void GzipInflater::restoreCheckpoint()
+{
+    m_position = m_savedPosition;
+    m_bitBuffer = m_savedBitBuffer;
+    m_bitCount = m_savedBitCount;
+}
+
+bool GzipInflater::readGzipHeader()
+{
+    auto readByte = [this](int* value) {
+        if (!needBits(8)) {
+            return false;
+        }
+        *value = int(takeBits(8));
+        return true;
+    };
+    auto skipBytes = [&readByte](int count) {
+        int ignored = 0;
+        for (int i = 0; i < count; ++i) {
+            if (!readByte(&ignored)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto skipString = [&readByte]() {
+        int value = 0;
+        do {
+            if (!readByte(&value)) {
+                return false;
+            }
+        } while (value != 0);
+        return true;
+    };
+
+    int magic1 = 0;
+    int magic2 = 0;
+    int method = 0;
+    int flags = 0;
+    if (!readByte(&magic1) || !readByte(&magic2) || !readByte(&method) || !readByte(&flags)) {
+        return false;
+    }
+    if (magic1 != 0x1f || magic2 != 0x8b || method != 8) {
+        m_stage = Failed;
+        return false;
+    }
+
+    // 修改时间、压缩标志和操作系统
+    if (!skipBytes(6)) {
+        return false;
+    }
+    if (flags & FLAG_EXTRA) {
+        int low = 0;
+        int high = 0;
+        if (!readByte(&low) || !readByte(&high) || !skipBytes(low | (high << 8))) {
+            return false;
+        }
+    }
+    if ((flags & FLAG_NAME) && !skipString()) {
+        return false;
+    }
+    if ((flags & FLAG_COMMENT) && !skipString()) {
+        return false;
+    }
+    if ((flags & FLAG_HCRC) && !skipBytes(2)) {
+        return false;
+    }
+    return true;
+}
+
+bool GzipInflater::readBlockHeader()
+{
+    if (!needBits(3)) {
+        return false;
+    }
+    m_finalBlock = takeBits(1) != 0;
+    switch (takeBits(2)) {
+    case 0:
+        return readStoredHeader();
+    case 1: {
+        // 固定霍夫曼码
+        quint8 lengths[288 + 30];
+        std::fill(lengths, lengths + 144, quint8(8));
+        std::fill(lengths + 144, lengths + 256, quint8(9));
+        std::fill(lengths + 256, lengths + 280, quint8(7));
+        std::fill(lengths + 280, lengths + 288, quint8(8));
+        std::fill(lengths + 288, lengths + 318, quint8(5));
+        buildHuffman(&m_literals, lengths, 288);
+        buildHuffman(&m_distances, lengths + 288, 30);
+        m_stage = HuffmanBlock;
+        return true;
+    }
+    case 2:
+        if (!readDynamicTables()) {
+            return false;
+        }
+        m_stage = HuffmanBlock;
+        return true;
+    default:
+        m_stage = Failed;
+        return false;
+    }
+}
+
+bool GzipInflater::readStoredHeader()
+{
+    // 存储块从字节边界开始
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    if (!needBits(16)) {
+        return false;
+    }
+    quint32 length = takeBits(16);
+    if (!needBits(16)) {
+        return false;
+    }
+    quint32 complement = takeBits(16);
+    if (length != (~complement & 0xffff)) {
+        m_stage = Failed;
+        return false;
+    }
+    m_storedRemaining = length;
+    m_stage = StoredBlock;
+    return true;
+}
+
+bool GzipInflater::readDynamicTables()
+{
+    if (!needBits(14)) {
+        return false;
+    }
+    int literalCount = int(takeBits(5)) + 257;
+    int distanceCount = int(takeBits(5)) + 1;
+    int codeLengthCount = int(takeBits(4)) + 4;
+    if (literalCount > 286 || distanceCount > 30) {
+        m_stage = Failed;
+        return false;
+    }
+
+    quint8 codeLengths[19] = {};
+    for (int i = 0; i < codeLengthCount; ++i) {
+        if (!needBits(3)) {
+            return false;
+        }
+        codeLengths[CODE_LENGTH_ORDER[i]] = quint8(takeBits(3));
+    }
+    Huffman codeLengthCode;
+    if (!buildHuffman(&codeLengthCode, codeLengths, 19)) {
+        m_stage = Failed;
+        return false;
+    }
+
+    quint8 lengths[286 + 30] = {};
+    int total = literalCount + distanceCount;
+    int count = 0;
+    while (count < total) {
+        int symbol = decodeSymbol(codeLengthCode);
+        if (symbol == -1) {
+            return false;
+        }
+        if (symbol < 0) {
+            m_stage = Failed;
+            return false;
+        }
+        if (symbol < 16) {
+            lengths[count++] = quint8(symbol);
+            continue;
+        }
+
+        int repeat = 0;
+        quint8 value = 0;
+        if (symbol == 16) {
+            if (count == 0) {
+                m_stage = Failed;
+                return false;
+            }
+            if (!needBits(2)) {
+                return false;
+            }
+            repeat = 3 + int(takeBits(2));
+            value = lengths[count - 1];
+        } else if (symbol == 17) {
+            if (!needBits(3)) {
+                return false;
+            }
+            repeat = 3 + int(takeBits(3));
+        } else {
+            if (!needBits(7)) {
+                return false;
+            }
+            repeat = 11 + int(takeBits(7));
+        }
+        if (count + repeat > total) {
+            m_stage = Failed;
+            return false;
+        }
+        std::fill(lengths + count, lengths + count + repeat, value);
+        count += repeat;
+    }
+
+    // 必须有块结束符
+    if (lengths[256] == 0
+        || !buildHuffman(&m_literals, lengths, literalCount)
+        || !buildHuffman(&m_distances, lengths + literalCount, distanceCount)) {
+        m_stage = Failed;
+        return false;
+    }
+    return true;
+}
+
+bool GzipInflater::buildHuffman(Huffman* huffman, const quint8* lengths, int count)
+{
+    std::fill(huffman->counts, huffman->counts + 16, quint16(0));
+    for (int i = 0; i < count; ++i) {
+        ++huffman->counts[lengths[i]];
+    }
+    huffman->counts[0] = 0;
+
+    // 码字不能超额分配，不完整的码（如只有一个距离码）是允许的
+    int left = 1;
+    for (int length = 1; length < 16; ++length) {
+        left <<= 1;
+        left -= huffman->counts[length];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    quint16 offsets[16];
+    offsets[1] = 0;
+    for (int length = 1; length < 15; ++length) {
+        offsets[length + 1] = offsets[length] + huffman->counts[length];
+    }
+    huffman->symbols.resize(count);
+    for (int symbol = 0; symbol < count; ++symbol) {
+        if (lengths[symbol] != 0) {
+            huffman->symbols[offsets[lengths[symbol]]++] = quint16(symbol);
+        }
+    }
+    return true;
+}
+
+int GzipInflater::decodeSymbol(const Huffman& huffman)
+{
+    // 逐位比较规范码，每个长度的码字是连续的一段
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length < 16; ++length) {
+        if (!needBits(1)) {
+            return -1;
+        }
+        code |= int(takeBits(1));
+        int count = huffman.counts[length];
+        if (code - count < first) {
+            return huffman.symbols.at(index + (code - first));
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+GzipInflater::Status GzipInflater::inflateBlock(QByteArray* output)
+{
+    for (;;) {
+        saveCheckpoint();
+        int symbol = decodeSymbol(m_literals);
+        if (symbol == -1) {
+            restoreCheckpoint();
+            return NeedMoreInput;
+        }
+        if (symbol < 0) {
+            m_stage = Failed;
+            return Error;
+        }
+        if (symbol < 256) {
+            if (!reserveOutput(*output, 1)) {
+                return Error;
+            }
+            output->append(char(symbol));
+            continue;
+        }
+        if (symbol == 256) {
+            // 本块结束，Finished表示可以继续处理下一块
+            m_stage = m_finalBlock ? Trailer : BlockHeader;
+            return Finished;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            m_stage = Failed;
+            return Error;
+        }
+        if (!needBits(LENGTH_EXTRA[symbol])) {
+            restoreCheckpoint();
+            return NeedMoreInput;
+        }
+        int length = LENGTH_BASE[symbol] + int(takeBits(LENGTH_EXTRA[symbol]));
+
+        int distanceSymbol = decodeSymbol(m_distances);
+        if (distanceSymbol == -1) {
+            restoreCheckpoint();
+            return NeedMoreInput;
+        }
+        if (distanceSymbol < 0 || distanceSymbol >= 30) {
+            m_stage = Failed;
+            return Error;
+        }
+        if (!needBits(DISTANCE_EXTRA[distanceSymbol])) {
+            restoreCheckpoint();
+            return NeedMoreInput;
+        }
+        int distance = DISTANCE_BASE[distanceSymbol] + int(takeBits(DISTANCE_EXTRA[distanceSymbol]));
+        if (distance > output->size() - m_outputStart) {
+            m_stage = Failed;
+            return Error;
+        }
+        if (!reserveOutput(*output, length)) {
+            return Error;
+        }
+
+        // 源和目标可能重叠，逐字节向前复制
+        int from = int(output->size()) - distance;
+        int to = int(output->size());
+        output->resize(to + length);
+        char* bytes = output->data();
+        for (int i = 0; i < length; ++i) {
+            bytes[to + i] = bytes[from + i];
+        }
+    }
+}
+
+GzipInflater::Status GzipInflater::copyStored(QByteArray* output)
+{
+    while (m_storedRemaining > 0) {
+        int available = int(m_input.size()) - m_position;
+        if (available == 0) {
+            return NeedMoreInput;
+        }
+        int count = int(qMin<quint32>(quint32(available), m_storedRemaining));
+        if (!reserveOutput(*output, count)) {
+            return Error;
+        }
+        output->append(m_input.constData() + m_position, count);
+        m_position += count;
+        m_storedRemaining -= quint32(count);
+    }
+    m_stage = m_finalBlock ? Trailer : BlockHeader;
+    return Finished;
+}
+
+bool GzipInflater::reserveOutput(const QByteArray& output, qint64 extra)
+{
+    if (m_outputLimit < 0 || output.size() - m_outputStart + extra <= m_outputLimit) {
+        return true;
+    }
+    m_outputLimitExceeded = true;
+    m_stage = Failed;
+    return false;
+}
+
+bool GzipInflater::readTrailer(const QByteArray& output)
+{
+    // 尾部从字节边界开始：CRC-32和原始长度，均为小端
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    if (m_input.size() - m_position < 8) {
+        return false;
+    }
+    quint32 crc = qFromLittleEndian<quint32>(m_input.constData() + m_position);
+    quint32 size = qFromLittleEndian<quint32>(m_input.constData() + m_position + 4);
+    m_position += 8;
+
+    qint64 produced = output.size() - m_outputStart;
+    if (size != quint32(produced) || crc != crc32(output.constData() + m_outputStart, produced)) {
+        m_stage = Failed;
+        return false;
+    }
+    return true;
+}
+
+QByteArray GzipInflater::compress(const QByteArray& data, int level)
+{
+    // qCompress的结果为4字节大端原始长度加zlib流（2字节头、deflate数据、4字节Adler-32），
+    // 取出其中的deflate数据换上gzip的头和尾
+    QByteArray zlib = qCompress(data, level);
+    if (zlib.size() < 10) {
+        return QByteArray();
+    }
+
+    static const char header[10] = { 0x1f, char(0x8b), 8, 0, 0, 0, 0, 0, 0, char(0xff) };
+    QByteArray gzip;
+    gzip.reserve(zlib.size() + 8);
+    gzip.append(header, sizeof(header));
+    gzip.append(zlib.constData() + 6, zlib.size() - 10);
+
+    char trailer[8];
+    qToLittleEndian<quint32>(crc32(data.constData(), data.size()), trailer);
+    qToLittleEndian<quint32>(quint32(data.size()), trailer + 4);
+    gzip.append(trailer, sizeof(trailer));
+    return gzip;
+}
+
+qint64 GzipInflater::uncompressedSize(const QByteArray& gzip)
+{
+    if (gzip.size() < 18) {
+        return -1;
+    }
+    return qFromLittleEndian<quint32>(gzip.constData() + gzip.size() - 4);
+}
+
+quint32 GzipInflater::crc32(const char* data, qint64 size, quint32 crc)
+{
+    const quint32* table = crcTable();
+    crc = ~crc;
+    for (qint64 i = 0; i < size; ++i) {
+        crc = table[(crc ^ quint8(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+/**
+ * @brief 可分段输入的gzip解压器
+ *
+ * 服务器对较大的响应使用gzip_packed。压缩数据按到达的分段逐段送入，
+ * 解压结果直接追加到调用方的输出缓冲（回溯引用也从中读取），
+ * 不需要先把整个压缩包拼接起来。一个符号或块头的输入不完整时回到它之前的位置，
+ * 等下一段数据到达后继续。同一个解压器可反复使用，reset后开始新的数据流。
+ * 解压结果可以限制长度，超过上限的符号或存储块在写入之前就会停止。
+ */
+class GzipInflater
+{
+public:
+    enum Status {
+        NeedMoreInput,
+        Finished,
+        Error
+    };
+
+    GzipInflater();
+
+    void reset();
+
+    // 送入一段压缩数据，解压结果追加到output，同一数据流的各段必须使用同一个output；
+    // outputLimit为本数据流解压结果的最大长度（-1不限），超过时返回Error
+    Status feed(const char* data, int size, QByteArray* output, qint64 outputLimit = -1);
+
+    Status status() const;
+    bool outputLimitExceeded() const;
+
+    // 压缩为gzip格式（使用Qt自带的zlib），level为-1时使用默认压缩级别
+    static QByteArray compress(const QByteArray& data, int level = -1);
+
+    // gzip尾部记录的原始长度，用于预先分配输出缓冲；数据不完整时返回-1
+    static qint64 uncompressedSize(const QByteArray& gzip);
+
+    static quint32 crc32(const char* data, qint64 size, quint32 crc = 0);
+
+private:
+    enum Stage {
+        GzipHeader,
+        BlockHeader,
+        StoredBlock,
+        HuffmanBlock,
+        Trailer,
+        Done,
+        Failed
+    };
+
+    // 规范霍夫曼码：各长度的码字数量和按码字排序的符号
+    struct Huffman
+    {
+        quint16 counts[16];
+        QVector<quint16> symbols;
+    };
+
+    bool needBits(int count);
+    quint32 takeBits(int count);
+    void saveCheckpoint();
+    void restoreCheckpoint();
+
+    // 再写入extra字节后是否仍在长度上限内，超过时标记为失败
+    bool reserveOutput(const QByteArray& output, qint64 extra);
+
+    bool readGzipHeader();
+    bool readBlockHeader();
+    bool readDynamicTables();
+    bool readStoredHeader();
+    Status inflateBlock(QByteArray* output);
+    Status copyStored(QByteArray* output);
+    bool readTrailer(const QByteArray& output);
+
+    // 返回符号，输入不足时返回-1，数据错误时返回-2
+    int decodeSymbol(const Huffman& huffman);
+    static bool buildHuffman(Huffman* huffman, const quint8* lengths, int count);
+
+    Stage m_stage;
+    bool m_finalBlock;
+    quint32 m_storedRemaining;
+
+    // 未消费的输入和位缓冲
+    QByteArray m_input;
+    int m_position;
+    quint32 m_bitBuffer;
+    int m_bitCount;
+
+    // 一个完整单元（符号、块头）开始前的位置，输入不足时回到这里
+    int m_savedPosition;
+    quint32 m_savedBitBuffer;
+    int m_savedBitCount;
+
+    Huffman m_literals;
+    Huffman m_distances;
+
+    // 本数据流在输出缓冲中的起点，回溯距离不能超过它
+    int m_outputStart;
+    bool m_outputStartKnown;
+    qint64 m_outputLimit;
+    bool m_outputLimitExceeded;
+};
@@ -1,4 +1,5 @@
 #include "mtproto_client.h"
+#include "core/clock.h"
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkProxyFactory>
@@ -6,23 +7,417 @@
 #include <QSslSocket>
 #include <QDebug>
 #include <QTimer>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QCborMap>
+#include <QCborValue>
+#include <limits>
 
 // 这里使用简化的实现 - 真实的MTProto实现会更复杂
 // 实际的Telegram tdesktop使用完整的MTProto协议实现
 
-// Telegram API URL (使用公共测试API)
-const QString API_URL = "https://api.telegram.org";
+namespace {
+
+// 模拟会话中的消息总数
+const int SIMULATED_HISTORY_SIZE = 300000;
+
+// 按会话和消息ID确定性地生成模拟消息，保证重复请求得到相同内容
+QJsonObject simulateMessage(qint64 peerId, qint32 id)
+{
+    static const char* const phrases[] = {
+        "大家好，今天的会议改到下午三点。",
+        "收到，谢谢！",
+        "这个版本的性能提升很明显，滚动流畅多了。",
+        "Please check the latest build before release.",
+        "晚上一起吃饭吗？",
+        "The download link is in the pinned message.",
+        "我已经把文档上传到群文件了，请大家查看并提出修改意见。",
+        "OK",
+        "明天天气不错，适合出去走走。",
+        "Does anyone know how to configure the SOCKS5 proxy?"
+    };
+    const int phraseCount = int(sizeof(phrases) / sizeof(phrases[0]));
+    
+    QRandomGenerator generator(quint32(peerId * 2654435761u) ^ quint32(id));
+    int parts = 1 + generator.bounded(4);
+    QString text;
+    for (int i = 0; i < parts; ++i) {
+        if (!text.isEmpty()) {
+            text += ' ';
+        }
+        text += QString::fromUtf8(phrases[generator.bounded(phraseCount)]);
+    }
+    
+    qint64 fromId = 1000 + generator.bounded(20);
+    
+    QJsonObject message;
+    message["id"] = id;
+    message["peer_id"] = double(peerId);
+    message["from_id"] = double(fromId);
+    message["from_name"] = "用户" + QString::number(fromId);
+    message["date"] = 1600000000 + id * 37;
+    message["edit_date"] = 0;
+    message["message"] = text;
+    return message;
+}
+
+// 模拟的网络往返时间，以及重连失败的概率（每N次失败一次）
+const int SIMULATED_ROUND_TRIP_MS = 500;
+const int SIMULATED_RECONNECT_FAILURE_RATE = 10;
+
+// 模拟的慢响应：每N个响应中有一个在服务器上多停留一段时间
+const int SIMULATED_SLOW_REPLY_RATE = 20;
+const int SIMULATED_SLOW_REPLY_MS = 4000;
+
+int simulatedRoundTrip()
+{
+    if (QRandomGenerator::global()->bounded(SIMULATED_SLOW_REPLY_RATE) == 0) {
+        return SIMULATED_ROUND_TRIP_MS + SIMULATED_SLOW_REPLY_MS;
+    }
+    return SIMULATED_ROUND_TRIP_MS;
+}
+
+// 重连的退避：第一次失败后等待的基数和上限
+const int RECONNECT_BASE_DELAY_MS = 250;
+const int RECONNECT_MAX_DELAY_MS = 30000;
+
+// 模拟服务器的盐：每个盐在一个周期内有效，并与下一个周期重叠一段时间
+const qint32 SIMULATED_SALT_PERIOD = 3600;
+const qint32 SIMULATED_SALT_OVERLAP = 1800;
+
+// 模拟的本地时钟与服务器时钟的最大偏差
+const int SIMULATED_MAX_CLOCK_SKEW_MS = 40000;
+
+// 服务器接受的msg_id时间范围：不早于服务器时间300秒，不晚于30秒
+const qint64 MSG_ID_MAX_AGE_MS = 300000;
+const qint64 MSG_ID_MAX_AHEAD_MS = 30000;
+
+// 每次预取的盐的个数
+const int FUTURE_SALTS_COUNT = 32;
+
+qint64 simulatedSalt(qint32 period)
+{
+    QRandomGenerator generator(quint32(period) * 2246822519u);
+    return qint64(generator.generate64() | 1);
+}
+
+bool simulatedSaltValid(qint64 salt, qint32 serverNow)
+{
+    qint32 period = serverNow / SIMULATED_SALT_PERIOD;
+    for (qint32 candidate = period - 1; candidate <= period; ++candidate) {
+        qint32 validUntil = (candidate + 1) * SIMULATED_SALT_PERIOD + SIMULATED_SALT_OVERLAP;
+        if (salt == simulatedSalt(candidate) && serverNow < validUntil) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 确认和状态变化最多积累这么久，期间有请求发出时随请求一起发送
+const int OUTGOING_FLUSH_DELAY_MS = 200;
+
+// 模拟联系人数量
+const int SIMULATED_CONTACT_COUNT = 5000;
+
+// 模拟服务器推送更新的间隔、涉及的会话数量和单次差异的最大条数
+const int SIMULATED_UPDATE_INTERVAL_MS = 2000;
+const int SIMULATED_ACTIVE_PEERS = 5;
+const int SIMULATED_DIFFERENCE_LIMIT = 100;
+
+// 模拟频道：数量、起始ID，以及服务器对频道差异请求的限流（每秒次数）
+const int SIMULATED_CHANNEL_COUNT = 2000;
+const qint64 SIMULATED_CHANNEL_BASE = 2000000000;
+const int SIMULATED_CHANNEL_DIFFERENCE_RATE = 100;
+
+// 单次频道差异最多返回的消息数，遗漏超过SIMULATED_CHANNEL_TOO_LONG时只返回最新的消息
+const int SIMULATED_CHANNEL_DIFFERENCE_LIMIT = 100;
+const int SIMULATED_CHANNEL_TOO_LONG = 1000;
+
+bool isSimulatedChannel(qint64 peerId)
+{
+    return peerId >= SIMULATED_CHANNEL_BASE && peerId < SIMULATED_CHANNEL_BASE + SIMULATED_CHANNEL_COUNT;
+}
+
+// 频道的消息ID与pts一致，按各自的发帖间隔随时间增长，离线一段时间后每个频道都有遗漏
+qint32 simulatedChannelPts(qint64 channelId)
+{
+    int index = int(channelId - SIMULATED_CHANNEL_BASE);
+    qint64 period = 30 + (index * 7919) % 900;
+    return qint32((Clock::instance()->currentSecsSinceEpoch() - 1600000000) / period);
+}
+
+// 约五分之一的频道有未读消息
+qint32 simulatedChannelReadMaxId(qint64 channelId)
+{
+    int index = int(channelId - SIMULATED_CHANNEL_BASE);
+    qint32 pts = simulatedChannelPts(channelId);
+    return index % 5 == 0 ? pts - 1 - index % 50 : pts;
+}
+
+// 约八分之一的频道在归档文件夹（1）中
+qint32 simulatedChannelFolder(qint64 channelId)
+{
+    return int(channelId - SIMULATED_CHANNEL_BASE) % 8 == 7 ? 1 : 0;
+}
+
+QJsonObject simulateChannel(qint64 channelId)
+{
+    static const char* const topics[] = {
+        "科技新闻", "开源软件", "Qt Developers", "每日一读", "摄影分享",
+        "Linux中文社区", "Crypto Daily", "旅行日记", "读书会", "游戏资讯"
+    };
+    int index = int(channelId - SIMULATED_CHANNEL_BASE);
+    QJsonObject channel;
+    channel["id"] = double(channelId);
+    channel["title"] = QString::fromUtf8(topics[index % 10]) + ' ' + QString::number(index);
+    channel["username"] = index % 3 == 0 ? "channel" + QString::number(index) : QString();
+    return channel;
+}
+
+// 按用户ID确定性地生成模拟联系人
+QJsonObject simulateUser(qint64 userId)
+{
+    static const char* const surnames[] = {
+        "王", "李", "张", "刘", "陈", "杨", "黄", "赵", "吴", "周",
+        "徐", "孙", "马", "朱", "胡", "郭", "何", "高", "林", "罗"
+    };
+    static const char* const givenNames[] = {
+        "伟", "芳", "娜", "敏", "静", "丽", "强", "磊", "军", "洋",
+        "勇", "艳", "杰", "娟", "涛", "明", "超", "秀英", "华", "建国",
+        "子涵", "雨桐", "浩然", "思远", "欣怡"
+    };
+    static const char* const englishFirstNames[] = {
+        "Alice", "Bob", "Carol", "David", "Emma", "Frank", "Grace", "Henry"
+    };
+    static const char* const englishLastNames[] = {
+        "Smith", "Johnson", "Brown", "Taylor", "Miller", "Wilson"
+    };
+    
+    QRandomGenerator generator(quint32(userId * 2246822519u));
+    QJsonObject user;
+    user["id"] = double(userId);
+    if (generator.bounded(4) == 0) {
+        QString first = QString::fromUtf8(englishFirstNames[generator.bounded(8)]);
+        QString last = QString::fromUtf8(englishLastNames[generator.bounded(6)]);
+        user["first_name"] = first;
+        user["last_name"] = last;
+        user["username"] = (first + last).toLower() + QString::number(userId % 1000);
+    } else {
+        user["first_name"] = QString::fromUtf8(surnames[generator.bounded(20)])
+                           + QString::fromUtf8(givenNames[generator.bounded(25)]);
+        user["last_name"] = QString();
+        user["username"] = generator.bounded(2) == 0 ? "cn_user" + QString::number(userId) : QString();
+    }
+    return user;
+}
+
+PeerData parseUser(const QJsonObject& object)
+{
+    PeerData peer;
+    peer.id = qint64(object["id"].toDouble());
+    peer.type = PeerData::User;
+    peer.firstName = object["first_name"].toString();
+    peer.lastName = object["last_name"].toString();
+    peer.username = object["username"].toString();
+    return peer;
+}
+
+MessageData parseMessage(const QJsonObject& object)
+{
+    MessageData message;
+    message.peerId = qint64(object["peer_id"].toDouble());
+    message.id = object["id"].toInt();
+    message.date = object["date"].toInt();
+    message.editDate = object["edit_date"].toInt();
+    message.fromId = qint64(object["from_id"].toDouble());
+    message.fromName = object["from_name"].toString();
+    message.text = object["message"].toString();
+    return message;
+}
+
+UpdateData parseUpdate(const QJsonObject& object)
+{
+    UpdateData update;
+    const QString type = object["_"].toString();
+    if (type == "updateNewMessage") {
+        update.type = UpdateData::NewMessage;
+        update.message = parseMessage(object["message"].toObject());
+        update.peerId = update.message.peerId;
+    } else if (type == "updateEditMessage") {
+        update.type = UpdateData::EditMessage;
+        update.message = parseMessage(object["message"].toObject());
+        update.peerId = update.message.peerId;
+    } else if (type == "updateDeleteMessages") {
+        update.type = UpdateData::DeleteMessages;
+        update.peerId = qint64(object["peer"].toDouble());
+        for (const QJsonValue& id : object["messages"].toArray()) {
+            update.messageIds.append(id.toInt());
+        }
+    } else if (type == "updateReadHistoryInbox") {
+        update.type = UpdateData::ReadHistoryInbox;
+        update.peerId = qint64(object["peer"].toDouble());
+        update.maxId = object["max_id"].toInt();
+    }
+    update.pts = object["pts"].toInt();
+    update.ptsCount = object["pts_count"].toInt();
+    update.qts = object["qts"].toInt();
+    return update;
+}
+
+UpdatesState parseState(const QJsonObject& object)
+{
+    UpdatesState state;
+    state.pts = object["pts"].toInt();
+    state.qts = object["qts"].toInt();
+    state.seq = object["seq"].toInt();
+    state.date = object["date"].toInt();
+    return state;
+}
+
+QJsonObject serializeState(const UpdatesState& state)
+{
+    QJsonObject object;
+    object["pts"] = state.pts;
+    object["qts"] = state.qts;
+    object["seq"] = state.seq;
+    object["date"] = state.date;
+    return object;
+}
+
+// 客户端带来的hash与服务器当前列表的hash一致；hash为0表示客户端没有缓存
+bool isListUnchanged(const QJsonObject& parameters, qint64 hash)
+{
+    qint64 clientHash = parameters["hash"].toString().toLongLong();
+    return clientHash != 0 && clientHash == hash;
+}
+
+// 序列化后超过这个大小的对象以gzip_packed传输
+const int GZIP_PACK_THRESHOLD = 16 * 1024;
+
+// 压缩数据按这个大小分段送入解压器，与网络读取的粒度相当
+const int INFLATE_CHUNK_SIZE = 16 * 1024;
+
+// gzip尾部的长度由服务器给出，预先分配时最多按压缩数据的这个倍数；解压结果超过上限时放弃
+const int INFLATE_RESERVE_RATIO = 16;
+const qint64 MAX_INFLATED_RESPONSE = 64 * 1024 * 1024;
+
+bool isGzipPacked(const QJsonObject& object)
+{
+    return object["_"].toString() == "gzip_packed";
+}
+
+// 对象在模拟网络上的序列化形式（相当于真实协议中的TL序列化）
+QByteArray serializeObject(const QJsonObject& object)
+{
+    return QCborMap::fromJsonObject(object).toCborValue().toCbor();
+}
+
+QJsonObject deserializeObject(const QByteArray& bytes)
+{
+    // 旧的抓包文件中gzip_packed的内容是JSON文本
+    if (bytes.startsWith('{')) {
+        return QJsonDocument::fromJson(bytes).object();
+    }
+    return QCborValue::fromCbor(bytes).toMap().toJsonObject();
+}
+
+// 较大的对象压缩为gzip_packed，rawBytes和packedBytes返回压缩前后的大小（未压缩时不变）
+QJsonObject packLargeObject(const QJsonObject& object, qint64* rawBytes = nullptr, qint64* packedBytes = nullptr)
+{
+    QByteArray raw = serializeObject(object);
+    if (raw.size() <= GZIP_PACK_THRESHOLD) {
+        return object;
+    }
+    QByteArray packed = GzipInflater::compress(raw);
+    if (packed.isEmpty() || packed.size() >= raw.size()) {
+        return object;
+    }
+    if (rawBytes) {
+        *rawBytes += raw.size();
+    }
+    if (packedBytes) {
+        *packedBytes += packed.size();
+    }
+    QJsonObject result;
+    result["_"] = "gzip_packed";
+    result["packed_data"] = QString::fromLatin1(packed.toBase64());
+    return result;
+}
+
+// 分段解压gzip_packed的内容，输出按gzip尾部记录的长度预先分配（有上限）
+bool inflatePacked(GzipInflater& inflater, const QByteArray& packed, QByteArray* output)
+{
+    inflater.reset();
+    output->clear();
+    qint64 expected = GzipInflater::uncompressedSize(packed);
+    if (expected > 0) {
+        output->reserve(qMin(expected, qMin(qint64(packed.size()) * INFLATE_RESERVE_RATIO, MAX_INFLATED_RESPONSE)));
+    }
+    GzipInflater::Status status = GzipInflater::NeedMoreInput;
+    for (qsizetype offset = 0; offset < packed.size() && status == GzipInflater::NeedMoreInput;
+         offset += INFLATE_CHUNK_SIZE) {
+        int size = int(qMin<qsizetype>(INFLATE_CHUNK_SIZE, packed.size() - offset));
+        status = inflater.feed(packed.constData() + offset, size, output, MAX_INFLATED_RESPONSE);
+    }
+    if (inflater.outputLimitExceeded()) {
+        qWarning() << "gzip_packed解压结果超过" << MAX_INFLATED_RESPONSE << "字节，放弃";
+        output->clear();
+        return false;
+    }
+    return status == GzipInflater::Finished;
+}
+
+// 推送的更新容器
+UpdatesBatch parseUpdatesContainer(const QJsonObject& object)
+{
+    UpdatesBatch batch;
+    batch.seq = object["seq"].toInt();
+    batch.seqStart = object["seq_start"].toInt();
+    batch.date = object["date"].toInt();
+    for (const QJsonValue& value : object["updates"].toArray()) {
+        batch.updates.append(parseUpdate(value.toObject()));
+    }
+    return batch;
+}
+
+} // namespace
 
 MTProtoClient::MTProtoClient(QObject *parent)
+    : MTProtoClient(nullptr, parent)
+{
+}
+
+MTProtoClient::MTProtoClient(QNetworkAccessManager* sharedNetworkManager, QObject *parent)
     : QObject(parent)
-    , m_networkManager(new QNetworkAccessManager(this))
+    , m_networkManager(sharedNetworkManager ? sharedNetworkManager : new QNetworkAccessManager(this))
+    , m_ownsNetworkManager(sharedNetworkManager == nullptr)
     , m_apiId(0)
     , m_proxyEnabled(false)
     , m_proxyPort(0)
-    , m_lastMessageId(0)
+    , m_endpoints(DcProber::defaultEndpoints())
+    , m_endpointIndex(0)
+    , m_simulatedUpdatesActive(false)
+    , m_simulatedBasePts(0)
+    , m_simulatedSeq(0)
+    , m_nextRequestId(0)
+    , m_replaying(false)
+    , m_replaySpeed(1.0)
+    , m_compressRequests(false)
+    , m_decoder(&m_arena)
+    , m_arenaDepth(0)
+    , m_connected(true)
+    , m_networkReachable(true)
+    , m_reconnectAttempts(0)
+    , m_reconnectTask(0)
+    , m_flushTask(0)
+    , m_saltsRequested(false)
+    , m_saltPrefetchTask(0)
+    , m_simulatedClockSkewMs(QRandomGenerator::global()->bounded(-SIMULATED_MAX_CLOCK_SKEW_MS, SIMULATED_MAX_CLOCK_SKEW_MS + 1))
 {
     // 连接网络响应信号
-    connect(m_networkManager, &QNetworkAccessManager::finished, this, &MTProtoClient::onNetworkReply);
+    if (m_ownsNetworkManager) {
+        connect(m_networkManager, &QNetworkAccessManager::finished, this, &MTProtoClient::onNetworkReply);
+    }
 }
 
 MTProtoClient::~MTProtoClient()
@@ -129,7 +524,212 @@ void MTProtoClient::getMe()
     makeApiRequest("users.getFullUser", parameters);
 }
 
-void MTProtoClient::makeApiRequest(const QString& method, const QJsonObject& parameters)
+void MTProtoClient::getHistory(qint64 peerId, qint32 offsetId, int limit)
+{
+    QJsonObject parameters;
+    parameters["peer"] = double(peerId);
+    parameters["offset_id"] = offsetId;
+    parameters["limit"] = limit;
+    makeApiRequest("messages.getHistory", parameters);
+}
+
+void MTProtoClient::sendMessage(qint64 peerId, const QString& text, qint64 randomId)
+{
+    QJsonObject parameters;
+    parameters["peer"] = double(peerId);
+    parameters["message"] = text;
+    parameters["random_id"] = QString::number(randomId);
+    makeApiRequest("messages.sendMessage", parameters);
+}
+
+void MTProtoClient::getContacts(qint64 hash)
+{
+    QJsonObject parameters;
+    parameters["hash"] = QString::number(hash);
+    makeApiRequest("contacts.getContacts", parameters);
+}
+
+void MTProtoClient::getUpdatesState()
+{
+    makeApiRequest("updates.getState", QJsonObject());
+}
+
+void MTProtoClient::getDifference(const UpdatesState& state)
+{
+    makeApiRequest("updates.getDifference", serializeState(state));
+}
+
+void MTProtoClient::getDialogs(qint64 hash)
+{
+    QJsonObject parameters;
+    parameters["hash"] = QString::number(hash);
+    makeApiRequest("messages.getDialogs", parameters);
+}
+
+quint64 MTProtoClient::getChannelDifference(qint64 channelId, qint32 pts, int limit)
+{
+    QJsonObject parameters;
+    parameters["channel"] = double(channelId);
+    parameters["pts"] = pts;
+    parameters["limit"] = limit;
+    return makeApiRequest("updates.getChannelDifference", parameters);
+}
+
+void MTProtoClient::cancelRequest(quint64 requestId)
+{
+    auto it = m_pendingRequests.find(requestId);
+    if (it == m_pendingRequests.end()) {
+        return;
+    }
+    cancelAttempts(&it.value());
+    m_pendingRequests.erase(it);
+}
+
+bool MTProtoClient::simulateFloodCheck(const QString& method, int perSecond)
+{
+    qint64 second = Clock::instance()->currentMSecsSinceEpoch() / 1000;
+    QPair<qint64, int>& window = m_simulatedCallWindows[method];
+    if (window.first != second) {
+        window = qMakePair(second, 0);
+    }
+    return ++window.second <= perSecond;
+}
+
+void MTProtoClient::startSimulatedUpdates()
+{
+    // 回放时推送来自抓包文件
+    if (m_replaying || m_simulatedUpdatesActive) {
+        return;
+    }
+    // 模拟服务器每次启动都从比上次更大的pts开始，上次保存的状态会被判定为遗漏过多
+    m_simulatedBasePts = qint32((Clock::instance()->currentSecsSinceEpoch() - 1600000000) * 4);
+    m_simulatedSeq = 0;
+    m_simulatedUpdates.clear();
+    m_simulatedUpdatesActive = true;
+    scheduleSimulatedUpdates();
+}
+
+void MTProtoClient::scheduleSimulatedUpdates()
+{
+    Clock::instance()->singleShot(SIMULATED_UPDATE_INTERVAL_MS, this, [this]() {
+        if (m_simulatedUpdatesActive) {
+            pushSimulatedUpdates();
+            scheduleSimulatedUpdates();
+        }
+    });
+}
+
+QJsonObject MTProtoClient::simulateHistoryMessage(qint64 peerId, qint32 id) const
+{
+    auto it = m_simulatedEdits.constFind(qMakePair(peerId, id));
+    return it != m_simulatedEdits.constEnd() ? it.value() : simulateMessage(peerId, id);
+}
+
+void MTProtoClient::pushSimulatedUpdates()
+{
+    QRandomGenerator* generator = QRandomGenerator::global();
+    qint32 now = qint32(Clock::instance()->currentSecsSinceEpoch());
+    
+    QJsonArray updates;
+    int count = 1 + generator->bounded(5);
+    for (int i = 0; i < count; ++i) {
+        qint64 peerId = 1 + generator->bounded(SIMULATED_ACTIVE_PEERS);
+        qint32 topId = m_simulatedTopIds.value(peerId, SIMULATED_HISTORY_SIZE);
+        int kind = generator->bounded(10);
+        
+        QJsonObject update;
+        if (kind < 7) {
+            m_simulatedTopIds.insert(peerId, ++topId);
+            update["_"] = "updateNewMessage";
+            update["message"] = simulateMessage(peerId, topId);
+        } else if (kind < 9) {
+            qint32 id = topId - generator->bounded(20);
+            QJsonObject message = simulateHistoryMessage(peerId, id);
+            message["message"] = message["message"].toString() + "（已编辑）";
+            message["edit_date"] = now;
+            m_simulatedEdits.insert(qMakePair(peerId, id), message);
+            update["_"] = "updateEditMessage";
+            update["message"] = message;
+        } else {
+            // 在其他设备上读完
+            m_simulatedReadMaxIds.insert(peerId, topId);
+            update["_"] = "updateReadHistoryInbox";
+            update["peer"] = double(peerId);
+            update["max_id"] = topId;
+        }
+        update["pts"] = m_simulatedBasePts + qint32(m_simulatedUpdates.size()) + 1;
+        update["pts_count"] = 1;
+        m_simulatedUpdates.append(update);
+        updates.append(update);
+    }
+    
+    QJsonObject container;
+    container["seq"] = ++m_simulatedSeq;
+    container["seq_start"] = m_simulatedSeq;
+    container["date"] = now;
+    container["updates"] = updates;
+    
+    // 模拟网络：偶尔丢失整个容器，晚于后面的容器送达，或者重复送达（同一个msg_id）；
+    // 断开期间的推送全部丢失，由差异补齐
+    quint64 messageId = simulatedServerMessageId();
+    int delivery = generator->bounded(20);
+    if (delivery == 0 || !m_connected) {
+        qDebug() << "模拟更新丢失: seq" << m_simulatedSeq;
+    } else if (delivery == 1) {
+        Clock::instance()->singleShot(300, this, [this, container, messageId]() {
+            deliverPush(container, messageId);
+        });
+    } else if (delivery == 2) {
+        deliverPush(container, messageId);
+        Clock::instance()->singleShot(100, this, [this, container, messageId]() {
+            deliverPush(container, messageId);
+        });
+    } else {
+        deliverPush(container, messageId);
+    }
+}
+
+void MTProtoClient::simulateOutgoing(const QJsonArray& messages)
+{
+    if (messages.isEmpty()) {
+        return;
+    }
+    // 单向送达，约为半个往返
+    Clock::instance()->singleShot(SIMULATED_ROUND_TRIP_MS / 2, this, [this, messages]() {
+        for (const QJsonValue& value : messages) {
+            QJsonObject message = value.toObject();
+            QString method = message["_"].toString();
+            if (method == "messages.readHistory") {
+                qint64 peerId = qint64(message["peer"].toDouble());
+                qint32& readMaxId = m_simulatedReadMaxIds[peerId];
+                readMaxId = qMax(readMaxId, message["max_id"].toInt());
+                ++m_outgoing.readMarks;
+            } else if (method == "messages.setTyping") {
+                ++m_outgoing.typingActions;
+            } else if (method == "account.updateStatus") {
+                ++m_outgoing.statusChanges;
+            }
+        }
+    });
+}
+
+qint32 MTProtoClient::simulatedReadMaxId(qint64 channelId) const
+{
+    // 客户端标记的已读位置不会超过频道的最新消息
+    qint32 pts = simulatedChannelPts(channelId);
+    return qMin(pts, qMax(simulatedChannelReadMaxId(channelId), m_simulatedReadMaxIds.value(channelId)));
+}
+
+void MTProtoClient::deliverPush(const QJsonObject& container, quint64 messageId)
+{
+    if (!receiveServerMessage(messageId)) {
+        return;
+    }
+    m_capture.write(TrafficCapture::Push, 0, "updates", container);
+    emit updatesReceived(parseUpdatesContainer(container));
+}
+
+quint64 MTProtoClient::makeApiRequest(const QString& method, const QJsonObject& parameters)
 {
     // 简化的API请求实现 - 实际的MTProto更复杂
     
@@ -138,19 +738,629 @@ void MTProtoClient::makeApiRequest(const QString& method, const QJsonObject& par
     
     qDebug() << "发起API请求: " << method << "参数: " << parameters;
     
+    // 较大的请求可选压缩后发送
+    QJsonObject payload = m_compressRequests
+        ? packLargeObject(parameters, &m_compression.requestBytes, &m_compression.requestCompressedBytes)
+        : parameters;
+    if (isGzipPacked(payload)) {
+        ++m_compression.packedRequests;
+    }
+    
+    quint64 requestId = ++m_nextRequestId;
+    m_capture.write(TrafficCapture::Request, requestId, method, payload);
+    
+    PendingRequest& pending = m_pendingRequests[requestId];
+    pending.method = method;
+    pending.payload = payload;
+    m_retryPolicy.addRequest();
+    if (RetryPolicy::isIdempotent(method)) {
+        ++m_hedge.idempotentRequests;
+    }
+    
+    // 回放时使用录制的响应和录制时的延迟
+    if (m_replaying) {
+        QQueue<ReplayResponse>& queue = m_replayResponses[method];
+        if (!queue.isEmpty()) {
+            pending.hasReplay = true;
+            pending.replay = queue.dequeue();
+        } else {
+            qWarning() << "抓包中没有更多" << method << "的响应，改用模拟服务器";
+        }
+    }
+    
+    // 断开期间的请求留在表中，重连后发出
+    if (m_connected) {
+        dispatchRequest(requestId);
+    }
+    return requestId;
+}
+
+void MTProtoClient::dispatchRequest(quint64 requestId, bool hedge)
+{
+    PendingRequest& pending = m_pendingRequests[requestId];
+    int delay = pending.hasReplay ? replayDelay(pending.replay.latencyUs) : simulatedRoundTrip();
+    
+    // 每次发送（包括重发和对冲）都使用新的msg_id和当前的盐
+    qint64 nowMs = Clock::instance()->currentMSecsSinceEpoch();
+    pending.messageId = m_messageIds.next(nowMs);
+    pending.salt = m_salts.current(serverNow());
+    quint64 messageId = pending.messageId;
+    qint64 salt = pending.salt;
+    
+    if (hedge) {
+        // 对冲副本在另一个连接上单独发出，不附带确认
+        ++m_outgoing.packets;
+        ++m_outgoing.messages;
+    } else {
+        // 延迟从首次发出算起，重发和重连多出的往返也计入
+        if (pending.sentAtMs == 0) {
+            pending.sentAtMs = nowMs;
+        }
+        
+        // 积累的确认和状态变化与请求放在同一个容器中
+        QJsonArray piggyback = takeOutgoing();
+        ++m_outgoing.packets;
+        m_outgoing.messages += 1 + piggyback.size();
+        simulateOutgoing(piggyback);
+        scheduleHedge(requestId);
+    }
+    
     // 在这个简化版本中，我们不实际发送网络请求，直接模拟响应
-    QTimer::singleShot(500, this, [this, method, parameters]() {
-        // 模拟网络延迟后，调用模拟响应
-        QJsonObject response = simulateRequest(method, parameters);
-        processSimulatedResponse(method, response);
+    int task = Clock::instance()->singleShot(delay, this, [this, requestId, hedge, messageId, salt]() {
+        auto it = m_pendingRequests.find(requestId);
+        if (it == m_pendingRequests.end()) {
+            return;
+        }
+        (hedge ? it->hedgeTask : it->task) = 0;
+        
+        // 模拟服务器先检查msg_id的时间和盐，不通过时返回错误，客户端校正后重发（多一次往返）。
+        // 服务器消息的时间戳取往返的中点，由此得到的偏差样本就是两边时钟的偏差
+        qint64 offsetSample = m_simulatedClockSkewMs;
+        if (!it->hasReplay) {
+            qint64 serverTimeMs = Clock::instance()->currentMSecsSinceEpoch() + m_simulatedClockSkewMs;
+            qint64 messageTime = MessageIdGenerator::timeOf(messageId);
+            if (messageTime < serverTimeMs - MSG_ID_MAX_AGE_MS || messageTime > serverTimeMs + MSG_ID_MAX_AHEAD_MS) {
+                ++m_session.badMsgNotifications;
+                qDebug() << "bad_msg_notification:" << it->method << "的msg_id与服务器时间相差"
+                         << (messageTime - serverTimeMs) / 1000 << "秒，校正时间后重发";
+                if (m_messageIds.resetOffset(offsetSample, Clock::instance()->currentMSecsSinceEpoch())) {
+                    // 时间往回修正，会话内的msg_id不能回退，改用新的会话
+                    ++m_session.sessionRestarts;
+                    m_sessionId = QString::number(QRandomGenerator::global()->generate64(), 16);
+                    m_messageIds.startSession();
+                    m_replayWindow.reset();
+                }
+                dispatchRequest(requestId, hedge);
+                return;
+            }
+            if (!simulatedSaltValid(salt, qint32(serverTimeMs / 1000))) {
+                ++m_session.badServerSalts;
+                qDebug() << "bad_server_salt:" << it->method << "使用的盐已失效，改用服务器给出的盐后重发";
+                m_salts.setCurrent(simulatedSalt(qint32(serverTimeMs / 1000) / SIMULATED_SALT_PERIOD),
+                                   qint32(serverTimeMs / 1000));
+                m_messageIds.addOffsetSample(offsetSample);
+                dispatchRequest(requestId, hedge);
+                prefetchSalts();
+                return;
+            }
+        }
+        m_messageIds.addOffsetSample(offsetSample);
+        
+        // 被重放检测丢弃的响应不会再来，与bad_msg一样用新的msg_id重发；断开时留给重连后发出
+        if (!receiveServerMessage(simulatedServerMessageId())) {
+            if (m_connected) {
+                dispatchRequest(requestId, hedge);
+            }
+            return;
+        }
+        
+        // 先到的响应有效，另一个连接上的副本不再等待
+        PendingRequest request = it.value();
+        m_pendingRequests.erase(it);
+        cancelAttempts(&request);
+        if (hedge) {
+            ++m_hedge.hedgeWins;
+        }
+        m_retryPolicy.recordLatency(request.method, Clock::instance()->currentMSecsSinceEpoch() - request.sentAtMs);
+        
+        // 模拟网络延迟后，调用模拟响应；与真实服务器一样，较大的响应以gzip_packed返回
+        QJsonObject response = request.hasReplay
+            ? request.replay.payload
+            : packLargeObject(simulateRequest(request.method, request.payload));
+        m_capture.write(TrafficCapture::Response, requestId, request.method, response);
+        processSimulatedResponse(request.method, serializeObject(response));
     });
+    (hedge ? pending.hedgeTask : pending.task) = task;
 }
 
-QJsonObject MTProtoClient::simulateRequest(const QString& method, const QJsonObject& parameters)
+void MTProtoClient::scheduleHedge(quint64 requestId)
 {
+    PendingRequest& pending = m_pendingRequests[requestId];
+    if (pending.hedgeTimer) {
+        Clock::instance()->cancel(pending.hedgeTimer);
+        pending.hedgeTimer = 0;
+    }
+    // 回放的响应时间是录制时的，对冲没有意义；已经发出对冲时不再发第二个
+    if (pending.hasReplay || pending.hedgeTask) {
+        return;
+    }
+    int delay = m_retryPolicy.hedgeDelay(pending.method);
+    if (delay < 0) {
+        return;
+    }
+    pending.hedgeTimer = Clock::instance()->singleShot(delay, this, [this, requestId, delay]() {
+        auto it = m_pendingRequests.find(requestId);
+        if (it == m_pendingRequests.end()) {
+            return;
+        }
+        it->hedgeTimer = 0;
+        if (!m_connected) {
+            return;
+        }
+        if (!m_retryPolicy.acquireHedge()) {
+            ++m_hedge.budgetDenied;
+            return;
+        }
+        ++m_hedge.hedges;
+        
+        // 副本发往下一个地址（只有一个地址时是同一数据中心的另一个连接），与原请求互不影响
+        const DcEndpoint& endpoint = m_endpoints.at((m_endpointIndex + 1) % m_endpoints.size());
+        qDebug() << it->method << "已等待" << delay << "毫秒，在" << endpoint.host << "上发送对冲请求";
+        dispatchRequest(requestId, true);
+    });
+}
+
+void MTProtoClient::cancelAttempts(PendingRequest* pending)
+{
+    for (int* task : { &pending->task, &pending->hedgeTimer, &pending->hedgeTask }) {
+        if (*task) {
+            Clock::instance()->cancel(*task);
+            *task = 0;
+        }
+    }
+}
+
+void MTProtoClient::setHedgeBudget(double share)
+{
+    m_retryPolicy.setHedgeBudget(share);
+}
+
+MTProtoClient::HedgeStats MTProtoClient::hedgeStats() const
+{
+    return m_hedge;
+}
+
+bool MTProtoClient::isConnected() const
+{
+    return m_connected;
+}
+
+void MTProtoClient::handleNetworkChange(bool reachable)
+{
+    m_networkReachable = reachable;
+    dropConnection();
+    
+    // 网络变化后的第一次重连不等待
+    m_reconnectAttempts = 0;
+    if (m_reconnectTask) {
+        Clock::instance()->cancel(m_reconnectTask);
+        m_reconnectTask = 0;
+    }
+    if (reachable) {
+        scheduleReconnect();
+    }
+}
+
+void MTProtoClient::dropConnection()
+{
+    if (!m_connected) {
+        return;
+    }
+    m_connected = false;
+    
+    // 旧连接上还没收到的响应不会再到达，请求保留在表中等待重发
+    for (PendingRequest& pending : m_pendingRequests) {
+        cancelAttempts(&pending);
+    }
+    qDebug() << "连接已断开，" << m_pendingRequests.size() << "个请求等待重发";
+    emit connectionStateChanged(false);
+}
+
+void MTProtoClient::scheduleReconnect()
+{
+    int delay = 0;
+    if (m_reconnectAttempts > 0) {
+        // 指数退避，取上限的一半到全部之间的随机值，避免大量客户端同时重连
+        int ceiling = qMin(RECONNECT_MAX_DELAY_MS, RECONNECT_BASE_DELAY_MS << qMin(m_reconnectAttempts - 1, 16));
+        delay = ceiling / 2 + QRandomGenerator::global()->bounded(ceiling / 2 + 1);
+    }
+    m_reconnectTask = Clock::instance()->singleShot(delay, this, [this]() {
+        m_reconnectTask = 0;
+        reconnect();
+    });
+}
+
+void MTProtoClient::reconnect()
+{
+    // 网络不可达时等待下一次网络变化
+    if (!m_networkReachable || m_connected) {
+        return;
+    }
+    ++m_reconnectAttempts;
+    
+    // 会话和密钥不变，新连接只需一次往返；模拟新接口刚启用时偶尔连接失败
+    m_reconnectTask = Clock::instance()->singleShot(SIMULATED_ROUND_TRIP_MS, this, [this]() {
+        m_reconnectTask = 0;
+        if (QRandomGenerator::global()->bounded(SIMULATED_RECONNECT_FAILURE_RATE) == 0) {
+            // 连接失败计入探测结果，下一次尝试改用下一个地址
+            qDebug() << "重连失败，第" << m_reconnectAttempts << "次尝试";
+            reportEndpointFailure();
+            scheduleReconnect();
+            return;
+        }
+        
+        m_connected = true;
+        qDebug() << "已重连到" << currentEndpoint().host << "，第" << m_reconnectAttempts << "次尝试，会话不变，重发"
+                 << m_pendingRequests.size() << "个未确认的请求";
+        m_reconnectAttempts = 0;
+        emit connectionStateChanged(true);
+        
+        const QList<quint64> pendingIds = m_pendingRequests.keys();
+        for (quint64 requestId : pendingIds) {
+            dispatchRequest(requestId);
+        }
+        
+        // 没有请求可以附带时，断开期间积累的确认单独发出
+        flushOutgoing();
+    });
+}
+
+void MTProtoClient::markRead(qint64 peerId, qint32 maxId)
+{
+    m_coalescer.markRead(peerId, maxId);
+    scheduleFlush();
+}
+
+void MTProtoClient::setTyping(qint64 peerId, const QString& action)
+{
+    m_coalescer.setTyping(peerId, action, Clock::instance()->currentMSecsSinceEpoch());
+    scheduleFlush();
+}
+
+void MTProtoClient::setOnline(bool online)
+{
+    m_coalescer.setOnline(online);
+    scheduleFlush();
+}
+
+MTProtoClient::SessionStats MTProtoClient::sessionStats() const
+{
+    SessionStats stats = m_session;
+    stats.timeOffsetMs = m_messageIds.offsetMs();
+    return stats;
+}
+
+qint32 MTProtoClient::serverNow() const
+{
+    return qint32(m_messageIds.serverTimeMs(Clock::instance()->currentMSecsSinceEpoch()) / 1000);
+}
+
+void MTProtoClient::prefetchSalts()
+{
+    if (m_saltsRequested) {
+        return;
+    }
+    m_saltsRequested = true;
+    makeApiRequest("get_future_salts", QJsonObject{{"num", FUTURE_SALTS_COUNT}});
+}
+
+void MTProtoClient::scheduleSaltPrefetch()
+{
+    if (m_saltPrefetchTask) {
+        Clock::instance()->cancel(m_saltPrefetchTask);
+    }
+    // 在已知的盐快用完之前再取一批，空闲时也不会用到过期的盐
+    qint64 delayMs = qint64(m_salts.secondsUntilPrefetch(serverNow())) * 1000;
+    m_saltPrefetchTask = Clock::instance()->singleShot(int(qMin<qint64>(delayMs, std::numeric_limits<int>::max())), this, [this]() {
+        m_saltPrefetchTask = 0;
+        prefetchSalts();
+    });
+}
+
+MTProtoClient::OutgoingStats MTProtoClient::outgoingStats() const
+{
+    OutgoingStats stats = m_outgoing;
+    stats.submitted = m_coalescer.submitted() + m_nextRequestId;
+    return stats;
+}
+
+quint64 MTProtoClient::simulatedServerMessageId()
+{
+    // 服务器消息的msg_id按服务器时间生成，除以4余1
+    return m_simulatedServerIds.next(Clock::instance()->currentMSecsSinceEpoch() + m_simulatedClockSkewMs) | 1;
+}
+
+bool MTProtoClient::receiveServerMessage(quint64 messageId)
+{
+    ReplayWindow::Result result = m_replayWindow.check(messageId, m_messageIds.serverTimeMs(Clock::instance()->currentMSecsSinceEpoch()));
+    if (result != ReplayWindow::Accepted) {
+        if (result == ReplayWindow::Duplicate) {
+            ++m_session.duplicateMessages;
+        } else {
+            ++m_session.staleMessages;
+        }
+        qDebug() << "丢弃服务器消息" << messageId << (result == ReplayWindow::Duplicate ? "（重复）" : "（时间超出范围）");
+        return false;
+    }
+    m_coalescer.ack(qint64(messageId));
+    scheduleFlush();
+    return true;
+}
+
+void MTProtoClient::scheduleFlush()
+{
+    if (m_flushTask || !m_connected || m_coalescer.isEmpty()) {
+        return;
+    }
+    m_flushTask = Clock::instance()->singleShot(OUTGOING_FLUSH_DELAY_MS, this, [this]() {
+        m_flushTask = 0;
+        flushOutgoing();
+    });
+}
+
+void MTProtoClient::flushOutgoing()
+{
+    // 断开期间保留，重连后发出
+    if (!m_connected) {
+        return;
+    }
+    QJsonArray messages = takeOutgoing();
+    if (messages.isEmpty()) {
+        return;
+    }
+    ++m_outgoing.packets;
+    m_outgoing.messages += messages.size();
+    simulateOutgoing(messages);
+}
+
+QJsonArray MTProtoClient::takeOutgoing()
+{
+    if (m_flushTask) {
+        Clock::instance()->cancel(m_flushTask);
+        m_flushTask = 0;
+    }
+    QJsonArray messages = m_coalescer.take();
+    for (const QJsonValue& message : std::as_const(messages)) {
+        QJsonObject object = message.toObject();
+        m_capture.write(TrafficCapture::Request, 0, object["_"].toString(), object);
+    }
+    return messages;
+}
+
+void MTProtoClient::setEndpoints(const QVector<DcEndpoint>& endpoints)
+{
+    if (endpoints.isEmpty()) {
+        return;
+    }
+    // 已建立的连接不受影响，只有新连接使用新的顺序
+    if (endpoints.first().host != currentEndpoint().host) {
+        qDebug() << "新连接改用地址" << endpoints.first().host << "DC" << endpoints.first().dcId;
+    }
+    m_endpoints = endpoints;
+    m_endpointIndex = 0;
+}
+
+DcEndpoint MTProtoClient::currentEndpoint() const
+{
+    return m_endpoints.at(m_endpointIndex);
+}
+
+void MTProtoClient::reportEndpointFailure()
+{
+    DcEndpoint failed = currentEndpoint();
+    m_endpointIndex = (m_endpointIndex + 1) % m_endpoints.size();
+    qWarning() << "地址" << failed.host << "连接失败，改用" << currentEndpoint().host;
+    emit endpointFailed(failed.host, failed.port);
+}
+
+MTProtoClient::CompressionStats MTProtoClient::compressionStats() const
+{
+    return m_compression;
+}
+
+void MTProtoClient::setRequestCompression(bool enabled)
+{
+    m_compressRequests = enabled;
+}
+
+QJsonObject MTProtoClient::unpackResponse(const QJsonObject& response)
+{
+    if (!isGzipPacked(response)) {
+        return response;
+    }
+    
+    QByteArray raw;
+    if (!inflateResponse(QByteArray::fromBase64(response["packed_data"].toString().toLatin1()), &raw)) {
+        return QJsonObject();
+    }
+    return deserializeObject(raw);
+}
+
+bool MTProtoClient::inflateResponse(const QByteArray& packed, QByteArray* raw)
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = inflatePacked(m_inflater, packed, raw);
+    qint64 elapsedNs = timer.nsecsElapsed();
+    if (!ok) {
+        qWarning() << "gzip_packed解压失败，压缩数据" << packed.size() << "字节";
+        return false;
+    }
+    
+    m_compression.packedResponses++;
+    m_compression.responseCompressedBytes += packed.size();
+    m_compression.responseBytes += raw->size();
+    m_compression.inflateNs += elapsedNs;
+    return true;
+}
+
+void MTProtoClient::processArenaResponse(const QString& method, const QByteArray& wire)
+{
+    bool isHistory = method == "messages.getHistory";
+    TlHistory history;
+    TlDialogs dialogs;
+    TlArena::Stats before = m_arena.stats();
+    QElapsedTimer timer;
+    timer.start();
+    
+    QByteArray bytes = wire;
+    TlDecoder::Status status = isHistory ? m_decoder.decodeHistory(bytes, &history)
+                                         : m_decoder.decodeDialogs(bytes, &dialogs);
+    if (status == TlDecoder::Packed) {
+        // 解压的时间计入gzip_packed的统计，不算作解码
+        m_decode.decodeNs += timer.nsecsElapsed();
+        bool inflated = inflateResponse(m_decoder.packedData(), &bytes);
+        if (inflated && bytes.startsWith('{')) {
+            bytes = serializeObject(deserializeObject(bytes));
+        }
+        timer.restart();
+        status = TlDecoder::Malformed;
+        if (inflated) {
+            history = TlHistory();
+            dialogs = TlDialogs();
+            status = isHistory ? m_decoder.decodeHistory(bytes, &history)
+                               : m_decoder.decodeDialogs(bytes, &dialogs);
+        }
+    }
+    m_decode.decodeNs += timer.nsecsElapsed();
+    
+    TlArena::Stats after = m_arena.stats();
+    ++m_decode.responses;
+    m_decode.objects += after.objects - before.objects;
+    m_decode.strings += after.strings - before.strings;
+    m_decode.heapAllocations += after.chunkAllocations - before.chunkAllocations;
+    m_decode.arenaBytes += after.bytesUsed - before.bytesUsed;
+    
+    // 处理响应的槽中可能进入嵌套的事件循环并收到下一个响应，最外层处理完才重置arena
+    ++m_arenaDepth;
+    if (status != TlDecoder::Ok) {
+        qWarning() << method << "响应解码失败";
+    } else if (isHistory && history.success) {
+        emit historyReceived(history);
+    } else if (!isHistory && dialogs.success && dialogs.notModified) {
+        emit listNotModified(method);
+    } else if (!isHistory && dialogs.success) {
+        emit dialogsReceived(dialogs);
+    } else {
+        qWarning() << (isHistory ? "获取消息历史失败" : "获取会话列表失败");
+    }
+    
+    // 接收方已经复制出要保存的对象，一次释放本次解码的全部对象
+    if (--m_arenaDepth == 0) {
+        m_arena.reset();
+    }
+}
+
+MTProtoClient::DecodeStats MTProtoClient::decodeStats() const
+{
+    return m_decode;
+}
+
+bool MTProtoClient::startRecording(const QString& path)
+{
+    if (!m_capture.open(path)) {
+        return false;
+    }
+    qDebug() << "开始录制请求和响应:" << path;
+    return true;
+}
+
+void MTProtoClient::stopRecording()
+{
+    m_capture.close();
+}
+
+bool MTProtoClient::startReplay(const QString& path, double speed)
+{
+    QVector<TrafficCapture::Record> records;
+    if (!TrafficCapture::read(path, &records)) {
+        return false;
+    }
+    m_replaySpeed = qMax(0.0, speed);
+    
+    // 按请求编号配对，得到每个响应录制时的延迟
+    QHash<quint64, qint64> requestTimes;
+    m_replayResponses.clear();
+    int pushes = 0;
+    for (const TrafficCapture::Record& record : std::as_const(records)) {
+        if (record.type == TrafficCapture::Request) {
+            requestTimes.insert(record.requestId, record.timeUs);
+        } else if (record.type == TrafficCapture::Response) {
+            ReplayResponse replay;
+            replay.latencyUs = record.timeUs - requestTimes.value(record.requestId, record.timeUs);
+            replay.payload = record.payload;
+            m_replayResponses[record.method].enqueue(replay);
+        } else if (record.type == TrafficCapture::Push) {
+            // 推送按录制时的时间点重放
+            QJsonObject container = record.payload;
+            Clock::instance()->singleShot(replayDelay(record.timeUs), this, [this, container]() {
+                deliverPush(container, simulatedServerMessageId());
+            });
+            ++pushes;
+        }
+    }
+    
+    m_replaying = true;
+    m_simulatedUpdatesActive = false;
+    qDebug() << "开始回放抓包:" << path << "共" << records.size() << "条记录，其中推送" << pushes
+             << "条，时间压缩" << m_replaySpeed << "倍";
+    return true;
+}
+
+bool MTProtoClient::isReplaying() const
+{
+    return m_replaying;
+}
+
+int MTProtoClient::replayDelay(qint64 us) const
+{
+    if (m_replaySpeed <= 0.0) {
+        return 0;
+    }
+    return int(qMin<double>(us / 1000.0 / m_replaySpeed, std::numeric_limits<int>::max()));
+}
+
+QJsonObject MTProtoClient::simulateRequest(const QString& method, const QJsonObject& request)
+{
+    // 模拟服务器解开压缩的请求
+    QJsonObject parameters = request;
+    if (isGzipPacked(request)) {
+        GzipInflater inflater;
+        QByteArray raw;
+        if (inflatePacked(inflater, QByteArray::fromBase64(request["packed_data"].toString().toLatin1()), &raw)) {
+            parameters = deserializeObject(raw);
+        }
+    }
+    
     QJsonObject response;
     
-    if (method == "auth.sendCode") {
+    if (method == "get_future_salts") {
+        // 从当前周期开始的若干个盐，盐是64位整数，以字符串表示
+        qint32 now = qint32((Clock::instance()->currentMSecsSinceEpoch() + m_simulatedClockSkewMs) / 1000);
+        int count = qBound(1, parameters["num"].toInt(), 64);
+        QJsonArray salts;
+        for (int i = 0; i < count; ++i) {
+            qint32 period = now / SIMULATED_SALT_PERIOD + i;
+            salts.append(QJsonObject{
+                {"salt", QString::number(simulatedSalt(period))},
+                {"valid_since", period * SIMULATED_SALT_PERIOD},
+                {"valid_until", (period + 1) * SIMULATED_SALT_PERIOD + SIMULATED_SALT_OVERLAP}
+            });
+        }
+        response["now"] = now;
+        response["salts"] = salts;
+    }
+    else if (method == "auth.sendCode") {
         // 生成随机验证码哈希
         QString phoneCodeHash = QString::number(QRandomGenerator::global()->generate() % 10000000);
         response["phone_code_hash"] = phoneCodeHash;
@@ -165,18 +1375,203 @@ QJsonObject MTProtoClient::simulateRequest(const QString& method, const QJsonObj
     else if (method == "users.getFullUser") {
         // 模拟用户信息
         QString username = "user" + QString::number(QRandomGenerator::global()->generate() % 10000);
+        response["id"] = 1;
         response["username"] = username;
         response["first_name"] = "测试";
         response["last_name"] = "用户";
         response["success"] = true;
     }
+    else if (method == "messages.getHistory") {
+        // 模拟消息历史，ID连续且从1开始
+        qint64 peerId = qint64(parameters["peer"].toDouble());
+        int offsetId = parameters["offset_id"].toInt();
+        int limit = qBound(0, parameters["limit"].toInt(), 100);
+        int serverTopId = isSimulatedChannel(peerId) ? simulatedChannelPts(peerId)
+                                                     : m_simulatedTopIds.value(peerId, SIMULATED_HISTORY_SIZE);
+        int topId = (offsetId <= 0 || offsetId > serverTopId) ? serverTopId : offsetId - 1;
+        
+        QJsonArray messages;
+        for (int id = topId; id > 0 && id > topId - limit; --id) {
+            messages.append(simulateHistoryMessage(peerId, id));
+        }
+        response["peer"] = double(peerId);
+        response["offset_id"] = offsetId;
+        response["limit"] = limit;
+        response["count"] = serverTopId;
+        response["messages"] = messages;
+        response["success"] = true;
+    }
+    else if (method == "messages.sendMessage") {
+        // 模拟发送：消息追加到会话末尾
+        qint64 peerId = qint64(parameters["peer"].toDouble());
+        qint32 id = m_simulatedTopIds.value(peerId, SIMULATED_HISTORY_SIZE) + 1;
+        m_simulatedTopIds.insert(peerId, id);
+        
+        QJsonObject message;
+        message["id"] = id;
+        message["peer_id"] = double(peerId);
+        message["from_id"] = 1;
+        message["from_name"] = "我";
+        message["date"] = qint32(Clock::instance()->currentSecsSinceEpoch());
+        message["edit_date"] = 0;
+        message["message"] = parameters["message"].toString();
+        response["random_id"] = parameters["random_id"];
+        response["message"] = message;
+        response["success"] = true;
+    }
+    else if (method == "contacts.getContacts") {
+        // 模拟联系人列表，hash按用户ID从小到大计算，与客户端的算法一致
+        ListHash hash;
+        for (int i = 0; i < SIMULATED_CONTACT_COUNT; ++i) {
+            hash.add(quint64(100000 + i));
+        }
+        if (isListUnchanged(parameters, hash.result())) {
+            response["_"] = "contacts.contactsNotModified";
+        } else {
+            QJsonArray users;
+            for (int i = 0; i < SIMULATED_CONTACT_COUNT; ++i) {
+                users.append(simulateUser(100000 + i));
+            }
+            response["users"] = users;
+        }
+        response["success"] = true;
+    }
+    else if (method == "messages.getDialogs") {
+        // 模拟会话列表：所有频道，带频道当前的pts和未读数
+        QJsonArray dialogs;
+        QJsonArray chats;
+        ListHash hash;
+        for (int i = 0; i < SIMULATED_CHANNEL_COUNT; ++i) {
+            qint64 channelId = SIMULATED_CHANNEL_BASE + i;
+            qint32 pts = simulatedChannelPts(channelId);
+            qint32 readMaxId = simulatedReadMaxId(channelId);
+            hash.add(quint64(channelId));
+            hash.add(quint64(pts));
+            hash.add(quint64(readMaxId));
+            hash.add(quint64(pts));
+            hash.add(quint64(simulatedChannelFolder(channelId)));
+            QJsonObject dialog;
+            dialog["peer"] = double(channelId);
+            dialog["top_message"] = pts;
+            dialog["read_inbox_max_id"] = readMaxId;
+            dialog["unread_count"] = pts - readMaxId;
+            dialog["pts"] = pts;
+            dialog["folder_id"] = simulatedChannelFolder(channelId);
+            dialogs.append(dialog);
+            chats.append(simulateChannel(channelId));
+        }
+        if (isListUnchanged(parameters, hash.result())) {
+            response["_"] = "messages.dialogsNotModified";
+        } else {
+            response["dialogs"] = dialogs;
+            response["chats"] = chats;
+        }
+        response["success"] = true;
+    }
+    else if (method == "updates.getChannelDifference") {
+        qint64 channelId = qint64(parameters["channel"].toDouble());
+        response["channel"] = double(channelId);
+        if (!isSimulatedChannel(channelId)) {
+            response["success"] = false;
+            response["error"] = "CHANNEL_INVALID";
+        } else if (!simulateFloodCheck(method, SIMULATED_CHANNEL_DIFFERENCE_RATE)) {
+            response["success"] = false;
+            response["error"] = "FLOOD_WAIT_1";
+        } else {
+            // 按客户端的频道pts返回之后的消息，遗漏过多时只给最新的一段
+            qint32 serverPts = simulatedChannelPts(channelId);
+            int clientPts = parameters["pts"].toInt();
+            int limit = qBound(1, parameters["limit"].toInt(), SIMULATED_CHANNEL_DIFFERENCE_LIMIT);
+            int from = clientPts + 1;
+            int to = clientPts;
+            if (clientPts >= serverPts) {
+                response["_"] = "updates.channelDifferenceEmpty";
+            } else if (serverPts - clientPts > SIMULATED_CHANNEL_TOO_LONG) {
+                response["_"] = "updates.channelDifferenceTooLong";
+                from = qMax(1, serverPts - limit + 1);
+                to = serverPts;
+            } else {
+                response["_"] = "updates.channelDifference";
+                to = qMin(serverPts, clientPts + limit);
+            }
+            QJsonArray messages;
+            for (int id = from; id <= to; ++id) {
+                messages.append(simulateHistoryMessage(channelId, id));
+            }
+            response["pts"] = qMax(clientPts, to);
+            response["final"] = to >= serverPts;
+            response["messages"] = messages;
+            response["success"] = true;
+        }
+    }
+    else if (method == "updates.getState") {
+        UpdatesState state;
+        state.pts = m_simulatedBasePts + qint32(m_simulatedUpdates.size());
+        state.seq = m_simulatedSeq;
+        state.date = qint32(Clock::instance()->currentSecsSinceEpoch());
+        response["state"] = serializeState(state);
+        response["success"] = true;
+    }
+    else if (method == "updates.getDifference") {
+        // 模拟差异：按客户端的pts返回之后的更新，过多时分片
+        UpdatesState current;
+        current.pts = m_simulatedBasePts + qint32(m_simulatedUpdates.size());
+        current.seq = m_simulatedSeq;
+        current.date = qint32(Clock::instance()->currentSecsSinceEpoch());
+        
+        int clientPts = parameters["pts"].toInt();
+        if (clientPts >= current.pts) {
+            response["_"] = "updates.differenceEmpty";
+            response["state"] = serializeState(current);
+        } else if (clientPts < m_simulatedBasePts) {
+            response["_"] = "updates.differenceTooLong";
+            response["state"] = serializeState(current);
+        } else {
+            int from = clientPts - m_simulatedBasePts;
+            int to = qMin(int(m_simulatedUpdates.size()), from + SIMULATED_DIFFERENCE_LIMIT);
+            QJsonArray updates;
+            for (int i = from; i < to; ++i) {
+                updates.append(m_simulatedUpdates.at(i));
+            }
+            UpdatesState state = current;
+            state.pts = m_simulatedBasePts + to;
+            response["_"] = to < m_simulatedUpdates.size() ? "updates.differenceSlice" : "updates.difference";
+            response["updates"] = updates;
+            response["state"] = serializeState(state);
+        }
+        response["success"] = true;
+    }
     
     return response;
 }
 
-void MTProtoClient::processSimulatedResponse(const QString& method, const QJsonObject& response)
+void MTProtoClient::processSimulatedResponse(const QString& method, const QByteArray& wire)
 {
-    if (method == "auth.sendCode") {
+    // 消息历史和会话列表包含大量小对象，直接从字节解码到arena
+    if (method == "messages.getHistory" || method == "messages.getDialogs") {
+        processArenaResponse(method, wire);
+        return;
+    }
+    
+    const QJsonObject response = unpackResponse(deserializeObject(wire));
+    
+    if (method == "get_future_salts") {
+        QVector<ServerSalts::Salt> salts;
+        for (const QJsonValue& value : response["salts"].toArray()) {
+            QJsonObject object = value.toObject();
+            ServerSalts::Salt salt;
+            salt.salt = object["salt"].toString().toLongLong();
+            salt.validSince = object["valid_since"].toInt();
+            salt.validUntil = object["valid_until"].toInt();
+            salts.append(salt);
+        }
+        m_salts.addFutureSalts(salts);
+        m_saltsRequested = false;
+        ++m_session.saltPrefetches;
+        qDebug() << "已预取" << salts.size() << "个服务器盐，覆盖" << m_salts.coverage(serverNow()) / 3600 << "小时";
+        scheduleSaltPrefetch();
+    }
+    else if (method == "auth.sendCode") {
         // 处理验证码请求响应
         if (response["success"].toBool()) {
             QString phoneCodeHash = response["phone_code_hash"].toString();
@@ -191,6 +1586,7 @@ void MTProtoClient::processSimulatedResponse(const QString& method, const QJsonO
         if (response["success"].toBool()) {
             QString username = response["username"].toString();
             qDebug() << "登录成功，用户名: " << username;
+            startSimulatedUpdates();
             emit authSuccess(username);
         } else {
             emit authError("登录失败: 验证码无效或已过期");
@@ -204,10 +1600,86 @@ void MTProtoClient::processSimulatedResponse(const QString& method, const QJsonO
             QString lastName = response["last_name"].toString();
             qDebug() << "成功获取用户信息: " << username << firstName << lastName;
             emit userDataReceived(username, firstName, lastName);
+            emit peersReceived({ parseUser(response) });
         } else {
             emit authError("获取用户信息失败");
         }
     }
+    else if (method == "messages.sendMessage") {
+        qint64 randomId = response["random_id"].toString().toLongLong();
+        if (response["success"].toBool()) {
+            emit messageSent(randomId, parseMessage(response["message"].toObject()));
+        } else {
+            emit messageSendFailed(randomId, response["error"].toString());
+        }
+    }
+    else if (method == "contacts.getContacts") {
+        // 处理联系人列表响应
+        if (response["success"].toBool() && response["_"].toString() == "contacts.contactsNotModified") {
+            emit listNotModified(method);
+        } else if (response["success"].toBool()) {
+            QJsonArray array = response["users"].toArray();
+            QVector<PeerData> peers;
+            peers.reserve(array.size());
+            for (const QJsonValue& value : array) {
+                peers.append(parseUser(value.toObject()));
+            }
+            emit contactsReceived(peers);
+        } else {
+            qWarning() << "获取联系人列表失败";
+        }
+    }
+    else if (method == "updates.getState") {
+        if (response["success"].toBool()) {
+            emit updatesStateReceived(parseState(response["state"].toObject()));
+        } else {
+            qWarning() << "获取更新状态失败";
+        }
+    }
+    else if (method == "updates.getDifference") {
+        if (response["success"].toBool()) {
+            UpdatesDifference difference;
+            const QString type = response["_"].toString();
+            if (type == "updates.difference") {
+                difference.kind = UpdatesDifference::Complete;
+            } else if (type == "updates.differenceSlice") {
+                difference.kind = UpdatesDifference::Slice;
+            } else if (type == "updates.differenceTooLong") {
+                difference.kind = UpdatesDifference::TooLong;
+            }
+            for (const QJsonValue& value : response["updates"].toArray()) {
+                difference.updates.append(parseUpdate(value.toObject()));
+            }
+            difference.state = parseState(response["state"].toObject());
+            emit differenceReceived(difference);
+        } else {
+            qWarning() << "获取更新差异失败";
+        }
+    }
+    else if (method == "updates.getChannelDifference") {
+        qint64 channelId = qint64(response["channel"].toDouble());
+        if (response["success"].toBool()) {
+            ChannelDifference difference;
+            const QString type = response["_"].toString();
+            if (type == "updates.channelDifference") {
+                difference.kind = ChannelDifference::Complete;
+            } else if (type == "updates.channelDifferenceTooLong") {
+                difference.kind = ChannelDifference::TooLong;
+            }
+            difference.channelId = channelId;
+            difference.pts = response["pts"].toInt();
+            difference.isFinal = response["final"].toBool();
+            for (const QJsonValue& value : response["messages"].toArray()) {
+                difference.messages.append(parseMessage(value.toObject()));
+            }
+            emit channelDifferenceReceived(difference);
+        } else {
+            // FLOOD_WAIT_X 表示该方法需要等待X秒后再调用
+            const QString error = response["error"].toString();
+            int retryAfter = error.startsWith("FLOOD_WAIT_") ? error.mid(11).toInt() : 0;
+            emit channelDifferenceFailed(channelId, error, retryAfter);
+        }
+    }
 }
 
 void MTProtoClient::onNetworkReply(QNetworkReply* reply)
@@ -217,6 +1689,15 @@ void MTProtoClient::onNetworkReply(QNetworkReply* reply)
     
     if (reply->error() != QNetworkReply::NoError) {
         qWarning() << "网络请求错误: " << reply->errorString();
+        
+        // 连接不上时改用下一个地址并重连，服务器返回的错误不算
+        if (reply->error() < QNetworkReply::ContentAccessDenied) {
+            reportEndpointFailure();
+            dropConnection();
+            if (!m_reconnectTask) {
+                scheduleReconnect();
+            }
+        }
     }
     
     reply->deleteLater();
@@ -228,9 +1709,10 @@ void MTProtoClient::init()
     qDebug() << "OpenSSL支持状态:" << QSslSocket::supportsSsl()
              << "版本:" << QSslSocket::sslLibraryVersionString();
     
-    m_networkManager = new QNetworkAccessManager(this);
-    connect(m_networkManager, &QNetworkAccessManager::sslErrors,
-            this, &MTProtoClient::onSslErrors);
+    if (m_ownsNetworkManager) {
+        connect(m_networkManager, &QNetworkAccessManager::sslErrors,
+                this, &MTProtoClient::onSslErrors);
+    }
 }
 
 void MTProtoClient::onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors)
@@ -12,6 +12,20 @@
 #include <QTimer>
 #include <QRandomGenerator>
 #include <QSslError>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QQueue>
+
+#include "core/telegram_types.h"
+#include "traffic_capture.h"
+#include "gzip_inflater.h"
+#include "dc_prober.h"
+#include "outgoing_coalescer.h"
+#include "session_clock.h"
+#include "replay_window.h"
+#include "tl_decoder.h"
+#include "retry_policy.h"
 
 class MTProtoClient : public QObject
 {
@@ -19,6 +33,9 @@ class MTProtoClient : public QObject
 
 public:
     explicit MTProtoClient(QObject *parent = nullptr);
+    
+    // 使用多个账号共享的网络管理器（共用连接池、DNS缓存和TLS会话缓存）
+    MTProtoClient(QNetworkAccessManager* sharedNetworkManager, QObject *parent);
     ~MTProtoClient();
 
     // 设置API凭据
@@ -39,6 +56,120 @@ public:
     
     // 用户数据方法
     void getMe();
+    
+    // 消息历史：返回ID小于offsetId的最近limit条消息，offsetId为0时从最新消息开始
+    void getHistory(qint64 peerId, qint32 offsetId, int limit);
+    
+    // 发送文本消息，randomId由调用方生成，用于匹配发送结果
+    void sendMessage(qint64 peerId, const QString& text, qint64 randomId);
+    
+    // 联系人列表，hash为缓存的列表的hash，列表没有变化时服务器只返回contactsNotModified
+    void getContacts(qint64 hash = 0);
+    
+    // 更新同步：获取当前状态，或获取某个状态之后遗漏的更新
+    void getUpdatesState();
+    void getDifference(const UpdatesState& state);
+    
+    // 会话列表，频道的会话带有频道自己的pts；hash的用法同getContacts
+    void getDialogs(qint64 hash = 0);
+    
+    // 频道差异：返回频道pts之后遗漏的最多limit条消息
+    quint64 getChannelDifference(qint64 channelId, qint32 pts, int limit);
+    
+    // 放弃一个尚未收到响应的请求（包括断开期间等待重发的），之后不会再有它的响应或错误
+    void cancelRequest(quint64 requestId);
+
+    // 把所有请求、响应和服务器推送录制到抓包文件
+    bool startRecording(const QString& path);
+    void stopRecording();
+    
+    // 回放抓包文件：每个请求依次取用同一方法录制的响应代替模拟服务器，推送按录制时间重放。
+    // speed为时间压缩倍数，1为原始时序，0为不等待
+    bool startReplay(const QString& path, double speed);
+    bool isReplaying() const;
+
+    // gzip_packed的统计：收到的压缩响应和发出的压缩请求
+    struct CompressionStats
+    {
+        qint64 packedResponses = 0;
+        qint64 responseCompressedBytes = 0;
+        qint64 responseBytes = 0;
+        qint64 inflateNs = 0;
+        qint64 packedRequests = 0;
+        qint64 requestCompressedBytes = 0;
+        qint64 requestBytes = 0;
+    };
+    CompressionStats compressionStats() const;
+    
+    // 较大的请求以gzip_packed发送
+    void setRequestCompression(bool enabled);
+    
+    // 新连接使用的数据中心地址（按优先顺序），当前地址失败时依次改用下一个
+    void setEndpoints(const QVector<DcEndpoint>& endpoints);
+    DcEndpoint currentEndpoint() const;
+    void reportEndpointFailure();
+    
+    // 网络可达性或接口变化时调用：断开当前连接，网络可达时立即重连（失败时按抖动的指数退避重试），
+    // 会话保持不变，重连后只重发还没有收到响应的请求
+    void handleNetworkChange(bool reachable);
+    bool isConnected() const;
+    
+    // 已读标记、输入状态和在线状态，不立即发送，合并后随下一个容器发出
+    void markRead(qint64 peerId, qint32 maxId);
+    void setTyping(qint64 peerId, const QString& action);
+    void setOnline(bool online);
+    
+    // 出站统计：提交的消息数（包括确认）、实际发送的消息数和容器数
+    struct OutgoingStats
+    {
+        qint64 submitted = 0;
+        qint64 messages = 0;
+        qint64 packets = 0;
+        qint64 readMarks = 0;       // 服务器收到的已读标记、输入状态和在线状态
+        qint64 typingActions = 0;
+        qint64 statusChanges = 0;
+    };
+    OutgoingStats outgoingStats() const;
+    
+    // 会话统计：因盐过期或msg_id时间错误而多出的往返，预取盐的次数，当前估计的时间偏差，
+    // 以及因重复或时间超出范围而丢弃的服务器消息
+    struct SessionStats
+    {
+        qint64 badServerSalts = 0;
+        qint64 badMsgNotifications = 0;
+        qint64 saltPrefetches = 0;
+        qint64 timeOffsetMs = 0;
+        qint64 duplicateMessages = 0;
+        qint64 staleMessages = 0;
+        qint64 sessionRestarts = 0;     // 时间往回修正而开始新会话的次数
+    };
+    SessionStats sessionStats() const;
+    
+    // 在arena中解码的响应：累计解码耗时、解码出的对象和字符串，以及arena向堆申请内存块的次数
+    struct DecodeStats
+    {
+        qint64 responses = 0;
+        qint64 decodeNs = 0;
+        qint64 objects = 0;
+        qint64 strings = 0;
+        qint64 heapAllocations = 0;
+        qint64 arenaBytes = 0;
+    };
+    DecodeStats decodeStats() const;
+    
+    // 幂等的查询超过最近延迟的第95百分位还没有响应时，在另一个连接上发送副本，先到的响应有效；
+    // share为对冲数占请求数的上限，0为不对冲
+    void setHedgeBudget(double share);
+    
+    // 对冲统计：可以对冲的请求数、发出的对冲、对冲副本先返回的次数，以及因预算不足没有对冲的次数
+    struct HedgeStats
+    {
+        qint64 idempotentRequests = 0;
+        qint64 hedges = 0;
+        qint64 hedgeWins = 0;
+        qint64 budgetDenied = 0;
+    };
+    HedgeStats hedgeStats() const;
 
     void init(); // 初始化函数
     QString getLastError() const;
@@ -51,6 +182,37 @@ signals:
     
     // 用户数据信号
     void userDataReceived(const QString& username, const QString& firstName, const QString& lastName);
+    
+    // 消息历史信号（消息按ID降序排列）。history中的对象在arena中，只在信号处理期间有效，
+    // 需要保存的对象由接收方复制出来
+    void historyReceived(const TlHistory& history);
+    
+    // 消息发送结果
+    void messageSent(qint64 randomId, const MessageData& message);
+    void messageSendFailed(qint64 randomId, const QString& error);
+    
+    // 响应中携带的用户、群组资料
+    void peersReceived(const QVector<PeerData>& peers);
+    void contactsReceived(const QVector<PeerData>& users);
+    
+    // 带hash的列表请求没有变化，method为请求的方法，接收方使用缓存的结果
+    void listNotModified(const QString& method);
+    
+    // 更新信号
+    void updatesReceived(const UpdatesBatch& batch);
+    void updatesStateReceived(const UpdatesState& state);
+    void differenceReceived(const UpdatesDifference& difference);
+    void dialogsReceived(const TlDialogs& dialogs);
+    void channelDifferenceReceived(const ChannelDifference& difference);
+    
+    // 频道差异请求失败，FLOOD_WAIT时retryAfter为需要等待的秒数
+    void channelDifferenceFailed(qint64 channelId, const QString& error, int retryAfter);
+
+    // 连接断开或重连成功
+    void connectionStateChanged(bool connected);
+    
+    // 连接某个地址失败，已改用下一个地址
+    void endpointFailed(const QString& host, quint16 port);
 
     void authCodeSent(const QString& phoneCodeHash);
     void authCodeError(const QString& error);
@@ -64,17 +226,36 @@ private slots:
 
 private:
     // API 调用帮助方法
-    void makeApiRequest(const QString& method, const QJsonObject& parameters);
+    quint64 makeApiRequest(const QString& method, const QJsonObject& parameters);
     
     // 模拟请求和响应处理
     QJsonObject simulateRequest(const QString& method, const QJsonObject& parameters);
-    void processSimulatedResponse(const QString& method, const QJsonObject& response);
+    void processSimulatedResponse(const QString& method, const QByteArray& wire);
+    void processArenaResponse(const QString& method, const QByteArray& wire);
+    
+    // 解开gzip_packed的响应，解压器在这个连接的所有响应间复用
+    QJsonObject unpackResponse(const QJsonObject& response);
+    bool inflateResponse(const QByteArray& packed, QByteArray* raw);
+    
+    // 模拟服务器推送：定时产生更新，偶尔丢失或延迟送达
+    void startSimulatedUpdates();
+    void scheduleSimulatedUpdates();
+    void pushSimulatedUpdates();
+    QJsonObject simulateHistoryMessage(qint64 peerId, qint32 id) const;
+    
+    // 模拟服务器限流，超过每秒调用次数时返回false
+    bool simulateFloodCheck(const QString& method, int perSecond);
+    
+    // 模拟服务器收到合并发送的容器：已读标记更新服务器的已读位置，这些消息没有响应
+    void simulateOutgoing(const QJsonArray& messages);
+    qint32 simulatedReadMaxId(qint64 channelId) const;
     
     // 应用代理设置
     void applyProxySettings();
     
-    // 网络管理
+    // 网络管理，共享时由共享运行时处理响应和SSL错误
     QNetworkAccessManager* m_networkManager;
+    bool m_ownsNetworkManager;
     
     // API凭据
     int m_apiId;
@@ -90,14 +271,110 @@ private:
     // 会话数据
     QString m_dcId;
     QString m_authKey;
-    QString m_serverSalt;
     QString m_sessionId;
-    qint64 m_lastMessageId;
+    ServerSalts m_salts;
+    MessageIdGenerator m_messageIds;
+    QVector<DcEndpoint> m_endpoints;
+    int m_endpointIndex;
     
     // 认证数据
     QString m_authToken;
 
     QString m_lastError;
+    
+    // 模拟服务器的更新状态
+    bool m_simulatedUpdatesActive;
+    QVector<QJsonObject> m_simulatedUpdates;    // 第i条更新的pts为 m_simulatedBasePts + i + 1
+    qint32 m_simulatedBasePts;
+    qint32 m_simulatedSeq;
+    QHash<qint64, qint32> m_simulatedTopIds;
+    QHash<QPair<qint64, qint32>, QJsonObject> m_simulatedEdits;
+    QHash<qint64, qint32> m_simulatedReadMaxIds;
+    
+    // 模拟服务器的限流：每个方法当前一秒内的调用次数
+    QHash<QString, QPair<qint64, int>> m_simulatedCallWindows;
+    
+    // 录制与回放
+    struct ReplayResponse
+    {
+        qint64 latencyUs = 0;       // 录制时请求到响应的间隔
+        QJsonObject payload;
+    };
+    int replayDelay(qint64 us) const;
+    TrafficCapture m_capture;
+    quint64 m_nextRequestId;
+    bool m_replaying;
+    double m_replaySpeed;
+    QHash<QString, QQueue<ReplayResponse>> m_replayResponses;
+    
+    // 已发出但还没有收到响应的请求，按请求编号排序，重连后按原顺序重发
+    struct PendingRequest
+    {
+        QString method;
+        QJsonObject payload;
+        int task = 0;               // 等待响应的模拟任务，未发出时为0
+        quint64 messageId = 0;      // 最近一次发送使用的msg_id和盐
+        qint64 salt = 0;
+        qint64 sentAtMs = 0;        // 首次发出的时间，重发时不变
+        int hedgeTimer = 0;         // 到期时发送对冲副本
+        int hedgeTask = 0;          // 等待对冲副本响应的模拟任务
+        bool hasReplay = false;
+        ReplayResponse replay;
+    };
+    void dispatchRequest(quint64 requestId, bool hedge = false);
+    void scheduleHedge(quint64 requestId);
+    void cancelAttempts(PendingRequest* pending);
+    QMap<quint64, PendingRequest> m_pendingRequests;
+    
+    // 连接状态与重连
+    void dropConnection();
+    void scheduleReconnect();
+    void reconnect();
+    bool m_connected;
+    bool m_networkReachable;
+    int m_reconnectAttempts;
+    int m_reconnectTask;
+    
+    // 收到的服务器消息先经过重放检测，通过后加入待确认
+    quint64 simulatedServerMessageId();
+    bool receiveServerMessage(quint64 messageId);
+    void deliverPush(const QJsonObject& container, quint64 messageId);
+    ReplayWindow m_replayWindow;
+    MessageIdGenerator m_simulatedServerIds;
+    
+    // 合并发送的确认和状态变化
+    void scheduleFlush();
+    void flushOutgoing();
+    QJsonArray takeOutgoing();
+    OutgoingCoalescer m_coalescer;
+    int m_flushTask;
+    OutgoingStats m_outgoing;
+    
+    // 服务器盐的预取和时间偏差
+    void prefetchSalts();
+    void scheduleSaltPrefetch();
+    qint32 serverNow() const;
+    bool m_saltsRequested;
+    int m_saltPrefetchTask;
+    SessionStats m_session;
+    
+    // 模拟服务器时钟与本地时钟的偏差
+    qint64 m_simulatedClockSkewMs;
+    
+    // gzip_packed
+    GzipInflater m_inflater;
+    CompressionStats m_compression;
+    bool m_compressRequests;
+    
+    // 解码响应用的arena，每个响应处理完后重置
+    TlArena m_arena;
+    TlDecoder m_decoder;
+    int m_arenaDepth;
+    DecodeStats m_decode;
+    
+    // 重试和对冲
+    RetryPolicy m_retryPolicy;
+    HedgeStats m_hedge;
 
     void setupProxy();
 }; 
\ No newline at end of file
@@ -0,0 +1,644 @@
+#include "mtproto_transport.h"
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace {
+
+// 非混淆连接开头的标记，混淆时同样的4字节藏在随机头的第56-59字节
+const quint8 ABRIDGED_TAG = 0xef;
+const quint8 INTERMEDIATE_TAG = 0xee;
+const quint8 PADDED_TAG = 0xdd;
+
+// 混淆随机头的长度，以及其中密钥、IV和标记的位置
+const int OBFUSCATED_HEADER_SIZE = 64;
+const int OBFUSCATED_KEY_OFFSET = 8;
+const int OBFUSCATED_IV_OFFSET = 40;
+const int OBFUSCATED_TAG_OFFSET = 56;
+
+// 单个包的长度上限，超过时认为数据错误
+const int MAX_PACKET_SIZE = 16 * 1024 * 1024;
+
+// 套接字中待写数据的水位，低于它时才从调度队列中取包
+const qint64 WRITE_LOW_WATERMARK = 64 * 1024;
+
+// 随机头的第一个整数不能与其他协议的开头相同，否则会被中间设备识别
+const quint32 FORBIDDEN_FIRST_WORDS[] = {
+    0x44414548, // "HEAD"
+    0x54534f50, // "POST"
+    0x20544547, // "GET "
+    0x4954504f, // "OPTI"
+    0xdddddddd,
+    0xeeeeeeee,
+    0x02010316  // TLS握手
+};
+
+quint8 tagOf(TransportCodec::Framing framing)
+{
+    switch (framing) {
+    case TransportCodec::Abridged:
+        return ABRIDGED_TAG;
+    case TransportCodec::PaddedIntermediate:
+        return PADDED_TAG;
+    default:
+        return INTERMEDIATE_TAG;
+    }
+}
+
+struct AesTables
+{
+    quint8 sbox[256];
+};
+
+// 由GF(2^8)上的乘法逆元和仿射变换生成S盒
+const AesTables& aesTables()
+{
+    static const AesTables tables = []() {
+        AesTables result;
+        auto rotate = [](quint8 value, int shift) {
+            return quint8((value << shift) | (value >> (8 - shift)));
+        };
+        quint8 p = 1;
+        quint8 q = 1;
+        do {
+            // p乘以3，q除以3，两者互为逆元
+            p = quint8(p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0));
+            q ^= quint8(q << 1);
+            q ^= quint8(q << 2);
+            q ^= quint8(q << 4);
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            quint8 value = quint8(q ^ rotate(q, 1) ^ rotate(q, 2) ^ rotate(q, 3) ^ rotate(q, 4));
+            result.sbox[p] = quint8(value ^ 0x63);
+        } while (p != 1);
+        result.sbox[0] = 0x63;
+        return result;
+    }();
+    return tables;
+}
+
+quint8 xtime(quint8 value)
+{
+    return quint8((value << 1) ^ ((value & 0x80) ? 0x1b : 0));
+}
+
+} // namespace
+
+AesCtr::AesCtr()
+    : m_keystreamUsed(16)
+    , m_valid(false)
+{
+    std::fill(m_roundKeys, m_roundKeys + 60, 0u);
+    std::fill(m_counter, m_counter + 16, quint8(0));
+    std::fill(m_keystream, m_keystream + 16, quint8(0));
+}
+
+void AesCtr::setKey(const QByteArray& key, const QByteArray& iv)
+{
+    m_valid = key.size() == 32 && iv.size() == 16;
+    if (!m_valid) {
+        return;
+    }
+
+    // AES-256密钥扩展：8个密钥字扩展为15轮共60个字
+    const quint8* sbox = aesTables().sbox;
+    auto subWord = [sbox](quint32 word) {
+        return quint32(sbox[word >> 24]) << 24 | quint32(sbox[(word >> 16) & 0xff]) << 16
+             | quint32(sbox[(word >> 8) & 0xff]) << 8 | quint32(sbox[word & 0xff]);
+    };
+    for (int i = 0; i < 8; ++i) {
+        m_roundKeys[i] = qFromBigEndian<quint32>(key.constData() + i * 4);
+    }
+    quint32 rcon = 0x01000000;
+    for (int i = 8; i < 60; ++i) {
+        quint32 temp = m_roundKeys[i - 1];
+        if (i % 8 == 0) {
+            temp = subWord((temp << 8) | (temp >> 24)) ^ rcon;
+            rcon = quint32(xtime(quint8(rcon >> 24))) << 24;
+        } else if (i % 8 == 4) {
+            temp = subWord(temp);
+        }
+        m_roundKeys[i] = m_roundKeys[i - 8] ^ temp;
+    }
+
+    std::copy(iv.constData(), iv.constData() + 16, reinterpret_cast<char*>(m_counter));
+    m_keystreamUsed = 16;
+}
+
+bool AesCtr::isValid() const
+{
+    return m_valid;
+}
+
+void AesCtr::encryptBlock(const quint8* in, quint8* out) const
+{
+    const quint8* sbox = aesTables().sbox;
+    quint8 state[16];
+    auto addRoundKey = [this, &state](int round) {
+        for (int column = 0; column < 4; ++column) {
+            quint32 word = m_roundKeys[round * 4 + column];
+            state[column * 4] ^= quint8(word >> 24);
+            state[column * 4 + 1] ^= quint8(word >> 16);
+            state[column * 4 + 2] ^= quint8(word >> 8);
+            state[column * 4 + 3] ^= quint8(word);
+        }
+    };
+    auto subBytesShiftRows = [sbox, &state]() {
+        quint8 shifted[16];
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                shifted[column * 4 + row] = sbox[state[((column + row) % 4) * 4 + row]];
+            }
+        }
+        std::copy(shifted, shifted + 16, state);
+    };
+
+    std::copy(in, in + 16, state);
+    addRoundKey(0);
+    for (int round = 1; round < 14; ++round) {
+        subBytesShiftRows();
+        for (int column = 0; column < 4; ++column) {
+            quint8* a = state + column * 4;
+            quint8 all = quint8(a[0] ^ a[1] ^ a[2] ^ a[3]);
+            quint8 first = a[0];
+            a[0] ^= quint8(all ^ xtime(quint8(a[0] ^ a[1])));
+            a[1] ^= quint8(all ^ xtime(quint8(a[1] ^ a[2])));
+            a[2] ^= quint8(all ^ xtime(quint8(a[2] ^ a[3])));
+            a[3] ^= quint8(all ^ xtime(quint8(a[3] ^ first)));
+        }
+        addRoundKey(round);
+    }
+    subBytesShiftRows();
+    addRoundKey(14);
+    std::copy(state, state + 16, out);
+}
+
+void AesCtr::apply(char* data, qsizetype size)
+{
+    for (qsizetype i = 0; i < size; ++i) {
+        if (m_keystreamUsed == 16) {
+            encryptBlock(m_counter, m_keystream);
+            for (int j = 15; j >= 0 && ++m_counter[j] == 0; --j) {
+            }
+            m_keystreamUsed = 0;
+        }
+        data[i] ^= char(m_keystream[m_keystreamUsed++]);
+    }
+}
+
+bool AesCtr::selfTest()
+{
+    // FIPS-197附录C.3：AES-256单个分组
+    AesCtr block;
+    block.setKey(QByteArray::fromHex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"),
+                 QByteArray(16, '\0'));
+    QByteArray plain = QByteArray::fromHex("00112233445566778899aabbccddeeff");
+    quint8 cipher[16];
+    block.encryptBlock(reinterpret_cast<const quint8*>(plain.constData()), cipher);
+    if (QByteArray(reinterpret_cast<const char*>(cipher), 16)
+        != QByteArray::fromHex("8ea2b7ca516745bfeafc49904b496089")) {
+        return false;
+    }
+
+    // SP 800-38A F.5.5：CTR-AES256，计数器末字节从0xff进位；分段长度不是16的倍数，检查密钥流的衔接
+    AesCtr ctr;
+    ctr.setKey(QByteArray::fromHex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4"),
+               QByteArray::fromHex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"));
+    QByteArray data = QByteArray::fromHex(
+        "6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51"
+        "30c81c46a35ce411e5fbc1191a0a52ef" "f69f2445df4f9b17ad2b417be66c3710");
+    ctr.apply(data.data(), 7);
+    ctr.apply(data.data() + 7, data.size() - 7);
+    return data == QByteArray::fromHex(
+        "601ec313775789a5b7a7f504bbf3d228" "f443e3ca4d62b59aca84e990cacaf5c5"
+        "2b0930daa23de94ce87017ba2d84988d" "dfc9c58db67aada613c2dd08457941a6");
+}
+
+TransportCodec::TransportCodec(Framing framing, bool obfuscated)
+    : m_framing(framing)
+    , m_obfuscated(obfuscated)
+{
+}
+
+TransportCodec::Framing TransportCodec::framing() const
+{
+    return m_framing;
+}
+
+bool TransportCodec::isObfuscated() const
+{
+    return m_obfuscated;
+}
+
+QString TransportCodec::framingName(Framing framing, bool obfuscated)
+{
+    QString name;
+    switch (framing) {
+    case Abridged:
+        name = "abridged";
+        break;
+    case Intermediate:
+        name = "intermediate";
+        break;
+    case PaddedIntermediate:
+        name = "padded";
+        break;
+    }
+    return obfuscated ? name + "+obfuscated" : name;
+}
+
+QByteArray TransportCodec::clientHandshake()
+{
+    quint8 tag = tagOf(m_framing);
+    if (!m_obfuscated) {
+        return m_framing == Abridged ? QByteArray(1, char(tag)) : QByteArray(4, char(tag));
+    }
+
+    // 生成不会被误认为其他协议的随机头
+    QByteArray header(OBFUSCATED_HEADER_SIZE, Qt::Uninitialized);
+    QRandomGenerator* generator = QRandomGenerator::system();
+    for (;;) {
+        generator->fillRange(reinterpret_cast<quint32*>(header.data()), OBFUSCATED_HEADER_SIZE / 4);
+        quint32 first = qFromLittleEndian<quint32>(header.constData());
+        quint32 second = qFromLittleEndian<quint32>(header.constData() + 4);
+        if (quint8(header.at(0)) == ABRIDGED_TAG || second == 0
+            || std::find(std::begin(FORBIDDEN_FIRST_WORDS), std::end(FORBIDDEN_FIRST_WORDS), first)
+               != std::end(FORBIDDEN_FIRST_WORDS)) {
+            continue;
+        }
+        break;
+    }
+    std::fill(header.begin() + OBFUSCATED_TAG_OFFSET, header.begin() + OBFUSCATED_TAG_OFFSET + 4, char(tag));
+
+    // 发送方向使用头中的密钥和IV，接收方向使用它们反转后的字节
+    QByteArray reversed = header.mid(OBFUSCATED_KEY_OFFSET, OBFUSCATED_TAG_OFFSET - OBFUSCATED_KEY_OFFSET);
+    std::reverse(reversed.begin(), reversed.end());
+    m_encrypt.setKey(header.mid(OBFUSCATED_KEY_OFFSET, 32), header.mid(OBFUSCATED_IV_OFFSET, 16));
+    m_decrypt.setKey(reversed.left(32), reversed.mid(32, 16));
+
+    // 整个头经过加密，但只替换标记及之后的字节，密钥本身以明文发送
+    QByteArray encrypted = header;
+    m_encrypt.apply(encrypted.data(), encrypted.size());
+    header.replace(OBFUSCATED_TAG_OFFSET, 8, encrypted.mid(OBFUSCATED_TAG_OFFSET, 8));
+    return header;
+}
+
+int TransportCodec::acceptHandshake(const QByteArray& data)
+{
+    if (data.isEmpty()) {
+        return 0;
+    }
+    quint8 first = quint8(data.at(0));
+    if (first == ABRIDGED_TAG) {
+        m_framing = Abridged;
+        m_obfuscated = false;
+        return 1;
+    }
+    if (first == INTERMEDIATE_TAG || first == PADDED_TAG) {
+        if (data.size() < 4) {
+            return 0;
+        }
+        if (data.left(4) == QByteArray(4, char(first))) {
+            m_framing = first == INTERMEDIATE_TAG ? Intermediate : PaddedIntermediate;
+            m_obfuscated = false;
+            return 4;
+        }
+    }
+
+    if (data.size() < OBFUSCATED_HEADER_SIZE) {
+        return 0;
+    }
+    QByteArray header = data.left(OBFUSCATED_HEADER_SIZE);
+    QByteArray reversed = header.mid(OBFUSCATED_KEY_OFFSET, OBFUSCATED_TAG_OFFSET - OBFUSCATED_KEY_OFFSET);
+    std::reverse(reversed.begin(), reversed.end());
+    m_decrypt.setKey(header.mid(OBFUSCATED_KEY_OFFSET, 32), header.mid(OBFUSCATED_IV_OFFSET, 16));
+    m_encrypt.setKey(reversed.left(32), reversed.mid(32, 16));
+
+    m_decrypt.apply(header.data(), header.size());
+    QByteArray tag = header.mid(OBFUSCATED_TAG_OFFSET, 4);
+    if (tag == QByteArray(4, char(ABRIDGED_TAG))) {
+        m_framing = Abridged;
+    } else if (tag == QByteArray(4, char(INTERMEDIATE_TAG))) {
+        m_framing = Intermediate;
+    } else if (tag == QByteArray(4, char(PADDED_TAG))) {
+        m_framing = PaddedIntermediate;
+    } else {
+        return -1;
+    }
+    m_obfuscated = true;
+    return OBFUSCATED_HEADER_SIZE;
+}
+
+QByteArray TransportCodec::encode(const QByteArray& payload)
+{
+    QByteArray frame;
+    if (m_framing == Abridged) {
+        Q_ASSERT(payload.size() % 4 == 0);
+        quint32 words = quint32(payload.size() / 4);
+        if (words < 0x7f) {
+            frame.reserve(1 + payload.size());
+            frame.append(char(words));
+        } else {
+            char header[4] = { char(0x7f), char(words), char(words >> 8), char(words >> 16) };
+            frame.reserve(4 + payload.size());
+            frame.append(header, 4);
+        }
+        frame.append(payload);
+    } else {
+        int padding = m_framing == PaddedIntermediate ? QRandomGenerator::global()->bounded(16) : 0;
+        frame.resize(4 + payload.size() + padding);
+        qToLittleEndian<quint32>(quint32(payload.size() + padding), frame.data());
+        std::copy(payload.constBegin(), payload.constEnd(), frame.begin() + 4);
+        for (int i = 0; i < padding; ++i) {
+            frame[4 + payload.size() + i] = char(QRandomGenerator::global()->bounded(256));
+        }
+    }
+
+    if (m_obfuscated) {
+        m_encrypt.apply(frame.data(), frame.size());
+    }
+    return frame;
+}
+
+bool TransportCodec::decode(const QByteArray& data, QVector<QByteArray>* packets)
+{
+    qsizetype start = m_buffer.size();
+    m_buffer.append(data);
+    if (m_obfuscated) {
+        m_decrypt.apply(m_buffer.data() + start, data.size());
+    }
+
+    qsizetype offset = 0;
+    for (;;) {
+        qsizetype available = m_buffer.size() - offset;
+        int headerSize = 0;
+        qint64 length = 0;
+        if (m_framing == Abridged) {
+            if (available < 1) {
+                break;
+            }
+            // 最高位为快速确认标志
+            quint8 first = quint8(m_buffer.at(offset)) & 0x7f;
+            if (first < 0x7f) {
+                headerSize = 1;
+                length = qint64(first) * 4;
+            } else {
+                if (available < 4) {
+                    break;
+                }
+                const quint8* bytes = reinterpret_cast<const quint8*>(m_buffer.constData() + offset);
+                headerSize = 4;
+                length = qint64(bytes[1] | bytes[2] << 8 | bytes[3] << 16) * 4;
+            }
+        } else {
+            if (available < 4) {
+                break;
+            }
+            headerSize = 4;
+            length = qFromLittleEndian<quint32>(m_buffer.constData() + offset) & 0x7fffffff;
+        }
+
+        if (length > MAX_PACKET_SIZE) {
+            return false;
+        }
+        if (available < headerSize + length) {
+            break;
+        }
+        // padded intermediate的填充由上层按消息自身的长度忽略
+        packets->append(m_buffer.mid(offset + headerSize, length));
+        offset += headerSize + length;
+    }
+    m_buffer.remove(0, offset);
+    return true;
+}
+
+TcpTransport::TcpTransport(TransportCodec::Framing framing, bool obfuscated, QObject* parent)
+    : QObject(parent)
+    , m_socket(new QTcpSocket(this))
+    , m_codec(framing, obfuscated)
+    , m_bytesSent(0)
+    , m_bytesReceived(0)
+    , m_fairQueuing(true)
+    , m_handshakeSent(false)
+{
+    m_clock.start();
+    m_throttleTimer.setSingleShot(true);
+    connect(&m_throttleTimer, &QTimer::timeout, this, &TcpTransport::flushQueue);
+    connect(m_socket, &QTcpSocket::connected, this, &TcpTransport::onConnected);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, &TcpTransport::flushQueue);
+    connect(m_socket, &QTcpSocket::readyRead, this, &TcpTransport::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &TcpTransport::disconnected);
+    connect(m_socket, &QTcpSocket::errorOccurred, this, [this]() {
+        emit errorOccurred(m_socket->errorString());
+    });
+}
+
+void TcpTransport::connectToHost(const QString& host, quint16 port)
+{
+    // 每个连接都从新的握手和密钥开始
+    m_codec = TransportCodec(m_codec.framing(), m_codec.isObfuscated());
+    m_handshakeSent = false;
+    m_socket->connectToHost(host, port);
+}
+
+void TcpTransport::disconnectFromHost()
+{
+    m_socket->disconnectFromHost();
+}
+
+bool TcpTransport::isConnected() const
+{
+    return m_socket->state() == QAbstractSocket::ConnectedState;
+}
+
+void TcpTransport::onConnected()
+{
+    // 小包不等待合并，降低往返延迟
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    QByteArray handshake = m_codec.clientHandshake();
+    m_bytesSent += m_socket->write(handshake);
+    m_handshakeSent = true;
+    flushQueue();
+    emit connected();
+}
+
+void TcpTransport::send(const QByteArray& payload, BandwidthScheduler::TrafficClass trafficClass)
+{
+    if (!m_fairQueuing && m_handshakeSent) {
+        write(payload);
+        return;
+    }
+    m_scheduler.enqueue(trafficClass, payload);
+    flushQueue();
+}
+
+void TcpTransport::setFairQueuing(bool enabled)
+{
+    m_fairQueuing = enabled;
+    flushQueue();
+}
+
+void TcpTransport::setBulkLimiter(RateLimiter* limiter)
+{
+    m_scheduler.setBulkLimiter(limiter);
+}
+
+void TcpTransport::write(const QByteArray& payload)
+{
+    // 混淆的密钥流是连续的，必须按写入的顺序编码
+    QByteArray frame = m_codec.encode(payload);
+    m_bytesSent += m_socket->write(frame);
+}
+
+void TcpTransport::flushQueue()
+{
+    if (!m_handshakeSent) {
+        return;
+    }
+    // 限速只挡住批量队列，其他类别照常发送；写缓冲达到水位时由bytesWritten继续
+    QByteArray payload;
+    while (!m_fairQueuing || m_socket->bytesToWrite() < WRITE_LOW_WATERMARK) {
+        qint64 waitMs = -1;
+        if (!m_scheduler.dequeue(m_clock.elapsed(), &payload, &waitMs)) {
+            // 只剩被限速的批量包时，按这次算出的等待时间重新定时
+            if (waitMs >= 0) {
+                m_throttleTimer.start(int(qMin<qint64>(waitMs, std::numeric_limits<int>::max())));
+            }
+            break;
+        }
+        write(payload);
+    }
+}
+
+void TcpTransport::onReadyRead()
+{
+    QByteArray data = m_socket->readAll();
+    m_bytesReceived += data.size();
+
+    QVector<QByteArray> packets;
+    if (!m_codec.decode(data, &packets)) {
+        emit errorOccurred("传输层数据格式错误");
+        m_socket->abort();
+        return;
+    }
+    for (const QByteArray& packet : std::as_const(packets)) {
+        emit packetReceived(packet);
+    }
+}
+
+qint64 TcpTransport::bytesSent() const
+{
+    return m_bytesSent;
+}
+
+qint64 TcpTransport::bytesReceived() const
+{
+    return m_bytesReceived;
+}
+
+TransportPool::TransportPool(TransportCodec::Framing framing, bool obfuscated, QObject* parent)
+    : QObject(parent)
+    , m_framing(framing)
+    , m_obfuscated(obfuscated)
+    , m_fairQueuing(true)
+    , m_main(nullptr)
+{
+}
+
+void TransportPool::connectToHost(const QString& host, quint16 port)
+{
+    if (!m_main) {
+        m_main = createTransport();
+        connect(m_main, &TcpTransport::connected, this, &TransportPool::connected);
+    }
+    m_main->connectToHost(host, port);
+}
+
+void TransportPool::addFileEndpoint(int dcId, const QString& host, quint16 port)
+{
+    Endpoint endpoint;
+    endpoint.host = host;
+    endpoint.port = port;
+    m_fileEndpoints.insert(dcId, endpoint);
+}
+
+void TransportPool::disconnectFromHost()
+{
+    if (m_main) {
+        m_main->disconnectFromHost();
+    }
+    for (TcpTransport* transport : std::as_const(m_fileConnections)) {
+        transport->disconnectFromHost();
+    }
+}
+
+void TransportPool::send(const QByteArray& payload, BandwidthScheduler::TrafficClass trafficClass, int fileDcId)
+{
+    TcpTransport* transport = trafficClass == BandwidthScheduler::Bulk ? fileConnection(fileDcId) : nullptr;
+    if (!transport) {
+        transport = m_main;
+    }
+    if (transport) {
+        transport->send(payload, trafficClass);
+    }
+}
+
+void TransportPool::setBulkRateLimit(qint64 bytesPerSecond)
+{
+    m_bulkLimiter.setRate(bytesPerSecond);
+}
+
+void TransportPool::setFairQueuing(bool enabled)
+{
+    m_fairQueuing = enabled;
+    if (m_main) {
+        m_main->setFairQueuing(enabled);
+    }
+    for (TcpTransport* transport : std::as_const(m_fileConnections)) {
+        transport->setFairQueuing(enabled);
+    }
+}
+
+int TransportPool::fileConnectionCount() const
+{
+    return int(m_fileConnections.size());
+}
+
+qint64 TransportPool::bytesSent() const
+{
+    qint64 bytes = m_main ? m_main->bytesSent() : 0;
+    for (const TcpTransport* transport : m_fileConnections) {
+        bytes += transport->bytesSent();
+    }
+    return bytes;
+}
+
+TcpTransport* TransportPool::createTransport()
+{
+    TcpTransport* transport = new TcpTransport(m_framing, m_obfuscated, this);
+    transport->setFairQueuing(m_fairQueuing);
+    transport->setBulkLimiter(&m_bulkLimiter);
+    connect(transport, &TcpTransport::packetReceived, this, &TransportPool::packetReceived);
+    connect(transport, &TcpTransport::errorOccurred, this, &TransportPool::errorOccurred);
+    return transport;
+}
+
+TcpTransport* TransportPool::fileConnection(int dcId)
+{
+    auto it = m_fileConnections.constFind(dcId);
+    if (it != m_fileConnections.constEnd()) {
+        return it.value();
+    }
+    auto endpoint = m_fileEndpoints.constFind(dcId);
+    if (endpoint == m_fileEndpoints.constEnd()) {
+        return nullptr;
+    }
+    // 连接建立前的包留在这个连接的调度队列中，握手后发出
+    TcpTransport* transport = createTransport();
+    m_fileConnections.insert(dcId, transport);
+    transport->connectToHost(endpoint->host, endpoint->port);
+    return transport;
+}
@@ -0,0 +1,99 @@
+#include "outgoing_coalescer.h"
+#include <QJsonObject>
+
+namespace {
+
+// 同一会话的相同输入状态在这个时间内不重复发送（服务器约6秒后才会让它过期）
+const qint64 TYPING_REPEAT_MS = 5000;
+
+// 单个msgs_ack最多携带的消息ID数
+const int MAX_ACKS_PER_MESSAGE = 8192;
+
+} // namespace
+
+OutgoingCoalescer::OutgoingCoalescer()
+    : m_presence(-1)
+    , m_sentPresence(-1)
+    , m_submitted(0)
+{
+}
+
+void OutgoingCoalescer::ack(qint64 messageId)
+{
+    ++m_submitted;
+    m_acks.append(messageId);
+}
+
+void OutgoingCoalescer::markRead(qint64 peerId, qint32 maxId)
+{
+    ++m_submitted;
+    if (maxId <= m_sentReadMarks.value(peerId, 0)) {
+        return;
+    }
+    qint32& pending = m_readMarks[peerId];
+    pending = qMax(pending, maxId);
+}
+
+void OutgoingCoalescer::setTyping(qint64 peerId, const QString& action, qint64 nowMs)
+{
+    ++m_submitted;
+    // 刚发送过相同的状态时不再发送；已经在等待发送的状态保留
+    auto sent = m_sentTyping.constFind(peerId);
+    if (sent != m_sentTyping.constEnd() && sent.value().first == action
+        && nowMs - sent.value().second < TYPING_REPEAT_MS) {
+        return;
+    }
+    m_typing.insert(peerId, qMakePair(action, nowMs));
+}
+
+void OutgoingCoalescer::setOnline(bool online)
+{
+    ++m_submitted;
+    m_presence = online ? 1 : 0;
+}
+
+bool OutgoingCoalescer::isEmpty() const
+{
+    return m_acks.isEmpty() && m_readMarks.isEmpty() && m_typing.isEmpty()
+        && (m_presence < 0 || m_presence == m_sentPresence);
+}
+
+QJsonArray OutgoingCoalescer::take()
+{
+    QJsonArray messages;
+
+    for (int start = 0; start < m_acks.size(); start += MAX_ACKS_PER_MESSAGE) {
+        QJsonArray ids;
+        int end = qMin(int(m_acks.size()), start + MAX_ACKS_PER_MESSAGE);
+        for (int i = start; i < end; ++i) {
+            ids.append(QString::number(m_acks.at(i)));
+        }
+        messages.append(QJsonObject{{"_", "msgs_ack"}, {"msg_ids", ids}});
+    }
+    m_acks.clear();
+
+    for (auto it = m_readMarks.constBegin(); it != m_readMarks.constEnd(); ++it) {
+        messages.append(QJsonObject{{"_", "messages.readHistory"}, {"peer", double(it.key())}, {"max_id", it.value()}});
+        m_sentReadMarks.insert(it.key(), it.value());
+    }
+    m_readMarks.clear();
+
+    for (auto it = m_typing.constBegin(); it != m_typing.constEnd(); ++it) {
+        messages.append(QJsonObject{{"_", "messages.setTyping"}, {"peer", double(it.key())}, {"action", it.value().first}});
+        m_sentTyping.insert(it.key(), it.value());
+    }
+    m_typing.clear();
+
+    if (m_presence >= 0 && m_presence != m_sentPresence) {
+        messages.append(QJsonObject{{"_", "account.updateStatus"}, {"offline", m_presence == 0}});
+        m_sentPresence = m_presence;
+    }
+    m_presence = -1;
+
+    return messages;
+}
+
+qint64 OutgoingCoalescer::submitted() const
+{
+    return m_submitted;
+}
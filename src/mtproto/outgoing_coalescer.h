@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QHash>
+#include <QJsonArray>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief 合并待发送的确认、已读标记、输入状态和在线状态
+ *
+ * 这些消息不需要立即发送，也不需要等待结果。收到的服务器消息的确认合并为一个msgs_ack，
+ * 同一会话的已读标记只保留最大的消息ID，输入状态在几秒内不重复发送，在线状态只保留最后一次。
+ * 积累的内容在短暂延时后作为一个容器发出，或者附加在下一个请求所在的容器中。
+ */
+class OutgoingCoalescer
+{
+public:
+    OutgoingCoalescer();
+
+    void ack(qint64 messageId);
+    void markRead(qint64 peerId, qint32 maxId);
+    void setTyping(qint64 peerId, const QString& action, qint64 nowMs);
+    void setOnline(bool online);
+
+    bool isEmpty() const;
+
+    // 取出积累的内容，每项是一条容器中的消息（"_"为方法名）
+    QJsonArray take();
+
+    // 调用方提交的消息条数，即不合并时需要发送的条数
+    qint64 submitted() const;
+
+private:
+    QVector<qint64> m_acks;
+
+    // 待发送和已发送的已读位置
+    QMap<qint64, qint32> m_readMarks;
+    QHash<qint64, qint32> m_sentReadMarks;
+
+    // 待发送的输入状态和提交时间，以及每个会话上次实际发送的状态和时间
+    QMap<qint64, QPair<QString, qint64>> m_typing;
+    QHash<qint64, QPair<QString, qint64>> m_sentTyping;
+
+    int m_presence;         // 待发送的在线状态：-1为无，0为离线，1为在线
+    int m_sentPresence;
+
+    qint64 m_submitted;
+};
@@ -0,0 +1,120 @@
+#include "replay_window.h"
+#include "session_clock.h"
+
+namespace {
+
+// 服务器消息的时间允许的范围
+const qint64 MAX_AGE_MS = 300000;
+const qint64 MAX_AHEAD_MS = 30000;
+
+} // namespace
+
+ReplayWindow::ReplayWindow(int capacity)
+    : m_head(0)
+    , m_count(0)
+    , m_floor(0)
+{
+    m_ring.resize(qMax(1, capacity));
+
+    // 散列表至少是容量的两倍，保持较低的装载率
+    int bits = 1;
+    while ((1 << bits) < m_ring.size() * 2) {
+        ++bits;
+    }
+    m_table.resize(1 << bits);
+    m_mask = (1 << bits) - 1;
+    m_shift = 64 - bits;
+}
+
+ReplayWindow::Result ReplayWindow::check(quint64 messageId, qint64 serverNowMs)
+{
+    if (messageId == 0 || messageId <= m_floor) {
+        return TooOld;
+    }
+    qint64 time = MessageIdGenerator::timeOf(messageId);
+    if (time < serverNowMs - MAX_AGE_MS) {
+        return TooOld;
+    }
+    if (time > serverNowMs + MAX_AHEAD_MS) {
+        return TooNew;
+    }
+    if (contains(messageId)) {
+        return Duplicate;
+    }
+
+    // 已满时淘汰最早到达的ID
+    if (m_count == m_ring.size()) {
+        quint64 evicted = m_ring.at(m_head);
+        remove(evicted);
+        m_floor = qMax(m_floor, evicted);
+        m_head = (m_head + 1) % m_ring.size();
+        --m_count;
+    }
+    m_ring[(m_head + m_count) % m_ring.size()] = messageId;
+    ++m_count;
+    insert(messageId);
+    return Accepted;
+}
+
+void ReplayWindow::reset()
+{
+    m_ring.fill(0);
+    m_table.fill(0);
+    m_head = 0;
+    m_count = 0;
+    m_floor = 0;
+}
+
+int ReplayWindow::size() const
+{
+    return m_count;
+}
+
+int ReplayWindow::slotOf(quint64 messageId) const
+{
+    // 乘法散列，msg_id的低位规律性很强，取乘积的高位
+    return int((messageId * 0x9e3779b97f4a7c15ull) >> m_shift);
+}
+
+bool ReplayWindow::contains(quint64 messageId) const
+{
+    for (int slot = slotOf(messageId); m_table.at(slot) != 0; slot = (slot + 1) & m_mask) {
+        if (m_table.at(slot) == messageId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ReplayWindow::insert(quint64 messageId)
+{
+    int slot = slotOf(messageId);
+    while (m_table.at(slot) != 0) {
+        slot = (slot + 1) & m_mask;
+    }
+    m_table[slot] = messageId;
+}
+
+void ReplayWindow::remove(quint64 messageId)
+{
+    int slot = slotOf(messageId);
+    while (m_table.at(slot) != messageId) {
+        if (m_table.at(slot) == 0) {
+            return;
+        }
+        slot = (slot + 1) & m_mask;
+    }
+
+    // 向后移动删除：把后面探测链上的元素移到空位，不需要墓碑
+    int hole = slot;
+    for (int next = (hole + 1) & m_mask; m_table.at(next) != 0; next = (next + 1) & m_mask) {
+        int home = slotOf(m_table.at(next));
+        // home不在(hole, next]这个循环区间内时，元素可以移到hole
+        bool between = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!between) {
+            m_table[hole] = m_table.at(next);
+            hole = next;
+        }
+    }
+    m_table[hole] = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QVector>
+
+/**
+ * @brief 收到的服务器msg_id的重放检测窗口
+ *
+ * 记住最近capacity个msg_id：按到达顺序存放在环形缓冲中，同时放入开放寻址的散列表，
+ * 检查并插入都是O(1)，内存固定。缓冲满时淘汰最早到达的ID，淘汰过的最大ID成为下限，
+ * 不大于下限的ID一律视为过旧。另外按MTProto的要求，时间早于服务器时间300秒或
+ * 晚于30秒的msg_id直接丢弃。
+ */
+class ReplayWindow
+{
+public:
+    enum Result {
+        Accepted,
+        Duplicate,
+        TooOld,
+        TooNew
+    };
+
+    explicit ReplayWindow(int capacity = 4096);
+
+    // 检查msg_id，未见过时记住它；serverNowMs为估计的服务器时间
+    Result check(quint64 messageId, qint64 serverNowMs);
+
+    void reset();
+    int size() const;
+
+private:
+    bool contains(quint64 messageId) const;
+    void insert(quint64 messageId);
+    void remove(quint64 messageId);
+    int slotOf(quint64 messageId) const;
+
+    QVector<quint64> m_ring;        // 按到达顺序，m_head为最早的一个
+    int m_head;
+    int m_count;
+
+    QVector<quint64> m_table;       // 线性探测，0为空位
+    int m_mask;
+    int m_shift;
+
+    quint64 m_floor;
+};
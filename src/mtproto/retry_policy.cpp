@@ -0,0 +1,110 @@
+#include "retry_policy.h"
+#include <QStringList>
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// 每个方法保留的延迟样本数，以及计算百分位至少需要的样本数
+const int LATENCY_SAMPLES = 64;
+const int MIN_LATENCY_SAMPLES = 8;
+
+// 超过这个百分位的延迟才对冲
+const int HEDGE_PERCENTILE = 95;
+
+// 没有足够样本时的对冲等待时间，以及等待时间的下限（避免延迟很低时几乎每个请求都对冲）
+const int DEFAULT_HEDGE_DELAY_MS = 1000;
+const int MIN_HEDGE_DELAY_MS = 50;
+
+// 预算允许的突发对冲数，初始时预算是满的
+const double HEDGE_BURST = 3.0;
+
+} // namespace
+
+RetryPolicy::RetryPolicy(double hedgeBudget)
+    : m_budget(qBound(0.0, hedgeBudget, 1.0))
+    , m_tokens(m_budget > 0.0 ? HEDGE_BURST : 0.0)
+{
+}
+
+bool RetryPolicy::isIdempotent(const QString& method)
+{
+    // 发送验证码、登录和发送消息会改变服务器状态，重复执行会产生重复的结果
+    static const QStringList readMethods = {
+        "users.getFullUser",
+        "messages.getHistory",
+        "messages.getDialogs",
+        "contacts.getContacts",
+        "updates.getState",
+        "updates.getDifference",
+        "updates.getChannelDifference",
+        "get_future_salts"
+    };
+    return readMethods.contains(method);
+}
+
+void RetryPolicy::setHedgeBudget(double share)
+{
+    m_budget = qBound(0.0, share, 1.0);
+    m_tokens = m_budget > 0.0 ? qMin(m_tokens, HEDGE_BURST) : 0.0;
+}
+
+double RetryPolicy::hedgeBudget() const
+{
+    return m_budget;
+}
+
+void RetryPolicy::addRequest()
+{
+    m_tokens = qMin(m_tokens + m_budget, HEDGE_BURST);
+}
+
+int RetryPolicy::hedgeDelay(const QString& method) const
+{
+    if (m_budget <= 0.0 || !isIdempotent(method)) {
+        return -1;
+    }
+    auto it = m_methods.constFind(method);
+    qint32 delay = DEFAULT_HEDGE_DELAY_MS;
+    if (it != m_methods.constEnd() && it->values.size() >= MIN_LATENCY_SAMPLES) {
+        delay = percentile(*it);
+    } else if (m_all.values.size() >= MIN_LATENCY_SAMPLES) {
+        delay = percentile(m_all);
+    }
+    return qMax(MIN_HEDGE_DELAY_MS, int(delay));
+}
+
+bool RetryPolicy::acquireHedge()
+{
+    if (m_tokens < 1.0) {
+        return false;
+    }
+    m_tokens -= 1.0;
+    return true;
+}
+
+void RetryPolicy::recordLatency(const QString& method, qint64 latencyMs)
+{
+    // 对冲成功时记录的是较快一方的延迟，慢的尾部被截断，百分位会略微偏低，由预算兜底
+    qint32 value = qint32(qBound<qint64>(0, latencyMs, std::numeric_limits<qint32>::max()));
+    addSample(&m_methods[method], value);
+    addSample(&m_all, value);
+}
+
+void RetryPolicy::addSample(Samples* samples, qint32 latencyMs)
+{
+    if (samples->values.size() < LATENCY_SAMPLES) {
+        samples->values.append(latencyMs);
+        return;
+    }
+    samples->values[samples->next] = latencyMs;
+    samples->next = (samples->next + 1) % LATENCY_SAMPLES;
+}
+
+qint32 RetryPolicy::percentile(const Samples& samples)
+{
+    QVector<qint32> values = samples.values;
+    int index = qMin(int(values.size()) - 1, int(values.size()) * HEDGE_PERCENTILE / 100);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values.at(index);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief 请求的重试和对冲策略
+ *
+ * 按方法区分是否幂等：只读的查询重复执行没有副作用，等待时间超过该方法最近延迟的第95百分位时
+ * 可以在另一个连接上发送一个副本（对冲），先到的响应有效；发送消息、登录等请求不对冲。
+ * 对冲受预算限制：每个请求积累budget个令牌，每次对冲消耗一个，长期来看对冲数不超过请求数的
+ * budget倍，另外允许少量突发，使登录后最初的几个请求也能对冲。
+ */
+class RetryPolicy
+{
+public:
+    explicit RetryPolicy(double hedgeBudget = 0.05);
+
+    static bool isIdempotent(const QString& method);
+
+    // 对冲数占请求数的上限，0为不对冲
+    void setHedgeBudget(double share);
+    double hedgeBudget() const;
+
+    // 发出新请求时调用，积累对冲预算
+    void addRequest();
+
+    // 请求发出后多久还没有响应时发送对冲副本（毫秒），不对冲时返回-1
+    int hedgeDelay(const QString& method) const;
+
+    // 对冲前调用，预算不足时返回false
+    bool acquireHedge();
+
+    // 从请求首次发出到收到响应的时间
+    void recordLatency(const QString& method, qint64 latencyMs);
+
+private:
+    // 最近的延迟样本，环形缓冲
+    struct Samples
+    {
+        QVector<qint32> values;
+        int next = 0;
+    };
+    static void addSample(Samples* samples, qint32 latencyMs);
+    static qint32 percentile(const Samples& samples);
+
+    double m_budget;
+    double m_tokens;
+    QHash<QString, Samples> m_methods;
+    Samples m_all;              // 所有方法，某个方法的样本不够时使用
+};
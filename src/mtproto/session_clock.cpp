@@ -0,0 +1,152 @@
+#include "session_clock.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// 还没有任何偏差样本
+const qint64 NO_OFFSET = std::numeric_limits<qint64>::min();
+
+// 偏差的指数加权平均中新样本的权重为1/OFFSET_SMOOTHING
+const qint64 OFFSET_SMOOTHING = 8;
+
+// 与当前估计相差超过这个值的样本直接采用（例如本地时钟被调整）
+const qint64 OFFSET_JUMP_MS = 5000;
+
+// 当前盐在到期前这么多秒切换到下一个
+const qint32 SALT_SWITCH_MARGIN = 60;
+
+// 已知的盐覆盖不足这么多秒时预取
+const qint32 SALT_PREFETCH_COVERAGE = 3600;
+
+// 只从bad_server_salt得到的盐，假定的有效期
+const qint32 SALT_DEFAULT_LIFETIME = 1800;
+
+} // namespace
+
+MessageIdGenerator::MessageIdGenerator()
+    : m_offsetMs(NO_OFFSET)
+    , m_last(0)
+{
+}
+
+quint64 MessageIdGenerator::next(qint64 localMs)
+{
+    qint64 ms = localMs + offsetMs();
+    quint64 candidate = (quint64(ms / 1000) << 32) | ((quint64(ms % 1000) << 32) / 1000);
+    candidate &= ~quint64(3);
+
+    // 同一毫秒内或时间回退时在上一个的基础上加4，保证严格递增
+    quint64 last = m_last.load(std::memory_order_relaxed);
+    quint64 id;
+    do {
+        id = std::max(candidate, last + 4);
+    } while (!m_last.compare_exchange_weak(last, id, std::memory_order_relaxed));
+    return id;
+}
+
+void MessageIdGenerator::addOffsetSample(qint64 offsetMs)
+{
+    // 第一个样本直接采用，与后续样本的平滑在同一个CAS中完成
+    qint64 current = m_offsetMs.load(std::memory_order_relaxed);
+    qint64 updated;
+    do {
+        updated = current == NO_OFFSET || qAbs(offsetMs - current) > OFFSET_JUMP_MS
+            ? offsetMs
+            : current + (offsetMs - current) / OFFSET_SMOOTHING;
+    } while (!m_offsetMs.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+}
+
+bool MessageIdGenerator::resetOffset(qint64 offsetMs, qint64 localMs)
+{
+    m_offsetMs.store(offsetMs);
+
+    // 仍保持递增：新的时间早于已经发出的msg_id时，next()会在其基础上加4，
+    // 这些msg_id的时间仍然不对，需要调用方开始新的会话
+    qint64 ms = localMs + offsetMs;
+    quint64 candidate = (quint64(ms / 1000) << 32) | ((quint64(ms % 1000) << 32) / 1000);
+    return (candidate & ~quint64(3)) <= m_last.load(std::memory_order_relaxed);
+}
+
+void MessageIdGenerator::startSession()
+{
+    m_last.store(0);
+}
+
+qint64 MessageIdGenerator::offsetMs() const
+{
+    qint64 offset = m_offsetMs.load(std::memory_order_relaxed);
+    return offset == NO_OFFSET ? 0 : offset;
+}
+
+qint64 MessageIdGenerator::serverTimeMs(qint64 localMs) const
+{
+    return localMs + offsetMs();
+}
+
+qint64 MessageIdGenerator::timeOf(quint64 messageId)
+{
+    return qint64(messageId >> 32) * 1000 + qint64(((messageId & 0xffffffffu) * 1000) >> 32);
+}
+
+ServerSalts::ServerSalts()
+{
+}
+
+bool ServerSalts::isEmpty() const
+{
+    return m_salts.isEmpty();
+}
+
+void ServerSalts::setCurrent(qint64 salt, qint32 serverNow)
+{
+    // 服务器认为已知的盐都不再有效
+    m_salts.clear();
+    Salt current;
+    current.salt = salt;
+    current.validSince = serverNow;
+    current.validUntil = serverNow + SALT_DEFAULT_LIFETIME;
+    m_salts.append(current);
+}
+
+void ServerSalts::addFutureSalts(const QVector<Salt>& salts)
+{
+    for (const Salt& salt : salts) {
+        auto same = std::find_if(m_salts.begin(), m_salts.end(), [&salt](const Salt& known) {
+            return known.salt == salt.salt;
+        });
+        if (same != m_salts.end()) {
+            *same = salt;
+        } else {
+            m_salts.append(salt);
+        }
+    }
+    std::sort(m_salts.begin(), m_salts.end(), [](const Salt& a, const Salt& b) {
+        return a.validSince < b.validSince;
+    });
+}
+
+qint64 ServerSalts::current(qint32 serverNow)
+{
+    // 丢弃已过期或即将过期、且下一个已经生效的盐
+    while (m_salts.size() > 1 && m_salts.at(0).validUntil - SALT_SWITCH_MARGIN <= serverNow
+           && m_salts.at(1).validSince <= serverNow) {
+        m_salts.removeFirst();
+    }
+    return m_salts.isEmpty() ? 0 : m_salts.first().salt;
+}
+
+qint32 ServerSalts::coverage(qint32 serverNow) const
+{
+    return m_salts.isEmpty() ? 0 : qMax(0, m_salts.last().validUntil - serverNow);
+}
+
+bool ServerSalts::needsPrefetch(qint32 serverNow) const
+{
+    return coverage(serverNow) < SALT_PREFETCH_COVERAGE;
+}
+
+qint32 ServerSalts::secondsUntilPrefetch(qint32 serverNow) const
+{
+    return qMax(0, coverage(serverNow) - SALT_PREFETCH_COVERAGE);
+}
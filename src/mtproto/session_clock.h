@@ -0,0 +1,84 @@
+#pragma once
+
+#include <QVector>
+#include <atomic>
+
+/**
+ * @brief 按服务器时间生成msg_id
+ *
+ * msg_id的高32位是服务器时间的秒数，低32位是秒内的小数部分，客户端的msg_id是4的倍数。
+ * 本地时钟与服务器的偏差由每次响应的时间戳平滑估计，偏差过大（服务器返回
+ * bad_msg_notification）时直接采用服务器时间。
+ * 生成和更新偏差都只使用原子操作，可以在任意线程调用，同一个会话中产生的msg_id严格递增。
+ */
+class MessageIdGenerator
+{
+public:
+    MessageIdGenerator();
+
+    // localMs为本地时间（毫秒）
+    quint64 next(qint64 localMs);
+
+    // 一次往返得到的偏差样本（服务器时间减本地时间），按指数加权平均
+    void addOffsetSample(qint64 offsetMs);
+
+    // 服务器拒绝了msg_id的时间：直接采用新的偏差。新的时间早于已经发出的msg_id时返回true，
+    // 会话内不能回退，调用方需要调用startSession并改用新的会话
+    bool resetOffset(qint64 offsetMs, qint64 localMs);
+
+    // 新的会话，msg_id从当前时间重新开始
+    void startSession();
+
+    qint64 offsetMs() const;
+    qint64 serverTimeMs(qint64 localMs) const;
+
+    // msg_id中的服务器时间（毫秒）
+    static qint64 timeOf(quint64 messageId);
+
+private:
+    std::atomic<qint64> m_offsetMs;     // 没有样本时为NO_OFFSET
+    std::atomic<quint64> m_last;
+};
+
+/**
+ * @brief 服务器盐的预取与轮换
+ *
+ * 每个盐只在一段时间内有效。通过get_future_salts提前取得之后的盐，
+ * 在当前的盐到期前切换到下一个，避免过期后收到bad_server_salt再重发。
+ * 已知的盐覆盖的时间不足时提示调用方再次预取。
+ */
+class ServerSalts
+{
+public:
+    struct Salt
+    {
+        qint64 salt = 0;
+        qint32 validSince = 0;
+        qint32 validUntil = 0;
+    };
+
+    ServerSalts();
+
+    bool isEmpty() const;
+
+    // 服务器在bad_server_salt中给出的当前盐，有效期未知时视为短期有效
+    void setCurrent(qint64 salt, qint32 serverNow);
+
+    // 合并get_future_salts的结果
+    void addFutureSalts(const QVector<Salt>& salts);
+
+    // serverNow时应使用的盐，快到期且下一个已生效时提前切换
+    qint64 current(qint32 serverNow);
+
+    // 已知的盐从serverNow起覆盖的秒数
+    qint32 coverage(qint32 serverNow) const;
+
+    bool needsPrefetch(qint32 serverNow) const;
+
+    // 距离需要预取还有多少秒
+    qint32 secondsUntilPrefetch(qint32 serverNow) const;
+
+private:
+    // 按生效时间排序
+    QVector<Salt> m_salts;
+};
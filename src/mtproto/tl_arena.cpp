@@ -0,0 +1,98 @@
+#include "tl_arena.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// 内存块按两倍增长，单块不超过这个大小（更大的请求单独分配一块）
+const qsizetype MAX_CHUNK_SIZE = 1024 * 1024;
+
+quintptr alignUp(quintptr value, qsizetype alignment)
+{
+    return (value + quintptr(alignment) - 1) & ~(quintptr(alignment) - 1);
+}
+
+} // namespace
+
+TlArena::TlArena(qsizetype initialChunkSize)
+    : m_current(nullptr)
+    , m_cursor(nullptr)
+    , m_end(nullptr)
+    , m_nextChunkSize(qMax<qsizetype>(initialChunkSize, 256))
+{
+}
+
+TlArena::~TlArena()
+{
+    while (m_current) {
+        Chunk* previous = m_current->previous;
+        std::free(m_current);
+        m_current = previous;
+    }
+}
+
+void* TlArena::allocate(qsizetype size, qsizetype alignment)
+{
+    quintptr address = alignUp(quintptr(m_cursor), alignment);
+    if (!m_current || address + quintptr(size) > quintptr(m_end)) {
+        addChunk(size + alignment);
+        address = alignUp(quintptr(m_cursor), alignment);
+    }
+    m_cursor = reinterpret_cast<char*>(address + quintptr(size));
+    m_stats.bytesUsed += size;
+    return reinterpret_cast<void*>(address);
+}
+
+const char* TlArena::copyString(const char* data, qsizetype size)
+{
+    if (size <= 0) {
+        return nullptr;
+    }
+    char* copy = static_cast<char*>(allocate(size, 1));
+    std::memcpy(copy, data, size_t(size));
+    ++m_stats.strings;
+    return copy;
+}
+
+void TlArena::reset()
+{
+    // 只保留最大的一块
+    Chunk* largest = m_current;
+    for (Chunk* chunk = m_current; chunk; chunk = chunk->previous) {
+        if (chunk->size > largest->size) {
+            largest = chunk;
+        }
+    }
+    while (m_current) {
+        Chunk* previous = m_current->previous;
+        if (m_current != largest) {
+            std::free(m_current);
+        }
+        m_current = previous;
+    }
+    m_current = largest;
+    if (largest) {
+        largest->previous = nullptr;
+        m_cursor = reinterpret_cast<char*>(largest + 1);
+        m_end = reinterpret_cast<char*>(largest) + largest->size;
+    }
+}
+
+TlArena::Stats TlArena::stats() const
+{
+    return m_stats;
+}
+
+void TlArena::addChunk(qsizetype minimumSize)
+{
+    qsizetype size = qMax<qsizetype>(m_nextChunkSize, minimumSize + qsizetype(sizeof(Chunk)));
+    Chunk* chunk = static_cast<Chunk*>(std::malloc(size_t(size)));
+    Q_CHECK_PTR(chunk);
+    chunk->previous = m_current;
+    chunk->size = size;
+    m_current = chunk;
+    m_cursor = reinterpret_cast<char*>(chunk + 1);
+    m_end = reinterpret_cast<char*>(chunk) + size;
+    m_nextChunkSize = qMin(m_nextChunkSize * 2, MAX_CHUNK_SIZE);
+    ++m_stats.chunkAllocations;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QtGlobal>
+#include <new>
+#include <type_traits>
+
+/**
+ * @brief 解码一个响应时使用的单调分配器
+ *
+ * 对象和字符串依次放在大块内存中，只分配不释放；响应处理完后reset()一次性丢弃全部对象，
+ * 并保留最大的一块供下一个响应使用，稳定后解码不再产生堆分配。字符串按UTF-8原样存放。
+ * 放在其中的对象不会被析构，只能是平凡析构的类型；需要长期保存的对象由使用方显式复制出来。
+ */
+class TlArena
+{
+public:
+    explicit TlArena(qsizetype initialChunkSize = 16 * 1024);
+    ~TlArena();
+
+    TlArena(const TlArena&) = delete;
+    TlArena& operator=(const TlArena&) = delete;
+
+    void* allocate(qsizetype size, qsizetype alignment);
+
+    // 分配count个值初始化的对象
+    template<typename T>
+    T* makeArray(qsizetype count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena中的对象不会被析构");
+        if (count <= 0) {
+            return nullptr;
+        }
+        T* items = static_cast<T*>(allocate(qsizetype(sizeof(T)) * count, qsizetype(alignof(T))));
+        for (qsizetype i = 0; i < count; ++i) {
+            new (items + i) T();
+        }
+        m_stats.objects += count;
+        return items;
+    }
+
+    // 复制字符串的字节，返回arena中的副本
+    const char* copyString(const char* data, qsizetype size);
+
+    void reset();
+
+    struct Stats
+    {
+        qint64 chunkAllocations = 0;    // 向堆申请内存块的次数
+        qint64 objects = 0;
+        qint64 strings = 0;
+        qint64 bytesUsed = 0;
+    };
+    // 自构造以来的累计统计，reset()不清零
+    Stats stats() const;
+
+private:
+    struct Chunk
+    {
+        Chunk* previous;
+        qsizetype size;
+    };
+
+    void addChunk(qsizetype minimumSize);
+
+    Chunk* m_current;
+    char* m_cursor;
+    char* m_end;
+    qsizetype m_nextChunkSize;
+    Stats m_stats;
+};
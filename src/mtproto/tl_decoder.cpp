@@ -0,0 +1,370 @@
+#include "tl_decoder.h"
+#include "utf8_codec.h"
+#include <QCborStreamReader>
+#include <QVarLengthArray>
+#include <cstring>
+
+QString TlString::toString() const
+{
+    return Utf8Codec::toString(data, size);
+}
+
+bool TlString::equals(QStringView text) const
+{
+    return Utf8Codec::equals(data, size, text);
+}
+
+bool TlString::operator==(const TlString& other) const
+{
+    return size == other.size && (size == 0 || std::memcmp(data, other.data, size_t(size)) == 0);
+}
+
+MessageData TlMessage::promote(const QString& sharedFromName) const
+{
+    MessageData message;
+    message.peerId = peerId;
+    message.id = id;
+    message.date = date;
+    message.editDate = editDate;
+    message.fromId = fromId;
+    message.fromName = sharedFromName;
+    message.text = text.toString();
+    return message;
+}
+
+MessageData TlMessage::promote() const
+{
+    return promote(fromName.toString());
+}
+
+PeerData TlPeer::promote() const
+{
+    PeerData peer;
+    peer.id = id;
+    peer.type = type;
+    peer.title = title.toString();
+    peer.username = username.toString();
+    peer.firstName = firstName.toString();
+    peer.lastName = lastName.toString();
+    return peer;
+}
+
+bool TlPeer::sameAs(const PeerData& peer) const
+{
+    return peer.id == id && peer.type == type && title.equals(peer.title) && username.equals(peer.username)
+        && firstName.equals(peer.firstName) && lastName.equals(peer.lastName);
+}
+
+QVector<MessageData> TlHistory::promoteMessages() const
+{
+    // 一页历史中的发送者很少，线性查找即可；直接比较UTF-8字节，同名只转换一次
+    struct Name
+    {
+        TlString utf8;
+        QString text;
+    };
+    QVarLengthArray<Name, 32> names;
+    QVector<MessageData> result;
+    result.reserve(messages.size());
+    for (const TlMessage& message : messages) {
+        QString fromName;
+        for (const Name& name : names) {
+            if (name.utf8 == message.fromName) {
+                fromName = name.text;
+                break;
+            }
+        }
+        if (fromName.isNull() && !message.fromName.isEmpty()) {
+            fromName = message.fromName.toString();
+            names.append({ message.fromName, fromName });
+        }
+        result.append(message.promote(fromName));
+    }
+    return result;
+}
+
+TlDecoder::TlDecoder(TlArena* arena)
+    : m_arena(arena)
+    , m_inputSize(0)
+    , m_keySize(0)
+    , m_scratchSize(0)
+    , m_packed(false)
+    , m_notModified(false)
+{
+    m_key.resize(64);
+    m_scratch.resize(1024);
+}
+
+TlDecoder::Status TlDecoder::decodeHistory(const QByteArray& bytes, TlHistory* history)
+{
+    QCborStreamReader reader(bytes);
+    m_inputSize = bytes.size();
+    m_packed = false;
+    m_notModified = false;
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return Malformed;
+    }
+    while (reader.hasNext()) {
+        if (!readKey(reader)) {
+            return Malformed;
+        }
+        if (readPackedField(reader)) {
+            continue;
+        }
+        if (isKey("success")) {
+            history->success = readBool(reader);
+        } else if (isKey("peer")) {
+            history->peerId = readInteger(reader);
+        } else if (isKey("offset_id")) {
+            history->offsetId = qint32(readInteger(reader));
+        } else if (isKey("limit")) {
+            history->limit = qint32(readInteger(reader));
+        } else if (isKey("count")) {
+            history->count = qint32(readInteger(reader));
+        } else if (isKey("messages")) {
+            if (!readArray(reader, &history->messages, &TlDecoder::readMessage)) {
+                return Malformed;
+            }
+        } else {
+            reader.next();
+        }
+    }
+    if (!reader.leaveContainer() || reader.lastError() != QCborError::NoError) {
+        return Malformed;
+    }
+    return m_packed ? Packed : Ok;
+}
+
+TlDecoder::Status TlDecoder::decodeDialogs(const QByteArray& bytes, TlDialogs* dialogs)
+{
+    QCborStreamReader reader(bytes);
+    m_inputSize = bytes.size();
+    m_packed = false;
+    m_notModified = false;
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return Malformed;
+    }
+    while (reader.hasNext()) {
+        if (!readKey(reader)) {
+            return Malformed;
+        }
+        if (readPackedField(reader)) {
+            continue;
+        }
+        if (isKey("success")) {
+            dialogs->success = readBool(reader);
+        } else if (isKey("chats")) {
+            if (!readArray(reader, &dialogs->chats, &TlDecoder::readChannel)) {
+                return Malformed;
+            }
+        } else if (isKey("dialogs")) {
+            if (!readArray(reader, &dialogs->dialogs, &TlDecoder::readDialog)) {
+                return Malformed;
+            }
+        } else {
+            reader.next();
+        }
+    }
+    if (!reader.leaveContainer() || reader.lastError() != QCborError::NoError) {
+        return Malformed;
+    }
+    dialogs->notModified = m_notModified;
+    return m_packed ? Packed : Ok;
+}
+
+QByteArray TlDecoder::packedData() const
+{
+    return m_packedData;
+}
+
+bool TlDecoder::readKey(QCborStreamReader& reader)
+{
+    return reader.isString() && readUtf8(reader, &m_key, &m_keySize);
+}
+
+bool TlDecoder::isKey(const char* name) const
+{
+    qsizetype size = qsizetype(std::strlen(name));
+    return size == m_keySize && std::memcmp(m_key.constData(), name, size_t(size)) == 0;
+}
+
+bool TlDecoder::readUtf8(QCborStreamReader& reader, QByteArray* buffer, qsizetype* size)
+{
+    *size = 0;
+    if (!reader.isString()) {
+        reader.next();
+        return false;
+    }
+    QCborStreamReader::StringResult<qsizetype> result;
+    do {
+        qsizetype chunk = qMax<qsizetype>(0, reader.currentStringChunkSize());
+        if (buffer->size() < *size + chunk) {
+            buffer->resize(*size + chunk);
+        }
+        result = reader.readStringChunk(buffer->data() + *size, chunk);
+        if (result.status == QCborStreamReader::Ok) {
+            *size += result.data;
+        }
+    } while (result.status == QCborStreamReader::Ok);
+    return result.status == QCborStreamReader::EndOfString;
+}
+
+TlString TlDecoder::readString(QCborStreamReader& reader)
+{
+    TlString string;
+    if (readUtf8(reader, &m_scratch, &m_scratchSize)) {
+        string.data = m_arena->copyString(m_scratch.constData(), m_scratchSize);
+        string.size = m_scratchSize;
+    }
+    return string;
+}
+
+qint64 TlDecoder::readInteger(QCborStreamReader& reader)
+{
+    // 较大的ID在JSON中以浮点数表示
+    qint64 value = 0;
+    if (reader.isInteger()) {
+        value = reader.toInteger();
+    } else if (reader.isDouble()) {
+        value = qint64(reader.toDouble());
+    } else if (reader.isFloat()) {
+        value = qint64(reader.toFloat());
+    }
+    reader.next();
+    return value;
+}
+
+bool TlDecoder::readBool(QCborStreamReader& reader)
+{
+    bool value = reader.isBool() && reader.toBool();
+    reader.next();
+    return value;
+}
+
+bool TlDecoder::readPackedField(QCborStreamReader& reader)
+{
+    if (isKey("_")) {
+        static const char PACKED_TYPE[] = "gzip_packed";
+        static const char NOT_MODIFIED_SUFFIX[] = "NotModified";
+        const qsizetype packedSize = qsizetype(sizeof(PACKED_TYPE) - 1);
+        const qsizetype suffixSize = qsizetype(sizeof(NOT_MODIFIED_SUFFIX) - 1);
+        if (!readUtf8(reader, &m_scratch, &m_scratchSize)) {
+            return true;
+        }
+        m_packed = m_scratchSize == packedSize
+            && std::memcmp(m_scratch.constData(), PACKED_TYPE, size_t(packedSize)) == 0;
+        // 如messages.dialogsNotModified，客户端继续使用缓存的结果
+        m_notModified = m_scratchSize > suffixSize
+            && std::memcmp(m_scratch.constData() + m_scratchSize - suffixSize, NOT_MODIFIED_SUFFIX, size_t(suffixSize)) == 0;
+        return true;
+    }
+    if (isKey("packed_data")) {
+        m_packedData.clear();
+        if (readUtf8(reader, &m_scratch, &m_scratchSize)) {
+            m_packedData = QByteArray::fromBase64(QByteArray::fromRawData(m_scratch.constData(), m_scratchSize));
+        }
+        return true;
+    }
+    return false;
+}
+
+template<typename T>
+bool TlDecoder::readArray(QCborStreamReader& reader, TlArray<T>* array, bool (TlDecoder::*read)(QCborStreamReader&, T*))
+{
+    // 序列化的数组都带长度，据此一次分配；每个元素至少占一个字节，长度不会超过输入
+    if (!reader.isArray() || !reader.isLengthKnown() || reader.length() > quint64(m_inputSize)) {
+        return false;
+    }
+    array->count = qsizetype(reader.length());
+    array->items = m_arena->makeArray<T>(array->count);
+    if (!reader.enterContainer()) {
+        return false;
+    }
+    for (qsizetype i = 0; i < array->count; ++i) {
+        if (!(this->*read)(reader, array->items + i)) {
+            return false;
+        }
+    }
+    return reader.leaveContainer();
+}
+
+bool TlDecoder::readMessage(QCborStreamReader& reader, TlMessage* message)
+{
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return false;
+    }
+    while (reader.hasNext()) {
+        if (!readKey(reader)) {
+            return false;
+        }
+        if (isKey("peer_id")) {
+            message->peerId = readInteger(reader);
+        } else if (isKey("id")) {
+            message->id = qint32(readInteger(reader));
+        } else if (isKey("date")) {
+            message->date = qint32(readInteger(reader));
+        } else if (isKey("edit_date")) {
+            message->editDate = qint32(readInteger(reader));
+        } else if (isKey("from_id")) {
+            message->fromId = readInteger(reader);
+        } else if (isKey("from_name")) {
+            message->fromName = readString(reader);
+        } else if (isKey("message")) {
+            message->text = readString(reader);
+        } else {
+            reader.next();
+        }
+    }
+    return reader.leaveContainer();
+}
+
+bool TlDecoder::readChannel(QCborStreamReader& reader, TlPeer* peer)
+{
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return false;
+    }
+    peer->type = PeerData::Channel;
+    while (reader.hasNext()) {
+        if (!readKey(reader)) {
+            return false;
+        }
+        if (isKey("id")) {
+            peer->id = readInteger(reader);
+        } else if (isKey("title")) {
+            peer->title = readString(reader);
+        } else if (isKey("username")) {
+            peer->username = readString(reader);
+        } else {
+            reader.next();
+        }
+    }
+    return reader.leaveContainer();
+}
+
+bool TlDecoder::readDialog(QCborStreamReader& reader, DialogData* dialog)
+{
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return false;
+    }
+    while (reader.hasNext()) {
+        if (!readKey(reader)) {
+            return false;
+        }
+        if (isKey("peer")) {
+            dialog->peerId = readInteger(reader);
+        } else if (isKey("top_message")) {
+            dialog->topMessageId = qint32(readInteger(reader));
+        } else if (isKey("read_inbox_max_id")) {
+            dialog->readInboxMaxId = qint32(readInteger(reader));
+        } else if (isKey("unread_count")) {
+            dialog->unreadCount = qint32(readInteger(reader));
+        } else if (isKey("pts")) {
+            dialog->pts = qint32(readInteger(reader));
+        } else if (isKey("folder_id")) {
+            dialog->folderId = qint32(readInteger(reader));
+        } else {
+            reader.next();
+        }
+    }
+    return reader.leaveContainer();
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include "core/telegram_types.h"
+#include "tl_arena.h"
+
+class QCborStreamReader;
+
+/**
+ * @brief arena中的定长数组
+ */
+template<typename T>
+struct TlArray
+{
+    T* items = nullptr;
+    qsizetype count = 0;
+
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+    qsizetype size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    const T& at(qsizetype i) const { return items[i]; }
+    const T& first() const { return items[0]; }
+    const T& last() const { return items[count - 1]; }
+};
+
+/**
+ * @brief arena中的UTF-8字符串
+ *
+ * 解码时只复制字节，用到时才校验并转换为UTF-16；只是比较或转发的字符串不需要转换
+ */
+struct TlString
+{
+    const char* data = nullptr;
+    qsizetype size = 0;
+
+    bool isEmpty() const { return size == 0; }
+    QString toString() const;
+    bool equals(QStringView text) const;
+    bool operator==(const TlString& other) const;
+};
+
+/**
+ * @brief 解码在arena中的消息，字符串指向arena
+ */
+struct TlMessage
+{
+    qint64 peerId = 0;
+    qint32 id = 0;
+    qint32 date = 0;
+    qint32 editDate = 0;
+    qint64 fromId = 0;
+    TlString fromName;
+    TlString text;
+
+    // 复制出可以长期保存的消息；fromName为已复制的发送者名字，可以在多条消息间共享
+    MessageData promote(const QString& fromName) const;
+    MessageData promote() const;
+};
+
+/**
+ * @brief 解码在arena中的用户、群组或频道资料
+ */
+struct TlPeer
+{
+    qint64 id = 0;
+    PeerData::Type type = PeerData::User;
+    TlString title;
+    TlString username;
+    TlString firstName;
+    TlString lastName;
+
+    PeerData promote() const;
+    bool sameAs(const PeerData& peer) const;
+};
+
+/**
+ * @brief messages.getHistory 的响应
+ */
+struct TlHistory
+{
+    bool success = false;
+    qint64 peerId = 0;
+    qint32 offsetId = 0;
+    qint32 limit = 0;
+    qint32 count = 0;
+    TlArray<TlMessage> messages;
+
+    // 复制出全部消息，同一发送者的名字只复制一次
+    QVector<MessageData> promoteMessages() const;
+};
+
+/**
+ * @brief messages.getDialogs 的响应
+ */
+struct TlDialogs
+{
+    bool success = false;
+    TlArray<TlPeer> chats;
+    TlArray<DialogData> dialogs;
+    bool notModified = false;   // 列表与请求中的hash一致，服务器没有返回内容
+};
+
+/**
+ * @brief 从响应的序列化字节直接解码到arena
+ *
+ * 边读边写入arena，不经过中间的文档对象；字符串在一个复用的缓冲中拼好后复制到arena。
+ * 解码出的对象在arena重置前有效。
+ */
+class TlDecoder
+{
+public:
+    enum Status {
+        Ok,
+        Packed,     // 内容是gzip_packed，解压packedData()后再解码
+        Malformed
+    };
+
+    explicit TlDecoder(TlArena* arena);
+
+    Status decodeHistory(const QByteArray& bytes, TlHistory* history);
+    Status decodeDialogs(const QByteArray& bytes, TlDialogs* dialogs);
+
+    // 上一次返回Packed时的压缩数据
+    QByteArray packedData() const;
+
+private:
+    bool readKey(QCborStreamReader& reader);
+    bool isKey(const char* name) const;
+    bool readUtf8(QCborStreamReader& reader, QByteArray* buffer, qsizetype* size);
+    TlString readString(QCborStreamReader& reader);
+    qint64 readInteger(QCborStreamReader& reader);
+    bool readBool(QCborStreamReader& reader);
+    bool readPackedField(QCborStreamReader& reader);
+
+    template<typename T>
+    bool readArray(QCborStreamReader& reader, TlArray<T>* array, bool (TlDecoder::*read)(QCborStreamReader&, T*));
+    bool readMessage(QCborStreamReader& reader, TlMessage* message);
+    bool readChannel(QCborStreamReader& reader, TlPeer* peer);
+    bool readDialog(QCborStreamReader& reader, DialogData* dialog);
+
+    TlArena* m_arena;
+    qsizetype m_inputSize;
+
+    // 当前读到的键或字符串（UTF-8），缓冲只增长不收缩
+    QByteArray m_key;
+    qsizetype m_keySize;
+    QByteArray m_scratch;
+    qsizetype m_scratchSize;
+
+    bool m_packed;
+    bool m_notModified;
+    QByteArray m_packedData;
+};
@@ -0,0 +1,97 @@
+#include "traffic_capture.h"
+#include <QCborValue>
+#include <QDebug>
+#include <QtEndian>
+
+namespace {
+
+const quint32 CAPTURE_MAGIC = 0x54474350; // "TGCP"
+const quint32 CAPTURE_VERSION = 1;
+
+} // namespace
+
+TrafficCapture::TrafficCapture()
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    close();
+}
+
+bool TrafficCapture::open(const QString& path)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "无法创建抓包文件:" << path << m_file.errorString();
+        return false;
+    }
+
+    QByteArray header(8, Qt::Uninitialized);
+    qToLittleEndian<quint32>(CAPTURE_MAGIC, header.data());
+    qToLittleEndian<quint32>(CAPTURE_VERSION, header.data() + 4);
+    m_file.write(header);
+
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_6_0);
+    m_clock.start();
+    return true;
+}
+
+void TrafficCapture::close()
+{
+    if (m_file.isOpen()) {
+        m_stream.setDevice(nullptr);
+        m_file.close();
+    }
+}
+
+bool TrafficCapture::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void TrafficCapture::write(RecordType type, quint64 requestId, const QString& method, const QJsonObject& payload)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_stream << quint8(type) << qint64(m_clock.nsecsElapsed() / 1000) << requestId << method
+             << QCborValue::fromJsonValue(payload).toCbor();
+}
+
+bool TrafficCapture::read(const QString& path, QVector<Record>* records)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "无法打开抓包文件:" << path << file.errorString();
+        return false;
+    }
+
+    QByteArray header = file.read(8);
+    if (header.size() != 8
+        || qFromLittleEndian<quint32>(header.constData()) != CAPTURE_MAGIC
+        || qFromLittleEndian<quint32>(header.constData() + 4) != CAPTURE_VERSION) {
+        qWarning() << "不是有效的抓包文件:" << path;
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    records->clear();
+    while (!stream.atEnd()) {
+        quint8 type = 0;
+        Record record;
+        QByteArray cbor;
+        stream >> type >> record.timeUs >> record.requestId >> record.method >> cbor;
+        if (stream.status() != QDataStream::Ok) {
+            // 末尾残缺的记录
+            break;
+        }
+        record.type = RecordType(type);
+        record.payload = QCborValue::fromCbor(cbor).toJsonValue().toObject();
+        records->append(record);
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief 请求和响应的二进制抓包文件
+ *
+ * 文件头为魔数和版本号，之后每条记录依次是：类型、相对录制开始的微秒数、
+ * 请求编号、方法名和以CBOR编码的内容。请求和它的响应使用相同的请求编号，
+ * 服务器推送和不需要响应的消息（确认、已读和输入状态）的请求编号为0。程序异常退出时文件末尾可能有残缺的记录，读取时忽略。
+ */
+class TrafficCapture
+{
+public:
+    enum RecordType : quint8 {
+        Request = 1,
+        Response = 2,
+        Push = 3
+    };
+
+    struct Record
+    {
+        RecordType type = Request;
+        qint64 timeUs = 0;
+        quint64 requestId = 0;
+        QString method;
+        QJsonObject payload;
+    };
+
+    TrafficCapture();
+    ~TrafficCapture();
+
+    // 开始录制，已有的文件被覆盖
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const;
+
+    void write(RecordType type, quint64 requestId, const QString& method, const QJsonObject& payload);
+
+    // 读取整个抓包文件，记录按写入顺序排列
+    static bool read(const QString& path, QVector<Record>* records);
+
+private:
+    QFile m_file;
+    QDataStream m_stream;
+    QElapsedTimer m_clock;
+};
@@ -0,0 +1,521 @@
+#include "utf8_codec.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_CODEC_X86 1
+#include <immintrin.h>
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define UTF8_CODEC_X86 1
+#include <immintrin.h>
+#include <intrin.h>
+#define TARGET_SSE4
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+bool isContinuation(uchar byte)
+{
+    return (byte & 0xC0) == 0x80;
+}
+
+// 转换一个已校验过的多字节字符，返回占用的字节数
+inline qsizetype decodeSequence(const uchar* in, char16_t*& out)
+{
+    uchar lead = in[0];
+    if (lead < 0xE0) {
+        *out++ = char16_t(((lead & 0x1F) << 6) | (in[1] & 0x3F));
+        return 2;
+    }
+    if (lead < 0xF0) {
+        *out++ = char16_t(((lead & 0x0F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F));
+        return 3;
+    }
+    uint codePoint = ((uint(lead) & 0x07) << 18) | ((uint(in[1]) & 0x3F) << 12)
+        | ((uint(in[2]) & 0x3F) << 6) | (uint(in[3]) & 0x3F);
+    codePoint -= 0x10000;
+    *out++ = char16_t(0xD800 | (codePoint >> 10));
+    *out++ = char16_t(0xDC00 | (codePoint & 0x3FF));
+    return 4;
+}
+
+// 多字节字符的长度，输入不完整或不合法时返回0
+qsizetype validSequenceLength(const uchar* in, qsizetype available)
+{
+    uchar lead = in[0];
+    if (lead < 0xC2) {
+        return 0;
+    }
+    if (lead < 0xE0) {
+        return available >= 2 && isContinuation(in[1]) ? 2 : 0;
+    }
+    if (lead < 0xF0) {
+        if (available < 3 || !isContinuation(in[1]) || !isContinuation(in[2])) {
+            return 0;
+        }
+        // 过长编码和代理区
+        if ((lead == 0xE0 && in[1] < 0xA0) || (lead == 0xED && in[1] >= 0xA0)) {
+            return 0;
+        }
+        return 3;
+    }
+    if (lead > 0xF4 || available < 4 || !isContinuation(in[1]) || !isContinuation(in[2])
+        || !isContinuation(in[3])) {
+        return 0;
+    }
+    // 过长编码和超出U+10FFFF
+    if ((lead == 0xF0 && in[1] < 0x90) || (lead == 0xF4 && in[1] >= 0x90)) {
+        return 0;
+    }
+    return 4;
+}
+
+bool isAsciiWord(const uchar* in)
+{
+    quint64 word;
+    std::memcpy(&word, in, sizeof(word));
+    return (word & 0x8080808080808080ull) == 0;
+}
+
+bool validateScalar(const uchar* in, qsizetype size)
+{
+    qsizetype i = 0;
+    while (i < size) {
+        if (i + 8 <= size && isAsciiWord(in + i)) {
+            i += 8;
+        } else if (in[i] < 0x80) {
+            ++i;
+        } else {
+            qsizetype length = validSequenceLength(in + i, size - i);
+            if (length == 0) {
+                return false;
+            }
+            i += length;
+        }
+    }
+    return true;
+}
+
+qsizetype toUtf16Scalar(const uchar* in, qsizetype size, char16_t* out)
+{
+    char16_t* start = out;
+    qsizetype i = 0;
+    while (i < size) {
+        if (i + 8 <= size && isAsciiWord(in + i)) {
+            for (int k = 0; k < 8; ++k) {
+                out[k] = in[i + k];
+            }
+            out += 8;
+            i += 8;
+        } else if (in[i] < 0x80) {
+            *out++ = in[i++];
+        } else {
+            if (validSequenceLength(in + i, size - i) == 0) {
+                return -1;
+            }
+            i += decodeSequence(in + i, out);
+        }
+    }
+    return out - start;
+}
+
+// 已校验输入的剩余部分
+qsizetype decodeValidTail(const uchar* in, qsizetype size, char16_t*& out)
+{
+    qsizetype i = 0;
+    while (i < size) {
+        if (in[i] < 0x80) {
+            *out++ = in[i++];
+        } else {
+            i += decodeSequence(in + i, out);
+        }
+    }
+    return i;
+}
+
+#ifdef UTF8_CODEC_X86
+
+// 查表法校验UTF-8（Keiser与Lemire）：按每个字节与前一字节的高低半字节查三张表，
+// 三个结果按位与后非零即为错误；另外检查三、四字节字符的后续字节是否都是续字节
+const uchar TOO_SHORT = 1 << 0;
+const uchar TOO_LONG = 1 << 1;
+const uchar OVERLONG_3 = 1 << 2;
+const uchar TOO_LARGE = 1 << 3;
+const uchar SURROGATE = 1 << 4;
+const uchar OVERLONG_2 = 1 << 5;
+const uchar TOO_LARGE_1000 = 1 << 6;
+const uchar OVERLONG_4 = 1 << 6;
+const uchar TWO_CONTS = 1 << 7;
+const uchar CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// 前一字节的高半字节
+alignas(16) const uchar BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+// 前一字节的低半字节
+alignas(16) const uchar BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+// 当前字节的高半字节
+alignas(16) const uchar BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// 块的最后三个字节是否开始了一个没有结束的多字节字符
+alignas(32) const uchar INCOMPLETE_MAX[32] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+struct SseState
+{
+    __m128i error;
+    __m128i previous;
+    __m128i incomplete;
+};
+
+TARGET_SSE4 inline __m128i highNibbles(__m128i bytes)
+{
+    return _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+}
+
+TARGET_SSE4 inline void checkBlockSse(__m128i input, SseState& state)
+{
+    if (_mm_movemask_epi8(input) == 0) {
+        state.error = _mm_or_si128(state.error, state.incomplete);
+        state.incomplete = _mm_setzero_si128();
+    } else {
+        __m128i prev1 = _mm_alignr_epi8(input, state.previous, 15);
+        __m128i special = _mm_and_si128(
+            _mm_and_si128(_mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH)), highNibbles(prev1)),
+                          _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW)),
+                                           _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+            _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH)), highNibbles(input)));
+        __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, state.previous, 14), _mm_set1_epi8(char(0xE0 - 0x80)));
+        __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, state.previous, 13), _mm_set1_epi8(char(0xF0 - 0x80)));
+        __m128i mustContinue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+        state.error = _mm_or_si128(state.error, _mm_xor_si128(mustContinue, special));
+        state.incomplete = _mm_subs_epu8(input, _mm_loadu_si128(reinterpret_cast<const __m128i*>(INCOMPLETE_MAX + 16)));
+    }
+    state.previous = input;
+}
+
+TARGET_SSE4 bool validateSse(const uchar* in, qsizetype size)
+{
+    SseState state = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+    qsizetype i = 0;
+    for (; i + 16 <= size; i += 16) {
+        checkBlockSse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), state);
+    }
+    if (i < size) {
+        alignas(16) uchar tail[16] = {};
+        std::memcpy(tail, in + i, size_t(size - i));
+        checkBlockSse(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)), state);
+    }
+    __m128i error = _mm_or_si128(state.error, state.incomplete);
+    return _mm_testz_si128(error, error) != 0;
+}
+
+// 从至少有16字节的位置转换一步，返回消耗的字节数
+TARGET_SSE4 inline qsizetype transcodeStepSse(const uchar* in, char16_t*& out)
+{
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    int mask = _mm_movemask_epi8(bytes);
+    if (mask == 0) {
+        __m128i zero = _mm_setzero_si128();
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(bytes, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(bytes, zero));
+        out += 16;
+        return 16;
+    }
+
+    // 连续四个三字节字符：每个放到一个32位通道中拼出码点，再压缩为16位
+    if ((in[0] & 0xF0) == 0xE0 && (in[3] & 0xF0) == 0xE0 && (in[6] & 0xF0) == 0xE0 && (in[9] & 0xF0) == 0xE0) {
+        __m128i lanes = _mm_shuffle_epi8(bytes, _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128,
+                                                              8, 7, 6, -128, 11, 10, 9, -128));
+        __m128i low = _mm_and_si128(lanes, _mm_set1_epi32(0x3F));
+        __m128i middle = _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x3F00)), 2);
+        __m128i high = _mm_srli_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0x0F0000)), 4);
+        __m128i codePoints = _mm_or_si128(_mm_or_si128(low, middle), high);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi32(codePoints, codePoints));
+        out += 4;
+        return 12;
+    }
+
+    // 开头的ASCII和一个多字节字符
+    qsizetype ascii = qCountTrailingZeroBits(uint(mask));
+    for (qsizetype k = 0; k < ascii; ++k) {
+        *out++ = in[k];
+    }
+    return ascii + decodeSequence(in + ascii, out);
+}
+
+TARGET_SSE4 qsizetype transcodeSse(const uchar* in, qsizetype size, char16_t* out)
+{
+    char16_t* start = out;
+    qsizetype i = 0;
+    while (i + 16 <= size) {
+        i += transcodeStepSse(in + i, out);
+    }
+    decodeValidTail(in + i, size - i, out);
+    return out - start;
+}
+
+struct AvxState
+{
+    __m256i error;
+    __m256i previous;
+    __m256i incomplete;
+};
+
+TARGET_AVX2 inline __m256i highNibbles256(__m256i bytes)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F));
+}
+
+TARGET_AVX2 inline __m256i table256(const uchar* table)
+{
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+TARGET_AVX2 inline void checkBlockAvx2(__m256i input, AvxState& state)
+{
+    if (_mm256_movemask_epi8(input) == 0) {
+        state.error = _mm256_or_si256(state.error, state.incomplete);
+        state.incomplete = _mm256_setzero_si256();
+    } else {
+        // 跨128位通道的前移：拼接上一块的高半部分和这一块的低半部分
+        __m256i shifted = _mm256_permute2x128_si256(state.previous, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        __m256i special = _mm256_and_si256(
+            _mm256_and_si256(_mm256_shuffle_epi8(table256(BYTE_1_HIGH), highNibbles256(prev1)),
+                             _mm256_shuffle_epi8(table256(BYTE_1_LOW), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+            _mm256_shuffle_epi8(table256(BYTE_2_HIGH), highNibbles256(input)));
+        __m256i third = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14), _mm256_set1_epi8(char(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13), _mm256_set1_epi8(char(0xF0 - 0x80)));
+        __m256i mustContinue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+        state.error = _mm256_or_si256(state.error, _mm256_xor_si256(mustContinue, special));
+        state.incomplete = _mm256_subs_epu8(input, _mm256_load_si256(reinterpret_cast<const __m256i*>(INCOMPLETE_MAX)));
+    }
+    state.previous = input;
+}
+
+TARGET_AVX2 bool validateAvx2(const uchar* in, qsizetype size)
+{
+    AvxState state = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+    qsizetype i = 0;
+    for (; i + 32 <= size; i += 32) {
+        checkBlockAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), state);
+    }
+    if (i < size) {
+        alignas(32) uchar tail[32] = {};
+        std::memcpy(tail, in + i, size_t(size - i));
+        checkBlockAvx2(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)), state);
+    }
+    __m256i error = _mm256_or_si256(state.error, state.incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+TARGET_AVX2 qsizetype transcodeAvx2(const uchar* in, qsizetype size, char16_t* out)
+{
+    char16_t* start = out;
+    qsizetype i = 0;
+    while (i + 32 <= size) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        if (_mm256_movemask_epi8(bytes) == 0) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)));
+            out += 32;
+            i += 32;
+        } else {
+            i += transcodeStepSse(in + i, out);
+        }
+    }
+    while (i + 16 <= size) {
+        i += transcodeStepSse(in + i, out);
+    }
+    decodeValidTail(in + i, size - i, out);
+    return out - start;
+}
+
+Utf8Codec::Implementation detectImplementation()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    // AVX需要操作系统保存YMM寄存器
+    bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osAvx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return Utf8Codec::Avx2;
+    }
+    return sse41 ? Utf8Codec::Sse4 : Utf8Codec::Scalar;
+}
+
+#else
+
+Utf8Codec::Implementation detectImplementation()
+{
+    return Utf8Codec::Scalar;
+}
+
+#endif
+
+} // namespace
+
+Utf8Codec::Implementation Utf8Codec::bestImplementation()
+{
+    static const Implementation best = detectImplementation();
+    return best;
+}
+
+const char* Utf8Codec::implementationName(Implementation implementation)
+{
+    switch (implementation) {
+    case Avx2:
+        return "AVX2";
+    case Sse4:
+        return "SSE4.1";
+    case Scalar:
+        break;
+    }
+    return "scalar";
+}
+
+bool Utf8Codec::isValid(const char* data, qsizetype size)
+{
+    return isValid(data, size, bestImplementation());
+}
+
+bool Utf8Codec::isValid(const char* data, qsizetype size, Implementation implementation)
+{
+    const uchar* in = reinterpret_cast<const uchar*>(data);
+#ifdef UTF8_CODEC_X86
+    if (implementation == Avx2) {
+        return validateAvx2(in, size);
+    }
+    if (implementation == Sse4) {
+        return validateSse(in, size);
+    }
+#else
+    Q_UNUSED(implementation);
+#endif
+    return validateScalar(in, size);
+}
+
+qsizetype Utf8Codec::toUtf16(const char* data, qsizetype size, char16_t* output)
+{
+    return toUtf16(data, size, output, bestImplementation());
+}
+
+qsizetype Utf8Codec::toUtf16(const char* data, qsizetype size, char16_t* output, Implementation implementation)
+{
+    const uchar* in = reinterpret_cast<const uchar*>(data);
+#ifdef UTF8_CODEC_X86
+    // 先整体校验，转换时不再检查
+    if (implementation == Avx2) {
+        return validateAvx2(in, size) ? transcodeAvx2(in, size, output) : -1;
+    }
+    if (implementation == Sse4) {
+        return validateSse(in, size) ? transcodeSse(in, size, output) : -1;
+    }
+#else
+    Q_UNUSED(implementation);
+#endif
+    return toUtf16Scalar(in, size, output);
+}
+
+QString Utf8Codec::toString(const char* data, qsizetype size)
+{
+    if (size <= 0) {
+        return QString();
+    }
+    QString result(size, Qt::Uninitialized);
+    qsizetype length = toUtf16(data, size, reinterpret_cast<char16_t*>(result.data()));
+    if (length < 0) {
+        return QString::fromUtf8(data, size);
+    }
+    // 非ASCII文本转换后变短，释放多预留的空间
+    result.resize(length);
+    if (length < size) {
+        result.squeeze();
+    }
+    return result;
+}
+
+bool Utf8Codec::equals(const char* data, qsizetype size, QStringView text)
+{
+    const uchar* in = reinterpret_cast<const uchar*>(data);
+    const char16_t* units = text.utf16();
+    qsizetype count = text.size();
+    qsizetype i = 0;
+    qsizetype j = 0;
+    while (i < size) {
+        if (in[i] < 0x80) {
+            if (j >= count || units[j] != in[i]) {
+                return false;
+            }
+            ++i;
+            ++j;
+            continue;
+        }
+        qsizetype length = validSequenceLength(in + i, size - i);
+        if (length == 0) {
+            // 非法输入很少见，按替换字符后的结果比较
+            return QString::fromUtf8(data, size) == text;
+        }
+        char16_t decoded[2];
+        char16_t* end = decoded;
+        decodeSequence(in + i, end);
+        for (char16_t* unit = decoded; unit < end; ++unit, ++j) {
+            if (j >= count || units[j] != *unit) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return j == count;
+}
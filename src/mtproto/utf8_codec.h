@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief 协议字符串的UTF-8校验和UTF-8到UTF-16的转换
+ *
+ * 按CPU在运行时选择实现：AVX2或SSE4.1时用向量指令校验（查表法，每次16或32字节），
+ * 转换时整块的ASCII和连续的三字节字符（中日韩文字）按向量处理；
+ * 其他平台或不支持的CPU使用逐字节的实现。非法的输入按QString::fromUtf8的方式替换为U+FFFD。
+ */
+class Utf8Codec
+{
+public:
+    enum Implementation {
+        Scalar,
+        Sse4,
+        Avx2
+    };
+
+    static Implementation bestImplementation();
+    static const char* implementationName(Implementation implementation);
+
+    static bool isValid(const char* data, qsizetype size);
+    static bool isValid(const char* data, qsizetype size, Implementation implementation);
+
+    // 校验并转换，output至少能容纳size个UTF-16单元；非法时返回-1
+    static qsizetype toUtf16(const char* data, qsizetype size, char16_t* output);
+    static qsizetype toUtf16(const char* data, qsizetype size, char16_t* output, Implementation implementation);
+
+    // 直接转换到新的QString中，只分配一次
+    static QString toString(const char* data, qsizetype size);
+
+    // 与UTF-16文本比较，不分配内存
+    static bool equals(const char* data, qsizetype size, QStringView text);
+};
@@ -0,0 +1,617 @@
+#include "history_view.h"
+#include <QApplication>
+#include <QDateTime>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QTextOption>
+#include <QThread>
+#include <QWheelEvent>
+#include <QtMath>
+
+namespace {
+
+// 每页消息数，与 messages.getHistory 的单次请求上限一致
+const int PAGE_SIZE = 100;
+
+// 视口前后预取的页数
+const int PREFETCH_PAGES = 1;
+
+// 超出视口前后该页数的页面会被释放
+const int KEEP_PAGES = 3;
+
+// 每条消息在滚动条上占用的刻度数
+const int SCROLL_UNITS = 256;
+
+// 消息内边距
+const int MESSAGE_PADDING = 6;
+
+} // namespace
+
+HistoryView::HistoryView(TelegramClient* client, QWidget* parent)
+    : QAbstractScrollArea(parent)
+    , m_client(client)
+    , m_peerId(0)
+    , m_topMessageId(0)
+    , m_layoutGeneration(0)
+    , m_threadedLayout(QFontDatabase::supportsThreadedFontRendering())
+    , m_headerHeight(0)
+{
+    setFocusPolicy(Qt::StrongFocus);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    verticalScrollBar()->setSingleStep(SCROLL_UNITS / 4);
+    verticalScrollBar()->setPageStep(SCROLL_UNITS * 5);
+
+    // 排版线程数量不超过CPU核数的一半，避免与界面线程争抢
+    m_layoutPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+
+    updateFontMetrics();
+
+    connect(m_client, &TelegramClient::historyReceived, this, &HistoryView::onHistoryReceived);
+    connect(m_client, &TelegramClient::messageEdited, this, &HistoryView::onMessageEdited);
+    connect(m_client, &TelegramClient::newMessagesReceived, this, &HistoryView::onNewMessages);
+    connect(m_client, &TelegramClient::messagesDeleted, this, &HistoryView::onMessagesDeleted);
+
+    updateScrollRange();
+}
+
+HistoryView::~HistoryView()
+{
+    // 等待排版任务结束，任务中持有this指针
+    m_layoutPool.clear();
+    m_layoutPool.waitForDone();
+}
+
+void HistoryView::openPeer(qint64 peerId)
+{
+    m_peerId = peerId;
+    m_topMessageId = 0;
+    m_pages.clear();
+    m_requestedPages.clear();
+    m_layouts.clear();
+    invalidateLayouts();
+    updateScrollRange();
+
+    // 先请求最新一页，得到最新消息ID后再按页加载
+    m_client->requestHistory(peerId, 0, PAGE_SIZE);
+    viewport()->update();
+}
+
+qint64 HistoryView::peerId() const
+{
+    return m_peerId;
+}
+
+void HistoryView::onHistoryReceived(qint64 peerId, qint32 offsetId, const QVector<MessageData>& messages, int totalCount)
+{
+    Q_UNUSED(totalCount);
+
+    if (peerId != m_peerId) {
+        return;
+    }
+
+    int page = -1;
+    if (offsetId <= 0) {
+        // 最新消息：确定滚动范围，只保留完整覆盖的最高一页
+        if (m_topMessageId != 0 || messages.isEmpty()) {
+            return;
+        }
+        m_topMessageId = messages.first().id;
+        page = pageOf(m_topMessageId);
+        if (messages.last().id > page * PAGE_SIZE + 1 && messages.size() >= PAGE_SIZE) {
+            page = -1;
+        }
+        updateScrollRange();
+        scrollToBottom();
+    } else {
+        page = pageOf(offsetId - 1);
+        // 请求发出后页面已被释放（用户已滚远），丢弃响应
+        if (!m_requestedPages.remove(page)) {
+            return;
+        }
+    }
+
+    if (page < 0 || m_pages.contains(page)) {
+        viewport()->update();
+        return;
+    }
+
+    // 按消息ID归入页面，缺失的消息（已删除）保留为空位
+    QVector<MessageData> pageMessages(PAGE_SIZE);
+    QVector<qint32> ids;
+    ids.reserve(messages.size());
+    for (const MessageData& message : messages) {
+        if (message.id > 0 && pageOf(message.id) == page) {
+            pageMessages[(message.id - 1) % PAGE_SIZE] = message;
+            ids.append(message.id);
+        }
+    }
+    m_pages.insert(page, pageMessages);
+
+    // 整页提前排版，滚动到这里时无需等待
+    scheduleLayouts(ids);
+    viewport()->update();
+}
+
+void HistoryView::onMessageEdited(const MessageData& message)
+{
+    if (message.peerId != m_peerId) {
+        return;
+    }
+
+    auto pageIt = m_pages.find(pageOf(message.id));
+    if (pageIt == m_pages.end()) {
+        return;
+    }
+    (*pageIt)[(message.id - 1) % PAGE_SIZE] = message;
+
+    // 保留旧高度作为估计值，避免重新排版前视图跳动
+    auto layoutIt = m_layouts.find(message.id);
+    if (layoutIt != m_layouts.end()) {
+        layoutIt->width = 0;
+        layoutIt->layout.reset();
+    }
+    m_pendingLayouts.remove(message.id);
+    scheduleLayouts(QVector<qint32>{message.id});
+    viewport()->update();
+}
+
+void HistoryView::onNewMessages(const QVector<MessageData>& messages)
+{
+    // 最新一页尚未加载时由首次请求带回
+    if (m_topMessageId <= 0) {
+        return;
+    }
+
+    bool atBottom = verticalScrollBar()->value() >= verticalScrollBar()->maximum();
+    int oldTopPage = pageOf(m_topMessageId);
+    QVector<qint32> ids;
+    for (const MessageData& message : messages) {
+        if (message.peerId != m_peerId || message.id <= 0) {
+            continue;
+        }
+        m_topMessageId = qMax(m_topMessageId, message.id);
+
+        // 新消息开启的页面此前不存在，直接建立；其他未加载的页面滚动到时再请求
+        int page = pageOf(message.id);
+        auto pageIt = m_pages.find(page);
+        if (pageIt == m_pages.end() && page > oldTopPage) {
+            pageIt = m_pages.insert(page, QVector<MessageData>(PAGE_SIZE));
+        }
+        if (pageIt != m_pages.end()) {
+            (*pageIt)[(message.id - 1) % PAGE_SIZE] = message;
+            ids.append(message.id);
+        }
+    }
+
+    updateScrollRange();
+    if (atBottom) {
+        scrollToBottom();
+    }
+    scheduleLayouts(ids);
+    viewport()->update();
+}
+
+void HistoryView::onMessagesDeleted(qint64 peerId, const QVector<qint32>& messageIds)
+{
+    if (peerId != m_peerId) {
+        return;
+    }
+    for (qint32 id : messageIds) {
+        auto pageIt = m_pages.find(pageOf(id));
+        if (pageIt != m_pages.end()) {
+            (*pageIt)[(id - 1) % PAGE_SIZE] = MessageData();
+        }
+        m_layouts.remove(id);
+        m_pendingLayouts.remove(id);
+    }
+    viewport()->update();
+}
+
+const MessageData* HistoryView::messageAt(qint32 id) const
+{
+    auto it = m_pages.constFind(pageOf(id));
+    if (it == m_pages.constEnd()) {
+        return nullptr;
+    }
+    return &it->at((id - 1) % PAGE_SIZE);
+}
+
+int HistoryView::pageOf(qint32 id) const
+{
+    return (id - 1) / PAGE_SIZE;
+}
+
+void HistoryView::requestPage(int page)
+{
+    m_requestedPages.insert(page);
+    m_client->requestHistory(m_peerId, (page + 1) * PAGE_SIZE + 1, PAGE_SIZE);
+}
+
+void HistoryView::updateWindow(qint32 firstVisibleId, qint32 lastVisibleId)
+{
+    if (m_topMessageId <= 0) {
+        return;
+    }
+
+    int lastPage = pageOf(m_topMessageId);
+    int first = qMax(0, pageOf(firstVisibleId) - PREFETCH_PAGES);
+    int last = qMin(lastPage, pageOf(lastVisibleId) + PREFETCH_PAGES);
+
+    for (int page = first; page <= last; ++page) {
+        if (!m_pages.contains(page) && !m_requestedPages.contains(page)) {
+            requestPage(page);
+        }
+    }
+
+    // 释放远离视口的页面
+    const QList<int> loaded = m_pages.keys();
+    for (int page : loaded) {
+        if (page < first - KEEP_PAGES || page > last + KEEP_PAGES) {
+            evictPage(page);
+        }
+    }
+    const QList<int> requested = m_requestedPages.values();
+    for (int page : requested) {
+        if (page < first - KEEP_PAGES || page > last + KEEP_PAGES) {
+            m_requestedPages.remove(page);
+        }
+    }
+}
+
+void HistoryView::evictPage(int page)
+{
+    auto it = m_pages.find(page);
+    if (it == m_pages.end()) {
+        return;
+    }
+    for (const MessageData& message : *it) {
+        if (message.id > 0) {
+            m_layouts.remove(message.id);
+            m_pendingLayouts.remove(message.id);
+        }
+    }
+    m_pages.erase(it);
+}
+
+int HistoryView::textWidth() const
+{
+    return qMax(1, viewport()->width() - MESSAGE_PADDING * 2);
+}
+
+int HistoryView::headerHeight() const
+{
+    return m_headerHeight;
+}
+
+void HistoryView::updateFontMetrics()
+{
+    QFont headerFont = font();
+    headerFont.setBold(true);
+    m_headerHeight = QFontMetrics(headerFont).lineSpacing();
+}
+
+int HistoryView::messageHeight(qint32 id) const
+{
+    const MessageData* message = messageAt(id);
+    if (message && message->id == 0) {
+        return 0;
+    }
+
+    // 未排版的消息按一行估计高度
+    auto it = m_layouts.constFind(id);
+    int bodyHeight = it != m_layouts.constEnd() ? it->height : fontMetrics().lineSpacing();
+    return MESSAGE_PADDING * 2 + headerHeight() + bodyHeight;
+}
+
+HistoryView::LayoutEntry HistoryView::buildLayout(const QString& text, const QFont& font, int width)
+{
+    LayoutEntry entry;
+    entry.width = width;
+    entry.layout = QSharedPointer<QTextLayout>::create(text, font);
+
+    QTextOption option;
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    entry.layout->setTextOption(option);
+    entry.layout->setCacheEnabled(true);
+
+    qreal y = 0;
+    entry.layout->beginLayout();
+    for (;;) {
+        QTextLine line = entry.layout->createLine();
+        if (!line.isValid()) {
+            break;
+        }
+        line.setLineWidth(width);
+        line.setPosition(QPointF(0, y));
+        y += line.height();
+    }
+    entry.layout->endLayout();
+
+    entry.height = qCeil(y);
+    return entry;
+}
+
+void HistoryView::invalidateLayouts()
+{
+    // 丢弃尚未开始的任务，已在运行的任务结果会因代数不符被忽略
+    ++m_layoutGeneration;
+    m_layoutPool.clear();
+    m_pendingLayouts.clear();
+}
+
+void HistoryView::scheduleLayouts(const QVector<qint32>& ids)
+{
+    int width = textWidth();
+
+    QVector<QPair<qint32, QString>> jobs;
+    for (qint32 id : ids) {
+        if (m_pendingLayouts.contains(id)) {
+            continue;
+        }
+        const MessageData* message = messageAt(id);
+        if (!message || message->id == 0) {
+            continue;
+        }
+        auto it = m_layouts.constFind(id);
+        if (it != m_layouts.constEnd() && it->width == width) {
+            continue;
+        }
+        jobs.append(qMakePair(id, message->text));
+        m_pendingLayouts.insert(id);
+    }
+    if (jobs.isEmpty()) {
+        return;
+    }
+
+    quint64 generation = m_layoutGeneration;
+    QFont layoutFont = font();
+    auto build = [jobs, layoutFont, width]() {
+        QVector<LayoutResult> results;
+        results.reserve(jobs.size());
+        for (const auto& job : jobs) {
+            LayoutResult result;
+            result.id = job.first;
+            result.text = job.second;
+            result.entry = buildLayout(job.second, layoutFont, width);
+            results.append(result);
+        }
+        return results;
+    };
+
+    // 平台不支持在非界面线程使用字体时，直接在当前线程排版
+    if (!m_threadedLayout) {
+        applyLayouts(generation, build());
+        return;
+    }
+
+    m_layoutPool.start([this, build, generation]() {
+        QVector<LayoutResult> results = build();
+        QMetaObject::invokeMethod(this, [this, generation, results]() {
+            applyLayouts(generation, results);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void HistoryView::applyLayouts(quint64 generation, const QVector<LayoutResult>& results)
+{
+    if (generation != m_layoutGeneration) {
+        return;
+    }
+
+    for (const LayoutResult& result : results) {
+        m_pendingLayouts.remove(result.id);
+
+        // 页面已释放或消息在排版期间被编辑
+        const MessageData* message = messageAt(result.id);
+        if (!message || message->id == 0 || message->text != result.text) {
+            continue;
+        }
+        m_layouts.insert(result.id, result.entry);
+    }
+    viewport()->update();
+}
+
+void HistoryView::updateScrollRange()
+{
+    // 值为视口底边的位置：value / SCROLL_UNITS 条消息位于底边之上
+    if (m_topMessageId <= 0) {
+        verticalScrollBar()->setRange(0, 0);
+    } else {
+        verticalScrollBar()->setRange(SCROLL_UNITS, m_topMessageId * SCROLL_UNITS);
+    }
+}
+
+void HistoryView::scrollToBottom()
+{
+    verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+}
+
+void HistoryView::scrollByPixels(int pixels)
+{
+    // pixels为正时向更早的消息滚动
+    QScrollBar* bar = verticalScrollBar();
+    int value = bar->value();
+
+    while (pixels != 0) {
+        qint32 bottomId = (value - 1) / SCROLL_UNITS + 1;
+        int part = value - (bottomId - 1) * SCROLL_UNITS;
+        int height = messageHeight(bottomId);
+
+        if (pixels > 0) {
+            int partPixels = part * height / SCROLL_UNITS;
+            if (height > 0 && pixels < partPixels) {
+                value -= qMax(1, pixels * SCROLL_UNITS / height);
+                pixels = 0;
+            } else {
+                value = (bottomId - 1) * SCROLL_UNITS;
+                pixels -= partPixels;
+                if (value <= bar->minimum()) {
+                    break;
+                }
+            }
+        } else {
+            int remainingPixels = (SCROLL_UNITS - part) * height / SCROLL_UNITS;
+            if (height > 0 && -pixels < remainingPixels) {
+                value += qMax(1, -pixels * SCROLL_UNITS / height);
+                pixels = 0;
+            } else {
+                value = bottomId * SCROLL_UNITS;
+                pixels += remainingPixels;
+                if (value >= bar->maximum()) {
+                    break;
+                }
+            }
+        }
+    }
+
+    bar->setValue(qBound(bar->minimum(), value, bar->maximum()));
+}
+
+void HistoryView::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().base());
+
+    if (m_topMessageId <= 0) {
+        painter.setPen(palette().color(QPalette::PlaceholderText));
+        painter.drawText(viewport()->rect(), Qt::AlignCenter, tr("正在加载消息..."));
+        return;
+    }
+
+    int value = verticalScrollBar()->value();
+    int viewHeight = viewport()->height();
+    qint32 bottomId = (value - 1) / SCROLL_UNITS + 1;
+    int part = value - (bottomId - 1) * SCROLL_UNITS;
+    int bottomEdge = viewHeight + (SCROLL_UNITS - part) * messageHeight(bottomId) / SCROLL_UNITS;
+
+    QVector<qint32> missingLayouts;
+
+    // 从底边的消息开始向上绘制
+    qint32 firstVisible = bottomId;
+    int y = bottomEdge;
+    for (qint32 id = bottomId; id >= 1 && y > 0; --id) {
+        int height = messageHeight(id);
+        y -= height;
+        paintMessage(painter, id, y, height, missingLayouts);
+        firstVisible = id;
+    }
+
+    // 底边以下可能还有因取整露出的消息
+    qint32 lastVisible = bottomId;
+    y = bottomEdge;
+    for (qint32 id = bottomId + 1; id <= m_topMessageId && y < viewHeight; ++id) {
+        int height = messageHeight(id);
+        paintMessage(painter, id, y, height, missingLayouts);
+        y += height;
+        lastVisible = id;
+    }
+
+    painter.end();
+
+    scheduleLayouts(missingLayouts);
+    updateWindow(firstVisible, lastVisible);
+
+    // 每次绘制都报告已读位置，发送前会合并为每个会话一条
+    if (messageAt(lastVisible)) {
+        m_client->markHistoryRead(m_peerId, lastVisible);
+    }
+}
+
+void HistoryView::paintMessage(QPainter& painter, qint32 id, int y, int height, QVector<qint32>& missingLayouts)
+{
+    if (height <= 0) {
+        return;
+    }
+
+    QRect rowRect(0, y, viewport()->width(), height);
+    QRect contentRect = rowRect.adjusted(MESSAGE_PADDING, MESSAGE_PADDING, -MESSAGE_PADDING, -MESSAGE_PADDING);
+
+    const MessageData* message = messageAt(id);
+    if (!message) {
+        painter.setPen(palette().color(QPalette::PlaceholderText));
+        painter.drawText(contentRect, Qt::AlignLeft | Qt::AlignTop, tr("加载中..."));
+        return;
+    }
+
+    painter.save();
+    painter.setClipRect(rowRect);
+
+    // 发送者和时间
+    QFont headerFont = font();
+    headerFont.setBold(true);
+    painter.setFont(headerFont);
+    painter.setPen(palette().color(QPalette::Link));
+    QString header = message->fromName + "  "
+        + QDateTime::fromSecsSinceEpoch(message->date).toString("yyyy-MM-dd hh:mm");
+    if (message->editDate > 0) {
+        header += tr("  已编辑");
+    }
+    painter.drawText(contentRect, Qt::AlignLeft | Qt::AlignTop, header);
+
+    // 正文：宽度不符的旧排版结果先用于绘制，同时排队重新排版
+    auto it = m_layouts.constFind(id);
+    if (it == m_layouts.constEnd() || it->width != textWidth()) {
+        missingLayouts.append(id);
+    }
+    if (it != m_layouts.constEnd() && it->layout) {
+        painter.setPen(palette().color(QPalette::Text));
+        it->layout->draw(&painter, QPointF(contentRect.left(), contentRect.top() + headerHeight()));
+    }
+
+    painter.restore();
+}
+
+void HistoryView::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+
+    // 只有宽度变化才需要重新排版，旧结果保留为高度估计
+    if (event->oldSize().width() != event->size().width()) {
+        invalidateLayouts();
+    }
+}
+
+void HistoryView::changeEvent(QEvent* event)
+{
+    QAbstractScrollArea::changeEvent(event);
+
+    if (event->type() == QEvent::FontChange) {
+        updateFontMetrics();
+        m_layouts.clear();
+        invalidateLayouts();
+        viewport()->update();
+    }
+}
+
+void HistoryView::wheelEvent(QWheelEvent* event)
+{
+    m_client->notifyUserActivity();
+    int pixels = event->pixelDelta().y();
+    if (pixels == 0) {
+        pixels = event->angleDelta().y() * fontMetrics().lineSpacing() * QApplication::wheelScrollLines() / 120;
+    }
+    scrollByPixels(pixels);
+    event->accept();
+}
+
+void HistoryView::keyPressEvent(QKeyEvent* event)
+{
+    m_client->notifyUserActivity();
+    switch (event->key()) {
+    case Qt::Key_PageUp:
+        scrollByPixels(viewport()->height());
+        break;
+    case Qt::Key_PageDown:
+        scrollByPixels(-viewport()->height());
+        break;
+    case Qt::Key_End:
+        scrollToBottom();
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+    event->accept();
+}
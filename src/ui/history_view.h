@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <QHash>
+#include <QPainter>
+#include <QSet>
+#include <QSharedPointer>
+#include <QTextLayout>
+#include <QThreadPool>
+#include <QVector>
+
+#include "core/telegram_client.h"
+#include "core/telegram_types.h"
+
+/**
+ * @brief 聊天记录视图
+ *
+ * 只保留视口附近的若干页消息，远离视口的页面连同其排版结果一起释放，
+ * 因此内存占用与会话的消息总数无关。每条消息的QTextLayout按宽度缓存，
+ * 只有宽度变化或消息被编辑时才重新排版，排版尽量在工作线程中完成。
+ *
+ * 滚动条的值以消息为单位（每条消息SCROLL_UNITS个刻度），
+ * 表示视口底边在消息序列中的位置，不需要知道所有消息的像素高度。
+ */
+class HistoryView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryView(TelegramClient* client, QWidget* parent = nullptr);
+    ~HistoryView();
+
+    // 打开会话，定位到最新消息
+    void openPeer(qint64 peerId);
+    qint64 peerId() const;
+
+private slots:
+    void onHistoryReceived(qint64 peerId, qint32 offsetId, const QVector<MessageData>& messages, int totalCount);
+    void onMessageEdited(const MessageData& message);
+    void onNewMessages(const QVector<MessageData>& messages);
+    void onMessagesDeleted(qint64 peerId, const QVector<qint32>& messageIds);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void changeEvent(QEvent* event) override;
+
+private:
+    // 已排版的消息正文
+    struct LayoutEntry
+    {
+        int width = 0;          // 排版时使用的宽度
+        int height = 0;         // 正文高度
+        QSharedPointer<QTextLayout> layout;
+    };
+
+    // 工作线程的排版结果
+    struct LayoutResult
+    {
+        qint32 id = 0;
+        QString text;           // 排版时的正文，用于丢弃编辑前的结果
+        LayoutEntry entry;
+    };
+
+    static LayoutEntry buildLayout(const QString& text, const QFont& font, int width);
+
+    // 消息索引与页面
+    const MessageData* messageAt(qint32 id) const;
+    int pageOf(qint32 id) const;
+    void requestPage(int page);
+    void updateWindow(qint32 firstVisibleId, qint32 lastVisibleId);
+    void evictPage(int page);
+
+    // 排版
+    int textWidth() const;
+    int messageHeight(qint32 id) const;
+    int headerHeight() const;
+    void updateFontMetrics();
+    void paintMessage(QPainter& painter, qint32 id, int y, int height, QVector<qint32>& missingLayouts);
+    void invalidateLayouts();
+    void scheduleLayouts(const QVector<qint32>& ids);
+    void applyLayouts(quint64 generation, const QVector<LayoutResult>& results);
+
+    // 滚动
+    void updateScrollRange();
+    void scrollByPixels(int pixels);
+    void scrollToBottom();
+
+    TelegramClient* m_client;
+
+    // 当前会话
+    qint64 m_peerId;
+    qint32 m_topMessageId;
+
+    // 已加载的页面，页号为 (id - 1) / PAGE_SIZE，空位的消息ID为0
+    QHash<int, QVector<MessageData>> m_pages;
+    QSet<int> m_requestedPages;
+
+    // 排版缓存，按消息ID索引
+    QHash<qint32, LayoutEntry> m_layouts;
+    QSet<qint32> m_pendingLayouts;
+    quint64 m_layoutGeneration;
+    QThreadPool m_layoutPool;
+    bool m_threadedLayout;
+    int m_headerHeight;
+};
@@ -7,15 +7,19 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QTimer>
+#include <QStringList>
+#include "core/clock.h"
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(const QString& accountId, QWidget *parent)
     : QMainWindow(parent)
-    , m_client(new TelegramClient(this))
+    , m_accountId(accountId)
+    , m_client(new TelegramClient(accountId, this))
     , m_proxyDialog(nullptr)
     , m_configManager(ConfigManager::instance())
 {
     // 设置窗口标题和大小
-    setWindowTitle("Telegram 客户端");
+    m_baseTitle = accountId.isEmpty() ? QString("Telegram 客户端") : QString("Telegram 客户端 - %1").arg(accountId);
+    setWindowTitle(m_baseTitle);
     resize(450, 350);
     
     // 设置UI
@@ -35,6 +39,11 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_loginButton, &QPushButton::clicked, this, &MainWindow::onLoginButtonClicked);
     connect(m_verifyButton, &QPushButton::clicked, this, &MainWindow::onVerificationCodeEntered);
     connect(m_getMeButton, &QPushButton::clicked, this, &MainWindow::onGetMeClicked);
+    connect(m_openHistoryButton, &QPushButton::clicked, this, &MainWindow::onOpenHistoryClicked);
+    connect(m_historyBackButton, &QPushButton::clicked, this, &MainWindow::onHistoryBackClicked);
+    connect(m_searchEdit, &QLineEdit::returnPressed, this, &MainWindow::onSearchRequested);
+    connect(m_peerSearchEdit, &QLineEdit::textChanged, this, &MainWindow::onPeerSearchTextChanged);
+    connect(m_peerResultList, &QListWidget::itemActivated, this, &MainWindow::onPeerResultActivated);
     
     // 连接客户端信号
     connect(m_client, &TelegramClient::loginSuccess, this, &MainWindow::onLoginSuccess);
@@ -42,6 +51,13 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_client, &TelegramClient::codeRequested, this, &MainWindow::onCodeRequested);
     connect(m_client, &TelegramClient::authorizationError, this, &MainWindow::onAuthorizationError);
     connect(m_client, &TelegramClient::userInfoReceived, this, &MainWindow::onUserInfoReceived);
+    connect(m_client, &TelegramClient::searchResultsReady, this, &MainWindow::onSearchResultsReady);
+    connect(m_client, &TelegramClient::peerSearchResultsReady, this, &MainWindow::onPeerSearchResultsReady);
+    
+    // 未读计数由核心层增量维护，一批更新处理完后通知一次
+    connect(m_client->dialogViews(), &DialogViews::totalChanged, this, &MainWindow::updateUnreadBadge);
+    connect(m_client->dialogViews(), &DialogViews::viewsReset, this, &MainWindow::updateUnreadBadge);
+    updateUnreadBadge();
     
     // 初始化界面值
     initializeWithConfig();
@@ -91,9 +107,9 @@ void MainWindow::initializeWithConfig()
 void MainWindow::updateUiFromConfig()
 {
     // 更新API凭据输入框
-    m_apiIdEdit->setText(QString::number(m_configManager->apiId()));
-    m_apiHashEdit->setText(m_configManager->apiHash());
-    m_phoneNumberEdit->setText(m_configManager->phoneNumber());
+    m_apiIdEdit->setText(QString::number(m_configManager->apiId(m_accountId)));
+    m_apiHashEdit->setText(m_configManager->apiHash(m_accountId));
+    m_phoneNumberEdit->setText(m_configManager->phoneNumber(m_accountId));
     
     // 如果代理对话框存在，更新代理设置
     if (m_proxyDialog) {
@@ -125,6 +141,7 @@ void MainWindow::setupUi()
     createLoginPage();
     createVerificationPage();
     createMainPage();
+    createHistoryPage();
     
     // 默认显示登录页面
     m_stackedWidget->setCurrentWidget(m_loginPage);
@@ -144,6 +161,27 @@ void MainWindow::createMenuBar()
     
     connect(proxyAction, &QAction::triggered, this, &MainWindow::onProxySettingsAction);
     connect(configPathAction, &QAction::triggered, this, &MainWindow::onShowConfigFilePathAction);
+    
+    // 多个账号在同一进程中运行，共用网络和工作线程
+    QMenu* accountMenu = menuBar->addMenu("账号");
+    QAction* addAccountAction = accountMenu->addAction("添加账号...");
+    connect(addAccountAction, &QAction::triggered, this, &MainWindow::onAddAccountAction);
+}
+
+MainWindow* MainWindow::openAccountWindow(const QString& accountId)
+{
+    // 以本窗口为父对象的QMainWindow仍是独立的顶层窗口，退出时随父窗口析构，保证存储落盘
+    MainWindow* window = new MainWindow(accountId, this);
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    window->show();
+    return window;
+}
+
+void MainWindow::onAddAccountAction()
+{
+    QString accountId = m_configManager->addAccount();
+    m_configManager->saveConfig();
+    openAccountWindow(accountId);
 }
 
 void MainWindow::createStatusBar()
@@ -233,6 +271,10 @@ void MainWindow::createMainPage()
     welcomeLabel->setStyleSheet("font-size: 16px; font-weight: bold;");
     layout->addWidget(welcomeLabel);
     
+    // 未读角标
+    m_unreadLabel = new QLabel(m_mainPage);
+    layout->addWidget(m_unreadLabel);
+    
     // 用户信息组
     QGroupBox* userInfoGroup = new QGroupBox("账户信息", m_mainPage);
     QVBoxLayout* userInfoLayout = new QVBoxLayout(userInfoGroup);
@@ -248,10 +290,68 @@ void MainWindow::createMainPage()
     m_getMeButton = new QPushButton("刷新账户信息", m_mainPage);
     layout->addWidget(m_getMeButton);
     
+    // 联系人查找组
+    QGroupBox* peerSearchGroup = new QGroupBox("查找联系人", m_mainPage);
+    QVBoxLayout* peerSearchLayout = new QVBoxLayout(peerSearchGroup);
+    
+    m_peerSearchEdit = new QLineEdit(m_mainPage);
+    m_peerSearchEdit->setPlaceholderText("输入名称、用户名或拼音（如 zhangsan、zs）");
+    peerSearchLayout->addWidget(m_peerSearchEdit);
+    
+    m_peerResultList = new QListWidget(m_mainPage);
+    m_peerResultList->setMaximumHeight(150);
+    peerSearchLayout->addWidget(m_peerResultList);
+    
+    layout->addWidget(peerSearchGroup);
+    
+    // 聊天记录组
+    QGroupBox* historyGroup = new QGroupBox("聊天记录", m_mainPage);
+    QHBoxLayout* historyLayout = new QHBoxLayout(historyGroup);
+    
+    m_peerIdEdit = new QLineEdit(m_mainPage);
+    m_peerIdEdit->setPlaceholderText("会话ID");
+    m_peerIdEdit->setText("1");
+    historyLayout->addWidget(m_peerIdEdit);
+    
+    m_openHistoryButton = new QPushButton("打开", m_mainPage);
+    historyLayout->addWidget(m_openHistoryButton);
+    
+    layout->addWidget(historyGroup);
+    
+    // 消息搜索组
+    QGroupBox* searchGroup = new QGroupBox("搜索消息", m_mainPage);
+    QVBoxLayout* searchLayout = new QVBoxLayout(searchGroup);
+    
+    m_searchEdit = new QLineEdit(m_mainPage);
+    m_searchEdit->setPlaceholderText("输入关键词后按回车（离线搜索已缓存的消息）");
+    searchLayout->addWidget(m_searchEdit);
+    
+    m_searchResultList = new QListWidget(m_mainPage);
+    searchLayout->addWidget(m_searchResultList);
+    
+    layout->addWidget(searchGroup, 1);
+    
     // 添加到堆叠部件
     m_stackedWidget->addWidget(m_mainPage);
 }
 
+void MainWindow::createHistoryPage()
+{
+    m_historyPage = new QWidget();
+    QVBoxLayout* layout = new QVBoxLayout(m_historyPage);
+    
+    // 返回按钮
+    m_historyBackButton = new QPushButton("返回", m_historyPage);
+    layout->addWidget(m_historyBackButton, 0, Qt::AlignLeft);
+    
+    // 消息列表
+    m_historyView = new HistoryView(m_client, m_historyPage);
+    layout->addWidget(m_historyView, 1);
+    
+    // 添加到堆叠部件
+    m_stackedWidget->addWidget(m_historyPage);
+}
+
 void MainWindow::createProxySettingsDialog()
 {
     // 如果对话框已存在，直接返回
@@ -391,7 +491,7 @@ void MainWindow::onLoginButtonClicked()
     m_client->sendAuthenticationCode(phoneNumber);
     
     // 在2秒后恢复按钮状态（无论操作成功与否，回调函数都会处理UI更新）
-    QTimer::singleShot(2000, this, [this]() {
+    Clock::instance()->singleShot(2000, this, [this]() {
         m_loginButton->setEnabled(true);
         m_loginButton->setText("登录");
     });
@@ -417,7 +517,7 @@ void MainWindow::onVerificationCodeEntered()
     m_client->signIn(m_client->phoneNumber(), m_phoneCodeHash, code);
     
     // 在1秒后恢复按钮状态（无论登录成功与否，回调函数都会处理UI更新）
-    QTimer::singleShot(1000, this, [this]() {
+    Clock::instance()->singleShot(1000, this, [this]() {
         m_verifyButton->setEnabled(true);
         m_verifyButton->setText("验证");
     });
@@ -428,6 +528,112 @@ void MainWindow::onGetMeClicked()
     m_client->getMe();
 }
 
+void MainWindow::onOpenHistoryClicked()
+{
+    bool ok = false;
+    qint64 peerId = m_peerIdEdit->text().trimmed().toLongLong(&ok);
+    if (!ok || peerId <= 0) {
+        QMessageBox::warning(this, "输入错误", "请输入有效的会话ID");
+        return;
+    }
+    
+    // 切换到聊天记录页面并加载最新消息
+    m_stackedWidget->setCurrentWidget(m_historyPage);
+    m_client->setVisiblePeer(peerId);
+    m_historyView->openPeer(peerId);
+    m_historyView->setFocus();
+    m_statusLabel->setText(tr("正在加载会话 %1 的聊天记录...").arg(peerId));
+}
+
+void MainWindow::onHistoryBackClicked()
+{
+    m_client->setVisiblePeer(0);
+    m_stackedWidget->setCurrentWidget(m_mainPage);
+}
+
+void MainWindow::onSearchRequested()
+{
+    QString query = m_searchEdit->text().trimmed();
+    if (query.isEmpty()) {
+        m_searchResultList->clear();
+        return;
+    }
+    m_client->searchMessages(query, 50);
+}
+
+void MainWindow::onPeerSearchTextChanged(const QString& text)
+{
+    m_client->notifyUserActivity();
+    
+    // 每次输入都重新查找，索引在内存中，无需等待回车
+    if (text.trimmed().isEmpty()) {
+        m_peerResultList->clear();
+        return;
+    }
+    m_client->searchPeers(text, 20);
+}
+
+void MainWindow::onPeerSearchResultsReady(const QString& query, const QVector<PeerData>& peers)
+{
+    if (query != m_peerSearchEdit->text()) {
+        return;
+    }
+    m_peerResultList->clear();
+    for (const PeerData& peer : peers) {
+        QString text = PeerSearchIndex::displayName(peer);
+        if (!peer.username.isEmpty()) {
+            text += " @" + peer.username;
+        }
+        QListWidgetItem* item = new QListWidgetItem(text, m_peerResultList);
+        item->setData(Qt::UserRole, peer.id);
+    }
+}
+
+void MainWindow::onPeerResultActivated(QListWidgetItem* item)
+{
+    m_peerIdEdit->setText(QString::number(item->data(Qt::UserRole).toLongLong()));
+    onOpenHistoryClicked();
+}
+
+void MainWindow::updateUnreadBadge()
+{
+    // 只读取各文件夹维护好的计数，与会话总数无关
+    DialogViews* views = m_client->dialogViews();
+    DialogViews::Counters total = views->total();
+    QStringList folders;
+    for (qint32 folderId : views->folders()) {
+        DialogViews::Counters counters = views->counters(folderId);
+        QString name = folderId == 0 ? QString("主列表")
+                     : folderId == 1 ? QString("归档")
+                                     : QString("文件夹%1").arg(folderId);
+        folders.append(QString("%1 %2/%3").arg(name).arg(counters.unreadDialogs).arg(counters.dialogs));
+    }
+    m_unreadLabel->setText(QString("未读: %1 个会话，%2 条消息%3")
+        .arg(total.unreadDialogs)
+        .arg(total.unreadMessages)
+        .arg(folders.isEmpty() ? QString() : QString("（%1）").arg(folders.join("，"))));
+    setWindowTitle(total.unreadDialogs > 0 ? QString("(%1) %2").arg(total.unreadDialogs).arg(m_baseTitle) : m_baseTitle);
+}
+
+void MainWindow::onSearchResultsReady(const QString& query, const QVector<MessageData>& messages)
+{
+    m_searchResultList->clear();
+    for (const MessageData& message : messages) {
+        m_searchResultList->addItem(tr("[会话 %1 #%2] %3: %4")
+                                    .arg(message.peerId).arg(message.id)
+                                    .arg(message.fromName, message.text));
+    }
+    m_statusLabel->setText(tr("\"%1\" 找到 %2 条消息").arg(query).arg(messages.size()));
+}
+
+void MainWindow::changeEvent(QEvent* event)
+{
+    QMainWindow::changeEvent(event);
+    if (event->type() == QEvent::ActivationChange) {
+        m_client->setOnline(isActiveWindow());
+    }
+}
+
 void MainWindow::onLoginSuccess(const QString& username)
 {
     // 更新状态栏
@@ -443,7 +649,7 @@ void MainWindow::onLoginSuccess(const QString& username)
     m_stackedWidget->setCurrentWidget(m_mainPage);
     
     // 自动获取账户详细信息
-    QTimer::singleShot(500, this, [this]() {
+    Clock::instance()->singleShot(500, this, [this]() {
         m_client->getMe();
     });
 }
@@ -15,23 +15,41 @@
 #include <QMenuBar>
 #include <QAction>
 #include <QStatusBar>
+#include <QListWidget>
 
 #include "core/telegram_client.h"
 #include "core/config_manager.h"
+#include "history_view.h"
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // accountId为配置中的账号命名空间，空字符串为默认账号
+    explicit MainWindow(const QString& accountId = QString(), QWidget *parent = nullptr);
     ~MainWindow();
+    
+    // 为另一个账号打开窗口，窗口随本窗口一起销毁
+    MainWindow* openAccountWindow(const QString& accountId);
+
+protected:
+    // 窗口是否处于激活状态作为账号的在线状态
+    void changeEvent(QEvent* event) override;
 
 private slots:
     // 登录相关槽函数
     void onLoginButtonClicked();
     void onVerificationCodeEntered();
     void onGetMeClicked();
+    void onOpenHistoryClicked();
+    void onHistoryBackClicked();
+    void onSearchRequested();
+    void onPeerSearchTextChanged(const QString& text);
+    void onPeerResultActivated(QListWidgetItem* item);
+    
+    // 会话视图的计数变化，刷新未读角标
+    void updateUnreadBadge();
 
     // 客户端信号响应槽
     void onLoginSuccess(const QString& username);
@@ -39,6 +57,8 @@ private slots:
     void onCodeRequested(const QString& phoneCodeHash);
     void onAuthorizationError(const QString& error);
     void onUserInfoReceived(const QString& username, const QString& firstName, const QString& lastName);
+    void onSearchResultsReady(const QString& query, const QVector<MessageData>& messages);
+    void onPeerSearchResultsReady(const QString& query, const QVector<PeerData>& peers);
     
     // 代理设置相关槽
     void onProxySettingsAction();
@@ -51,12 +71,16 @@ private slots:
     
     // 显示配置文件路径
     void onShowConfigFilePathAction();
+    
+    // 添加账号并打开它的窗口
+    void onAddAccountAction();
 
 private:
     void setupUi();
     void createLoginPage();
     void createVerificationPage();
     void createMainPage();
+    void createHistoryPage();
     void createProxySettingsDialog();
     void createMenuBar();
     void createStatusBar();
@@ -83,7 +107,19 @@ private:
     // 主页面
     QWidget* m_mainPage;
     QLabel* m_usernameLabel;
+    QLabel* m_unreadLabel;
     QPushButton* m_getMeButton;
+    QLineEdit* m_peerSearchEdit;
+    QListWidget* m_peerResultList;
+    QLineEdit* m_peerIdEdit;
+    QPushButton* m_openHistoryButton;
+    QLineEdit* m_searchEdit;
+    QListWidget* m_searchResultList;
+    
+    // 聊天记录页面
+    QWidget* m_historyPage;
+    HistoryView* m_historyView;
+    QPushButton* m_historyBackButton;
     
     // 代理设置对话框
     QDialog* m_proxyDialog;
@@ -98,6 +134,8 @@ private:
     QLabel* m_statusLabel;
     
     // 客户端核心
+    QString m_accountId;
+    QString m_baseTitle;            // 不带未读数的窗口标题
     TelegramClient* m_client;
     QString m_phoneCodeHash;
     